@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// Light Model Vertex Shader - Instanced
+//--------------------------------------------------------------------------------------
+// Basic matrix transformations only. Same as BasicTransform_vs but draws many copies of a mesh in one draw call,
+// each copy taking its world matrix and tint colour from the instance buffer
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Vertex shader gets vertices from the mesh one at a time, along with the index of the instance being drawn
+SimplePixelShaderInput main(BasicVertex modelVertex, uint instanceID : SV_InstanceID)
+{
+    SimplePixelShaderInput output; // This is the data the pixel shader requires from this vertex shader
+
+    // Get the data for this copy of the mesh
+    InstanceData instance = gInstances[gInstanceOffset + instanceID];
+
+    // Input position is x,y,z only - need a 4th element to multiply by a 4x4 matrix. Use 1 for a point (0 for a vector) - recall lectures
+    float4 modelPosition = float4(modelVertex.position, 1); 
+
+    // Transform the vertex by the instance's world matrix, then the usual view and projection matrices
+    float4 worldPosition     = mul(instance.worldMatrix, modelPosition);
+    float4 viewPosition      = mul(gViewMatrix,          worldPosition);
+    output.projectedPosition = mul(gProjectionMatrix,    viewPosition);
+
+    // Pass texture coordinates (UVs) on to the pixel shader, the vertex shader doesn't need them
+    output.uv = modelVertex.uv;
+
+    // Each instance has its own tint colour
+    output.colour = instance.colour;
+
+    // And its own texture in the texture array
+    output.textureSlot = instance.textureSlot;
+
+    return output; // Ouput data sent down the pipeline (to the pixel shader)
+}
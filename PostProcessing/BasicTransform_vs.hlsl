@@ -29,5 +29,9 @@ SimplePixelShaderInput main(BasicVertex modelVertex)
     // Pass texture coordinates (UVs) on to the pixel shader, the vertex shader doesn't need them
     output.uv = modelVertex.uv;
 
+    // Tint colour for the pixel shader
+    output.colour = gObjectColour;
+    output.textureSlot = 0; // The whole texture, non-instanced draws don't use texture arrays
+
     return output; // Ouput data sent down the pipeline (to the pixel shader)
 }
@@ -0,0 +1,18 @@
+//--------------------------------------------------------------------------------------
+// Bone palette - all skinning matrices for a frame in a single GPU structured buffer
+//--------------------------------------------------------------------------------------
+
+#include "BonePalette.h"
+#include "Common.h" // For gD3DContext
+
+
+// The palette used for all skinned models
+BonePalette gBonePalette;
+
+
+// Bind the palette for use in the vertex shader (at the register used in Common.hlsli)
+void BonePalette::SetVertexShaderResource(unsigned int slot)
+{
+	ID3D11ShaderResourceView* srv = mBuffer.SRV();
+	gD3DContext->VSSetShaderResources(slot, 1, &srv);
+}
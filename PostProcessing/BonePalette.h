@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// Bone palette - all skinning matrices for a frame in a single GPU structured buffer
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Before rendering, each skinned model writes its bone matrices into the palette and remembers where they start.
+// The whole palette is then sent to the GPU in one upload, and each draw just tells the shader the offset of its
+// bones. There is no fixed limit on the number of bones per model or skinned models per frame, the GPU buffer
+// grows when needed.
+
+#ifndef _BONE_PALETTE_H_INCLUDED_
+#define _BONE_PALETTE_H_INCLUDED_
+
+#include "CMatrix4x4.h"
+#include "DynamicStructuredBuffer.h"
+#include <vector>
+
+
+class BonePalette
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// The GPU buffer is created on the first upload so a palette can be declared before DirectX is set up
+	BonePalette() : mBuffer(sizeof(CMatrix4x4)) {}
+
+
+	// Empty the palette, call at the start of each frame before models write their bones
+	void Reset()  { mMatrices.clear(); }
+
+	// Reserve space for the given number of matrices, returns the index of the first one. Fill them in using Matrices
+	// Pointers returned by Matrices are invalidated by the next call to Allocate
+	unsigned int Allocate(unsigned int count)
+	{
+		unsigned int offset = static_cast<unsigned int>(mMatrices.size());
+		mMatrices.resize(offset + count);
+		return offset;
+	}
+	CMatrix4x4* Matrices(unsigned int offset)  { return mMatrices.data() + offset; }
+
+	// Send all the matrices written this frame over to the GPU, making the buffer larger if necessary. Call once per
+	// frame after all models have written their bones and before rendering. Returns false on failure
+	bool Upload()  { return mBuffer.Upload(mMatrices.data(), static_cast<unsigned int>(mMatrices.size())); }
+
+	// Bind the palette for use in the vertex shader (at the register used in Common.hlsli)
+	void SetVertexShaderResource(unsigned int slot);
+
+	// Release GPU resources (they will be recreated if the palette is uploaded again)
+	void Release()  { mBuffer.Release(); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	std::vector<CMatrix4x4>  mMatrices; // CPU-side matrices for this frame
+	DynamicStructuredBuffer  mBuffer;   // GPU copy
+};
+
+
+// The palette used for all skinned models
+extern BonePalette gBonePalette;
+
+
+#endif //_BONE_PALETTE_H_INCLUDED_
@@ -42,13 +42,15 @@ public:
 	void SetPosition(CVector3 position)  { mPosition = position; }
 	void SetRotation(CVector3 rotation)  { mRotation = rotation; }
 
-	float FOV()       { return mFOVx;     }
-	float NearClip()  { return mNearClip; }
-	float FarClip()   { return mFarClip;  }
-
-	void SetFOV     (float fov     )  { mFOVx     = fov;      }
-	void SetNearClip(float nearClip)  { mNearClip = nearClip; }
-	void SetFarClip (float farClip )  { mFarClip  = farClip;  }
+	float FOV()          { return mFOVx;        }
+	float AspectRatio()  { return mAspectRatio; }
+	float NearClip()     { return mNearClip;    }
+	float FarClip()      { return mFarClip;     }
+
+	void SetFOV        (float fov        )  { mFOVx        = fov;         }
+	void SetAspectRatio(float aspectRatio)  { mAspectRatio = aspectRatio; }
+	void SetNearClip   (float nearClip   )  { mNearClip    = nearClip;    }
+	void SetFarClip    (float farClip    )  { mFarClip     = farClip;     }
 
 	// Read only access to camera matrices, updated on request from position, rotation and camera settings
 	CMatrix4x4 WorldMatrix()           { UpdateMatrices(); return mWorldMatrix; }
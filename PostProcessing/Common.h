@@ -64,21 +64,27 @@ struct PerFrameConstants
 	CMatrix4x4 projectionMatrix;
 	CMatrix4x4 viewProjectionMatrix; // The above two matrices multiplied together to combine their effects
 
-	CVector3   light1Position; // 3 floats: x, y z
-	float      viewportWidth;  // Using viewport width and height as padding - see this structure in earlier labs to read about padding here
-	CVector3   light1Colour;
-	float      viewportHeight;
-
-    CVector3   light2Position;
-    float      padding1;
-    CVector3   light2Colour;
-    float      padding2;
-
     CVector3   ambientColour;
     float      specularPower;
 
     CVector3   cameraPosition;
 	float      frameTime;      // This app does updates on the GPU so we pass over the frame update time
+
+	float      viewportWidth;
+	float      viewportHeight;
+	float      clusterSliceScale; // Lights are in clusters (see LightClusters.h), these give the depth slice of a pixel
+	float      clusterSliceBias;
+
+	unsigned int clusterTilesX; // Size of the light cluster grid
+	unsigned int clusterTilesY;
+	unsigned int clusterSlices;
+	unsigned int numLights;     // Total number of point lights in the scene
+
+	// Shadow casting lights have cube shadow maps (see ShadowMaps.h). For each: the point the map was rendered from
+	// (xyz) and its far clip distance (w). Array size must match ShadowMaps::MaxLights
+	CVector4   shadowOrigins[4];
+	float      shadowNearClip;
+	CVector3   padding1;
 };
 
 extern PerFrameConstants gPerFrameConstants;      // This variable holds the CPU-side constant buffer described above
@@ -86,10 +92,9 @@ extern ID3D11Buffer*     gPerFrameConstantBuffer; // This variable controls the
 
 
 
-static const int MAX_BONES = 64;
-
 // This is the matrix that positions the next thing to be rendered in the scene. Unlike the structure above this data can be
 // updated and sent to the GPU several times every frame (once per model). However, apart from that it works in the same way.
+// Kept small since it is sent for every node that is drawn - bone matrices are in the bone palette (see BonePalette.h)
 struct PerModelConstants
 {
     CMatrix4x4 worldMatrix;
@@ -97,12 +102,24 @@ struct PerModelConstants
     CVector3   objectColour;  // Allows each light model to be tinted to match the light colour they cast
 	float      explodeAmount; // Used in the geometry shader to control how much the polygons are exploded outwards
 
-	CMatrix4x4 boneMatrices[MAX_BONES];
+	unsigned int boneOffset;     // Skinned models: index of the first bone matrix of the current sub-mesh in the bone palette
+	unsigned int instanceOffset; // Instanced draws: index of the first instance of the current draw in the instance buffer
+	CVector2     padding1;       // Pad to a multiple of 16 bytes
 };
 extern PerModelConstants gPerModelConstants;      // This variable holds the CPU-side constant buffer described above
 extern ID3D11Buffer*     gPerModelConstantBuffer; // This variable controls the GPU-side constant buffer related to the above structure
 
 
+// Per-instance data for instanced rendering, an array of these is sent to the GPU each frame (see InstanceBatcher.h)
+// Must match the InstanceData structure in Common.hlsli
+struct InstanceData
+{
+	CMatrix4x4   worldMatrix;
+	CVector3     colour;      // Tint colour, replaces objectColour above for instanced draws
+	unsigned int textureSlot; // Where the model's texture is in the bound texture array (see TextureArrays.h)
+};
+
+
 
 
 //**************************
@@ -16,6 +16,12 @@ struct BasicVertex
     float2 uv : uv;
 };
 
+// Position only, for depth-only rendering. Meshes keep a separate stream with just the positions for this
+struct PositionOnlyVertex
+{
+    float3 position : position;
+};
+
 
 
 // This structure describes what data the lighting pixel shader receives from the vertex shader.
@@ -34,6 +40,8 @@ struct LightingPixelShaderInput
                                             // its position and normal in the world - required for lighting equations
     
     float2 uv : uv; // UVs are texture coordinates. The artist specifies for every vertex which point on the texture is "pinned" to that vertex.
+
+    nointerpolation uint textureSlot : textureSlot; // Where the model's texture is in the texture array (see gTextureSlots below)
 };
 
 
@@ -42,6 +50,8 @@ struct SimplePixelShaderInput
 {
     float4 projectedPosition : SV_Position;
     float2 uv : uv;
+    float3 colour : colour; // Tint colour, from the per-model constants or from the instance data for instanced draws
+    nointerpolation uint textureSlot : textureSlot; // Where the model's texture is in the texture array (see gTextureSlots below)
 };
 
 
@@ -78,28 +88,32 @@ cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer th
     float4x4 gProjectionMatrix;
     float4x4 gViewProjectionMatrix; // The above two matrices multiplied together to combine their effects
 
-    float3 gLight1Position; // 3 floats: x, y z
-    float  gViewportWidth; // Using viewport width and height as padding - see this structure in earlier labs to read about padding here
-    float3 gLight1Colour;
-    float  gViewportHeight;
-
-    float3 gLight2Position;
-    float  padding1;
-    float3 gLight2Colour;
-    float  padding2;
-
     float3 gAmbientColour;
     float  gSpecularPower;
 
     float3 gCameraPosition;
     float  gFrameTime; // This app does updates on the GPU so we pass over the frame update time
+
+    float  gViewportWidth;
+    float  gViewportHeight;
+    float  gClusterSliceScale; // A pixel's light cluster depth slice is log2(view space depth) * scale + bias
+    float  gClusterSliceBias;
+
+    uint   gClusterTilesX; // Size of the light cluster grid (see LightClusters.h)
+    uint   gClusterTilesY;
+    uint   gClusterSlices;
+    uint   gNumLights;     // Total number of point lights in the scene
+
+    // Shadow casting lights have cube shadow maps. For each: the point the map was rendered from (xyz) and its far
+    // clip distance (w). Array size must match ShadowMaps::MaxLights in the C++ code
+    float4 gShadowOrigins[4];
+    float  gShadowNearClip;
+    float3 padding1;
 }
 // Note constant buffers are not structs: we don't use the name of the constant buffer, these are really just a collection of global variables (hence the 'g')
 
 
 
-static const int MAX_BONES = 64;
-
 // If we have multiple models then we need to update the world matrix from C++ to GPU multiple times per frame because we
 // only have one world matrix here. Because this data is updated more frequently it is kept in a different buffer for better performance.
 // We also keep other data that changes per-model here
@@ -111,7 +125,78 @@ cbuffer PerModelConstants : register(b1) // The b1 gives this constant buffer th
     float3   gObjectColour; // Useed for tinting light models
     float    gExplodeAmount; // Used in the geometry shader to control how much the polygons are exploded outwards
 
-    float4x4 gBoneMatrices[MAX_BONES];
+    uint     gBoneOffset;     // Skinned models: where the current sub-mesh's bones start in the bone palette below
+    uint     gInstanceOffset; // Instanced draws: where the current draw's instances start in the instance buffer below
+    float2   padding3;
+}
+
+
+// Bone matrices for every skinned model in the frame, written and uploaded once per frame by the C++ BonePalette class
+// Vertex bone indexes are local to the sub-mesh being drawn, so a vertex's bone matrix is gBonePalette[gBoneOffset + index]
+// Not a constant buffer so there is no limit on the number of bones. Uses a register clear of the textures
+StructuredBuffer<float4x4> gBonePalette : register(t8);
+
+
+// Per-instance data for instanced draws, written and uploaded once per frame by the C++ InstanceBatcher class
+// Instance i of the current draw is gInstances[gInstanceOffset + i]. Must match the InstanceData structure in Common.h
+struct InstanceData
+{
+    float4x4 worldMatrix;
+    float3   colour;
+    uint     textureSlot;
+};
+StructuredBuffer<InstanceData> gInstances : register(t9);
+
+
+// Point lights for the lighting pixel shader, sorted into clusters (a grid over the camera's view) each frame by the
+// C++ LightClusters class. For cluster c the lights are gPointLights[gLightIndices[gLightClusters[c].x + i]] for
+// i = 0 to gLightClusters[c].y - 1. PointLight must match the structure in LightClusters.h
+struct PointLight
+{
+    float3 position;
+    float  radius;    // No light beyond this distance
+    float3 colour;
+    int    shadowMap; // Index of the light's cube shadow map, -1 if it doesn't cast shadows
+};
+StructuredBuffer<PointLight> gPointLights   : register(t10);
+StructuredBuffer<uint2>      gLightClusters : register(t11); // Offset and count of each cluster's lights in the list below
+StructuredBuffer<uint>       gLightIndices  : register(t12);
+
+
+// Where each texture is in the texture arrays, created by the C++ TextureArrays class. A model's slot comes from its
+// instance data. Must match the TextureSlot structure in TextureArrays.h
+struct TextureSlot
+{
+    float2 uvScale;  // UV in the layer = model UV * scale + offset, after wrapping the model UV to 0-1
+    float2 uvOffset;
+    uint   layer;
+    uint3  padding;
+};
+StructuredBuffer<TextureSlot> gTextureSlots : register(t14);
+
+// Sample the texture in a slot of a texture array with the given UVs. Textures filling their layer are sampled as
+// usual. Textures in an atlas wrap their UVs within their own area, using the gradients of the unwrapped UVs so the
+// mip doesn't jump at the wrap, and keep half a texel (at the mip being read) clear of the edge so filtering doesn't
+// pick up their neighbours
+float4 SampleTextureSlot(Texture2DArray textures, SamplerState textureSampler, uint slot, float2 uv)
+{
+    TextureSlot textureSlot = gTextureSlots[slot];
+    float2 uvDX = ddx(uv) * textureSlot.uvScale;
+    float2 uvDY = ddy(uv) * textureSlot.uvScale;
+    if (all(textureSlot.uvScale == 1.0f))
+    {
+        return textures.Sample(textureSampler, float3(uv, textureSlot.layer));
+    }
+
+    float width, height, layers, mips;
+    textures.GetDimensions(0, width, height, layers, mips);
+    float2 texelsDX = uvDX * float2(width, height);
+    float2 texelsDY = uvDY * float2(width, height);
+    float  mip = clamp(0.5f * log2(max(dot(texelsDX, texelsDX), dot(texelsDY, texelsDY))), 0.0f, mips - 1.0f);
+    float2 edge = 0.5f * exp2(mip) / (float2(width, height) * textureSlot.uvScale); // Half a texel in the texture's own UVs
+
+    float2 atlasUV = clamp(frac(uv), edge, 1.0f - edge) * textureSlot.uvScale + textureSlot.uvOffset;
+    return textures.SampleGrad(textureSampler, float3(atlasUV, textureSlot.layer), uvDX, uvDY);
 }
 
 
@@ -0,0 +1,39 @@
+//--------------------------------------------------------------------------------------
+// DDS texture files - reading and writing them
+//--------------------------------------------------------------------------------------
+
+#include "DDSFile.h"
+#include "FileSystem.h" // DDS files may be in a pack
+
+#include <fstream>
+#include <algorithm>
+
+
+// Read the header of a DDS file and find where its mips are. Only single 2D textures in the formats supported by
+// FormatSize can be read. Returns false on failure
+bool ReadDDSFileInfo(const std::string& filename, DDSFileInfo& file)
+{
+	// Only the pages holding the header are read from a mapped file
+	AssetFile assetFile;
+	if (!assetFile.Open(filename))  return false;
+	size_t headerBytes = static_cast<size_t>(std::min<uint64_t>(assetFile.Size(), DDS_MAX_HEADER_BYTES));
+	if (!ParseDDSHeader(assetFile.Data(), headerBytes, assetFile.Size(), file))  return false;
+	file.filename = filename;
+	return true;
+}
+
+
+// Write a 2D texture to a DDS file, with a DX10 header so any format can be used. Pass the data for each mip, most
+// detailed first. Returns false on failure
+bool WriteDDSFile(const std::string& filename, DXGI_FORMAT format, unsigned int width, unsigned int height,
+                  const std::vector<std::vector<uint8_t>>& mips)
+{
+	std::vector<uint8_t> header;
+	if (mips.empty() || !MakeDDSHeader(format, width, height, static_cast<unsigned int>(mips.size()), header))  return false;
+
+	std::ofstream stream(filename, std::ios::binary);
+	if (!stream)  return false;
+	stream.write(reinterpret_cast<const char*>(header.data()), header.size());
+	for (auto& mip : mips)  stream.write(reinterpret_cast<const char*>(mip.data()), mip.size());
+	return static_cast<bool>(stream);
+}
@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// DDS texture files - reading and writing them
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The layout of the files (headers, formats and where the mips are) is in DDSLayout.h, which works on data in memory.
+// This adds reading the header of a file, which may be in a pack, and writing a texture out to a new file
+
+#ifndef _DDS_FILE_H_INCLUDED_
+#define _DDS_FILE_H_INCLUDED_
+
+#include "DDSLayout.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+// Read the header of a DDS file and find where its mips are. Only single 2D textures in the formats supported by
+// FormatSize can be read. Returns false on failure
+bool ReadDDSFileInfo(const std::string& filename, DDSFileInfo& file);
+
+// Write a 2D texture to a DDS file, with a DX10 header so any format can be used. Pass the data for each mip, most
+// detailed first. Returns false on failure
+bool WriteDDSFile(const std::string& filename, DXGI_FORMAT format, unsigned int width, unsigned int height,
+                  const std::vector<std::vector<uint8_t>>& mips);
+
+
+#endif //_DDS_FILE_H_INCLUDED_
@@ -0,0 +1,188 @@
+//--------------------------------------------------------------------------------------
+// DDS texture layout - the headers of DDS files, the formats they hold and where their mips are
+//--------------------------------------------------------------------------------------
+
+#include "DDSLayout.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+// Bytes per row of a mip and the number of rows, where rows are of 4x4 blocks for block compressed formats
+static void MipLayout(unsigned int width, unsigned int height, unsigned int formatSize, bool blockCompressed,
+                      unsigned int& rowPitch, unsigned int& numRows)
+{
+	if (blockCompressed)
+	{
+		rowPitch = std::max((width  + 3) / 4, 1u) * formatSize;
+		numRows  = std::max((height + 3) / 4, 1u);
+	}
+	else
+	{
+		rowPitch = width * formatSize;
+		numRows  = height;
+	}
+}
+
+
+// DXGI format of an older style DDS pixel format, DXGI_FORMAT_UNKNOWN if not supported
+DXGI_FORMAT FormatFromPixelFormat(const DDSPixelFormat& pixelFormat)
+{
+	if (pixelFormat.flags & DDPF_FOURCC)
+	{
+		if (pixelFormat.fourCC == FourCC('D', 'X', 'T', '1'))  return DXGI_FORMAT_BC1_UNORM;
+		if (pixelFormat.fourCC == FourCC('D', 'X', 'T', '3'))  return DXGI_FORMAT_BC2_UNORM;
+		if (pixelFormat.fourCC == FourCC('D', 'X', 'T', '5'))  return DXGI_FORMAT_BC3_UNORM;
+		if (pixelFormat.fourCC == FourCC('A', 'T', 'I', '1') ||
+		    pixelFormat.fourCC == FourCC('B', 'C', '4', 'U'))  return DXGI_FORMAT_BC4_UNORM;
+		if (pixelFormat.fourCC == FourCC('A', 'T', 'I', '2') ||
+		    pixelFormat.fourCC == FourCC('B', 'C', '5', 'U'))  return DXGI_FORMAT_BC5_UNORM;
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	if ((pixelFormat.flags & DDPF_RGB) && pixelFormat.rgbBitCount == 32)
+	{
+		bool hasAlpha = (pixelFormat.flags & DDPF_ALPHAPIXELS) != 0;
+		if (pixelFormat.rBitMask == 0x00ff0000 && pixelFormat.gBitMask == 0x0000ff00 && pixelFormat.bBitMask == 0x000000ff)
+		{
+			return hasAlpha ? DXGI_FORMAT_B8G8R8A8_UNORM : DXGI_FORMAT_B8G8R8X8_UNORM;
+		}
+		if (pixelFormat.rBitMask == 0x000000ff && pixelFormat.gBitMask == 0x0000ff00 && pixelFormat.bBitMask == 0x00ff0000)
+		{
+			return DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+	}
+	return DXGI_FORMAT_UNKNOWN;
+}
+
+
+// Size of the formats supported: bytes per 4x4 block for block compressed formats, otherwise bytes per pixel. Returns 0
+// for formats that aren't supported
+unsigned int FormatSize(DXGI_FORMAT format, bool& blockCompressed)
+{
+	blockCompressed = true;
+	switch (format)
+	{
+	case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM: case DXGI_FORMAT_BC4_SNORM:
+		return 8;
+
+	case DXGI_FORMAT_BC2_UNORM: case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM: case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC7_UNORM: case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 16;
+
+	default:
+		break;
+	}
+
+	blockCompressed = false;
+	switch (format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM: case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM: case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM: case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		return 4;
+
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return 8;
+
+	default:
+		return 0;
+	}
+}
+
+
+// Parse the headers at the start of a DDS file held in memory and find where its mips are. Pass at least the headers
+// (DDS_MAX_HEADER_BYTES, or the whole file if smaller) and the size of the whole file, which is checked to hold every
+// mip. Only single 2D textures in the formats supported by FormatSize can be read. Returns false on failure
+bool ParseDDSHeader(const uint8_t* data, size_t dataSize, uint64_t fileSize, DDSFileInfo& file)
+{
+	// Copied out of the data as it may not be aligned
+	uint32_t  magic;
+	DDSHeader header;
+	size_t headerBytes = sizeof(magic) + sizeof(header);
+	if (dataSize < headerBytes || fileSize < headerBytes)  return false;
+	std::memcpy(&magic,  data, sizeof(magic));
+	std::memcpy(&header, data + sizeof(magic), sizeof(header));
+	if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader))  return false;
+	if (header.caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME))  return false;
+
+	if ((header.pixelFormat.flags & DDPF_FOURCC) && header.pixelFormat.fourCC == FourCC('D', 'X', '1', '0'))
+	{
+		DDSHeaderDX10 headerDX10;
+		if (dataSize < headerBytes + sizeof(headerDX10))  return false;
+		std::memcpy(&headerDX10, data + headerBytes, sizeof(headerDX10));
+		headerBytes += sizeof(headerDX10);
+		if (headerDX10.resourceDimension != DDS_DIMENSION_TEXTURE2D || headerDX10.arraySize > 1)  return false;
+		file.format = static_cast<DXGI_FORMAT>(headerDX10.dxgiFormat);
+	}
+	else
+	{
+		file.format = FormatFromPixelFormat(header.pixelFormat);
+	}
+
+	bool blockCompressed;
+	unsigned int formatSize = FormatSize(file.format, blockCompressed);
+	if (formatSize == 0 || header.width  == 0 || header.width  > DDS_MAX_TEXTURE_SIZE ||
+	                       header.height == 0 || header.height > DDS_MAX_TEXTURE_SIZE)  return false;
+
+	file.width  = header.width;
+	file.height = header.height;
+
+	// The mips follow the headers one after another, most detailed first
+	unsigned int numMips = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(header.mipMapCount, 1u) : 1;
+	uint64_t offset = headerBytes;
+	file.mips.clear();
+	for (unsigned int mip = 0; mip < numMips; ++mip)
+	{
+		unsigned int width  = std::max(file.width  >> mip, 1u);
+		unsigned int height = std::max(file.height >> mip, 1u);
+		unsigned int rowPitch, numRows;
+		MipLayout(width, height, formatSize, blockCompressed, rowPitch, numRows);
+		file.mips.push_back({ offset, rowPitch * numRows, rowPitch });
+		offset += rowPitch * numRows;
+		if (width == 1 && height == 1)  break;
+	}
+
+	// Check the file holds all the mips
+	return fileSize >= offset;
+}
+
+
+// The headers for a DDS file holding a 2D texture, with a DX10 header so any format supported by FormatSize can be
+// used. The mips follow the headers, most detailed first. Returns false if the format isn't supported
+bool MakeDDSHeader(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int numMips,
+                   std::vector<uint8_t>& result)
+{
+	bool blockCompressed;
+	unsigned int formatSize = FormatSize(format, blockCompressed);
+	if (formatSize == 0 || numMips == 0)  return false;
+
+	unsigned int rowPitch, numRows;
+	MipLayout(width, height, formatSize, blockCompressed, rowPitch, numRows);
+
+	DDSHeader header = {};
+	header.size   = sizeof(DDSHeader);
+	header.flags  = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = height;
+	header.width  = width;
+	header.pitchOrLinearSize = rowPitch * numRows;
+	header.mipMapCount = numMips;
+	header.pixelFormat.size   = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags  = DDPF_FOURCC;
+	header.pixelFormat.fourCC = FourCC('D', 'X', '1', '0');
+	header.caps = DDSCAPS_TEXTURE | (numMips > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	DDSHeaderDX10 headerDX10 = {};
+	headerDX10.dxgiFormat = format;
+	headerDX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	headerDX10.arraySize = 1;
+
+	result.resize(sizeof(DDS_MAGIC) + sizeof(header) + sizeof(headerDX10));
+	std::memcpy(result.data(), &DDS_MAGIC, sizeof(DDS_MAGIC));
+	std::memcpy(result.data() + sizeof(DDS_MAGIC), &header, sizeof(header));
+	std::memcpy(result.data() + sizeof(DDS_MAGIC) + sizeof(header), &headerDX10, sizeof(headerDX10));
+	return true;
+}
@@ -0,0 +1,168 @@
+//--------------------------------------------------------------------------------------
+// DDS texture layout - the headers of DDS files, the formats they hold and where their mips are
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// DDS files hold textures ready for the GPU: the pixels are in a DXGI format (often block compressed) with all the mips
+// stored one after another, most detailed first. Newer formats (e.g. BC7) need the extra DX10 header
+//
+// Everything here works on file data already in memory. Reading and writing the files themselves is in DDSFile.h
+
+#ifndef _DDS_LAYOUT_H_INCLUDED_
+#define _DDS_LAYOUT_H_INCLUDED_
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <dxgiformat.h>
+#else
+// The DXGI formats used here, with the same values as dxgiformat.h
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN             = 0,
+	DXGI_FORMAT_R16G16B16A16_FLOAT  = 10,
+	DXGI_FORMAT_R8G8B8A8_UNORM      = 28,
+	DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+	DXGI_FORMAT_BC1_UNORM           = 71,
+	DXGI_FORMAT_BC1_UNORM_SRGB      = 72,
+	DXGI_FORMAT_BC2_UNORM           = 74,
+	DXGI_FORMAT_BC2_UNORM_SRGB      = 75,
+	DXGI_FORMAT_BC3_UNORM           = 77,
+	DXGI_FORMAT_BC3_UNORM_SRGB      = 78,
+	DXGI_FORMAT_BC4_UNORM           = 80,
+	DXGI_FORMAT_BC4_SNORM           = 81,
+	DXGI_FORMAT_BC5_UNORM           = 83,
+	DXGI_FORMAT_BC5_SNORM           = 84,
+	DXGI_FORMAT_B8G8R8A8_UNORM      = 87,
+	DXGI_FORMAT_B8G8R8X8_UNORM      = 88,
+	DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91,
+	DXGI_FORMAT_B8G8R8X8_UNORM_SRGB = 93,
+	DXGI_FORMAT_BC7_UNORM           = 98,
+	DXGI_FORMAT_BC7_UNORM_SRGB      = 99,
+};
+#endif
+
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+const uint32_t DDSD_CAPS         = 0x1;
+const uint32_t DDSD_HEIGHT       = 0x2;
+const uint32_t DDSD_WIDTH        = 0x4;
+const uint32_t DDSD_PIXELFORMAT  = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT  = 0x20000;
+const uint32_t DDSD_LINEARSIZE   = 0x80000;
+const uint32_t DDPF_ALPHAPIXELS  = 0x1;
+const uint32_t DDPF_FOURCC       = 0x4;
+const uint32_t DDPF_RGB          = 0x40;
+const uint32_t DDSCAPS_COMPLEX   = 0x8;
+const uint32_t DDSCAPS_TEXTURE   = 0x1000;
+const uint32_t DDSCAPS_MIPMAP    = 0x400000;
+const uint32_t DDSCAPS2_CUBEMAP  = 0x200;
+const uint32_t DDSCAPS2_VOLUME   = 0x200000;
+const uint32_t DDS_DIMENSION_TEXTURE2D = 3; // In the DX10 header
+
+const unsigned int DDS_MAX_HEADER_BYTES = 4 + 124 + 20; // Magic number, header and DX10 header
+const unsigned int DDS_MAX_TEXTURE_SIZE = 16384;        // Largest 2D texture DirectX 11 supports
+
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t rBitMask;
+	uint32_t gBitMask;
+	uint32_t bBitMask;
+	uint32_t aBitMask;
+};
+
+struct DDSHeader
+{
+	uint32_t       size;
+	uint32_t       flags;
+	uint32_t       height;
+	uint32_t       width;
+	uint32_t       pitchOrLinearSize;
+	uint32_t       depth;
+	uint32_t       mipMapCount;
+	uint32_t       reserved1[11];
+	DDSPixelFormat pixelFormat;
+	uint32_t       caps;
+	uint32_t       caps2;
+	uint32_t       caps3;
+	uint32_t       caps4;
+	uint32_t       reserved2;
+};
+
+// Follows the header when the pixel format's fourCC is "DX10"
+struct DDSHeaderDX10
+{
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+inline uint32_t FourCC(char a, char b, char c, char d)
+{
+	return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+}
+
+
+// DXGI format of an older style DDS pixel format, DXGI_FORMAT_UNKNOWN if not supported
+DXGI_FORMAT FormatFromPixelFormat(const DDSPixelFormat& pixelFormat);
+
+// Size of the formats supported: bytes per 4x4 block for block compressed formats, otherwise bytes per pixel. Returns 0
+// for formats that aren't supported
+unsigned int FormatSize(DXGI_FORMAT format, bool& blockCompressed);
+
+
+// Where a 2D texture's mips are in a DDS file. The mips are stored most detailed first
+struct DDSFileInfo
+{
+	std::string  filename;
+	DXGI_FORMAT  format = DXGI_FORMAT_UNKNOWN;
+	unsigned int width  = 0;
+	unsigned int height = 0;
+
+	struct Mip
+	{
+		uint64_t     offset; // Position in the file
+		unsigned int size;   // Bytes
+		unsigned int pitch;  // Bytes per row (of 4x4 blocks for block compressed formats)
+	};
+	std::vector<Mip> mips;
+};
+
+// Parse the headers at the start of a DDS file held in memory and find where its mips are. Pass at least the headers
+// (DDS_MAX_HEADER_BYTES, or the whole file if smaller) and the size of the whole file, which is checked to hold every
+// mip. Only single 2D textures in the formats supported by FormatSize can be read. Returns false on failure. Doesn't
+// set the filename
+bool ParseDDSHeader(const uint8_t* data, size_t dataSize, uint64_t fileSize, DDSFileInfo& file);
+
+// Initial data for creating a texture from the mips of a DDS file held in memory (e.g. a mapped file), from firstMip to
+// the last. Points into the file data so nothing is copied. The result has one entry per mip. SubresourceData is
+// D3D11_SUBRESOURCE_DATA or any struct with the same members: data pointer, row pitch and slice pitch
+template <typename SubresourceData>
+void DDSSubresourceData(const DDSFileInfo& file, const uint8_t* fileData, unsigned int firstMip,
+                        std::vector<SubresourceData>& result)
+{
+	result.clear();
+	for (unsigned int mip = firstMip; mip < file.mips.size(); ++mip)
+	{
+		const DDSFileInfo::Mip& fileMip = file.mips[mip];
+		result.push_back({ fileData + fileMip.offset, fileMip.pitch, fileMip.size });
+	}
+}
+
+
+// The headers for a DDS file holding a 2D texture, with a DX10 header so any format supported by FormatSize can be
+// used. The mips follow the headers, most detailed first. Returns false if the format isn't supported
+bool MakeDDSHeader(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int numMips,
+                   std::vector<uint8_t>& result);
+
+
+#endif //_DDS_LAYOUT_H_INCLUDED_
@@ -0,0 +1,26 @@
+//--------------------------------------------------------------------------------------
+// Depth-Only Vertex Shader - Instanced
+//--------------------------------------------------------------------------------------
+// Used for the depth pre-pass, which fills the depth buffer before any lighting is done. Reads only vertex positions
+// and is used without a pixel shader. The position must be calculated in exactly the same way as the colour pass
+// vertex shader (PixelLightingInstanced_vs) so the depths match for the equal depth test used afterwards
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Vertex shader gets vertex positions from the mesh one at a time, along with the index of the instance being drawn
+float4 main(PositionOnlyVertex modelVertex, uint instanceID : SV_InstanceID) : SV_Position
+{
+    // Get the world matrix for this copy of the mesh
+    float4x4 worldMatrix = gInstances[gInstanceOffset + instanceID].worldMatrix;
+
+    // Same transforms as the colour pass, marked "precise" so the compiler can't reorder them differently
+    float4 modelPosition = float4(modelVertex.position, 1);
+    precise float4 worldPosition = mul(worldMatrix,       modelPosition);
+    precise float4 viewPosition  = mul(gViewMatrix,       worldPosition);
+    return                         mul(gProjectionMatrix, viewPosition);
+}
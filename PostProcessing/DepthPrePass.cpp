@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// Decides when to use a depth pre-pass by measuring overdraw
+//--------------------------------------------------------------------------------------
+
+#include "DepthPrePass.h"
+#include "Common.h" // For gD3DDevice and gD3DContext
+
+
+// Overdraw above which the pre-pass is switched on, and below which it is switched off again. The gap stops it
+// switching back and forth when the overdraw is close to the limit
+const float ENABLE_OVERDRAW  = 1.5f;
+const float DISABLE_OVERDRAW = 1.25f;
+
+// While the pre-pass is off, it is used on one frame in this many to measure the overdraw
+const int PROBE_INTERVAL = 30;
+
+
+// Decide whether to use the pre-pass this frame from the most recent measurements. Returns true if it should be used
+bool DepthPrePass::BeginFrame()
+{
+	mMeasuring = false;
+	if (mQueriesFailed)  return false;
+
+	// Create the queries on first use
+	if (mQuerySets[0].depthPass == nullptr)
+	{
+		D3D11_QUERY_DESC queryDesc = {};
+		queryDesc.Query = D3D11_QUERY_OCCLUSION; // Counts pixels passing the depth test
+		for (auto& set : mQuerySets)
+		{
+			if (FAILED(gD3DDevice->CreateQuery(&queryDesc, &set.depthPass)) ||
+			    FAILED(gD3DDevice->CreateQuery(&queryDesc, &set.colourPass)))
+			{
+				Release();
+				mQueriesFailed = true;
+				return false;
+			}
+		}
+	}
+
+	ReadResults();
+
+	// Measure whenever the pre-pass is used, if there is a free set of queries (the GPU may be running behind)
+	bool querySetFree = !mQuerySets[mNextSet].pending;
+	if (mEnabled)
+	{
+		mMeasuring = querySetFree;
+		if (mMeasuring)  mFramesUntilProbe = PROBE_INTERVAL;
+		return true;
+	}
+
+	// While disabled the pre-pass is only used to measure, so wait at zero until a set of queries is free rather than
+	// using it unmeasured (and counting down further) every frame until one is
+	if (mFramesUntilProbe > 0)  --mFramesUntilProbe;
+	if (mFramesUntilProbe > 0 || !querySetFree)  return false;
+
+	mMeasuring = true;
+	mFramesUntilProbe = PROBE_INTERVAL;
+	return true;
+}
+
+
+// When the pre-pass is used, call these around the depth-only pass and around the opaque colour pass
+void DepthPrePass::BeginDepthPass()
+{
+	if (mMeasuring)  gD3DContext->Begin(mQuerySets[mNextSet].depthPass);
+}
+
+void DepthPrePass::EndDepthPass()
+{
+	if (mMeasuring)  gD3DContext->End(mQuerySets[mNextSet].depthPass);
+}
+
+void DepthPrePass::BeginColourPass()
+{
+	if (mMeasuring)  gD3DContext->Begin(mQuerySets[mNextSet].colourPass);
+}
+
+void DepthPrePass::EndColourPass()
+{
+	if (!mMeasuring)  return;
+
+	gD3DContext->End(mQuerySets[mNextSet].colourPass);
+	mQuerySets[mNextSet].pending = true;
+	mNextSet = (mNextSet + 1) % NUM_QUERY_SETS;
+	mMeasuring = false;
+}
+
+
+// Release the queries (they will be recreated if used again)
+void DepthPrePass::Release()
+{
+	for (auto& set : mQuerySets)
+	{
+		if (set.depthPass)   set.depthPass ->Release();
+		if (set.colourPass)  set.colourPass->Release();
+		set = QuerySet();
+	}
+	mNextSet = mOldestSet = 0;
+}
+
+
+// Read any finished measurements and update the decision
+void DepthPrePass::ReadResults()
+{
+	// Results are read without flushing so the CPU doesn't wait. Queries finish in the order they were issued so stop
+	// at the first one that isn't ready
+	while (mQuerySets[mOldestSet].pending)
+	{
+		QuerySet& set = mQuerySets[mOldestSet];
+		UINT64 depthPassPixels, colourPassPixels;
+		if (gD3DContext->GetData(set.depthPass,  &depthPassPixels,  sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+		    gD3DContext->GetData(set.colourPass, &colourPassPixels, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)  break;
+
+		set.pending = false;
+		mOldestSet = (mOldestSet + 1) % NUM_QUERY_SETS;
+
+		if (colourPassPixels == 0)  continue; // Nothing opaque on screen, nothing to learn
+		mOverdraw = static_cast<float>(depthPassPixels) / static_cast<float>(colourPassPixels);
+
+		if      (!mEnabled && mOverdraw > ENABLE_OVERDRAW)   mEnabled = true;
+		else if ( mEnabled && mOverdraw < DISABLE_OVERDRAW)  mEnabled = false;
+	}
+}
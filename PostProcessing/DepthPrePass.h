@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// Decides when to use a depth pre-pass by measuring overdraw
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// A depth pre-pass draws the opaque models into the depth buffer only (cheap - positions only, no pixel shader), then
+// draws them again with lighting using an equal depth test, so only the nearest surface at each pixel is lit. This
+// saves a lot of pixel shading when models overlap on screen, but costs a second geometry pass when they don't.
+//
+// The overdraw is measured with occlusion queries, which count the pixels passing the depth test. In the pre-pass that
+// is every pixel that would have been lit without the pre-pass (the draw order is the same), and in the colour pass it
+// is every pixel that is actually lit, so the ratio is the overdraw. The pre-pass is switched on when the overdraw is
+// high and off when it is low. While it is off, every so often a frame uses it anyway to measure the overdraw again.
+// Query results are read a few frames later so the CPU never waits for the GPU
+
+#ifndef _DEPTH_PRE_PASS_H_INCLUDED_
+#define _DEPTH_PRE_PASS_H_INCLUDED_
+
+#include <d3d11.h>
+
+class DepthPrePass
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Queries are created on first use so this can be declared before DirectX is set up
+	DepthPrePass() {}
+
+	// Decide whether to use the pre-pass this frame from the most recent measurements. Returns true if it should be used
+	bool BeginFrame();
+
+	// When the pre-pass is used, call these around the depth-only pass and around the opaque colour pass
+	void BeginDepthPass();
+	void EndDepthPass();
+	void BeginColourPass();
+	void EndColourPass();
+
+	// Release the queries (they will be recreated if used again)
+	void Release();
+
+
+	// Most recent measurement of the average number of times each opaque pixel is drawn without a pre-pass
+	float Overdraw()  { return mOverdraw; }
+
+	// Whether the pre-pass is currently chosen (not including the occasional measuring frames)
+	bool Enabled()  { return mEnabled; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Queries for one frame's measurement
+	struct QuerySet
+	{
+		ID3D11Query* depthPass  = nullptr;
+		ID3D11Query* colourPass = nullptr;
+		bool         pending    = false; // Issued but results not yet read
+	};
+
+	// Read any finished measurements and update the decision
+	void ReadResults();
+
+	// Enough sets for the GPU to be a few frames behind the CPU
+	static const unsigned int NUM_QUERY_SETS = 4;
+	QuerySet     mQuerySets[NUM_QUERY_SETS];
+	unsigned int mNextSet   = 0; // Set used for the next measurement
+	unsigned int mOldestSet = 0; // Oldest set that may be pending, results are read in the order issued
+
+	bool  mMeasuring        = false; // Whether the queries are being used this frame
+	bool  mEnabled          = false;
+	bool  mQueriesFailed    = false; // Queries couldn't be created, never use the pre-pass
+	int   mFramesUntilProbe = 0;     // Frames until the pre-pass is used to measure again while it is disabled
+	float mOverdraw         = 1.0f;
+};
+
+
+#endif //_DEPTH_PRE_PASS_H_INCLUDED_
@@ -0,0 +1,150 @@
+//--------------------------------------------------------------------------------------
+// Collects models that share a mesh and material so they can be drawn with instancing
+//--------------------------------------------------------------------------------------
+
+#include "InstanceBatcher.h"
+#include "Mesh.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+// Remove all models, call at the start of each frame. The models and batches are kept in frame memory (see
+// FrameAllocator.h) so must be prepared and submitted in the frame they are added
+void InstanceBatcher::Reset()
+{
+	NewFrameStorage(mItems);
+	NewFrameStorage(mBatches);
+	NewFrameStorage(mInstances);
+	NewFrameStorage(mRanges);
+	NewFrameStorage(mMeshletCameras);
+}
+
+
+// Add a model to be drawn this frame using the given material and tint colour (only used by some shaders). The model
+// is drawn at its current level of detail (see Model::SelectLod). Skinned models can't be instanced
+void InstanceBatcher::Add(Model* model, const Material* material, const CVector3& colour /*= { 1, 1, 1 }*/)
+{
+	assert(!model->GetMesh()->HasBones());
+	mItems.push_back({ model->GetMesh(), material, model, model->Lod(), colour });
+}
+
+
+// Group models into batches and send the instance data to the GPU. Call after all models are added and before
+// rendering. Returns false on failure
+bool InstanceBatcher::Prepare()
+{
+	mBatches.clear();
+	mInstances.clear();
+	mRanges.clear();
+
+	// Sort so models with the same mesh, material and level of detail are next to each other
+	std::sort(mItems.begin(), mItems.end(), [](const Item& a, const Item& b)
+	{
+		if (a.mesh != b.mesh)          return a.mesh < b.mesh;
+		if (a.material != b.material)  return a.material < b.material;
+		return a.lod < b.lod;
+	});
+
+	// Each group of models with the same mesh, material and level of detail gives one batch for each node with
+	// geometry. A batch's instances are contiguous: the node's absolute matrix from each model in the group, in turn
+	size_t groupStart = 0;
+	while (groupStart < mItems.size())
+	{
+		Mesh* mesh = mItems[groupStart].mesh;
+		const Material* material = mItems[groupStart].material;
+		unsigned int lod = mItems[groupStart].lod;
+		size_t groupEnd = groupStart + 1;
+		while (groupEnd < mItems.size() && mItems[groupEnd].mesh == mesh && mItems[groupEnd].material == material &&
+		       mItems[groupEnd].lod == lod)  ++groupEnd;
+		unsigned int numInstances = static_cast<unsigned int>(groupEnd - groupStart);
+
+		for (unsigned int node = 0; node < mesh->NumberNodes(); ++node)
+		{
+			if (!mesh->NodeHasGeometry(node))  continue;
+
+			mBatches.push_back({ mesh, material, node, lod, static_cast<unsigned int>(mInstances.size()), numInstances, false, 0, 0 });
+			for (size_t i = groupStart; i < groupEnd; ++i)
+			{
+				mInstances.push_back({ mItems[i].model->AbsoluteMatrices()[node], mItems[i].colour, mItems[i].material->textureSlot });
+			}
+		}
+
+		groupStart = groupEnd;
+	}
+
+	return mInstanceBuffer.Upload(mInstances.data(), static_cast<unsigned int>(mInstances.size()));
+}
+
+
+// Cull the meshlets of each batch against a camera's frustum (world space planes) and position. A meshlet is kept if
+// any model in the batch might show it. Optional, call after Prepare and before Submit. Batches with nothing left
+// aren't submitted
+void InstanceBatcher::CullMeshlets(const CVector3& cameraPosition, const Frustum& frustum)
+{
+	mRanges.clear();
+	mNumMeshletIndices      = 0;
+	mNumMeshletIndicesDrawn = 0;
+
+	for (auto& batch : mBatches)
+	{
+		batch.hasRanges = batch.mesh->NodeHasMeshlets(batch.node);
+		if (!batch.hasRanges)  continue;
+
+		// Back-facing meshlets can only be skipped if the material culls back faces. No rasterizer state means the
+		// DirectX default, which does
+		bool cullBackFaces = true;
+		if (batch.material->rasterizerState != nullptr)
+		{
+			D3D11_RASTERIZER_DESC rasterizerDesc;
+			batch.material->rasterizerState->GetDesc(&rasterizerDesc);
+			cullBackFaces = (rasterizerDesc.CullMode == D3D11_CULL_BACK);
+		}
+
+		// Culling is done in the mesh's space, so move the camera into the space of each instance
+		mMeshletCameras.clear();
+		for (unsigned int i = batch.firstInstance; i < batch.firstInstance + batch.numInstances; ++i)
+		{
+			mMeshletCameras.push_back(MeshletCameraFromWorld(mInstances[i].worldMatrix, cameraPosition, frustum));
+		}
+
+		batch.firstRange = static_cast<unsigned int>(mRanges.size());
+		unsigned int numIndicesDrawn = batch.mesh->CullMeshlets(batch.node, batch.lod, mMeshletCameras.data(),
+		                                                        batch.numInstances, cullBackFaces, mRanges);
+		batch.numRanges = static_cast<unsigned int>(mRanges.size()) - batch.firstRange;
+
+		mNumMeshletIndices      += batch.mesh->NodeNumIndices(batch.node, batch.lod) * batch.numInstances;
+		mNumMeshletIndicesDrawn += numIndicesDrawn * batch.numInstances;
+	}
+}
+
+
+// Bind the instance buffer to the vertex shader at the given slot (must match register in Common.hlsli)
+void InstanceBatcher::SetVertexShaderResource(unsigned int slot)
+{
+	ID3D11ShaderResourceView* instanceSRV = mInstanceBuffer.SRV();
+	gD3DContext->VSSetShaderResources(slot, 1, &instanceSRV);
+}
+
+
+// Submit a draw for each batch to the render queue. Each draw is ordered by the distance from the camera to the
+// nearest instance in the batch
+void InstanceBatcher::Submit(RenderQueue& queue, const CVector3& cameraPosition)
+{
+	for (auto& batch : mBatches)
+	{
+		if (batch.hasRanges && batch.numRanges == 0)  continue; // Every meshlet was culled
+
+		float nearestDistance = 3.4e38f;
+		for (unsigned int i = batch.firstInstance; i < batch.firstInstance + batch.numInstances; ++i)
+		{
+			float distance = Length(mInstances[i].worldMatrix.GetPosition() - cameraPosition);
+			if (distance < nearestDistance)  nearestDistance = distance;
+		}
+
+		const MeshDrawRange* ranges = batch.hasRanges ? mRanges.data() + batch.firstRange : nullptr;
+		queue.Submit(batch.material, nearestDistance, batch.mesh, batch.node, batch.lod, batch.firstInstance, batch.numInstances,
+		             ranges, batch.numRanges);
+	}
+}
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------------------
+// Collects models that share a mesh and material so they can be drawn with instancing
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Each frame, models are added to a batcher along with their material and tint colour. Prepare groups them by
+// (mesh, material, level of detail), writes every model's world matrices and colour into one instance buffer and
+// sends it to the GPU. Submit then gives the render queue one instanced draw per group (per node with geometry), so
+// the number of draw calls depends on the number of different meshes, not the number of models.
+// Optionally CullMeshlets then removes the parts of each batch that no model in it shows to the camera, for meshes split
+// into meshlets (see Meshlets.h), and Submit draws only what is left.
+// Rigid meshes only, skinned models should be rendered with Model::Render
+
+#ifndef _INSTANCE_BATCHER_H_INCLUDED_
+#define _INSTANCE_BATCHER_H_INCLUDED_
+
+#include "Common.h"
+#include "RenderQueue.h"
+#include "DynamicStructuredBuffer.h"
+#include "Mesh.h" // For MeshDrawRange
+#include "BoundingVolumes.h"
+#include "FrameAllocator.h" // Models and batches only last for the frame
+#include <d3d11.h>
+#include <vector>
+
+class Model;
+
+class InstanceBatcher
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// The GPU buffer is created on the first upload so a batcher can be declared before DirectX is set up
+	InstanceBatcher() : mInstanceBuffer(sizeof(InstanceData)) {}
+
+	// Remove all models, call at the start of each frame. The models and batches are kept in frame memory (see
+	// FrameAllocator.h) so must be prepared and submitted in the frame they are added
+	void Reset();
+
+	// Add a model to be drawn this frame using the given material and tint colour (only used by some shaders). The model
+	// is drawn at its current level of detail (see Model::SelectLod). The model's mesh must not be skinned: instances
+	// only carry one matrix per node, not bones
+	void Add(Model* model, const Material* material, const CVector3& colour = { 1, 1, 1 });
+
+	// Group models into batches and send the instance data to the GPU. Call after all models are added and before
+	// rendering. Returns false on failure
+	bool Prepare();
+
+	// Cull the meshlets of each batch against a camera's frustum (world space planes) and position. A meshlet is kept if
+	// any model in the batch might show it. Optional, call after Prepare and before Submit. Batches with nothing left
+	// aren't submitted
+	void CullMeshlets(const CVector3& cameraPosition, const Frustum& frustum);
+
+	// Bind the instance buffer to the vertex shader at the given slot (must match register in Common.hlsli)
+	void SetVertexShaderResource(unsigned int slot);
+
+	// Submit a draw for each batch to the render queue. Each draw is ordered by the distance from the camera to the
+	// nearest instance in the batch
+	void Submit(RenderQueue& queue, const CVector3& cameraPosition);
+
+	// Release GPU resources (they will be recreated if the batcher is used again)
+	void Release()  { mInstanceBuffer.Release(); }
+
+
+	// Statistics for the last Prepare
+	unsigned int NumInstances()  { return static_cast<unsigned int>(mItems.size()); }
+	unsigned int NumDraws()      { return static_cast<unsigned int>(mBatches.size()); }
+
+	// Statistics for the last CullMeshlets, indices drawn for batches with meshlets (counting every instance) before and
+	// after culling
+	unsigned int NumMeshletIndices()       { return mNumMeshletIndices; }
+	unsigned int NumMeshletIndicesDrawn()  { return mNumMeshletIndicesDrawn; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// A model added this frame
+	struct Item
+	{
+		Mesh*           mesh;
+		const Material* material;
+		Model*          model;
+		unsigned int    lod;
+		CVector3        colour;
+	};
+
+	// One instanced draw - a node of a mesh drawn for every model in a group
+	struct Batch
+	{
+		Mesh*           mesh;
+		const Material* material;
+		unsigned int    node;
+		unsigned int    lod;
+		unsigned int    firstInstance; // Index into mInstances
+		unsigned int    numInstances;
+		bool            hasRanges;     // If meshlets were culled, draw only mRanges[firstRange] to mRanges[firstRange + numRanges - 1]
+		unsigned int    firstRange;
+		unsigned int    numRanges;
+	};
+
+	FrameVector<Item>         mItems;
+	FrameVector<Batch>        mBatches;
+	FrameVector<InstanceData> mInstances;      // CPU-side instance data for this frame
+	DynamicStructuredBuffer   mInstanceBuffer; // GPU copy
+
+	FrameVector<MeshDrawRange> mRanges;         // Index ranges left after meshlet culling for all batches
+	FrameVector<MeshletCamera> mMeshletCameras; // Scratch space, the camera in the space of each instance of a batch
+
+	unsigned int mNumMeshletIndices      = 0;
+	unsigned int mNumMeshletIndicesDrawn = 0;
+};
+
+
+#endif //_INSTANCE_BATCHER_H_INCLUDED_
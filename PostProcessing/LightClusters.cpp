@@ -0,0 +1,256 @@
+//--------------------------------------------------------------------------------------
+// Clustered lighting - point lights sorted into a grid over the camera's view
+//--------------------------------------------------------------------------------------
+
+#include "LightClusters.h"
+#include "ThreadPool.h" // Depth slices are binned in parallel
+
+#include <xmmintrin.h> // SSE intrinsics
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+
+// Far side of the first depth slice. The slices after it are spaced exponentially out to the far clip. Without this
+// the near clip is so close to the camera that the first few slices would be tiny and almost never used
+const float FIRST_SLICE_DEPTH = 5.0f;
+
+
+LightClusters::LightClusters()
+{
+	mClusterBounds.resize(NumClusters);
+	mRowBounds.resize(NumTilesY * NumSlices);
+	mSliceBounds.resize(NumSlices);
+	mSliceWork.resize(NumSlices);
+	mClusters.resize(NumClusters);
+}
+
+
+// Sort the given lights into the clusters for a camera. The camera is given by its view matrix and the settings
+// used for its projection matrix (horizontal field of view in radians)
+void LightClusters::Build(const CMatrix4x4& viewMatrix, float fovX, float aspectRatio, float nearClip, float farClip,
+                          const PointLight* lights, unsigned int numLights)
+{
+	if (fovX != mFOVx || aspectRatio != mAspectRatio || nearClip != mNearClip || farClip != mFarClip)
+	{
+		CalculateClusterBounds(fovX, aspectRatio, nearClip, farClip);
+	}
+
+	// Transform the light positions into view space, one SSE multiply-add per matrix row
+	__m128 row0 = _mm_loadu_ps(&viewMatrix.e00);
+	__m128 row1 = _mm_loadu_ps(&viewMatrix.e10);
+	__m128 row2 = _mm_loadu_ps(&viewMatrix.e20);
+	__m128 row3 = _mm_loadu_ps(&viewMatrix.e30);
+
+	mViewLights.Clear();
+	for (unsigned int i = 0; i < numLights; ++i)
+	{
+		const PointLight& light = lights[i];
+		__m128 view =                  _mm_mul_ps(_mm_set1_ps(light.position.x), row0);
+		view = _mm_add_ps(view, _mm_mul_ps(_mm_set1_ps(light.position.y), row1));
+		view = _mm_add_ps(view, _mm_mul_ps(_mm_set1_ps(light.position.z), row2));
+		view = _mm_add_ps(view, row3);
+
+		float viewPosition[4];
+		_mm_storeu_ps(viewPosition, view);
+		mViewLights.Add(viewPosition[0], viewPosition[1], viewPosition[2], light.radius * light.radius, i);
+	}
+	mViewLights.Pad();
+
+	// Each slice writes its own light lists so no locking is needed
+	ParallelFor(NumSlices, 1, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int slice = begin; slice < end; ++slice)  BinSlice(slice);
+	});
+
+	// Join the slices' light lists together. The cluster offsets are relative to the start of their slice's list
+	size_t numIndices = 0;
+	for (auto& work : mSliceWork)  numIndices += work.indices.size();
+	mLightIndices.resize(numIndices);
+
+	uint32_t sliceOffset = 0;
+	mMaxLightsPerCluster = 0;
+	for (unsigned int slice = 0; slice < NumSlices; ++slice)
+	{
+		const auto& indices = mSliceWork[slice].indices;
+		if (!indices.empty())  std::memcpy(&mLightIndices[sliceOffset], indices.data(), indices.size() * sizeof(uint32_t));
+
+		Cluster* cluster = &mClusters[slice * NumTilesX * NumTilesY];
+		for (unsigned int i = 0; i < NumTilesX * NumTilesY; ++i)
+		{
+			cluster[i].offset += sliceOffset;
+			mMaxLightsPerCluster = std::max(mMaxLightsPerCluster, cluster[i].count);
+		}
+		sliceOffset += static_cast<uint32_t>(indices.size());
+	}
+}
+
+
+// Index of the cluster containing a point, given its screen position (0 to 1 across the viewport, y down) and its
+// depth in view space. This is the same calculation as the lighting shader
+unsigned int LightClusters::ClusterIndex(float screenX, float screenY, float viewDepth)
+{
+	unsigned int tileX = static_cast<unsigned int>(std::max(screenX * NumTilesX, 0.0f));
+	unsigned int tileY = static_cast<unsigned int>(std::max(screenY * NumTilesY, 0.0f));
+	unsigned int slice = static_cast<unsigned int>(std::max(std::log2(viewDepth) * mSliceScale + mSliceBias, 0.0f));
+	tileX = std::min(tileX, NumTilesX - 1);
+	tileY = std::min(tileY, NumTilesY - 1);
+	slice = std::min(slice, NumSlices - 1);
+	return (slice * NumTilesY + tileY) * NumTilesX + tileX;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helper functions
+//--------------------------------------------------------------------------------------
+
+// Calculate the view space box of every cluster, only needed when the camera's projection changes
+void LightClusters::CalculateClusterBounds(float fovX, float aspectRatio, float nearClip, float farClip)
+{
+	mFOVx        = fovX;
+	mAspectRatio = aspectRatio;
+	mNearClip    = nearClip;
+	mFarClip     = farClip;
+
+	// Slice 0 covers the near clip to the first slice depth, then slices 1 to NumSlices - 1 are spaced exponentially out
+	// to the far clip, i.e. slice = 1 + log2(depth / firstDepth) * scale
+	float firstDepth = std::max(std::min(FIRST_SLICE_DEPTH, farClip * 0.5f), nearClip * 2.0f);
+	mSliceScale = (NumSlices - 1) / std::log2(farClip / firstDepth);
+	mSliceBias  = 1.0f - std::log2(firstDepth) * mSliceScale;
+
+	// Half the width and height of the view at a depth of 1 (same as the camera's projection matrix)
+	float tanHalfFOVx = std::tan(fovX * 0.5f);
+	float tanHalfFOVy = tanHalfFOVx / aspectRatio;
+
+	for (unsigned int slice = 0; slice < NumSlices; ++slice)
+	{
+		float sliceNear = (slice == 0) ? nearClip : firstDepth * std::pow(farClip / firstDepth, (slice - 1.0f) / (NumSlices - 1));
+		float sliceFar  = firstDepth * std::pow(farClip / firstDepth, static_cast<float>(slice) / (NumSlices - 1));
+		if (slice == NumSlices - 1)  sliceFar = farClip;
+
+		mSliceBounds[slice] = AABB();
+		for (unsigned int tileY = 0; tileY < NumTilesY; ++tileY)
+		{
+			AABB& rowBounds = mRowBounds[slice * NumTilesY + tileY];
+			rowBounds = AABB();
+
+			// Screen y is down, view space y is up
+			float top    = 1.0f - 2.0f * tileY       / NumTilesY;
+			float bottom = 1.0f - 2.0f * (tileY + 1) / NumTilesY;
+			for (unsigned int tileX = 0; tileX < NumTilesX; ++tileX)
+			{
+				float left  = -1.0f + 2.0f * tileX       / NumTilesX;
+				float right = -1.0f + 2.0f * (tileX + 1) / NumTilesX;
+
+				// The cluster is a piece of the view frustum, the box contains its eight corners
+				AABB& box = mClusterBounds[(slice * NumTilesY + tileY) * NumTilesX + tileX];
+				box = AABB();
+				for (float depth : { sliceNear, sliceFar })
+				{
+					box.Add({ left  * tanHalfFOVx * depth, top    * tanHalfFOVy * depth, depth });
+					box.Add({ right * tanHalfFOVx * depth, bottom * tanHalfFOVy * depth, depth });
+				}
+				rowBounds.Add(box);
+			}
+			mSliceBounds[slice].Add(rowBounds);
+		}
+	}
+}
+
+
+// Find the lights touching each cluster in a depth slice
+void LightClusters::BinSlice(unsigned int slice)
+{
+	SliceWork& work = mSliceWork[slice];
+	work.indices.clear();
+
+	FilterLights(mViewLights, mSliceBounds[slice], work.sliceLights);
+
+	const __m128 zero = _mm_setzero_ps();
+	for (unsigned int tileY = 0; tileY < NumTilesY; ++tileY)
+	{
+		FilterLights(work.sliceLights, mRowBounds[slice * NumTilesY + tileY], work.rowLights);
+		const LightSet& lights = work.rowLights;
+
+		for (unsigned int tileX = 0; tileX < NumTilesX; ++tileX)
+		{
+			unsigned int clusterIndex = (slice * NumTilesY + tileY) * NumTilesX + tileX;
+			const AABB& box = mClusterBounds[clusterIndex];
+			__m128 minX = _mm_set1_ps(box.min.x), minY = _mm_set1_ps(box.min.y), minZ = _mm_set1_ps(box.min.z);
+			__m128 maxX = _mm_set1_ps(box.max.x), maxY = _mm_set1_ps(box.max.y), maxZ = _mm_set1_ps(box.max.z);
+
+			size_t first = work.indices.size();
+			for (unsigned int i = 0; i < lights.count; i += 4)
+			{
+				// Distance squared from each sphere centre to the nearest point in the box
+				__m128 x = _mm_loadu_ps(&lights.x[i]);
+				__m128 y = _mm_loadu_ps(&lights.y[i]);
+				__m128 z = _mm_loadu_ps(&lights.z[i]);
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+				__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+				__m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+				int touching = _mm_movemask_ps(_mm_cmple_ps(distanceSq, _mm_loadu_ps(&lights.radiusSq[i])));
+				for (unsigned int bit = 0; touching; ++bit, touching >>= 1)
+				{
+					if (touching & 1)  work.indices.push_back(lights.index[i + bit]);
+				}
+			}
+
+			// Offset is within this slice's list for now, fixed up when the slices are joined
+			mClusters[clusterIndex].offset = static_cast<uint32_t>(first);
+			mClusters[clusterIndex].count  = static_cast<uint32_t>(work.indices.size() - first);
+		}
+	}
+}
+
+
+// Add the lights from one set that touch a box to another set
+void LightClusters::FilterLights(const LightSet& lights, const AABB& box, LightSet& result)
+{
+	result.Clear();
+
+	const __m128 zero = _mm_setzero_ps();
+	__m128 minX = _mm_set1_ps(box.min.x), minY = _mm_set1_ps(box.min.y), minZ = _mm_set1_ps(box.min.z);
+	__m128 maxX = _mm_set1_ps(box.max.x), maxY = _mm_set1_ps(box.max.y), maxZ = _mm_set1_ps(box.max.z);
+	for (unsigned int i = 0; i < lights.count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&lights.x[i]);
+		__m128 y = _mm_loadu_ps(&lights.y[i]);
+		__m128 z = _mm_loadu_ps(&lights.z[i]);
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)), zero);
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)), zero);
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)), zero);
+		__m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		int touching = _mm_movemask_ps(_mm_cmple_ps(distanceSq, _mm_loadu_ps(&lights.radiusSq[i])));
+		for (unsigned int bit = 0; touching; ++bit, touching >>= 1)
+		{
+			if (touching & 1)  result.Add(lights.x[i + bit], lights.y[i + bit], lights.z[i + bit], lights.radiusSq[i + bit], lights.index[i + bit]);
+		}
+	}
+	result.Pad();
+}
+
+
+void LightClusters::LightSet::Clear()
+{
+	x.clear();  y.clear();  z.clear();  radiusSq.clear();  index.clear();
+	count = 0;
+}
+
+void LightClusters::LightSet::Add(float lightX, float lightY, float lightZ, float lightRadiusSq, uint32_t lightIndex)
+{
+	x.push_back(lightX);  y.push_back(lightY);  z.push_back(lightZ);  radiusSq.push_back(lightRadiusSq);  index.push_back(lightIndex);
+	++count;
+}
+
+// Pad to a multiple of four lights. The padding has a negative radius squared so it never touches anything
+void LightClusters::LightSet::Pad()
+{
+	while (x.size() % 4 != 0)
+	{
+		x.push_back(0);  y.push_back(0);  z.push_back(0);  radiusSq.push_back(-1.0f);  index.push_back(0);
+	}
+}
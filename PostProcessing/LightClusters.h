@@ -0,0 +1,144 @@
+//--------------------------------------------------------------------------------------
+// Clustered lighting - point lights sorted into a grid over the camera's view
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The camera's view frustum is split into a grid of clusters: tiles across the screen, and slices in depth that get
+// thicker further from the camera. Each frame every point light is tested against the clusters (the light is a sphere,
+// each cluster is given a box in view space) and each cluster gets a list of the lights that touch it. The lighting
+// pixel shader finds its cluster from its screen position and depth, and only loops over that cluster's lights. So
+// there can be thousands of lights in the scene but each pixel only pays for the few lights near it.
+//
+// - Light positions are transformed to view space first, stored as separate x/y/z/radius arrays so four lights can be
+//   tested against a box at once with SSE
+// - Each depth slice is handled by a worker thread. Lights are first tested against the whole slice, then against each
+//   row of tiles in the slice, then against each cluster in the row, so most lights are rejected early
+// - The results are a list of light indices and an (offset, count) pair for each cluster, both sent to the GPU as
+//   structured buffers
+
+#ifndef _LIGHT_CLUSTERS_H_INCLUDED_
+#define _LIGHT_CLUSTERS_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "BoundingVolumes.h"
+
+#include <vector>
+#include <stdint.h>
+
+
+// A point light as the lighting shader sees it. Must match the PointLight structure in Common.hlsli
+struct PointLight
+{
+	CVector3 position;  // World space
+	float    radius;    // The light has no effect at all beyond this distance
+	CVector3 colour;    // Colour multiplied by strength
+	int32_t  shadowMap; // Index of the light's cube shadow map (see ShadowMaps.h), -1 if it doesn't cast shadows
+};
+
+
+class LightClusters
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Size of the cluster grid. The lighting shader gets these values from the per-frame constants
+	static const unsigned int NumTilesX   = 16;
+	static const unsigned int NumTilesY   = 8;
+	static const unsigned int NumSlices   = 24;
+	static const unsigned int NumClusters = NumTilesX * NumTilesY * NumSlices;
+
+	// Lights for one cluster are LightIndices()[offset] to LightIndices()[offset + count - 1]
+	// Must match the uint2 used for gLightClusters in Common.hlsli
+	struct Cluster
+	{
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	LightClusters();
+
+	// Sort the given lights into the clusters for a camera. The camera is given by its view matrix and the settings
+	// used for its projection matrix (horizontal field of view in radians)
+	void Build(const CMatrix4x4& viewMatrix, float fovX, float aspectRatio, float nearClip, float farClip,
+	           const PointLight* lights, unsigned int numLights);
+
+
+	// Results of the last Build: the light list for each cluster, and the light indices the lists refer to
+	const Cluster*  Clusters()         { return mClusters.data(); }
+	const uint32_t* LightIndices()     { return mLightIndices.data(); }
+	unsigned int    NumLightIndices()  { return static_cast<unsigned int>(mLightIndices.size()); }
+
+	// The depth slice of a point is floor(log2(viewDepth) * SliceScale() + SliceBias()), clamped to the grid
+	float SliceScale()  { return mSliceScale; }
+	float SliceBias()   { return mSliceBias;  }
+
+	// Index of the cluster containing a point, given its screen position (0 to 1 across the viewport, y down) and its
+	// depth in view space. This is the same calculation as the lighting shader
+	unsigned int ClusterIndex(float screenX, float screenY, float viewDepth);
+
+	// Statistics for the last Build
+	unsigned int MaxLightsPerCluster()  { return mMaxLightsPerCluster; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// A set of lights in view space, each component in a separate array so four lights can be tested at once. The
+	// arrays are padded to a multiple of four with lights that never touch anything
+	struct LightSet
+	{
+		std::vector<float>    x, y, z, radiusSq;
+		std::vector<uint32_t> index; // Index of the light in the array passed to Build
+
+		unsigned int count = 0; // Not including padding
+
+		void Clear();
+		void Add(float lightX, float lightY, float lightZ, float lightRadiusSq, uint32_t lightIndex);
+		void Pad();
+	};
+
+	// Working data for one depth slice, each slice is binned by a single thread
+	struct SliceWork
+	{
+		LightSet              sliceLights; // Lights touching the slice
+		LightSet              rowLights;   // Lights touching the current row of tiles in the slice
+		std::vector<uint32_t> indices;     // Light lists for the clusters in this slice, one after another
+	};
+
+	// Calculate the view space box of every cluster, only needed when the camera's projection changes
+	void CalculateClusterBounds(float fovX, float aspectRatio, float nearClip, float farClip);
+
+	// Find the lights touching each cluster in a depth slice
+	void BinSlice(unsigned int slice);
+
+	// Add the lights from one set that touch a box to another set
+	static void FilterLights(const LightSet& lights, const AABB& box, LightSet& result);
+
+
+	// Projection used for the current cluster boxes
+	float mFOVx        = 0;
+	float mAspectRatio = 0;
+	float mNearClip    = 0;
+	float mFarClip     = 0;
+
+	float mSliceScale = 0;
+	float mSliceBias  = 0;
+
+	// View space boxes for each cluster, for each row of tiles in each slice and for each whole slice
+	std::vector<AABB> mClusterBounds;
+	std::vector<AABB> mRowBounds;
+	std::vector<AABB> mSliceBounds;
+
+	LightSet               mViewLights; // All lights in view space
+	std::vector<SliceWork> mSliceWork;
+
+	std::vector<Cluster>  mClusters;
+	std::vector<uint32_t> mLightIndices;
+	unsigned int          mMaxLightsPerCluster = 0;
+};
+
+
+#endif //_LIGHT_CLUSTERS_H_INCLUDED_
@@ -0,0 +1,176 @@
+//--------------------------------------------------------------------------------------
+// Bounding volumes (axis-aligned boxes, spheres) and view frustum tests
+//--------------------------------------------------------------------------------------
+
+#include "BoundingVolumes.h"
+
+#include <xmmintrin.h> // SSE intrinsics
+
+
+/*-----------------------------------------------------------------------------------------
+    Member functions
+-----------------------------------------------------------------------------------------*/
+
+// Grow the box to include a point
+void AABB::Add(const CVector3& point)
+{
+    if (point.x < min.x)  min.x = point.x;
+    if (point.y < min.y)  min.y = point.y;
+    if (point.z < min.z)  min.z = point.z;
+    if (point.x > max.x)  max.x = point.x;
+    if (point.y > max.y)  max.y = point.y;
+    if (point.z > max.z)  max.z = point.z;
+}
+
+// Grow the box to include another box
+void AABB::Add(const AABB& box)
+{
+    if (box.IsEmpty())  return;
+    Add(box.min);
+    Add(box.max);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Box that encloses the given box after it is transformed by a matrix. Will be larger than the box
+// is if there is any rotation, but is much quicker than transforming all eight corners
+AABB TransformAABB(const AABB& box, const CMatrix4x4& m)
+{
+    if (box.IsEmpty())  return box;
+
+    // Transform the centre as a point. The new extent on each world axis is the sum of the box's
+    // extents projected onto that axis, i.e. the extents multiplied by the absolute matrix values
+    CVector3 centre  = box.Centre();
+    CVector3 extents = box.Extents();
+
+    CVector3 newCentre = { centre.x * m.e00 + centre.y * m.e10 + centre.z * m.e20 + m.e30,
+                           centre.x * m.e01 + centre.y * m.e11 + centre.z * m.e21 + m.e31,
+                           centre.x * m.e02 + centre.y * m.e12 + centre.z * m.e22 + m.e32 };
+
+    CVector3 newExtents = { extents.x * std::abs(m.e00) + extents.y * std::abs(m.e10) + extents.z * std::abs(m.e20),
+                            extents.x * std::abs(m.e01) + extents.y * std::abs(m.e11) + extents.z * std::abs(m.e21),
+                            extents.x * std::abs(m.e02) + extents.y * std::abs(m.e12) + extents.z * std::abs(m.e22) };
+
+    AABB result;
+    result.min = newCentre - newExtents;
+    result.max = newCentre + newExtents;
+    return result;
+}
+
+
+// Sphere centred on the middle of the given points' bounding box, just large enough to enclose them all
+// Not the smallest possible sphere, but close for most meshes and cheap to calculate
+BoundingSphere BoundingSphereFromPoints(const CVector3* points, unsigned int numPoints, unsigned int stride, const AABB& box)
+{
+    BoundingSphere sphere;
+    if (box.IsEmpty())  return sphere;
+
+    sphere.centre = box.Centre();
+    float maxDistanceSquared = 0;
+    const unsigned char* point = reinterpret_cast<const unsigned char*>(points);
+    for (unsigned int i = 0; i < numPoints; ++i, point += stride)
+    {
+        CVector3 offset = *reinterpret_cast<const CVector3*>(point) - sphere.centre;
+        float distanceSquared = Dot(offset, offset);
+        if (distanceSquared > maxDistanceSquared)  maxDistanceSquared = distanceSquared;
+    }
+    sphere.radius = std::sqrt(maxDistanceSquared);
+    return sphere;
+}
+
+
+// Extract the view frustum planes from a camera's view-projection matrix (DirectX clip space, z from 0 to 1)
+Frustum FrustumFromViewProjection(const CMatrix4x4& viewProj)
+{
+    // Points are row vectors, so each clip space component is a dot product with a column of the matrix.
+    // A point is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w, giving each plane as a sum or
+    // difference of columns
+    const CMatrix4x4& m = viewProj;
+    float planes[6][4] =
+    {
+        { m.e03 + m.e00, m.e13 + m.e10, m.e23 + m.e20, m.e33 + m.e30 }, // Left
+        { m.e03 - m.e00, m.e13 - m.e10, m.e23 - m.e20, m.e33 - m.e30 }, // Right
+        { m.e03 + m.e01, m.e13 + m.e11, m.e23 + m.e21, m.e33 + m.e31 }, // Bottom
+        { m.e03 - m.e01, m.e13 - m.e11, m.e23 - m.e21, m.e33 - m.e31 }, // Top
+        { m.e02,         m.e12,         m.e22,         m.e32         }, // Near
+        { m.e03 - m.e02, m.e13 - m.e12, m.e23 - m.e22, m.e33 - m.e32 }, // Far
+    };
+
+    // Normalise the planes so distances are in world units (not needed for the tests but easier to debug)
+    Frustum frustum;
+    for (int i = 0; i < 6; ++i)
+    {
+        float invLength = InvSqrt(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+        frustum.normalX[i] = planes[i][0] * invLength;
+        frustum.normalY[i] = planes[i][1] * invLength;
+        frustum.normalZ[i] = planes[i][2] * invLength;
+        frustum.d[i]       = planes[i][3] * invLength;
+    }
+    return frustum;
+}
+
+
+// Test a single box against the frustum. Returns false if the box is entirely outside any plane
+bool FrustumTestAABB(const Frustum& frustum, const AABB& box)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        // The corner of the box furthest along the plane normal is the last to go outside
+        float x = frustum.normalX[i] >= 0 ? box.max.x : box.min.x;
+        float y = frustum.normalY[i] >= 0 ? box.max.y : box.min.y;
+        float z = frustum.normalZ[i] >= 0 ? box.max.z : box.min.z;
+        if (frustum.normalX[i] * x + frustum.normalY[i] * y + frustum.normalZ[i] * z + frustum.d[i] < 0)  return false;
+    }
+    return true;
+}
+
+
+// Test four boxes against the frustum at once using SSE. The boxes are given as separate arrays of their min/max
+// components (4 floats each, 16-byte aligned). Returns a 4-bit mask with bit i set if box i is at least partly inside
+// the frustum. If insideMask is given it is set to a mask of boxes that are entirely inside (need no further tests)
+unsigned int FrustumTest4AABBs(const Frustum& frustum, const float* minX, const float* minY, const float* minZ,
+                                                       const float* maxX, const float* maxY, const float* maxZ,
+                                                       unsigned int* insideMask /*= nullptr*/)
+{
+    __m128 boxMinX = _mm_load_ps(minX);
+    __m128 boxMinY = _mm_load_ps(minY);
+    __m128 boxMinZ = _mm_load_ps(minZ);
+    __m128 boxMaxX = _mm_load_ps(maxX);
+    __m128 boxMaxY = _mm_load_ps(maxY);
+    __m128 boxMaxZ = _mm_load_ps(maxZ);
+
+    __m128 outside    = _mm_setzero_ps(); // Lanes set to all 1s once a box is found outside a plane
+    __m128 straddling = _mm_setzero_ps(); // Lanes set to all 1s once a box is found crossing a plane
+    __m128 zero       = _mm_setzero_ps();
+    for (int i = 0; i < 6; ++i)
+    {
+        // The plane is the same for all four boxes, so the choice of nearest and furthest corner along the plane
+        // normal is a scalar decision, only the distance calculations need to be done per box
+        __m128 nx = _mm_set1_ps(frustum.normalX[i]);
+        __m128 ny = _mm_set1_ps(frustum.normalY[i]);
+        __m128 nz = _mm_set1_ps(frustum.normalZ[i]);
+        __m128 d  = _mm_set1_ps(frustum.d[i]);
+
+        __m128 farX  = frustum.normalX[i] >= 0 ? boxMaxX : boxMinX;
+        __m128 farY  = frustum.normalY[i] >= 0 ? boxMaxY : boxMinY;
+        __m128 farZ  = frustum.normalZ[i] >= 0 ? boxMaxZ : boxMinZ;
+        __m128 nearX = frustum.normalX[i] >= 0 ? boxMinX : boxMaxX;
+        __m128 nearY = frustum.normalY[i] >= 0 ? boxMinY : boxMaxY;
+        __m128 nearZ = frustum.normalZ[i] >= 0 ? boxMinZ : boxMaxZ;
+
+        __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, farX), _mm_mul_ps(ny, farY)),
+                                        _mm_add_ps(_mm_mul_ps(nz, farZ), d));
+        __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nearX), _mm_mul_ps(ny, nearY)),
+                                         _mm_add_ps(_mm_mul_ps(nz, nearZ), d));
+
+        outside    = _mm_or_ps(outside,    _mm_cmplt_ps(farDistance,  zero));
+        straddling = _mm_or_ps(straddling, _mm_cmplt_ps(nearDistance, zero));
+    }
+
+    unsigned int visibleMask = ~_mm_movemask_ps(outside) & 0xf;
+    if (insideMask)  *insideMask = ~_mm_movemask_ps(straddling) & 0xf;
+    return visibleMask;
+}
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Bounding volumes (axis-aligned boxes, spheres) and view frustum tests
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _BOUNDING_VOLUMES_H_DEFINED_
+#define _BOUNDING_VOLUMES_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+
+// Axis-aligned bounding box. A default constructed box is empty (min > max) so any point added to it becomes the box
+struct AABB
+{
+    CVector3 min = {  3.4e38f,  3.4e38f,  3.4e38f };
+    CVector3 max = { -3.4e38f, -3.4e38f, -3.4e38f };
+
+    bool IsEmpty() const  { return min.x > max.x; }
+
+    CVector3 Centre()  const  { return (min + max) * 0.5f; }
+    CVector3 Extents() const  { return (max - min) * 0.5f; } // Half size on each axis
+
+    // Grow the box to include a point or another box
+    void Add(const CVector3& point);
+    void Add(const AABB& box);
+};
+
+
+// Bounding sphere
+struct BoundingSphere
+{
+    CVector3 centre = { 0, 0, 0 };
+    float    radius = 0;
+};
+
+
+// The six planes of a camera's view frustum, each pointing inwards (a point p is inside a plane if
+// normal.p + d >= 0). Stored as separate arrays for each component so four boxes can be tested at once with SSE
+struct Frustum
+{
+    float normalX[6];
+    float normalY[6];
+    float normalZ[6];
+    float d[6];
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Box that encloses the given box after it is transformed by a matrix. Will be larger than the box
+// is if there is any rotation, but is much quicker than transforming all eight corners
+AABB TransformAABB(const AABB& box, const CMatrix4x4& m);
+
+// Sphere centred on the middle of the given points' bounding box, just large enough to enclose them all
+BoundingSphere BoundingSphereFromPoints(const CVector3* points, unsigned int numPoints, unsigned int stride, const AABB& box);
+
+// Extract the view frustum planes from a camera's view-projection matrix (DirectX clip space, z from 0 to 1)
+Frustum FrustumFromViewProjection(const CMatrix4x4& viewProj);
+
+// Test a single box against the frustum. Returns false if the box is entirely outside any plane
+bool FrustumTestAABB(const Frustum& frustum, const AABB& box);
+
+
+// Test four boxes against the frustum at once using SSE. The boxes are given as separate arrays of their min/max
+// components (4 floats each, 16-byte aligned). Returns a 4-bit mask with bit i set if box i is at least partly inside
+// the frustum. If insideMask is given it is set to a mask of boxes that are entirely inside (need no further tests)
+unsigned int FrustumTest4AABBs(const Frustum& frustum, const float* minX, const float* minY, const float* minZ,
+                                                       const float* maxX, const float* maxY, const float* maxZ,
+                                                       unsigned int* insideMask = nullptr);
+
+
+#endif // _BOUNDING_VOLUMES_H_DEFINED_
@@ -5,6 +5,7 @@
 #include "CMatrix4x4.h"
 
 #include <algorithm>
+#include <xmmintrin.h> // SSE intrinsics
 
 /*-----------------------------------------------------------------------------------------
     Member functions
@@ -110,6 +111,39 @@ CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2)
 }
 
 
+// SSE matrix-matrix multiplication, mOut = m1 * m2. Same result as operator* but each row of the result is
+// built with four vector multiply-adds. mOut may be the same matrix as m1 or m2
+void MatrixMultiply(CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2)
+{
+    // Each row of the result is a combination of the rows of m2, weighted by the elements in the same row of m1
+    // Matrices are not guaranteed to be 16-byte aligned so use unaligned loads / stores
+    const float* a = &m1.e00;
+    const float* b = &m2.e00;
+    __m128 b0 = _mm_loadu_ps(b);
+    __m128 b1 = _mm_loadu_ps(b + 4);
+    __m128 b2 = _mm_loadu_ps(b + 8);
+    __m128 b3 = _mm_loadu_ps(b + 12);
+
+    __m128 rows[4];
+    for (int row = 0; row < 4; ++row)
+    {
+        const float* aRow = a + row * 4;
+        __m128 r =            _mm_mul_ps(_mm_set1_ps(aRow[0]), b0);
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(aRow[1]), b1));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(aRow[2]), b2));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(aRow[3]), b3));
+        rows[row] = r;
+    }
+
+    // Only write the result once all rows are calculated so the output can alias an input
+    float* out = &mOut.e00;
+    _mm_storeu_ps(out,      rows[0]);
+    _mm_storeu_ps(out + 4,  rows[1]);
+    _mm_storeu_ps(out + 8,  rows[2]);
+    _mm_storeu_ps(out + 12, rows[3]);
+}
+
+
 
 /*-----------------------------------------------------------------------------------------
     Non-member functions
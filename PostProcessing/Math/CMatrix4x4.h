@@ -69,6 +69,10 @@ public:
 // Matrix-matrix multiplication
 CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2);
 
+// SSE matrix-matrix multiplication, mOut = m1 * m2. Same result as operator* but each row of the result is
+// built with four vector multiply-adds. mOut may be the same matrix as m1 or m2
+void MatrixMultiply(CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2);
+
 
 /*-----------------------------------------------------------------------------------------
   Non-member functions
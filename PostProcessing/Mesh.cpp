@@ -8,81 +8,48 @@
 #include "Mesh.h"
 #include "Shader.h" // Needed for helper function CreateSignatureForVertexLayout
 #include "GraphicsHelpers.h" // Helper functions to unclutter the code here
+#include "ThreadPool.h"      // Vertex data is copied in parallel
+#include "BonePalette.h"     // Skinning matrices are sent to the GPU via the bone palette
+#include "OcclusionBuffer.h" // Meshes can optionally be occluders
+#include "MeshSimplifier.h"  // Levels of detail are built when loading
+#include "MeshOptimiser.h"   // Triangle and vertex order are optimised when loading
+#include "UploadRing.h"      // Vertex and index data is uploaded through staging buffers
+#include "MeshImport.h"      // Mesh files are read into sub-meshes and nodes, by the .x parser or assimp
 #include "CVector2.h" 
 #include "CVector3.h" 
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-#include <assimp/DefaultLogger.hpp>
-
 #include <memory>
+#include <cstdio>
+#include <algorithm>
 
 
-// Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
-// Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
-// Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
-{
-	Assimp::Importer importer;
-
-	// Flags for processing the mesh. Assimp provides a huge amount of control - right click any of these
-	// and "Peek Definition" to see documention above each constant
-	unsigned int assimpFlags = aiProcess_MakeLeftHanded |
-		aiProcess_GenSmoothNormals |
-		aiProcess_FixInfacingNormals |
-		aiProcess_GenUVCoords |
-		aiProcess_TransformUVCoords |
-		aiProcess_FlipUVs |
-		aiProcess_FlipWindingOrder |
-		aiProcess_Triangulate |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_ImproveCacheLocality |
-		aiProcess_SortByPType |
-		aiProcess_FindInvalidData |
-		aiProcess_OptimizeMeshes |
-		aiProcess_FindInstances |
-		aiProcess_FindDegenerates |
-		aiProcess_RemoveRedundantMaterials |
-		aiProcess_Debone |
-		aiProcess_SplitByBoneCount |
-		aiProcess_LimitBoneWeights |
-		aiProcess_RemoveComponent;
-
-	// Flags to specify what mesh data to ignore
-	int removeComponents = aiComponent_LIGHTS | aiComponent_CAMERAS | aiComponent_TEXTURES | aiComponent_COLORS |
-		aiComponent_ANIMATIONS | aiComponent_MATERIALS;
-
-	// Add / remove tangents as required by user
-	if (requireTangents)
-	{
-		assimpFlags |= aiProcess_CalcTangentSpace;
-	}
-	else
-	{
-		removeComponents |= aiComponent_TANGENTS_AND_BITANGENTS;
-	}
+// Levels of detail after the first have about these fractions of the original triangles
+const float LOD_TRIANGLE_FRACTIONS[Mesh::MaxLods - 1] = { 0.5f, 0.25f, 0.1f };
+
+// Sub-meshes with fewer triangles than this are not simplified, they are cheap enough already
+const unsigned int LOD_MIN_TRIANGLES = 256;
 
-	// Other miscellaneous settings
-	importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f); // Smoothing angle for normals
-	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);  // Remove points and lines (keep triangles only)
-	importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);                 // Remove degenerate triangles
-	importer.SetPropertyBool(AI_CONFIG_PP_DB_ALL_OR_NONE, true);            // Default to removing bones/weights from meshes that don't need skinning
+// A level of detail is only kept if it has at most this fraction of the triangles of the level before, and the error
+// of the simplification (distance from the original surface) is at most this fraction of the sub-mesh's bounding radius
+const float LOD_MIN_REDUCTION = 0.75f;
+const float LOD_MAX_ERROR     = 0.05f;
 
-	// Set maximum bones that can affect one vertex, and also maximum bones affecting a single mesh
-	unsigned int maxBonesPerVertex = 4; // The shaders support 4 bones per verted (null bones are added if necessary)
-	unsigned int maxBonesPerMesh = 256; // Bone indexes are stored in a byte, so no more than 256 
-	importer.SetPropertyInteger(AI_CONFIG_PP_LBW_MAX_WEIGHTS, maxBonesPerVertex);
-	importer.SetPropertyInteger(AI_CONFIG_PP_SBBC_MAX_BONES, maxBonesPerMesh);
+// Sub-meshes with at least this many triangles are split into meshlets (see Meshlets.h). Smaller sub-meshes are drawn
+// whole, culling parts of them would save less than it costs
+const unsigned int MESHLET_MIN_TRIANGLES = 1024;
 
-	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removeComponents);
 
-	// Import mesh with assimp given above requirements - log output
-	Assimp::DefaultLogger::create("", Assimp::DefaultLogger::VERBOSE);
-	const aiScene* scene = importer.ReadFile(fileName, assimpFlags);
-	Assimp::DefaultLogger::kill();
-	if (scene == nullptr)  throw std::runtime_error("Error loading mesh (" + fileName + "). " + importer.GetErrorString());
-	if (scene->mNumMeshes == 0)  throw std::runtime_error("No usable geometry in mesh: " + fileName);
+// Pass the name of the mesh file to load. .x files are read by a dedicated parser, other file types by assimp
+// (http://www.assimp.org/) - see MeshImport.h
+// Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+// Optionally keep a CPU-side copy of the geometry so models using the mesh can be occluders (see OcclusionBuffer)
+// Will throw a std::runtime_error exception on failure (since constructors can't return errors).
+Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/, bool keepOccluderGeometry /*= false*/)
+{
+	// Read the file into sub-meshes and nodes (see MeshImport.h). .x files use the dedicated parser, anything else assimp
+	ImportedMesh importedMesh;
+	ImportMesh(fileName, requireTangents, importedMesh);
+	unsigned int numSubMeshes = static_cast<unsigned int>(importedMesh.subMeshes.size());
 
 
 	//-----------------------------------
@@ -90,9 +57,36 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 	//*********************************************************************//
 	// Read node hierachy - each node has a matrix and contains sub-meshes //
 
-	// Uses recursive helper functions to build node hierarchy    
-	mNodes.resize(CountNodes(scene->mRootNode));
-	ReadNodes(scene->mRootNode, 0, 0);
+	// The imported nodes are already in depth-first order
+	unsigned int numNodes = static_cast<unsigned int>(importedMesh.nodes.size());
+	mNodeNames          .resize(numNodes);
+	mNodeParents        .resize(numNodes);
+	mNodeSubtreeEnds    .resize(numNodes);
+	mNodeDefaultMatrices.resize(numNodes);
+	mNodeOffsetMatrices .resize(numNodes, MatrixIdentity()); // Bones will replace this with their offset matrix when geometry is read
+	mNodeBounds         .resize(numNodes);                   // Bounds start empty and grow as geometry is read
+	mNodeSpheres        .resize(numNodes);
+	mNodeSubMeshStarts  .resize(numNodes + 1);
+	mNodeLookup.reserve(numNodes);
+	mSubMeshNodes.resize(numSubMeshes, 0);
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		const ImportedNode& importedNode = importedMesh.nodes[node];
+		mNodeNames          [node] = importedNode.name;
+		mNodeParents        [node] = importedNode.parent;
+		mNodeSubtreeEnds    [node] = importedNode.subtreeEnd;
+		mNodeDefaultMatrices[node] = importedNode.matrix;
+		mNodeLookup.emplace(mNodeNames[node], node); // If names are duplicated, bones will refer to the first node with the name
+
+		// Each node's sub-meshes follow on from the previous node's
+		mNodeSubMeshStarts[node] = static_cast<unsigned int>(mNodeSubMeshes.size());
+		for (unsigned int subMesh : importedNode.subMeshes)
+		{
+			mNodeSubMeshes.push_back(subMesh);
+			mSubMeshNodes[subMesh] = node;
+		}
+	}
+	mNodeSubMeshStarts[numNodes] = static_cast<unsigned int>(mNodeSubMeshes.size());
 
 
 
@@ -100,32 +94,36 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 	// Read geometry - multiple parts supported //
 
 	mHasBones = false;
-	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
-		if (scene->mMeshes[m]->HasBones())  mHasBones = true;
+	for (auto& importedSubMesh : importedMesh.subMeshes)
+		if (!importedSubMesh.bones.empty())  mHasBones = true;
+
+	if (keepOccluderGeometry && mHasBones)  throw std::runtime_error("Skinned meshes can't be occluders: " + fileName);
+
+	// Occluder geometry is gathered per sub-mesh then merged per node once all sub-meshes are read
+	std::vector<std::vector<CVector3>> occluderPositions(keepOccluderGeometry ? numSubMeshes : 0);
+	std::vector<std::vector<uint32_t>> occluderIndices  (keepOccluderGeometry ? numSubMeshes : 0);
 
 
 	// A mesh is made of sub-meshes, each one can have a different material (texture)
 	// Import each sub-mesh in the file to seperate index / vertex buffer (could share buffers between sub-meshes but that would make things more complex)
-	mSubMeshes.resize(scene->mNumMeshes);
-	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+	mSubMeshes.resize(numSubMeshes);
+	for (unsigned int m = 0; m < numSubMeshes; ++m)
 	{
-		aiMesh* assimpMesh = scene->mMeshes[m];
-		std::string subMeshName = assimpMesh->mName.C_Str();
+		const ImportedSubMesh& importedSubMesh = importedMesh.subMeshes[m];
+		const CVector3* positions = importedSubMesh.positions.data();
 		auto& subMesh = mSubMeshes[m]; // Short name for the submesh we're currently preparing - makes code below more readable
 
 
 		//-----------------------------------
 
-		// Check for presence of position and normal data. Tangents and UVs are optional.
+		// Every sub-mesh has positions and normals. Tangents and UVs are optional.
 		std::vector<D3D11_INPUT_ELEMENT_DESC> vertexElements;
 		unsigned int offset = 0;
 
-		if (!assimpMesh->HasPositions())  throw std::runtime_error("No position data for sub-mesh " + subMeshName + " in " + fileName);
 		unsigned int positionOffset = offset;
 		vertexElements.push_back({ "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, positionOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
 		offset += 12;
 
-		if (!assimpMesh->HasNormals())  throw std::runtime_error("No normal data for sub-mesh " + subMeshName + " in " + fileName);
 		unsigned int normalOffset = offset;
 		vertexElements.push_back({ "normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, normalOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
 		offset += 12;
@@ -133,15 +131,14 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 		unsigned int tangentOffset = offset;
 		if (requireTangents)
 		{
-			if (!assimpMesh->HasTangentsAndBitangents())  throw std::runtime_error("No tangent data for sub-mesh " + subMeshName + " in " + fileName);
 			vertexElements.push_back({ "tangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, tangentOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
 			offset += 12;
 		}
 
+		const bool hasUVs = !importedSubMesh.uvs.empty();
 		unsigned int uvOffset = offset;
-		if (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0))
+		if (hasUVs)
 		{
-			if (assimpMesh->mNumUVComponents[0] != 2)  throw std::runtime_error("Unsupported texture coordinates in " + subMeshName + " in " + fileName);
 			vertexElements.push_back({ "uv", 0, DXGI_FORMAT_R32G32_FLOAT, 0, uvOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 });
 			offset += 8;
 		}
@@ -170,279 +167,557 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 
 		//-----------------------------------
 
-		// Create CPU-side buffers to hold current mesh data - exact content is flexible so can't use a structure for a vertex - so just a block of bytes
-		// Note: for large arrays a unique_ptr is better than a vector because vectors default-initialise all the values which is a waste of time.
-		subMesh.numVertices = assimpMesh->mNumVertices;
-		subMesh.numIndices = assimpMesh->mNumFaces * 3;
-		auto vertices = std::make_unique<unsigned char[]>(subMesh.numVertices * subMesh.vertexSize);
-		auto indices  = std::make_unique<unsigned char[]>(subMesh.numIndices * 4); // Using 32 bit indexes (4 bytes) for each indeex
+		// The mesh data is built in place in the sub-mesh's CPU-side copy, which is kept once loaded (see below) - exact
+		// content is flexible so can't use a structure for a vertex - so just a block of bytes
+		subMesh.numVertices = static_cast<unsigned int>(importedSubMesh.positions.size());
+		subMesh.numIndices = static_cast<unsigned int>(importedSubMesh.indices.size());
+		const bool makeLods = (subMesh.numIndices >= LOD_MIN_TRIANGLES * 3);
+		subMesh.vertexData.resize(subMesh.numVertices * subMesh.vertexSize);
+		subMesh.indexData .resize(subMesh.numIndices * (makeLods ? MaxLods : 1)); // With space for the levels of detail
 
 
 		//-----------------------------------
 
-		// Copy mesh data from assimp to our CPU-side vertex buffer
+		// Copy mesh data from the imported sub-mesh to our CPU-side vertex buffer
 
-		CVector3* assimpPosition = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
-		unsigned char* position = vertices.get() + positionOffset;
-		unsigned char* positionEnd = position + subMesh.numVertices * subMesh.vertexSize;
-		while (position != positionEnd)
+		// Bone influences are stored per-bone when imported, but per-vertex in our vertex buffer. Gather them per vertex first
+		// in a single pass over all the bone weights. Each vertex holds up to 4 influences, stored in the exact layout used
+		// in the vertex (4 byte-sized bone indexes followed by 4 float weights, 20 bytes)
+		// The bone indexes stored are local to this sub-mesh (the position of the bone in the sub-mesh's bone list), so
+		// rendering only needs to send the matrices for this sub-mesh's bones rather than for the whole hierarchy
+		struct VertexInfluences
 		{
-			*(CVector3*)position = *assimpPosition;
-			position += subMesh.vertexSize;
-			++assimpPosition;
-		}
-
-		CVector3* assimpNormal = reinterpret_cast<CVector3*>(assimpMesh->mNormals);
-		unsigned char* normal = vertices.get() + normalOffset;
-		unsigned char* normalEnd = normal + subMesh.numVertices * subMesh.vertexSize;
-		while (normal != normalEnd)
+			unsigned char bones[4];
+			float         weights[4];
+		};
+		std::vector<VertexInfluences> influences;
+		subMesh.firstBone = static_cast<unsigned int>(mBoneNodes.size());
+		if (mHasBones && !importedSubMesh.bones.empty())
 		{
-			*(CVector3*)normal = *assimpNormal;
-			normal += subMesh.vertexSize;
-			++assimpNormal;
-		}
+			subMesh.numBones = static_cast<unsigned int>(importedSubMesh.bones.size());
+			influences.resize(subMesh.numVertices, VertexInfluences{}); // All bones and weights start at 0
+			std::vector<unsigned char> numInfluences(subMesh.numVertices, 0);
 
-		if (requireTangents)
-		{
-			CVector3* assimpTangent = reinterpret_cast<CVector3*>(assimpMesh->mTangents);
-			unsigned char* tangent = vertices.get() + tangentOffset;
-			unsigned char* tangentEnd = tangent + subMesh.numVertices * subMesh.vertexSize;
-			while (tangent != tangentEnd)
+			for (unsigned int i = 0; i < subMesh.numBones; ++i)
 			{
-				*(CVector3*)tangent = *assimpTangent;
-				tangent += subMesh.vertexSize;
-				++assimpTangent;
+				// Get offset matrix for the bone (transform from skinned mesh root to bone root)
+				const ImportedBone& bone = importedSubMesh.bones[i];
+				auto node = mNodeLookup.find(bone.name);
+				if (node == mNodeLookup.end())  throw std::runtime_error("Bone with no matching node in " + fileName);
+				unsigned int nodeIndex = node->second;
+				mBoneNodes.push_back(nodeIndex);
+
+				mNodeOffsetMatrices[nodeIndex] = bone.offsetMatrix;
+
+				// Add this bone's influence to each vertex it affects. A vertex can only have up to 4 influences
+				// (bone weights are limited to 4 when imported, so extra influences are not expected)
+				// Each influenced vertex also grows the bone's bounds. A skinned vertex is a weighted average of its
+				// position moved by each of its bones, so it always lies within the union of its bones' moved bounds
+				for (size_t j = 0; j < bone.vertices.size(); ++j)
+				{
+					unsigned int vertexIndex = bone.vertices[j];
+					if (bone.weights[j] > 0)
+					{
+						mNodeBounds[nodeIndex].Add(positions[vertexIndex]);
+					}
+					unsigned char& slot = numInfluences[vertexIndex];
+					if (slot < 4)
+					{
+						influences[vertexIndex].bones[slot]   = static_cast<unsigned char>(i); // Local bone index
+						influences[vertexIndex].weights[slot] = bone.weights[j];
+						++slot;
+					}
+				}
 			}
 		}
-
-		if (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0))
+		else if (mHasBones)
 		{
-			aiVector3D* assimpUV = assimpMesh->mTextureCoords[0];
-			unsigned char* uv = vertices.get() + uvOffset;
-			unsigned char* uvEnd = uv + subMesh.numVertices * subMesh.vertexSize;
-			while (uv != uvEnd)
-			{
-				*(CVector2*)uv = CVector2(assimpUV->x, assimpUV->y);
-				uv += subMesh.vertexSize;
-				++assimpUV;
-			}
+			// In a mesh that uses skinning any sub-meshes that don't contain bones are given bones so the whole mesh can use one shader.
+			// They are fully influenced by the node that owns them, which becomes their only bone (local index 0)
+			subMesh.numBones = 1;
+			mBoneNodes.push_back(mSubMeshNodes[m]);
 		}
 
-
-		if (mHasBones)
+		// Fill all the vertex streams (position, normal, tangent, uv, bones) in a single interleaved pass. Vertices are
+		// independent of each other so split the work over all cores in ranges of vertices
+		const bool hasInfluences = !influences.empty();
+		const unsigned int vertexSize = subMesh.vertexSize;
+		unsigned char* vertexData = subMesh.vertexData.data();
+		ParallelFor(subMesh.numVertices, 4096, [&](unsigned int begin, unsigned int end)
 		{
-			if (assimpMesh->HasBones())
+			unsigned char* vertex = vertexData + begin * vertexSize;
+			for (unsigned int v = begin; v < end; ++v, vertex += vertexSize)
 			{
-				// Set all bones and weights to 0 to start with
-				unsigned char* bones = vertices.get() + bonesOffset;
-				unsigned char* bonesEnd = bones + subMesh.numVertices * subMesh.vertexSize;
-				while (bones != bonesEnd)
+				*reinterpret_cast<CVector3*>(vertex + positionOffset) = positions[v];
+				*reinterpret_cast<CVector3*>(vertex + normalOffset)   = importedSubMesh.normals[v];
+
+				if (requireTangents)
 				{
-					memset(bones, 0, 20);
-					bones += subMesh.vertexSize;
+					*reinterpret_cast<CVector3*>(vertex + tangentOffset) = importedSubMesh.tangents[v];
 				}
 
-				for (auto& node : mNodes)
+				if (hasUVs)
 				{
-					node.offsetMatrix = MatrixIdentity();
+					*reinterpret_cast<CVector2*>(vertex + uvOffset) = importedSubMesh.uvs[v];
 				}
 
-				// Go through each assimp bone
-				bones = vertices.get() + bonesOffset;
-				for (unsigned int i = 0; i < assimpMesh->mNumBones; ++i)
+				if (mHasBones)
 				{
-					// Get offset matrix for the bone (transform from skinned mesh root to bone root
-					aiBone* assimpBone = assimpMesh->mBones[i];
-					std::string boneName = assimpBone->mName.C_Str();
-					unsigned int nodeIndex;
-					for (nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+					unsigned char* bones = vertex + bonesOffset;
+					if (hasInfluences)
 					{
-						if (mNodes[nodeIndex].name == boneName)
-						{
-							mNodes[nodeIndex].offsetMatrix.SetValues(&assimpBone->mOffsetMatrix.a1);
-							mNodes[nodeIndex].offsetMatrix.Transpose(); // Assimp stores matrices differently to this app
-							break;
-						}
+						memcpy(bones, &influences[v], 20);
 					}
-					if (nodeIndex == mNodes.size())  throw std::runtime_error("Bone with no matching node in " + fileName);
-
-					// Go through each weight of the bone and update the vertex it influences
-					// Find the first 0 weight on that vertex and put the new influence / weight there.
-					// A vertex can only have up to 4 influences
-					for (unsigned int j = 0; j < assimpBone->mNumWeights; ++j)
+					else
 					{
-						unsigned int vertexIndex = assimpBone->mWeights[j].mVertexId;
-						unsigned char* bone = bones + vertexIndex * subMesh.vertexSize;
-						float* weight = (float*)(bone + 4);
-						float* lastWeight = weight + 3;
-						while (*weight != 0.0f && weight != lastWeight)
-						{
-							bone++; weight++;
-						}
-						if (*weight == 0.0f)
-						{
-							*bone = nodeIndex;
-							*weight = assimpBone->mWeights[j].mWeight;
-						}
+						memset(bones, 0, 20); // Bone index 0 - the node that owns the sub-mesh
+						*reinterpret_cast<float*>(bones + 4) = 1.0f;
 					}
 				}
 			}
-			else
+		});
+
+
+		// Bounding box and sphere for the sub-mesh
+		for (unsigned int v = 0; v < subMesh.numVertices; ++v)
+		{
+			subMesh.bounds.Add(positions[v]);
+		}
+		subMesh.sphere = BoundingSphereFromPoints(positions, subMesh.numVertices, sizeof(CVector3), subMesh.bounds);
+
+		// Rigid sub-meshes move with the node that owns them, as do sub-meshes without bones in a skinned mesh (their
+		// only bone is the owning node)
+		if (!hasInfluences)  mNodeBounds[mSubMeshNodes[m]].Add(subMesh.bounds);
+
+
+
+		//-----------------------------------
+
+		// Copy face data from the imported triangle list to our CPU-side index buffer
+		std::copy(importedSubMesh.indices.begin(), importedSubMesh.indices.end(), subMesh.indexData.begin());
+
+		if (keepOccluderGeometry)
+		{
+			occluderPositions[m].assign(positions, positions + subMesh.numVertices);
+			occluderIndices[m]  .assign(importedSubMesh.indices.begin(), importedSubMesh.indices.end());
+		}
+
+		// Optimise the triangle order for the vertex cache and then for overdraw (see MeshOptimiser.h). Some files already
+		// have a good order (e.g. from a modelling tool's own optimisation), keep that if the new order is no better. The
+		// overdraw pass reorders the clusters made by the vertex cache pass, so it is skipped for an imported order
+		uint32_t* lodIndices = subMesh.indexData.data();
+		IndexOrderStats importedOrderStats = AnalyseIndexOrder(lodIndices, subMesh.numIndices, subMesh.numVertices, subMesh.vertexSize);
+		std::vector<uint32_t> importedOrder(lodIndices, lodIndices + subMesh.numIndices);
+		OptimiseVertexCache(lodIndices, subMesh.numIndices, subMesh.numVertices);
+		if (AnalyseIndexOrder(lodIndices, subMesh.numIndices, subMesh.numVertices, 0).ACMR() > importedOrderStats.ACMR())
+		{
+			std::copy(importedOrder.begin(), importedOrder.end(), lodIndices);
+		}
+		else
+		{
+			OptimiseOverdraw(positions, subMesh.numVertices, lodIndices, subMesh.numIndices);
+		}
+
+		// Simplified levels of detail are stored after the full detail indices (see MeshSimplifier.h). Each level is
+		// simplified from the level before, which is quicker and keeps the levels consistent with each other. Simplifying
+		// stops at the first level that doesn't remove enough triangles or is too far from the original surface, the
+		// remaining levels repeat the last good one. The simplified triangles are reordered for the vertex cache too
+		unsigned int totalIndices = subMesh.numIndices;
+		subMesh.lodFirstIndex[0] = 0;
+		subMesh.lodNumIndices[0] = subMesh.numIndices;
+		unsigned int lod = 1;
+		if (makeLods)
+		{
+			for (; lod < MaxLods; ++lod)
+			{
+				unsigned int previousFirst = subMesh.lodFirstIndex[lod - 1];
+				unsigned int previousCount = subMesh.lodNumIndices[lod - 1];
+				unsigned int target = static_cast<unsigned int>(subMesh.numIndices / 3 * LOD_TRIANGLE_FRACTIONS[lod - 1]) * 3;
+				float error;
+				unsigned int count = SimplifyMesh(positions, subMesh.numVertices,
+				                                  lodIndices + previousFirst, previousCount, target, lodIndices + totalIndices, &error);
+				if (count == 0 || count > previousCount * LOD_MIN_REDUCTION || error > subMesh.sphere.radius * LOD_MAX_ERROR)  break;
+
+				OptimiseVertexCache(lodIndices + totalIndices, count, subMesh.numVertices);
+				subMesh.lodFirstIndex[lod] = totalIndices;
+				subMesh.lodNumIndices[lod] = count;
+				totalIndices += count;
+				if (lod >= mNumLods)  mNumLods = lod + 1;
+			}
+		}
+		for (; lod < MaxLods; ++lod)
+		{
+			subMesh.lodFirstIndex[lod] = subMesh.lodFirstIndex[lod - 1];
+			subMesh.lodNumIndices[lod] = subMesh.lodNumIndices[lod - 1];
+		}
+
+		// Split dense rigid sub-meshes into meshlets, each level of detail separately. This reorders the triangles of
+		// each level, so must come after all the levels are simplified, and replaces the overdraw order (culling meshlets
+		// saves more). The triangles within each meshlet are put back in vertex cache order. Repeated levels share the
+		// meshlets of the level they repeat. Skinned meshes move their vertices on the GPU so their meshlet bounds would
+		// be wrong
+		if (!mHasBones && subMesh.numIndices >= MESHLET_MIN_TRIANGLES * 3)
+		{
+			for (lod = 0; lod < MaxLods; ++lod)
 			{
-				// In a mesh that uses skinning any sub-meshes that don't contain bones are given bones so the whole mesh can use one shader
-				unsigned int subMeshNode = 0;
-				for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+				if (lod > 0 && subMesh.lodFirstIndex[lod] == subMesh.lodFirstIndex[lod - 1])
 				{
-					for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
-					{
-						if (subMeshIndex == m)
-							subMeshNode = nodeIndex;
-					}
+					subMesh.lodFirstMeshlet[lod] = subMesh.lodFirstMeshlet[lod - 1];
+					subMesh.lodNumMeshlets[lod]  = subMesh.lodNumMeshlets[lod - 1];
+					continue;
 				}
 
-				unsigned char* bones = vertices.get() + bonesOffset;
-				unsigned char* bonesEnd = bones + subMesh.numVertices * subMesh.vertexSize;
-				while (bones != bonesEnd)
+				unsigned int firstMeshlet = static_cast<unsigned int>(mMeshlets.size());
+				BuildMeshlets(positions, subMesh.numVertices,
+				              lodIndices + subMesh.lodFirstIndex[lod], subMesh.lodNumIndices[lod], mMeshlets);
+				for (unsigned int i = firstMeshlet; i < mMeshlets.size(); ++i)
 				{
-					memset(bones, 0, 20);
-					bones[0] = subMeshNode;
-					*(float*)(bones + 4) = 1.0f;
-					bones += subMesh.vertexSize;
+					mMeshlets[i].firstIndex += subMesh.lodFirstIndex[lod];
+					OptimiseVertexCache(lodIndices + mMeshlets[i].firstIndex, mMeshlets[i].numIndices, subMesh.numVertices);
 				}
-
+				subMesh.lodFirstMeshlet[lod] = firstMeshlet;
+				subMesh.lodNumMeshlets[lod]  = static_cast<unsigned int>(mMeshlets.size()) - firstMeshlet;
 			}
 		}
 
+		// Reorder the vertices into the order the triangles first use them, all levels of detail together (see
+		// MeshOptimiser.h). Vertices that no triangle uses are dropped. The positions for the position-only buffer are
+		// reordered to match
+		std::vector<uint32_t> vertexRemap(subMesh.numVertices);
+		unsigned int numUsedVertices = OptimiseVertexFetchRemap(vertexRemap.data(), lodIndices, totalIndices, subMesh.numVertices);
+		RemapIndices(lodIndices, totalIndices, vertexRemap.data());
+		std::vector<unsigned char> remappedVertices(numUsedVertices * subMesh.vertexSize);
+		RemapVertices(remappedVertices.data(), subMesh.vertexData.data(), subMesh.numVertices, subMesh.vertexSize, vertexRemap.data());
+		subMesh.vertexData.swap(remappedVertices);
+		std::vector<CVector3> remappedPositions;
+		if (!mHasBones)
+		{
+			remappedPositions.resize(numUsedVertices);
+			RemapVertices(remappedPositions.data(), positions, subMesh.numVertices, sizeof(CVector3), vertexRemap.data());
+		}
+		subMesh.numVertices = numUsedVertices;
+
+		// Keep the quality of the order before and after for the report
+		mImportedOrderStats .Add(importedOrderStats);
+		mOptimisedOrderStats.Add(AnalyseIndexOrder(lodIndices, subMesh.numIndices, subMesh.numVertices, subMesh.vertexSize));
 
 
 		//-----------------------------------
 
-		// Copy face data from assimp to our CPU-side index buffer
-		if (!assimpMesh->HasFaces())  throw std::runtime_error("No face data in " + subMeshName + " in " + fileName);
+		// The final vertices and indices are kept. The GPU buffers are uploaded from them through the upload ring, and
+		// they are used to create the buffers again if the mesh is evicted (see ResidencyManager.h). Space kept for levels
+		// of detail that weren't made is given back
+		subMesh.indexData.resize(totalIndices);
+		subMesh.indexData.shrink_to_fit();
+		subMesh.positionData = std::move(remappedPositions);
+
+		if (!CreateSubMeshBuffers(subMesh))  throw std::runtime_error("Failure creating vertex and index buffers for " + fileName);
+		mGpuBytes += SubMeshBufferBytes(subMesh);
 
-		DWORD* index = reinterpret_cast<DWORD*>(indices.get());
-		for (unsigned int face = 0; face < assimpMesh->mNumFaces; ++face)
+		// Input layout for the position-only vertex buffer, which skinned meshes don't have
+		if (!mHasBones)
 		{
-			*index++ = assimpMesh->mFaces[face].mIndices[0];
-			*index++ = assimpMesh->mFaces[face].mIndices[1];
-			*index++ = assimpMesh->mFaces[face].mIndices[2];
+			D3D11_INPUT_ELEMENT_DESC positionElement = { "position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 };
+			auto positionSignature = CreateSignatureForVertexLayout(&positionElement, 1);
+			hr = gD3DDevice->CreateInputLayout(&positionElement, 1, positionSignature->GetBufferPointer(),
+			                                   positionSignature->GetBufferSize(), &subMesh.positionLayout);
+			if (positionSignature)  positionSignature->Release();
+			if (FAILED(hr))  throw std::runtime_error("Failure creating position input layout for " + fileName);
 		}
+	}
 
 
-		//-----------------------------------
-
-		D3D11_BUFFER_DESC bufferDesc;
-		D3D11_SUBRESOURCE_DATA initData;
+	//-----------------------------------
 
-		// Create GPU-side vertex buffer and copy the vertices imported by assimp into it
-		bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Indicate it is a vertex buffer
-		bufferDesc.Usage = D3D11_USAGE_DEFAULT;          // Default usage for this buffer - we'll see other usages later
-		bufferDesc.ByteWidth = subMesh.numVertices * subMesh.vertexSize; // Size of the buffer in bytes
-		bufferDesc.CPUAccessFlags = 0;
-		bufferDesc.MiscFlags = 0;
-		initData.pSysMem = vertices.get(); // Fill the new vertex buffer with data loaded by assimp
+	// Merge the occluder geometry of all the sub-meshes on each node
+	if (keepOccluderGeometry)
+	{
+		mNodeOccluderVertexStarts.resize(numNodes + 1);
+		mNodeOccluderIndexStarts .resize(numNodes + 1);
+		for (unsigned int node = 0; node < numNodes; ++node)
+		{
+			mNodeOccluderVertexStarts[node] = static_cast<unsigned int>(mOccluderPositions.size());
+			mNodeOccluderIndexStarts [node] = static_cast<unsigned int>(mOccluderIndices.size());
+			for (unsigned int i = mNodeSubMeshStarts[node]; i < mNodeSubMeshStarts[node + 1]; ++i)
+			{
+				unsigned int subMesh = mNodeSubMeshes[i];
+				uint32_t firstVertex = static_cast<uint32_t>(mOccluderPositions.size()) - mNodeOccluderVertexStarts[node];
+				mOccluderPositions.insert(mOccluderPositions.end(), occluderPositions[subMesh].begin(), occluderPositions[subMesh].end());
+				for (uint32_t index : occluderIndices[subMesh])  mOccluderIndices.push_back(firstVertex + index);
+			}
+		}
+		mNodeOccluderVertexStarts[numNodes] = static_cast<unsigned int>(mOccluderPositions.size());
+		mNodeOccluderIndexStarts [numNodes] = static_cast<unsigned int>(mOccluderIndices.size());
+	}
 
-		hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.vertexBuffer);
-		if (FAILED(hr))  throw std::runtime_error("Failure creating vertex buffer for " + fileName);
 
+	//-----------------------------------
 
-		// Create GPU-side index buffer and copy the vertices imported by assimp into it
-		bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; // Indicate it is an index buffer
-		bufferDesc.Usage = D3D11_USAGE_DEFAULT;         // Default usage for this buffer - we'll see other usages later
-		bufferDesc.ByteWidth = subMesh.numIndices * sizeof(DWORD); // Size of the buffer in bytes
-		bufferDesc.CPUAccessFlags = 0;
-		bufferDesc.MiscFlags = 0;
-		initData.pSysMem = indices.get(); // Fill the new index buffer with data loaded by assimp
+	// Bounding spheres for each node, centred on the node's bounding box. For rigid nodes the sphere just encloses the
+	// spheres of its sub-meshes. Bones use the sphere around their box, calculating it exactly would need another pass
+	// over every vertex influenced by the bone
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		const AABB& bounds = mNodeBounds[node];
+		if (bounds.IsEmpty())  continue;
 
-		hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &subMesh.indexBuffer);
-		if (FAILED(hr))  throw std::runtime_error("Failure creating index buffer for " + fileName);
+		BoundingSphere& sphere = mNodeSpheres[node];
+		sphere.centre = bounds.Centre();
+		sphere.radius = Length(bounds.Extents());
+		if (!mHasBones)
+		{
+			float radius = 0;
+			for (unsigned int i = mNodeSubMeshStarts[node]; i < mNodeSubMeshStarts[node + 1]; ++i)
+			{
+				const BoundingSphere& subMeshSphere = mSubMeshes[mNodeSubMeshes[i]].sphere;
+				float distance = Length(subMeshSphere.centre - sphere.centre) + subMeshSphere.radius;
+				if (distance > radius)  radius = distance;
+			}
+			if (radius < sphere.radius)  sphere.radius = radius;
+		}
 	}
+
+
+	//-----------------------------------
+
+	// The buffers are counted by the residency manager, which can evict the mesh when over the GPU memory budget
+	mResource = gResidency.Register(ResourceClass::Mesh, mGpuBytes, [this]() { Evict(); });
+
+
+	//-----------------------------------
+
+	// Report how much the triangle and vertex order optimisation helped, to the debugger output window
+	char report[256];
+	std::snprintf(report, sizeof(report), "Mesh %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %.3f -> %.3f\n",
+	              fileName.c_str(), mImportedOrderStats.ACMR(), mOptimisedOrderStats.ACMR(),
+	              mImportedOrderStats.ATVR(), mOptimisedOrderStats.ATVR(),
+	              mImportedOrderStats.Overfetch(), mOptimisedOrderStats.Overfetch());
+	OutputDebugStringA(report);
 }
 
 
 Mesh::~Mesh()
 {
+	gResidency.Unregister(mResource);
 	for (auto& subMesh : mSubMeshes)
 	{
-		if (subMesh.indexBuffer)   subMesh.indexBuffer ->Release();
-		if (subMesh.vertexBuffer)  subMesh.vertexBuffer->Release();
+		ReleaseSubMeshBuffers(subMesh);
+		if (subMesh.positionLayout)  subMesh.positionLayout->Release();
 		if (subMesh.vertexLayout)  subMesh.vertexLayout->Release();
 	}
 }
 
 
+//--------------------------------------------------------------------------------------
+
+// Create the GPU vertex and index buffers of a sub-mesh and queue their data to be uploaded from the CPU-side copy
+// through the upload ring (see UploadRing.h). The buffers can't be used until the uploads are complete. Returns false
+// on failure
+bool Mesh::CreateSubMeshBuffers(SubMesh& subMesh)
+{
+	// The buffers are created empty, the data arrives through the upload ring's staging buffers
+	D3D11_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Indicate it is a vertex buffer
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;          // Default usage, GPU memory that can be copied into
+	bufferDesc.ByteWidth = subMesh.numVertices * subMesh.vertexSize; // Size of the buffer in bytes
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &subMesh.vertexBuffer)))  return false;
+
+	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; // Indicate it is an index buffer
+	bufferDesc.ByteWidth = static_cast<UINT>(subMesh.indexData.size() * sizeof(uint32_t)); // All levels of detail
+	if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &subMesh.indexBuffer)))
+	{
+		ReleaseSubMeshBuffers(subMesh);
+		return false;
+	}
+
+	// Position-only vertex buffer for depth-only rendering. Skinned meshes would also need bones so don't have one
+	if (!subMesh.positionData.empty())
+	{
+		bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		bufferDesc.ByteWidth = subMesh.numVertices * 12;
+		if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &subMesh.positionBuffer)))
+		{
+			ReleaseSubMeshBuffers(subMesh);
+			return false;
+		}
+	}
+
+	// Uploads complete in the order they are queued, so the last ticket covers them all
+	mUploadTicket = gUploadRing.Upload(subMesh.vertexBuffer, 0, subMesh.vertexData.data(), static_cast<unsigned int>(subMesh.vertexData.size()));
+	mUploadTicket = gUploadRing.Upload(subMesh.indexBuffer,  0, subMesh.indexData .data(), static_cast<unsigned int>(subMesh.indexData.size() * sizeof(uint32_t)));
+	if (subMesh.positionBuffer)
+	{
+		mUploadTicket = gUploadRing.Upload(subMesh.positionBuffer, 0, subMesh.positionData.data(), static_cast<unsigned int>(subMesh.positionData.size() * sizeof(CVector3)));
+	}
+	return true;
+}
+
+
+// Release the GPU vertex and index buffers of a sub-mesh, cancelling any uploads into them. The CPU-side copy is kept
+void Mesh::ReleaseSubMeshBuffers(SubMesh& subMesh)
+{
+	for (ID3D11Buffer** buffer : { &subMesh.positionBuffer, &subMesh.indexBuffer, &subMesh.vertexBuffer })
+	{
+		if (*buffer == nullptr)  continue;
+		gUploadRing.Cancel(*buffer);
+		(*buffer)->Release();
+		*buffer = nullptr;
+	}
+}
+
+
+// GPU memory used by the vertex and index buffers of a sub-mesh
+uint64_t Mesh::SubMeshBufferBytes(const SubMesh& subMesh)
+{
+	return static_cast<uint64_t>(subMesh.numVertices) * subMesh.vertexSize + subMesh.indexData.size() * sizeof(uint32_t) +
+	       subMesh.positionData.size() * sizeof(CVector3);
+}
+
+
+// Mark the mesh as used this frame, creating its GPU buffers again if it has been evicted. Returns false if the buffers
+// couldn't be created or their data is still being uploaded, the mesh can't be drawn then
+bool Mesh::MakeResident()
+{
+	gResidency.Touch(mResource);
+	if (mResident)  return gUploadRing.IsComplete(mUploadTicket);
+
+	for (auto& subMesh : mSubMeshes)
+	{
+		if (!CreateSubMeshBuffers(subMesh))
+		{
+			for (auto& created : mSubMeshes)  ReleaseSubMeshBuffers(created);
+			return false;
+		}
+	}
+	mResident = true;
+	gResidency.Resize(mResource, mGpuBytes);
+	return gUploadRing.IsComplete(mUploadTicket);
+}
+
+
+// Release the GPU buffers when over the GPU memory budget, called by the residency manager. They are created again from
+// the CPU-side copy the next time the mesh is drawn
+void Mesh::Evict()
+{
+	for (auto& subMesh : mSubMeshes)  ReleaseSubMeshBuffers(subMesh);
+	mResident = false;
+	gResidency.Resize(mResource, 0);
+}
+
+
 //--------------------------------------------------------------------------------------
 
 // Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
-void Mesh::RenderSubMesh(const SubMesh& subMesh)
+// Optionally render several instances of the sub-mesh in one draw call, optionally use the position-only vertices, and
+// optionally render a simplified level of detail
+void Mesh::RenderSubMesh(const SubMesh& subMesh, unsigned int numInstances /*= 1*/, bool positionsOnly /*= false*/,
+                         unsigned int lod /*= 0*/)
+{
+	SetSubMeshBuffers(subMesh, positionsOnly);
+
+	// Render mesh, the level of detail is a range of the index buffer
+	if (lod >= MaxLods)  lod = MaxLods - 1;
+	unsigned int firstIndex = subMesh.lodFirstIndex[lod];
+	unsigned int numIndices = subMesh.lodNumIndices[lod];
+	if (numInstances == 1)  gD3DContext->DrawIndexed(numIndices, firstIndex, 0);
+	else                    gD3DContext->DrawIndexedInstanced(numIndices, numInstances, firstIndex, 0, 0);
+}
+
+
+// Set the vertex and index buffers of a sub-mesh ready to draw, optionally using the position-only vertices
+void Mesh::SetSubMeshBuffers(const SubMesh& subMesh, bool positionsOnly)
 {
 	// Set vertex buffer as next data source for GPU
-	UINT stride = subMesh.vertexSize;
+	UINT stride = positionsOnly ? 12 : subMesh.vertexSize;
 	UINT offset = 0;
-	gD3DContext->IASetVertexBuffers(0, 1, &subMesh.vertexBuffer, &stride, &offset);
+	gD3DContext->IASetVertexBuffers(0, 1, positionsOnly ? &subMesh.positionBuffer : &subMesh.vertexBuffer, &stride, &offset);
 
 	// Indicate the layout of vertex buffer
-	gD3DContext->IASetInputLayout(subMesh.vertexLayout);
+	gD3DContext->IASetInputLayout(positionsOnly ? subMesh.positionLayout : subMesh.vertexLayout);
 
 	// Set index buffer as next data source for GPU, indicate it uses 32-bit integers
 	gD3DContext->IASetIndexBuffer(subMesh.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
 	// Using triangle lists only in this class
 	gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-	// Render mesh
-	gD3DContext->DrawIndexed(subMesh.numIndices, 0, 0);
 }
 
 
 
-// Render the mesh with the given matrices
-// Handles rigid body meshes (including single part meshes) as well as skinned meshes
-// LIMITATION: The mesh must use a single texture throughout
-void Mesh::Render(std::vector<CMatrix4x4>& modelMatrices)
+// Write the bone matrices for a model using this mesh into the bone palette, returns where they start in the palette
+// Does nothing for meshes without skinning (returns 0). Call each frame before the palette is uploaded and rendered
+unsigned int Mesh::WriteBonePalette(TransformHierarchy& transforms)
 {
-	// Skinning needs all matrices available in the shader at the same time, so first calculate all the absolute
-	// matrices before rendering anything
-	std::vector<CMatrix4x4> absoluteMatrices(modelMatrices.size());
-	absoluteMatrices[0] = modelMatrices[0]; // First matrix for a model is the root matrix, already in world space
-	for (unsigned int nodeIndex = 1; nodeIndex < mNodes.size(); ++nodeIndex)
+	if (!mHasBones)  return 0;
+
+	// Skinning needs all matrices available in the shader at the same time, so first make sure all the absolute
+	// matrices are up to date. Only the parts of the model that have moved since the last frame are recalculated
+	transforms.Update();
+
+	// Advanced point: the absolute world matrices are those **of the bones**. However, they are
+	// not actually rendered, they merely influence the skinned mesh, which has its origin at a particular node.
+	// So for each bone there is a fixed offset (transform) between where that bone is and where the root of the
+	// skinned mesh is. The transform hierarchy has applied these offsets (calculated when the mesh was imported)
+	// to give the skinning matrices used here
+	const CMatrix4x4* skinningMatrices = transforms.SkinningMatrices();
+
+	// The palette entries are laid out in the same order as mBoneNodes, so each sub-mesh's bones are found at
+	// the model's offset plus the sub-mesh's firstBone
+	unsigned int numBones = static_cast<unsigned int>(mBoneNodes.size());
+	unsigned int offset = gBonePalette.Allocate(numBones);
+	CMatrix4x4* palette = gBonePalette.Matrices(offset);
+	for (unsigned int bone = 0; bone < numBones; ++bone)
 	{
-		// Multiply each model matrix by its parent's absolute world matrix (already calculated earlier in this loop)
-		// Same process as for rigid bodies, simply done prior to rendering now
-		absoluteMatrices[nodeIndex] = modelMatrices[nodeIndex] * absoluteMatrices[mNodes[nodeIndex].parentIndex];
+		palette[bone] = skinningMatrices[mBoneNodes[bone]];
 	}
+	return offset;
+}
 
-	if (mHasBones) // Render a mesh that uses skinning
+
+// World space bounding box of a model using this mesh, from the bounds of each node and the model's matrices
+AABB Mesh::CalculateWorldBounds(TransformHierarchy& transforms)
+{
+	transforms.Update();
+
+	// Node bounds for skinned meshes are moved by the skinning matrices, rigid ones by the absolute matrices
+	const CMatrix4x4* matrices = mHasBones ? transforms.SkinningMatrices() : transforms.AbsoluteMatrices();
+
+	AABB worldBounds;
+	for (unsigned int node = 0; node < NumberNodes(); ++node)
 	{
-		// Advanced point: the above loop will get the absolute world matrices **of the bones**. However, they are
-		// not actually rendered, they merely influence the skinned mesh, which has its origin at a particular node.
-		// So for each bone there is a fixed offset (transform) between where that bone is and where the root of the
-		// skinned mesh is. We need to apply that offset to each of the bone matrices calculated in the last loop to make
-		// the bone influences work on the skinned mesh.
-		// These offset matrices are fixed for the model and have been calculated when the mesh was imported
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
-		{
-			absoluteMatrices[nodeIndex] = mNodes[nodeIndex].offsetMatrix * absoluteMatrices[nodeIndex];
-		}
+		if (mNodeBounds[node].IsEmpty())  continue;
+		worldBounds.Add(TransformAABB(mNodeBounds[node], matrices[node]));
+	}
+	return worldBounds;
+}
 
-		// Send all matrices over to the GPU for skinning via a constant buffer - each matrix can represent a bone which influences nearby vertices
-		// MISSING - code to fill the gPerModelConstants.boneMatrices array with the contents of the absoluteMatrices vector
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
-		{
-			gPerModelConstants.boneMatrices[nodeIndex] = absoluteMatrices[nodeIndex];
-		}
-		UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
 
-		// Indicate that the constant buffer we just updated is for use in the vertex shader (VS), geometry shader (GS) and pixel shader (PS)
-		gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-		gD3DContext->GSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-		gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+// Render the mesh with the given model matrices, recalculating any that have changed
+// Handles rigid body meshes (including single part meshes) as well as skinned meshes. For skinned meshes pass
+// the offset returned from WriteBonePalette this frame
+// Optionally render a simplified level of detail (levels beyond NumLods use the last level)
+// LIMITATION: The mesh must use a single texture throughout
+void Mesh::Render(TransformHierarchy& transforms, unsigned int bonePaletteOffset /*= 0*/, unsigned int lod /*= 0*/)
+{
+	// Make sure all the absolute matrices are up to date before rendering anything. Only the parts of the model that
+	// have moved since the last render are recalculated, the rest are cached in the transform hierarchy
+	transforms.Update();
+	if (!MakeResident())  return;
 
-		// Already sent over all the absolute matrices for the entire mesh so we can render sub-meshes directly
-		// rather than iterating through the nodes. 
+	if (mHasBones) // Render a mesh that uses skinning
+	{
+		// The bone matrices are already on the GPU in the bone palette, each sub-mesh only needs to tell the
+		// shader where its bones start. Skinned vertices are placed in the world by their bones, the world matrix
+		// is set to the root for shaders that use it
+		gPerModelConstants.worldMatrix = transforms.AbsoluteMatrices()[0];
 		for (auto& subMesh : mSubMeshes)
 		{
-			RenderSubMesh(subMesh);
+			gPerModelConstants.boneOffset = bonePaletteOffset + subMesh.firstBone;
+			UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
+
+			RenderSubMesh(subMesh, 1, false, lod);
 		}
 	}
 	else
@@ -450,66 +725,158 @@ void Mesh::Render(std::vector<CMatrix4x4>& modelMatrices)
 		// Render a mesh without skinning. Although slightly reorganised to use the matrices calculated
 		// above, this is basically the same code as the rigid body animation lab
 		// Iterate through each node
-		for (unsigned int nodeIndex = 0; nodeIndex < mNodes.size(); ++nodeIndex)
+		const CMatrix4x4* absoluteMatrices = transforms.AbsoluteMatrices();
+		for (unsigned int nodeIndex = 0; nodeIndex < NumberNodes(); ++nodeIndex)
 		{
-			// Send this node's matrix to the GPU via a constant buffer
+			// Nodes without geometry don't need their matrix sent to the GPU
+			unsigned int subMeshStart = mNodeSubMeshStarts[nodeIndex];
+			unsigned int subMeshEnd   = mNodeSubMeshStarts[nodeIndex + 1];
+			if (subMeshStart == subMeshEnd)  continue;
+
+			// Send this node's matrix to the GPU via a constant buffer. Only the small per-model buffer is updated for rigid
+			// nodes. The buffer is already selected for the vertex and pixel shaders (see RenderSceneFromCamera)
 			gPerModelConstants.worldMatrix = absoluteMatrices[nodeIndex];
 			UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
 
-			// Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-			gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-			gD3DContext->GSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
-			gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
-
 			// Render the sub-meshes attached to this node (no bones - rigid movement)
-			for (auto& subMeshIndex : mNodes[nodeIndex].subMeshes)
+			for (unsigned int i = subMeshStart; i < subMeshEnd; ++i)
 			{
-				RenderSubMesh(mSubMeshes[subMeshIndex]);
+				RenderSubMesh(mSubMeshes[mNodeSubMeshes[i]], 1, false, lod);
 			}
 		}
 	}
 }
 
 
-//--------------------------------------------------------------------------------------
-// Helper functions
-//--------------------------------------------------------------------------------------
-
-// Count the number of nodes with given assimp node as root - recursive
-unsigned int Mesh::CountNodes(aiNode* assimpNode)
+// Add a model using this mesh to the occlusion buffer as an occluder. Only available for rigid meshes that kept their
+// occluder geometry when loaded (does nothing otherwise)
+void Mesh::AddToOcclusionBuffer(TransformHierarchy& transforms, OcclusionBuffer& occlusionBuffer)
 {
-	unsigned int count = 1;
-	for (unsigned int child = 0; child < assimpNode->mNumChildren; ++child)
-		count += CountNodes(assimpNode->mChildren[child]);
-	return count;
+	if (mOccluderPositions.empty())  return;
+
+	transforms.Update();
+	const CMatrix4x4* absoluteMatrices = transforms.AbsoluteMatrices();
+	for (unsigned int node = 0; node < NumberNodes(); ++node)
+	{
+		unsigned int firstVertex = mNodeOccluderVertexStarts[node];
+		unsigned int firstIndex  = mNodeOccluderIndexStarts[node];
+		unsigned int numIndices  = mNodeOccluderIndexStarts[node + 1] - firstIndex;
+		if (numIndices == 0)  continue;
+
+		occlusionBuffer.AddOccluder(&mOccluderPositions[firstVertex], mNodeOccluderVertexStarts[node + 1] - firstVertex,
+		                            &mOccluderIndices[firstIndex], numIndices, absoluteMatrices[node]);
+	}
 }
 
 
-// Help build the arrays of submeshes and nodes from the assimp data - recursive
-unsigned int Mesh::ReadNodes(aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex)
+// Render the geometry of one node for several models at once, rigid meshes only. The world matrices for each copy
+// must already be in the instance buffer starting at instanceOffset (see InstanceBatcher), and an instanced vertex
+// shader selected. The level of detail is the same for every copy. Optionally send only vertex positions, for
+// depth-only rendering with a shader that only needs positions (see DepthOnlyInstanced_vs)
+void Mesh::RenderInstanced(unsigned int node, unsigned int lod, unsigned int instanceOffset, unsigned int numInstances,
+                           bool positionsOnly /*= false*/, const MeshDrawRange* ranges /*= nullptr*/,
+                           unsigned int numRanges /*= 0*/)
 {
-	auto& node = mNodes[nodeIndex];
-	node.parentIndex = parentIndex;
-	unsigned int thisIndex = nodeIndex;
-	++nodeIndex;
+	if (!MakeResident())  return;
 
-	node.name = assimpNode->mName.C_Str();
+	// The shader reads instance data from gInstances[instanceOffset + SV_InstanceID]. SV_InstanceID always starts at 0
+	// (the start instance location in the draw call doesn't change it), so the offset is passed in the constant buffer
+	gPerModelConstants.instanceOffset = instanceOffset;
+	UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
 
-	node.defaultMatrix.SetValues(&assimpNode->mTransformation.a1);
-	node.defaultMatrix.Transpose(); // Assimp stores matrices differently to this app
+	if (ranges == nullptr)
+	{
+		for (unsigned int i = mNodeSubMeshStarts[node]; i < mNodeSubMeshStarts[node + 1]; ++i)
+		{
+			RenderSubMesh(mSubMeshes[mNodeSubMeshes[i]], numInstances, positionsOnly, lod);
+		}
+		return;
+	}
 
-	node.subMeshes.resize(assimpNode->mNumMeshes);
-	for (unsigned int i = 0; i < assimpNode->mNumMeshes; ++i)
+	// Draw each range left after meshlet culling. Ranges for the same sub-mesh are together so the buffers are only set
+	// when the sub-mesh changes
+	unsigned int currentSubMesh = ~0u;
+	for (unsigned int r = 0; r < numRanges; ++r)
 	{
-		node.subMeshes[i] = assimpNode->mMeshes[i];
+		const MeshDrawRange& range = ranges[r];
+		if (range.subMesh != currentSubMesh)
+		{
+			currentSubMesh = range.subMesh;
+			SetSubMeshBuffers(mSubMeshes[mNodeSubMeshes[mNodeSubMeshStarts[node] + currentSubMesh]], positionsOnly);
+		}
+		if (numInstances == 1)  gD3DContext->DrawIndexed(range.numIndices, range.firstIndex, 0);
+		else                    gD3DContext->DrawIndexedInstanced(range.numIndices, numInstances, range.firstIndex, 0, 0);
 	}
+}
 
-	node.childNodes.resize(assimpNode->mNumChildren);
-	for (unsigned int i = 0; i < assimpNode->mNumChildren; ++i)
+
+// Whether any of a node's geometry is split into meshlets (see Meshlets.h)
+bool Mesh::NodeHasMeshlets(unsigned int node)
+{
+	for (unsigned int i = mNodeSubMeshStarts[node]; i < mNodeSubMeshStarts[node + 1]; ++i)
+	{
+		if (mSubMeshes[mNodeSubMeshes[i]].lodNumMeshlets[0] > 0)  return true;
+	}
+	return false;
+}
+
+
+// Total number of indices in a node's sub-meshes at a level of detail
+unsigned int Mesh::NodeNumIndices(unsigned int node, unsigned int lod)
+{
+	if (lod >= MaxLods)  lod = MaxLods - 1;
+	unsigned int numIndices = 0;
+	for (unsigned int i = mNodeSubMeshStarts[node]; i < mNodeSubMeshStarts[node + 1]; ++i)
 	{
-		node.childNodes[i] = nodeIndex;
-		nodeIndex = ReadNodes(assimpNode->mChildren[i], nodeIndex, thisIndex);
+		numIndices += mSubMeshes[mNodeSubMeshes[i]].lodNumIndices[lod];
 	}
+	return numIndices;
+}
+
+
+// Find the parts of a node that might be visible to any of the given cameras, which must be in the node's space (one
+// camera for each model being drawn, see MeshletCameraFromWorld). The index ranges to draw are added to the given
+// vector, with neighbouring ranges merged. Sub-meshes without meshlets are added whole. Returns the number of indices
+// in the ranges added
+unsigned int Mesh::CullMeshlets(unsigned int node, unsigned int lod, const MeshletCamera* cameras, unsigned int numCameras,
+                                bool cullBackFaces, FrameVector<MeshDrawRange>& ranges)
+{
+	if (lod >= MaxLods)  lod = MaxLods - 1;
 
-	return nodeIndex;
+	unsigned int numIndices = 0;
+	unsigned int numSubMeshes = mNodeSubMeshStarts[node + 1] - mNodeSubMeshStarts[node];
+	for (unsigned int s = 0; s < numSubMeshes; ++s)
+	{
+		const SubMesh& subMesh = mSubMeshes[mNodeSubMeshes[mNodeSubMeshStarts[node] + s]];
+		if (subMesh.lodNumMeshlets[lod] == 0)
+		{
+			ranges.push_back({ s, subMesh.lodFirstIndex[lod], subMesh.lodNumIndices[lod] });
+			numIndices += subMesh.lodNumIndices[lod];
+			continue;
+		}
+
+		// Meshlets are stored in index buffer order, so a visible meshlet following another visible one extends its range
+		bool extendRange = false;
+		const Meshlet* meshlet    = mMeshlets.data() + subMesh.lodFirstMeshlet[lod];
+		const Meshlet* meshletEnd = meshlet + subMesh.lodNumMeshlets[lod];
+		for (; meshlet != meshletEnd; ++meshlet)
+		{
+			bool visible = false;
+			for (unsigned int c = 0; c < numCameras && !visible; ++c)
+			{
+				visible = MeshletVisible(*meshlet, cameras[c], cullBackFaces);
+			}
+			if (!visible)
+			{
+				extendRange = false;
+				continue;
+			}
+
+			if (extendRange)  ranges.back().numIndices += meshlet->numIndices;
+			else              ranges.push_back({ s, meshlet->firstIndex, meshlet->numIndices });
+			numIndices += meshlet->numIndices;
+			extendRange = true;
+		}
+	}
+	return numIndices;
 }
@@ -4,17 +4,37 @@
 // The mesh class splits the mesh into sub-meshes that only use one texture each.
 // The class also doesn't load textures, filters or shaders as the outer code is
 // expected to select these things
+// The GPU buffers are registered with the residency manager (see ResidencyManager.h). A CPU-side copy of the vertices
+// and indices is kept, so when over the GPU memory budget the buffers can be released and created again on next use.
+// Buffer data is sent through the upload ring (see UploadRing.h), a mesh isn't drawn until its upload is complete
 
 #include "CMatrix4x4.h"
+#include "TransformHierarchy.h"
+#include "BoundingVolumes.h"
+#include "Meshlets.h"
+#include "MeshOptimiser.h"
+#include "ResidencyManager.h"
+#include "FrameAllocator.h"
 #define NOMINMAX // Use this to stop Windows headers defining "min" and "max", which breaks some libraries (e.g. assimp)
 #include <d3d11.h>
-#include <assimp/scene.h>
 #include <string>
 #include <vector>
+#include <unordered_map>
 
 #ifndef _MESH_H_INCLUDED_
 #define _MESH_H_INCLUDED_
 
+class OcclusionBuffer;
+
+// A range of indices from one of a node's sub-meshes, the part of a node left to draw after its meshlets are culled
+// (see Mesh::CullMeshlets). The sub-mesh is given by its position in the node's list of sub-meshes
+struct MeshDrawRange
+{
+	unsigned int subMesh;
+	unsigned int firstIndex;
+	unsigned int numIndices;
+};
+
 class Mesh
 {
 //--------------------------------------------------------------------------------------
@@ -22,25 +42,99 @@ class Mesh
 //--------------------------------------------------------------------------------------
 public:
 
-    // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
+    // Pass the name of the mesh file to load. .x files are read by a dedicated parser, other file types by assimp
+    // (http://www.assimp.org/) - see MeshImport.h
     // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+    // Optionally keep a CPU-side copy of the geometry so models using the mesh can be occluders (see OcclusionBuffer)
     // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-    Mesh(const std::string& fileName, bool requireTangents = false);
+    Mesh(const std::string& fileName, bool requireTangents = false, bool keepOccluderGeometry = false);
     ~Mesh();
 
+	// Prevent copying - owns GPU resources and is registered with the residency manager
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
 
 	// How many nodes are in the hierarchy for this mesh. Nodes can control individual parts (rigid body animation),
 	// or bones (skinned animation), or they can be dummy nodes to create child parts in a more convenient way
-	unsigned int NumberNodes()  { return static_cast<unsigned int>(mNodes.size()); }
+	unsigned int NumberNodes()  { return static_cast<unsigned int>(mNodeParents.size()); }
 
     // The default matrix for a given node - used to set the initial position for a new model
-    CMatrix4x4 GetNodeDefaultMatrix(unsigned int node) { return mNodes[node].defaultMatrix; }
+    CMatrix4x4 GetNodeDefaultMatrix(unsigned int node) { return mNodeDefaultMatrices[node]; }
+
+	// Flat hierarchy data, one entry per node in depth-first order. Used by TransformHierarchy to update matrices
+	// - Parent index of each node (root refers to itself)
+	// - One past the last node in each node's subtree, i.e. the node and all its descendants are [node, subtreeEnd)
+	// - Offset matrix of each bone from the skinned mesh's origin (identity for nodes that aren't bones)
+	const unsigned int* NodeParents()         { return mNodeParents.data(); }
+	const unsigned int* NodeSubtreeEnds()     { return mNodeSubtreeEnds.data(); }
+	const CMatrix4x4*   NodeOffsetMatrices()  { return mNodeOffsetMatrices.data(); }
+
+	bool HasBones()  { return mHasBones; }
+
+	// Most levels of detail a mesh can have, including the full detail mesh (level 0)
+	static const unsigned int MaxLods = 4;
+
+	// Number of levels of detail. Simplified versions of each sub-mesh are built when the mesh is loaded, with about half,
+	// a quarter and a tenth of the triangles (see MeshSimplifier.h). All levels share the same vertices, only the
+	// triangles differ. Small meshes, or meshes that can't be simplified well, have fewer levels
+	unsigned int NumLods()  { return mNumLods; }
+
+	// How well the full detail triangles use the vertex caches (see MeshOptimiser.h), as imported and after the triangle
+	// and vertex order are optimised when loading. All sub-meshes together. Also written to the debugger output window
+	const IndexOrderStats& ImportedOrderStats()   { return mImportedOrderStats;  }
+	const IndexOrderStats& OptimisedOrderStats()  { return mOptimisedOrderStats; }
+
+	// Whether a node has any geometry attached (rigid meshes only draw nodes with geometry)
+	bool NodeHasGeometry(unsigned int node)  { return mNodeSubMeshStarts[node] != mNodeSubMeshStarts[node + 1]; }
+
+	// Whether any of a node's geometry is split into meshlets (see Meshlets.h). Dense sub-meshes of rigid meshes are split
+	// into meshlets when loaded, separately for each level of detail
+	bool NodeHasMeshlets(unsigned int node);
+
+	// Total number of indices in a node's sub-meshes at a level of detail
+	unsigned int NodeNumIndices(unsigned int node, unsigned int lod);
+
+	// Find the parts of a node that might be visible to any of the given cameras, which must be in the node's space (one
+	// camera for each model being drawn, see MeshletCameraFromWorld). Meshlets outside every camera's frustum are culled,
+	// as are meshlets facing away from every camera if the mesh is drawn with back-face culling. The index ranges to draw
+	// are added to the given vector, with neighbouring ranges merged. Sub-meshes without meshlets are added whole.
+	// Returns the number of indices in the ranges added
+	unsigned int CullMeshlets(unsigned int node, unsigned int lod, const MeshletCamera* cameras, unsigned int numCameras,
+	                          bool cullBackFaces, FrameVector<MeshDrawRange>& ranges);
+
+	// Bounds of the geometry that moves with each node, calculated when the mesh is loaded. Empty for nodes that don't move
+	// any geometry. For rigid meshes this is the node's sub-meshes in the node's local space. For skinned meshes it is the
+	// vertices the node influences as a bone, in the space transformed by the node's skinning matrix
+	const AABB&           NodeBounds(unsigned int node)          { return mNodeBounds[node]; }
+	const BoundingSphere& NodeBoundingSphere(unsigned int node)  { return mNodeSpheres[node]; }
+
+	// World space bounding box of a model using this mesh, from the bounds of each node and the model's matrices
+	AABB CalculateWorldBounds(TransformHierarchy& transforms);
+
+
+	// Write the bone matrices for a model using this mesh into the bone palette, returns where they start in the palette
+	// Does nothing for meshes without skinning (returns 0). Call each frame before the palette is uploaded and rendered
+	unsigned int WriteBonePalette(TransformHierarchy& transforms);
+
+	// Render the mesh with the given model matrices, recalculating any that have changed
+	// Handles rigid body meshes (including single part meshes) as well as skinned meshes. For skinned meshes pass
+	// the offset returned from WriteBonePalette this frame
+	// Optionally render a simplified level of detail (levels beyond NumLods use the last level)
+	// LIMITATION: The mesh must use a single texture throughout
+	void Render(TransformHierarchy& transforms, unsigned int bonePaletteOffset = 0, unsigned int lod = 0);
 
+	// Add a model using this mesh to the occlusion buffer as an occluder. Only available for rigid meshes that kept their
+	// occluder geometry when loaded (does nothing otherwise)
+	void AddToOcclusionBuffer(TransformHierarchy& transforms, OcclusionBuffer& occlusionBuffer);
 
-	// Render the mesh with the given matrices
-	// Handles rigid body meshes (including single part meshes) as well as skinned meshes
-	// LIMITATION: The mesh must use a single texture throughout
-	void Render(std::vector<CMatrix4x4>& modelMatrices);
+	// Render the geometry of one node for several models at once, rigid meshes only. The world matrices for each copy
+	// must already be in the instance buffer starting at instanceOffset (see InstanceBatcher), and an instanced vertex
+	// shader selected. The level of detail is the same for every copy. Optionally send only vertex positions, for
+	// depth-only rendering with a shader that only needs positions (see DepthOnlyInstanced_vs). Optionally draw only the
+	// given index ranges from CullMeshlets, rather than the whole node
+	void RenderInstanced(unsigned int node, unsigned int lod, unsigned int instanceOffset, unsigned int numInstances,
+	                     bool positionsOnly = false, const MeshDrawRange* ranges = nullptr, unsigned int numRanges = 0);
 
 
 
@@ -62,25 +156,37 @@ private:
 
 		unsigned int       numIndices = 0;
 		ID3D11Buffer*      indexBuffer  = nullptr;
-	};
-
-
-	// A mesh contains a hierarchy of nodes. A node represents a seperate animatable part of the mesh
-	// A node can contain several sub-meshes (because a single node might use multiple textures)
-	// A node can also have child nodes. The children will follow the motion of the parent node
-	// Each node has a default matrix which is it's initial/ default position. Models using this mesh are
-	// given these default matrices as a starting position.
-	struct Node
-	{
-		std::string  name;
-
-		CMatrix4x4   defaultMatrix; // Starting position/rotation/scale for this node. Relative to parent. Used when first creating a model from this mesh
-		CMatrix4x4   offsetMatrix;
 
-		unsigned int parentIndex;   // Index of the parent node (from the mNodes vector below). Root node refers to itself (0)
-
-		std::vector<unsigned int> childNodes; // Child nodes that are controlled by this node (indexes into the mNodes vector below)
-		std::vector<unsigned int> subMeshes;  // The geometry representing this node (indexes into the mSubMeshes vector below)
+		// CPU-side copy of the vertex and index buffers (and the position-only buffer below), to create them again after
+		// the mesh is evicted
+		std::vector<unsigned char> vertexData;
+		std::vector<uint32_t>      indexData;
+		std::vector<CVector3>      positionData;
+
+		// Levels of detail, all stored in the index buffer one after another. Level n uses lodNumIndices[n] indices from
+		// lodFirstIndex[n]. Level 0 is the full detail mesh, levels that couldn't be simplified further repeat the level before
+		unsigned int       lodFirstIndex[MaxLods] = {};
+		unsigned int       lodNumIndices[MaxLods] = {};
+
+		// Meshlets for each level of detail: level n uses mMeshlets[lodFirstMeshlet[n]] to
+		// mMeshlets[lodFirstMeshlet[n] + lodNumMeshlets[n] - 1]. Their index ranges are relative to the start of the index
+		// buffer. No meshlets for small sub-meshes or skinned meshes
+		unsigned int       lodFirstMeshlet[MaxLods] = {};
+		unsigned int       lodNumMeshlets[MaxLods] = {};
+
+		// Second vertex buffer holding only positions, for depth-only rendering. A 12 byte stride instead of 32 or more
+		// means much less memory bandwidth when the vertices are read (rigid meshes only)
+		ID3D11Buffer*      positionBuffer = nullptr;
+		ID3D11InputLayout* positionLayout = nullptr;
+
+		// Bones used by this sub-mesh (skinned meshes only): mBoneNodes[firstBone] to mBoneNodes[firstBone + numBones - 1]
+		// The bone indexes in the vertices are local to this list, so in the bone palette they are relative to firstBone
+		unsigned int       firstBone = 0;
+		unsigned int       numBones  = 0;
+
+		// Bounds of the vertices in the space of the node that owns the sub-mesh (the skinned mesh's space if it has bones)
+		AABB               bounds;
+		BoundingSphere     sphere;
 	};
 
 
@@ -89,14 +195,31 @@ private:
 //--------------------------------------------------------------------------------------
 private:
 
-	// Count the number of nodes with given assimp node as root
-	unsigned int CountNodes(aiNode* assimpNode);
+	// Create the GPU vertex and index buffers of a sub-mesh and queue their data to be uploaded from the CPU-side copy
+	// through the upload ring. The buffers can't be used until the uploads are complete. Returns false on failure
+	bool CreateSubMeshBuffers(SubMesh& subMesh);
+
+	// Release the GPU vertex and index buffers of a sub-mesh, cancelling any uploads into them. The CPU-side copy is kept
+	void ReleaseSubMeshBuffers(SubMesh& subMesh);
+
+	// GPU memory used by the vertex and index buffers of a sub-mesh
+	static uint64_t SubMeshBufferBytes(const SubMesh& subMesh);
 
-	// Help build the arrays of submeshes and nodes from the assimp data - recursive
-	unsigned int ReadNodes(aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex);
+	// Mark the mesh as used this frame, creating its GPU buffers again if it has been evicted. Returns false if the
+	// buffers couldn't be created or their data is still being uploaded, the mesh can't be drawn then
+	bool MakeResident();
+
+	// Release the GPU buffers when over the GPU memory budget, called by the residency manager. They are created again
+	// from the CPU-side copy the next time the mesh is drawn
+	void Evict();
+
+	// Set the vertex and index buffers of a sub-mesh ready to draw, optionally using the position-only vertices
+	void SetSubMeshBuffers(const SubMesh& subMesh, bool positionsOnly);
 
 	// Helper function for Render function - renders a given sub-mesh. World matrices / textures / states etc. must already be set
-	void RenderSubMesh(const SubMesh& subMesh);
+	// Optionally render several instances of the sub-mesh in one draw call, optionally use the position-only vertices, and
+	// optionally render a simplified level of detail
+	void RenderSubMesh(const SubMesh& subMesh, unsigned int numInstances = 1, bool positionsOnly = false, unsigned int lod = 0);
 
 
 
@@ -106,7 +229,59 @@ private:
 private:
 
     std::vector<SubMesh> mSubMeshes; // The mesh geometry. Nodes refer to sub-meshes in this vector
-    std::vector<Node>    mNodes;     // The mesh hierarchy. First entry is root. remainder aree stored in depth-first order
+
+	// A mesh contains a hierarchy of nodes. A node represents a seperate animatable part of the mesh
+	// A node can contain several sub-meshes (because a single node might use multiple textures)
+	// A node can also have child nodes. The children will follow the motion of the parent node
+	// The hierarchy is stored as flat arrays, one entry per node. First entry is root, remainder are stored in
+	// depth-first order, so a node's descendants immediately follow it
+	std::vector<std::string>  mNodeNames;
+	std::vector<unsigned int> mNodeParents;          // Index of the parent node. Root node refers to itself (0)
+	std::vector<unsigned int> mNodeSubtreeEnds;      // One past the last descendant of each node
+	std::vector<CMatrix4x4>   mNodeDefaultMatrices;  // Starting position/rotation/scale for each node. Relative to parent. Used when first creating a model from this mesh
+	std::vector<CMatrix4x4>   mNodeOffsetMatrices;   // Offset from skinned mesh origin for bones, identity otherwise
+	std::vector<AABB>           mNodeBounds;         // Bounds of geometry moved by each node (see NodeBounds)
+	std::vector<BoundingSphere> mNodeSpheres;
+
+	// The geometry representing each node: the sub-meshes for node n are mNodeSubMeshes[mNodeSubMeshStarts[n]]
+	// up to mNodeSubMeshes[mNodeSubMeshStarts[n + 1]] (indexes into the mSubMeshes vector above)
+	std::vector<unsigned int> mNodeSubMeshStarts;
+	std::vector<unsigned int> mNodeSubMeshes;
+
+	// Node names interned to node indexes, built while reading the hierarchy. Bones refer to nodes by name so this
+	// avoids a string search through every node for every bone
+	std::unordered_map<std::string, unsigned int> mNodeLookup;
+
+	// The node that owns each sub-mesh (node index for each entry in mSubMeshes)
+	std::vector<unsigned int> mSubMeshNodes;
+
+	// Node index for each sub-mesh bone, sub-meshes refer to a range in this list (see SubMesh)
+	std::vector<unsigned int> mBoneNodes;
+
+	// CPU-side copy of the geometry for occlusion culling, only kept if requested. All the sub-meshes for each node are
+	// merged: node n uses mOccluderPositions from mNodeOccluderVertexStarts[n] and mOccluderIndices from
+	// mNodeOccluderIndexStarts[n] (up to the start for node n + 1). Positions are in node space and indices are relative
+	// to the node's first position
+	std::vector<CVector3>     mOccluderPositions;
+	std::vector<uint32_t>     mOccluderIndices;
+	std::vector<unsigned int> mNodeOccluderVertexStarts;
+	std::vector<unsigned int> mNodeOccluderIndexStarts;
+
+	// Meshlets for all sub-meshes, each sub-mesh refers to ranges in this list (see SubMesh)
+	std::vector<Meshlet> mMeshlets;
+
+	IndexOrderStats mImportedOrderStats;
+	IndexOrderStats mOptimisedOrderStats;
+
+	unsigned int mNumLods = 1;
+
+	// Registration with the residency manager, and whether the GPU buffers exist (false after eviction until next drawn)
+	unsigned int mResource = ResidencyManager::NoResource;
+	bool         mResident = true;
+	uint64_t     mGpuBytes = 0;
+
+	// Upload ticket for the last buffer data queued, the buffers can be drawn once it is complete
+	uint64_t mUploadTicket = 0;
 
 	bool mHasBones; // If any submesh has bones, then all submeshes are given bones - makes rendering easier (one shader for the whole mesh)
 };
@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// Mesh benchmark - compares loading .x meshes with the dedicated parser and with assimp
+//--------------------------------------------------------------------------------------
+// Usage: MeshBenchmark [repeats]
+//
+// Run from the app's folder. Every .x file in the folder is read both ways (see MeshImport.h), repeats times each
+// (default 10), and the fastest time for each is reported. Only the import is timed, not creating the GPU buffers,
+// which is the same for both. The vertex and triangle counts from each are shown so any difference in the results can
+// be seen too
+
+#include "MeshImport.h"
+#include "Timer.h"
+
+#define NOMINMAX // Stop Windows headers defining "min" and "max"
+#include <windows.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+
+// Times each file is read when the number isn't given
+const int DEFAULT_REPEATS = 10;
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+static void CountGeometry(const ImportedMesh& mesh, size_t& numVertices, size_t& numTriangles)
+{
+	numVertices = numTriangles = 0;
+	for (const auto& subMesh : mesh.subMeshes)
+	{
+		numVertices  += subMesh.positions.size();
+		numTriangles += subMesh.indices.size() / 3;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Entry point
+//--------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	int repeats = (argc > 1) ? std::max(1, std::atoi(argv[1])) : DEFAULT_REPEATS;
+
+	std::vector<std::string> files;
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA("*.x", &found);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))  files.push_back(found.cFileName);
+		} while (FindNextFileA(find, &found));
+		FindClose(find);
+	}
+	if (files.empty())
+	{
+		std::printf("No .x files found, run from the app's folder\n");
+		return 1;
+	}
+
+	std::printf("%-20s %10s %9s %9s   %10s %9s %9s   %7s\n", "File", "Parser ms", "Vertices", "Triangles",
+	            "Assimp ms", "Vertices", "Triangles", "Speedup");
+
+	Timer timer;
+	float totalParserTime = 0, totalAssimpTime = 0;
+	for (auto& file : files)
+	{
+		float parserTime = 1e9f, assimpTime = 1e9f;
+		ImportedMesh parsed, imported;
+		std::string error;
+		for (int repeat = 0; repeat < repeats; ++repeat)
+		{
+			parsed = ImportedMesh();
+			timer.GetLapTime();
+			try
+			{
+				ImportMeshWithXFileParser(file, false, parsed);
+			}
+			catch (const std::runtime_error& e)
+			{
+				error = std::string("Parser failed: ") + e.what();
+				break;
+			}
+			parserTime = std::min(parserTime, timer.GetLapTime());
+		}
+		for (int repeat = 0; repeat < repeats && error.empty(); ++repeat)
+		{
+			imported = ImportedMesh();
+			timer.GetLapTime();
+			try
+			{
+				ImportMeshWithAssimp(file, false, imported);
+			}
+			catch (const std::runtime_error& e)
+			{
+				error = std::string("Assimp failed: ") + e.what();
+				break;
+			}
+			assimpTime = std::min(assimpTime, timer.GetLapTime());
+		}
+		if (!error.empty())
+		{
+			std::printf("%-20s %s\n", file.c_str(), error.c_str());
+			continue;
+		}
+
+		size_t parsedVertices, parsedTriangles, importedVertices, importedTriangles;
+		CountGeometry(parsed,   parsedVertices,   parsedTriangles);
+		CountGeometry(imported, importedVertices, importedTriangles);
+		std::printf("%-20s %10.3f %9zu %9zu   %10.3f %9zu %9zu   %6.1fx\n", file.c_str(),
+		            parserTime * 1000, parsedVertices, parsedTriangles,
+		            assimpTime * 1000, importedVertices, importedTriangles, assimpTime / parserTime);
+		totalParserTime += parserTime;
+		totalAssimpTime += assimpTime;
+	}
+
+	std::printf("%-20s %10.3f %9s %9s   %10.3f %9s %9s   %6.1fx\n", "Total", totalParserTime * 1000, "", "",
+	            totalAssimpTime * 1000, "", "", totalAssimpTime / totalParserTime);
+	return 0;
+}
@@ -0,0 +1,246 @@
+//--------------------------------------------------------------------------------------
+// Mesh import - read a mesh file into the geometry and node hierarchy used to build a Mesh
+//--------------------------------------------------------------------------------------
+
+#include "MeshImport.h"
+#include "XFileParser.h"   // .x files have their own parser
+#include "AssetIOSystem.h" // Assimp reads files through the file system
+#include "FileSystem.h"    // The .x parser reads files where the file system has them in memory
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/DefaultLogger.hpp>
+
+#include <stdexcept>
+#include <cctype>
+
+#define NOMINMAX // Stop Windows headers defining "min" and "max"
+#include <windows.h>
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+static bool IsXFile(const std::string& fileName)
+{
+	size_t length = fileName.size();
+	return length > 2 && fileName[length - 2] == '.' && std::tolower(static_cast<unsigned char>(fileName[length - 1])) == 'x';
+}
+
+
+// Count the number of nodes with given assimp node as root
+static unsigned int CountNodes(aiNode* assimpNode)
+{
+	unsigned int count = 1;
+	for (unsigned int child = 0; child < assimpNode->mNumChildren; ++child)
+		count += CountNodes(assimpNode->mChildren[child]);
+	return count;
+}
+
+
+// Copy the assimp node hierarchy into depth-first order - recursive. Returns one past the last node in the subtree
+static unsigned int ReadNodes(aiNode* assimpNode, unsigned int nodeIndex, unsigned int parentIndex, ImportedMesh& mesh)
+{
+	unsigned int thisIndex = nodeIndex;
+	++nodeIndex;
+
+	ImportedNode& node = mesh.nodes[thisIndex];
+	node.parent = parentIndex;
+	node.name = assimpNode->mName.C_Str();
+	node.matrix.SetValues(&assimpNode->mTransformation.a1);
+	node.matrix.Transpose(); // Assimp stores matrices differently to this app
+	node.subMeshes.assign(assimpNode->mMeshes, assimpNode->mMeshes + assimpNode->mNumMeshes);
+
+	// Children are stored immediately after this node, depth-first
+	for (unsigned int i = 0; i < assimpNode->mNumChildren; ++i)
+	{
+		nodeIndex = ReadNodes(assimpNode->mChildren[i], nodeIndex, thisIndex, mesh);
+	}
+
+	// Having read all the descendants, nodeIndex is now one past the end of this node's subtree
+	mesh.nodes[thisIndex].subtreeEnd = nodeIndex;
+	return nodeIndex;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Import
+//--------------------------------------------------------------------------------------
+
+// Read a mesh file, using the .x parser for .x files and assimp for everything else, or if the parser fails. Optionally
+// calculate tangents (for normal mapping). Will throw a std::runtime_error exception on failure
+void ImportMesh(const std::string& fileName, bool requireTangents, ImportedMesh& mesh)
+{
+	if (IsXFile(fileName))
+	{
+		try
+		{
+			ImportMeshWithXFileParser(fileName, requireTangents, mesh);
+			return;
+		}
+		catch (const std::runtime_error& e)
+		{
+			// Let assimp try, it reports its own error if it can't read the file either
+			OutputDebugStringA(("X file parser: " + std::string(e.what()) + ", using assimp\n").c_str());
+			mesh = ImportedMesh();
+		}
+	}
+	ImportMeshWithAssimp(fileName, requireTangents, mesh);
+}
+
+
+// Read a .x file with the .x parser only. Will throw a std::runtime_error exception on failure
+void ImportMeshWithXFileParser(const std::string& fileName, bool requireTangents, ImportedMesh& mesh)
+{
+	AssetFile file;
+	if (!file.Open(fileName))  throw std::runtime_error("Error loading mesh (" + fileName + "). Can't open file");
+
+	std::string error;
+	if (!ParseXFile(file.Data(), static_cast<size_t>(file.Size()), requireTangents, mesh, error))
+	{
+		throw std::runtime_error("Error loading mesh (" + fileName + "). " + error);
+	}
+}
+
+
+// Read a mesh file with assimp whatever its type. Will throw a std::runtime_error exception on failure
+void ImportMeshWithAssimp(const std::string& fileName, bool requireTangents, ImportedMesh& mesh)
+{
+	Assimp::Importer importer;
+	importer.SetIOHandler(new AssetIOSystem); // Read through the file system so meshes can come from a pack, the importer deletes it
+
+	// Flags for processing the mesh. Assimp provides a huge amount of control - right click any of these
+	// and "Peek Definition" to see documention above each constant
+	unsigned int assimpFlags = aiProcess_MakeLeftHanded |
+		aiProcess_GenSmoothNormals |
+		aiProcess_FixInfacingNormals |
+		aiProcess_GenUVCoords |
+		aiProcess_TransformUVCoords |
+		aiProcess_FlipUVs |
+		aiProcess_FlipWindingOrder |
+		aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_SortByPType |
+		aiProcess_FindInvalidData |
+		aiProcess_OptimizeMeshes |
+		aiProcess_FindInstances |
+		aiProcess_FindDegenerates |
+		aiProcess_RemoveRedundantMaterials |
+		aiProcess_Debone |
+		aiProcess_SplitByBoneCount |
+		aiProcess_LimitBoneWeights |
+		aiProcess_RemoveComponent;
+
+	// Flags to specify what mesh data to ignore
+	int removeComponents = aiComponent_LIGHTS | aiComponent_CAMERAS | aiComponent_TEXTURES | aiComponent_COLORS |
+		aiComponent_ANIMATIONS | aiComponent_MATERIALS;
+
+	// Add / remove tangents as required by user
+	if (requireTangents)
+	{
+		assimpFlags |= aiProcess_CalcTangentSpace;
+	}
+	else
+	{
+		removeComponents |= aiComponent_TANGENTS_AND_BITANGENTS;
+	}
+
+	// Other miscellaneous settings
+	importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 80.0f); // Smoothing angle for normals
+	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);  // Remove points and lines (keep triangles only)
+	importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);                 // Remove degenerate triangles
+	importer.SetPropertyBool(AI_CONFIG_PP_DB_ALL_OR_NONE, true);            // Default to removing bones/weights from meshes that don't need skinning
+
+	// Set maximum bones that can affect one vertex, and also maximum bones affecting a single mesh
+	unsigned int maxBonesPerVertex = 4; // The shaders support 4 bones per verted (null bones are added if necessary)
+	unsigned int maxBonesPerMesh = 256; // Bone indexes (local to each sub-mesh) are stored in a byte, so no more than 256
+	importer.SetPropertyInteger(AI_CONFIG_PP_LBW_MAX_WEIGHTS, maxBonesPerVertex);
+	importer.SetPropertyInteger(AI_CONFIG_PP_SBBC_MAX_BONES, maxBonesPerMesh);
+
+	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removeComponents);
+
+	// Import mesh with assimp given above requirements - log output
+	Assimp::DefaultLogger::create("", Assimp::DefaultLogger::VERBOSE);
+	const aiScene* scene = importer.ReadFile(fileName, assimpFlags);
+	Assimp::DefaultLogger::kill();
+	if (scene == nullptr)  throw std::runtime_error("Error loading mesh (" + fileName + "). " + importer.GetErrorString());
+	if (scene->mNumMeshes == 0)  throw std::runtime_error("No usable geometry in mesh: " + fileName);
+
+
+	//-----------------------------------
+
+	// Node hierarchy, each node has a matrix and contains sub-meshes
+	mesh.nodes.resize(CountNodes(scene->mRootNode));
+	ReadNodes(scene->mRootNode, 0, 0, mesh);
+
+
+	//-----------------------------------
+
+	// Geometry, one sub-mesh for each assimp mesh
+	mesh.subMeshes.resize(scene->mNumMeshes);
+	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+	{
+		aiMesh* assimpMesh = scene->mMeshes[m];
+		ImportedSubMesh& subMesh = mesh.subMeshes[m];
+		subMesh.name = assimpMesh->mName.C_Str();
+
+		// Check for presence of position and normal data. Tangents and UVs are optional.
+		if (!assimpMesh->HasPositions())  throw std::runtime_error("No position data for sub-mesh " + subMesh.name + " in " + fileName);
+		if (!assimpMesh->HasNormals())    throw std::runtime_error("No normal data for sub-mesh " + subMesh.name + " in " + fileName);
+		if (requireTangents && !assimpMesh->HasTangentsAndBitangents())
+		{
+			throw std::runtime_error("No tangent data for sub-mesh " + subMesh.name + " in " + fileName);
+		}
+		if (!assimpMesh->HasFaces())  throw std::runtime_error("No face data in " + subMesh.name + " in " + fileName);
+
+		const CVector3* positions = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
+		const CVector3* normals   = reinterpret_cast<CVector3*>(assimpMesh->mNormals);
+		subMesh.positions.assign(positions, positions + assimpMesh->mNumVertices);
+		subMesh.normals  .assign(normals,   normals   + assimpMesh->mNumVertices);
+		if (requireTangents)
+		{
+			const CVector3* tangents = reinterpret_cast<CVector3*>(assimpMesh->mTangents);
+			subMesh.tangents.assign(tangents, tangents + assimpMesh->mNumVertices);
+		}
+
+		if (assimpMesh->GetNumUVChannels() > 0 && assimpMesh->HasTextureCoords(0))
+		{
+			if (assimpMesh->mNumUVComponents[0] != 2)  throw std::runtime_error("Unsupported texture coordinates in " + subMesh.name + " in " + fileName);
+			subMesh.uvs.resize(assimpMesh->mNumVertices);
+			for (unsigned int v = 0; v < assimpMesh->mNumVertices; ++v)
+			{
+				const aiVector3D& assimpUV = assimpMesh->mTextureCoords[0][v];
+				subMesh.uvs[v] = CVector2(assimpUV.x, assimpUV.y);
+			}
+		}
+
+		// Faces are all triangles after the processing above
+		subMesh.indices.resize(assimpMesh->mNumFaces * 3);
+		uint32_t* index = subMesh.indices.data();
+		for (unsigned int face = 0; face < assimpMesh->mNumFaces; ++face)
+		{
+			*index++ = assimpMesh->mFaces[face].mIndices[0];
+			*index++ = assimpMesh->mFaces[face].mIndices[1];
+			*index++ = assimpMesh->mFaces[face].mIndices[2];
+		}
+
+		subMesh.bones.resize(assimpMesh->mNumBones);
+		for (unsigned int i = 0; i < assimpMesh->mNumBones; ++i)
+		{
+			aiBone* assimpBone = assimpMesh->mBones[i];
+			ImportedBone& bone = subMesh.bones[i];
+			bone.name = assimpBone->mName.C_Str();
+			bone.offsetMatrix.SetValues(&assimpBone->mOffsetMatrix.a1);
+			bone.offsetMatrix.Transpose(); // Assimp stores matrices differently to this app
+			bone.vertices.resize(assimpBone->mNumWeights);
+			bone.weights .resize(assimpBone->mNumWeights);
+			for (unsigned int j = 0; j < assimpBone->mNumWeights; ++j)
+			{
+				bone.vertices[j] = assimpBone->mWeights[j].mVertexId;
+				bone.weights [j] = assimpBone->mWeights[j].mWeight;
+			}
+		}
+	}
+}
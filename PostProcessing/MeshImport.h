@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------------------------
+// Mesh import - read a mesh file into the geometry and node hierarchy used to build a Mesh
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// DirectX .x files, which is every mesh the app ships, are read by a dedicated parser (see XFileParser.h). Other file
+// types are read by assimp (http://www.assimp.org/), as are .x files the parser can't handle (e.g. compressed ones).
+// Both produce the same result, so the Mesh class builds its GPU data the same way whichever reader was used.
+//
+// The geometry is ready to use: triangle lists in the app's left-handed space, with one set of UVs, at most 4 bone
+// influences per vertex and at most 256 bones per sub-mesh. Lights, cameras, materials and animations are not read.
+
+#ifndef _MESH_IMPORT_H_INCLUDED_
+#define _MESH_IMPORT_H_INCLUDED_
+
+#include "CMatrix4x4.h"
+#include "CVector3.h"
+#include "CVector2.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+// A bone influencing a sub-mesh, found in the hierarchy by name
+struct ImportedBone
+{
+	std::string           name;
+	CMatrix4x4            offsetMatrix; // Transform from the skinned mesh's origin to the bone's
+	std::vector<uint32_t> vertices;     // Vertices influenced by the bone, and the weight of the influence on each
+	std::vector<float>    weights;
+};
+
+// Geometry for one sub-mesh
+struct ImportedSubMesh
+{
+	std::string               name;
+	std::vector<CVector3>     positions;
+	std::vector<CVector3>     normals;
+	std::vector<CVector3>     tangents; // Empty unless tangents were requested
+	std::vector<CVector2>     uvs;      // Empty if the sub-mesh has no texture coordinates
+	std::vector<uint32_t>     indices;  // Triangle list
+	std::vector<ImportedBone> bones;    // Empty for sub-meshes without skinning
+};
+
+// A node in the hierarchy. Nodes are in depth-first order with the root first, so a node's descendants immediately
+// follow it
+struct ImportedNode
+{
+	std::string               name;
+	unsigned int              parent;        // Root refers to itself (0)
+	unsigned int              subtreeEnd;    // One past the last descendant
+	CMatrix4x4                matrix;        // Relative to parent
+	std::vector<unsigned int> subMeshes;     // Indexes into ImportedMesh::subMeshes
+};
+
+struct ImportedMesh
+{
+	std::vector<ImportedNode>    nodes;
+	std::vector<ImportedSubMesh> subMeshes;
+};
+
+
+// Read a mesh file, using the .x parser for .x files and assimp for everything else, or if the parser fails. Optionally
+// calculate tangents (for normal mapping). Will throw a std::runtime_error exception on failure
+void ImportMesh(const std::string& fileName, bool requireTangents, ImportedMesh& mesh);
+
+// Read a .x file with the .x parser only. Will throw a std::runtime_error exception on failure
+void ImportMeshWithXFileParser(const std::string& fileName, bool requireTangents, ImportedMesh& mesh);
+
+// Read a mesh file with assimp whatever its type. Will throw a std::runtime_error exception on failure
+void ImportMeshWithAssimp(const std::string& fileName, bool requireTangents, ImportedMesh& mesh);
+
+
+#endif //_MESH_IMPORT_H_INCLUDED_
@@ -0,0 +1,304 @@
+//--------------------------------------------------------------------------------------
+// Mesh optimisation - triangle and vertex order for faster rendering
+//--------------------------------------------------------------------------------------
+
+#include "MeshOptimiser.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+// Memory cache used when measuring vertex fetch: lines of this many bytes, holding this many lines
+const unsigned int FETCH_CACHE_LINE_SIZE = 64;
+const unsigned int FETCH_CACHE_LINES     = 128;
+
+// The overdraw optimisation splits the cache optimised order into clusters wherever a cluster started with an empty
+// cache has reached an ACMR within this factor of the whole mesh's ACMR. Larger values give more, smaller clusters to
+// reorder, at the cost of more vertex shader runs
+const float OVERDRAW_ACMR_THRESHOLD = 1.05f;
+
+
+// The post-transform cache is simulated as a FIFO with timestamps. A vertex is in the cache if it was added in the last
+// VERTEX_CACHE_SIZE additions. Timestamps start at 0 and the clock starts beyond the cache size, so every vertex starts
+// outside the cache. Returns true if the vertex was a miss (and adds it to the cache)
+static bool CacheMiss(std::vector<uint32_t>& cacheTimes, unsigned int& time, uint32_t vertex)
+{
+	if (time - cacheTimes[vertex] <= VERTEX_CACHE_SIZE)  return false;
+	cacheTimes[vertex] = time++;
+	return true;
+}
+
+
+// Triangles using each vertex: triangles[triangleStarts[v]] to triangles[triangleStarts[v + 1] - 1]
+static void BuildVertexTriangles(const uint32_t* indices, unsigned int numIndices, unsigned int numVertices,
+                                 std::vector<uint32_t>& triangleStarts, std::vector<uint32_t>& triangles)
+{
+	triangleStarts.assign(numVertices + 1, 0);
+	triangles.resize(numIndices);
+	for (unsigned int i = 0; i < numIndices; ++i)  ++triangleStarts[indices[i] + 1];
+	for (unsigned int v = 0; v < numVertices; ++v)  triangleStarts[v + 1] += triangleStarts[v];
+	for (unsigned int i = 0; i < numIndices; ++i)  triangles[triangleStarts[indices[i]]++] = i / 3;
+	for (unsigned int v = numVertices; v > 0; --v)  triangleStarts[v] = triangleStarts[v - 1];
+	triangleStarts[0] = 0;
+}
+
+
+// Measure a triangle list drawn from vertices of the given size (bytes) with the vertex caches
+IndexOrderStats AnalyseIndexOrder(const uint32_t* indices, unsigned int numIndices, unsigned int numVertices,
+                                  unsigned int vertexSize)
+{
+	IndexOrderStats stats;
+	stats.numTriangles = numIndices / 3;
+
+	std::vector<uint32_t> cacheTimes(numVertices, 0);
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+
+	// Vertex fetch only happens on a post-transform cache miss. The memory cache is simulated as a FIFO in the same way
+	unsigned int numLines = (numVertices * vertexSize + FETCH_CACHE_LINE_SIZE - 1) / FETCH_CACHE_LINE_SIZE;
+	std::vector<uint32_t> lineTimes(numLines, 0);
+	unsigned int lineTime = FETCH_CACHE_LINES + 1;
+
+	std::vector<uint8_t> used(numVertices, 0);
+	for (unsigned int i = 0; i < stats.numTriangles * 3; ++i)
+	{
+		uint32_t vertex = indices[i];
+		if (!used[vertex])
+		{
+			used[vertex] = 1;
+			++stats.numVertices;
+		}
+
+		if (!CacheMiss(cacheTimes, time, vertex))  continue;
+		++stats.numVertexShaderRuns;
+		if (vertexSize == 0)  continue;
+
+		unsigned int firstLine = vertex * vertexSize / FETCH_CACHE_LINE_SIZE;
+		unsigned int lastLine  = (vertex * vertexSize + vertexSize - 1) / FETCH_CACHE_LINE_SIZE;
+		for (unsigned int line = firstLine; line <= lastLine; ++line)
+		{
+			if (lineTime - lineTimes[line] > FETCH_CACHE_LINES)
+			{
+				lineTimes[line] = lineTime++;
+				stats.numBytesFetched += FETCH_CACHE_LINE_SIZE;
+			}
+		}
+	}
+	stats.numVertexBytes = stats.numVertices * vertexSize;
+
+	return stats;
+}
+
+
+// Reorder the triangles of a triangle list in place for the post-transform cache. Tipsify works through the mesh in
+// fans: it outputs all the remaining triangles around one vertex, then picks the next fan vertex from the vertices just
+// output, preferring one that is still in the cache and will stay there while its own fan is output. When no such
+// vertex is left (a dead end) it backtracks through recently used vertices, then takes the next vertex in index order
+void OptimiseVertexCache(uint32_t* indices, unsigned int numIndices, unsigned int numVertices)
+{
+	unsigned int numTriangles = numIndices / 3;
+	if (numTriangles == 0)  return;
+
+	std::vector<uint32_t> triangleStarts, triangles;
+	BuildVertexTriangles(indices, numTriangles * 3, numVertices, triangleStarts, triangles);
+
+	// Number of triangles not yet output around each vertex
+	std::vector<uint32_t> liveTriangles(numVertices);
+	for (unsigned int v = 0; v < numVertices; ++v)  liveTriangles[v] = triangleStarts[v + 1] - triangleStarts[v];
+
+	std::vector<uint32_t> cacheTimes(numVertices, 0);
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+
+	std::vector<uint8_t>  emitted(numTriangles, 0);
+	std::vector<uint32_t> deadEnds;   // Vertices output so far, most recent last, for backtracking
+	std::vector<uint32_t> candidates; // Vertices of the current fan
+	std::vector<uint32_t> result;
+	deadEnds.reserve(numTriangles * 3);
+	result.reserve(numTriangles * 3);
+
+	unsigned int nextVertex = 0; // All vertices before this one have no triangles left
+	uint32_t fan = indices[0];
+	while (fan != UINT32_MAX)
+	{
+		// Output the remaining triangles around the fan vertex, in the order they were given
+		candidates.clear();
+		for (unsigned int i = triangleStarts[fan]; i < triangleStarts[fan + 1]; ++i)
+		{
+			uint32_t t = triangles[i];
+			if (emitted[t])  continue;
+			emitted[t] = 1;
+
+			for (unsigned int corner = 0; corner < 3; ++corner)
+			{
+				uint32_t vertex = indices[t * 3 + corner];
+				result.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				--liveTriangles[vertex];
+				CacheMiss(cacheTimes, time, vertex);
+			}
+		}
+
+		// Next fan: the candidate that has been in the cache longest but will still be in it after its remaining triangles
+		// are output (each triangle adds at most two new vertices). Candidates that would drop out have priority 0
+		fan = UINT32_MAX;
+		int bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)  continue;
+
+			int priority = 0;
+			unsigned int age = time - cacheTimes[vertex];
+			if (age + 2 * liveTriangles[vertex] <= VERTEX_CACHE_SIZE)  priority = static_cast<int>(age);
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fan = vertex;
+			}
+		}
+
+		// Dead end, backtrack or move on to the next vertex with triangles left
+		while (fan == UINT32_MAX && !deadEnds.empty())
+		{
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0)  fan = vertex;
+		}
+		while (fan == UINT32_MAX && nextVertex < numVertices)
+		{
+			if (liveTriangles[nextVertex] > 0)  fan = nextVertex;
+			++nextVertex;
+		}
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+
+// Reorder the clusters of a triangle list already optimised with OptimiseVertexCache, outward facing clusters first.
+// Clusters start where the order jumps to an unconnected part of the mesh (all three vertices of a triangle miss the
+// cache), and are split further once their own ACMR is close to the mesh's. Clusters are sorted by how far they are in
+// front of the mesh's centre along their average normal, so those on the outside facing out are drawn first
+void OptimiseOverdraw(const CVector3* positions, unsigned int numVertices, uint32_t* indices, unsigned int numIndices)
+{
+	unsigned int numTriangles = numIndices / 3;
+	if (numTriangles == 0)  return;
+
+	float targetACMR = AnalyseIndexOrder(indices, numTriangles * 3, numVertices, 0).ACMR() * OVERDRAW_ACMR_THRESHOLD;
+
+	// Find the cluster boundaries. The cache is emptied at each boundary so each cluster's ACMR is measured as if it was
+	// drawn on its own
+	std::vector<uint32_t> clusterStarts; // First triangle of each cluster
+	std::vector<uint32_t> cacheTimes(numVertices, 0);
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+	unsigned int clusterMisses = 0;
+	unsigned int clusterTriangles = 0;
+	for (unsigned int t = 0; t < numTriangles; ++t)
+	{
+		unsigned int misses = 0;
+		for (unsigned int corner = 0; corner < 3; ++corner)
+		{
+			if (CacheMiss(cacheTimes, time, indices[t * 3 + corner]))  ++misses;
+		}
+
+		if (clusterTriangles == 0 || misses == 3)
+		{
+			clusterStarts.push_back(t);
+			clusterMisses = 0;
+			clusterTriangles = 0;
+		}
+		clusterMisses += misses;
+		++clusterTriangles;
+
+		if (clusterMisses <= targetACMR * clusterTriangles)
+		{
+			clusterTriangles = 0;
+			time += VERTEX_CACHE_SIZE + 1; // Empty the cache
+		}
+	}
+	clusterStarts.push_back(numTriangles);
+	unsigned int numClusters = static_cast<unsigned int>(clusterStarts.size()) - 1;
+	if (numClusters < 2)  return;
+
+	// Centre of the mesh, the average of the triangle centres weighted by area
+	std::vector<CVector3> clusterCentres(numClusters, { 0, 0, 0 }); // Area weighted sum of triangle centres
+	std::vector<CVector3> clusterNormals(numClusters, { 0, 0, 0 }); // Area weighted sum of triangle normals
+	std::vector<float>    clusterAreas(numClusters, 0);
+	CVector3 meshCentre = { 0, 0, 0 };
+	float    meshArea = 0;
+	for (unsigned int c = 0; c < numClusters; ++c)
+	{
+		for (unsigned int t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+		{
+			const CVector3& p0 = positions[indices[t * 3]];
+			const CVector3& p1 = positions[indices[t * 3 + 1]];
+			const CVector3& p2 = positions[indices[t * 3 + 2]];
+			CVector3 normal = Cross(p1 - p0, p2 - p0);
+			float area = Length(normal);
+			clusterCentres[c] = clusterCentres[c] + (p0 + p1 + p2) * (area / 3);
+			clusterNormals[c] = clusterNormals[c] + normal;
+			clusterAreas[c] += area;
+		}
+		meshCentre = meshCentre + clusterCentres[c];
+		meshArea += clusterAreas[c];
+	}
+	if (meshArea <= 0)  return;
+	meshCentre = meshCentre * (1.0f / meshArea);
+
+	std::vector<float>    sortKeys(numClusters, 0);
+	std::vector<uint32_t> order(numClusters);
+	for (unsigned int c = 0; c < numClusters; ++c)
+	{
+		order[c] = c;
+		float normalLength = Length(clusterNormals[c]);
+		if (clusterAreas[c] <= 0 || normalLength <= 0)  continue;
+		CVector3 centre = clusterCentres[c] * (1.0f / clusterAreas[c]);
+		sortKeys[c] = Dot(centre - meshCentre, clusterNormals[c]) / normalLength;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(numTriangles * 3);
+	for (uint32_t c : order)
+	{
+		result.insert(result.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+	}
+	std::copy(result.begin(), result.end(), indices);
+}
+
+
+// Find a new order for the vertices, the order the triangles first use them. On return remap[v] is the new position of
+// vertex v, or ~0 if no triangle uses it. Returns the number of vertices used
+unsigned int OptimiseVertexFetchRemap(uint32_t* remap, const uint32_t* indices, unsigned int numIndices,
+                                      unsigned int numVertices)
+{
+	std::fill(remap, remap + numVertices, UINT32_MAX);
+
+	uint32_t nextVertex = 0;
+	for (unsigned int i = 0; i < numIndices; ++i)
+	{
+		if (remap[indices[i]] == UINT32_MAX)  remap[indices[i]] = nextVertex++;
+	}
+	return nextVertex;
+}
+
+
+// Change a triangle list to use vertices reordered by OptimiseVertexFetchRemap
+void RemapIndices(uint32_t* indices, unsigned int numIndices, const uint32_t* remap)
+{
+	for (unsigned int i = 0; i < numIndices; ++i)  indices[i] = remap[indices[i]];
+}
+
+
+// Copy vertices of the given size (bytes) into their new order from OptimiseVertexFetchRemap, unused vertices are dropped
+void RemapVertices(void* destination, const void* vertices, unsigned int numVertices, unsigned int vertexSize,
+                   const uint32_t* remap)
+{
+	unsigned char*       destinationBytes = static_cast<unsigned char*>(destination);
+	const unsigned char* vertexBytes      = static_cast<const unsigned char*>(vertices);
+	for (unsigned int v = 0; v < numVertices; ++v)
+	{
+		if (remap[v] != UINT32_MAX)  memcpy(destinationBytes + remap[v] * vertexSize, vertexBytes + v * vertexSize, vertexSize);
+	}
+}
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// Mesh optimisation - triangle and vertex order for faster rendering
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The order of a mesh's triangles and vertices doesn't change what is drawn, but it changes how much work the GPU does:
+// - The GPU keeps the results of the vertex shader for the last few vertices it processed (the post-transform cache).
+//   Triangles that reuse recent vertices don't run the vertex shader again. The vertex cache optimisation reorders
+//   triangles for the most reuse, using Tipsify (Sander, Nehab & Barczak, "Fast triangle reordering for vertex locality
+//   and reduced overdraw", 2007)
+// - Tipsify's order is made of clusters, it jumps to a new part of the mesh when it runs out of nearby triangles. The
+//   overdraw optimisation reorders whole clusters so the ones facing outwards from the middle of the mesh come first,
+//   as they tend to hide the others. Reordering whole clusters keeps almost all of the cache reuse
+// - Vertices are read from memory in cache lines. The vertex fetch optimisation reorders the vertices into the order the
+//   triangles first use them, so nearby triangles read nearby memory
+//
+// The quality of an order is measured as:
+// - ACMR (average cache miss ratio): vertex shader runs per triangle. 3 is the worst, about 0.5-0.7 is typical of a
+//   good order for a closed mesh
+// - ATVR (average transform to vertex ratio): vertex shader runs per vertex. 1 is the best possible
+// - Overfetch: bytes read from the vertex buffer per byte of vertices used. 1 is the best possible
+
+#ifndef _MESH_OPTIMISER_H_INCLUDED_
+#define _MESH_OPTIMISER_H_INCLUDED_
+
+#include "CVector3.h"
+
+#include <stdint.h>
+
+
+// Size of the post-transform cache assumed when optimising and measuring. Real GPUs vary, an order that is good for
+// one cache size is good for most
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+
+// Measurements of how well a triangle list uses the vertex caches. Statistics for several meshes can be added together
+struct IndexOrderStats
+{
+	unsigned int numTriangles        = 0;
+	unsigned int numVertices         = 0; // Vertices used by the triangles
+	unsigned int numVertexShaderRuns = 0; // Post-transform cache misses
+	unsigned int numVertexBytes      = 0; // Size of the vertices used
+	unsigned int numBytesFetched     = 0; // Bytes read from memory by the vertex fetch, in whole cache lines
+
+	float ACMR()       const { return numTriangles   > 0 ? static_cast<float>(numVertexShaderRuns) / numTriangles   : 0.0f; }
+	float ATVR()       const { return numVertices    > 0 ? static_cast<float>(numVertexShaderRuns) / numVertices    : 0.0f; }
+	float Overfetch()  const { return numVertexBytes > 0 ? static_cast<float>(numBytesFetched)     / numVertexBytes : 0.0f; }
+
+	void Add(const IndexOrderStats& stats)
+	{
+		numTriangles        += stats.numTriangles;
+		numVertices         += stats.numVertices;
+		numVertexShaderRuns += stats.numVertexShaderRuns;
+		numVertexBytes      += stats.numVertexBytes;
+		numBytesFetched     += stats.numBytesFetched;
+	}
+};
+
+
+// Measure a triangle list drawn from vertices of the given size (bytes) with the vertex caches
+IndexOrderStats AnalyseIndexOrder(const uint32_t* indices, unsigned int numIndices, unsigned int numVertices,
+                                  unsigned int vertexSize);
+
+
+// Reorder the triangles of a triangle list in place for the post-transform cache
+void OptimiseVertexCache(uint32_t* indices, unsigned int numIndices, unsigned int numVertices);
+
+// Reorder the clusters of a triangle list already optimised with OptimiseVertexCache, outward facing clusters first
+void OptimiseOverdraw(const CVector3* positions, unsigned int numVertices, uint32_t* indices, unsigned int numIndices);
+
+
+// Find a new order for the vertices, the order the triangles first use them. remap must have space for numVertices,
+// on return remap[v] is the new position of vertex v, or ~0 if no triangle uses it. Returns the number of vertices used
+// Apply the result with RemapIndices and RemapVertices
+unsigned int OptimiseVertexFetchRemap(uint32_t* remap, const uint32_t* indices, unsigned int numIndices,
+                                      unsigned int numVertices);
+
+// Change a triangle list to use vertices reordered by OptimiseVertexFetchRemap
+void RemapIndices(uint32_t* indices, unsigned int numIndices, const uint32_t* remap);
+
+// Copy vertices of the given size (bytes) into their new order from OptimiseVertexFetchRemap, unused vertices are dropped
+// The destination must not overlap the source
+void RemapVertices(void* destination, const void* vertices, unsigned int numVertices, unsigned int vertexSize,
+                   const uint32_t* remap);
+
+
+#endif //_MESH_OPTIMISER_H_INCLUDED_
@@ -0,0 +1,390 @@
+//--------------------------------------------------------------------------------------
+// Mesh simplification - reduce the triangle count of a mesh for distant levels of detail
+//--------------------------------------------------------------------------------------
+
+#include "MeshSimplifier.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+
+// Open edges get extra error for moving away from them, scaled by this. Higher values keep borders more exact at the
+// expense of the rest of the mesh
+const float BORDER_WEIGHT = 10.0f;
+
+// A pass collapses the cheapest edges in the mesh but stops at edges costing more than this multiple of the cost of
+// the edge that would just reach the target. Without it, a pass where many cheap edges are blocked (they share a vertex
+// with an earlier collapse) would go on to collapse much more expensive ones
+const float PASS_COST_LIMIT = 1.5f;
+
+
+// How a vertex position can be moved, decided before simplifying
+enum class VertexKind : uint8_t
+{
+	Free,   // Inside the surface, or on a seam. Can collapse onto any neighbour (seams are checked when collapsing)
+	Border, // On an open edge. Can only collapse along the edge
+	Locked, // Corners, vertices shared by more than two seams, non-manifold vertices etc. Never moves
+};
+
+
+// Quadric for the error metric. The error at a point p is p.A.p + 2 b.p + c, where A is a symmetric 3x3 matrix.
+// Doubles are used since errors are sums of many squared terms. Weight is the total area of triangles in the quadric,
+// used to turn the error into an average squared distance
+struct Quadric
+{
+	double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double weight = 0;
+};
+
+
+// Quadric for squared distance to the plane n.p + d = 0 (n must be unit length), scaled by weight
+static Quadric PlaneQuadric(const CVector3& n, float d, float weight)
+{
+	Quadric q;
+	q.a00 = weight * n.x * n.x;  q.a01 = weight * n.x * n.y;  q.a02 = weight * n.x * n.z;
+	q.a11 = weight * n.y * n.y;  q.a12 = weight * n.y * n.z;  q.a22 = weight * n.z * n.z;
+	q.b0  = weight * n.x * d;    q.b1  = weight * n.y * d;    q.b2  = weight * n.z * d;
+	q.c   = weight * d * d;
+	q.weight = weight;
+	return q;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& r)
+{
+	q.a00 += r.a00;  q.a01 += r.a01;  q.a02 += r.a02;
+	q.a11 += r.a11;  q.a12 += r.a12;  q.a22 += r.a22;
+	q.b0  += r.b0;   q.b1  += r.b1;   q.b2  += r.b2;
+	q.c   += r.c;
+	q.weight += r.weight;
+}
+
+// Squared distance error of moving the point(s) in the sum of the two quadrics to p, averaged over their area
+static float CollapseError(const Quadric& q, const Quadric& r, const CVector3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double a00 = q.a00 + r.a00, a01 = q.a01 + r.a01, a02 = q.a02 + r.a02;
+	double a11 = q.a11 + r.a11, a12 = q.a12 + r.a12, a22 = q.a22 + r.a22;
+	double error = x * (a00 * x + 2 * (a01 * y + a02 * z + q.b0 + r.b0)) +
+	               y * (a11 * y + 2 * (a12 * z + q.b1 + r.b1)) +
+	               z * (a22 * z + 2 * (q.b2 + r.b2)) + q.c + r.c;
+	double weight = q.weight + r.weight;
+	return static_cast<float>(std::fabs(error) / (weight > 0 ? weight : 1));
+}
+
+
+// A possible collapse of one vertex position onto another
+struct Collapse
+{
+	float    cost;
+	uint32_t from;
+	uint32_t to;
+};
+
+static inline uint64_t EdgeKey(uint32_t a, uint32_t b)  { return (static_cast<uint64_t>(a) << 32) | b; }
+
+
+// Simplify a triangle list down to about the target number of indices (three per triangle). The result is written to
+// the given array, which must have space for numIndices, and the number of indices in the result is returned. The
+// result can have more indices than the target if the mesh can't be simplified that far (e.g. most vertices are on
+// seams or borders). The result refers to the same vertices as the original
+// Optionally returns the largest error of any collapse made, as an approximate distance from the original surface
+unsigned int SimplifyMesh(const CVector3* positions, unsigned int numVertices,
+                          const uint32_t* indices, unsigned int numIndices,
+                          unsigned int targetNumIndices, uint32_t* result, float* resultError /*= nullptr*/)
+{
+	std::memcpy(result, indices, numIndices * sizeof(uint32_t));
+	if (resultError)  *resultError = 0;
+	numIndices -= numIndices % 3;
+	if (numIndices <= targetNumIndices || numVertices == 0)  return numIndices;
+
+
+	//-----------------------------------
+	// Seams
+
+	// Vertices sharing a position are welded into a single point for the topology and error, the lowest vertex index
+	// stands for the point. Vertices sharing a position are also linked in a ring through wedgeNext so all copies of
+	// a point can be found (a copy of a vertex with different normals / UVs is often called a wedge)
+	std::vector<uint32_t> point    (numVertices);
+	std::vector<uint32_t> wedgeNext(numVertices);
+	std::vector<uint32_t> sorted   (numVertices);
+	for (uint32_t v = 0; v < numVertices; ++v)  sorted[v] = v;
+	auto positionLess = [&](uint32_t a, uint32_t b)
+	{
+		const CVector3& p = positions[a];
+		const CVector3& q = positions[b];
+		if (p.x != q.x)  return p.x < q.x;
+		if (p.y != q.y)  return p.y < q.y;
+		if (p.z != q.z)  return p.z < q.z;
+		return a < b;
+	};
+	std::sort(sorted.begin(), sorted.end(), positionLess);
+
+	std::vector<uint8_t> numWedges(numVertices, 0);
+	for (uint32_t i = 0; i < numVertices; )
+	{
+		uint32_t first = sorted[i];
+		uint32_t end = i + 1;
+		while (end < numVertices && positions[sorted[end]].x == positions[first].x &&
+		       positions[sorted[end]].y == positions[first].y && positions[sorted[end]].z == positions[first].z)  ++end;
+		for (uint32_t j = i; j < end; ++j)
+		{
+			point[sorted[j]] = first;
+			wedgeNext[sorted[j]] = sorted[j + 1 < end ? j + 1 : i];
+		}
+		numWedges[first] = static_cast<uint8_t>(std::min(end - i, 255u));
+		i = end;
+	}
+
+
+	//-----------------------------------
+	// Quadrics and vertex kinds
+
+	// Every triangle's plane is added to the quadrics of its corners, weighted by its area
+	std::vector<Quadric> quadrics(numVertices);
+	for (unsigned int i = 0; i < numIndices; i += 3)
+	{
+		uint32_t p0 = point[result[i]], p1 = point[result[i + 1]], p2 = point[result[i + 2]];
+		CVector3 normal = Cross(positions[p1] - positions[p0], positions[p2] - positions[p0]);
+		float length = Length(normal);
+		if (length == 0)  continue;
+
+		normal = normal * (1.0f / length);
+		Quadric q = PlaneQuadric(normal, -Dot(normal, positions[p0]), length * 0.5f);
+		AddQuadric(quadrics[p0], q);
+		AddQuadric(quadrics[p1], q);
+		AddQuadric(quadrics[p2], q);
+	}
+
+	// Directed edges between points. An edge without a matching edge in the opposite direction is an open edge (border).
+	// An edge used twice in the same direction is non-manifold (or the triangles have inconsistent winding)
+	std::vector<uint64_t> edges;
+	edges.reserve(numIndices);
+	auto collectEdges = [&](unsigned int count)
+	{
+		edges.clear();
+		for (unsigned int i = 0; i < count; i += 3)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				uint32_t a = point[result[i + corner]];
+				uint32_t b = point[result[i + (corner + 1) % 3]];
+				if (a != b)  edges.push_back(EdgeKey(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+	};
+	auto hasEdge = [&](uint32_t a, uint32_t b)  { return std::binary_search(edges.begin(), edges.end(), EdgeKey(a, b)); };
+
+	collectEdges(numIndices);
+	std::vector<VertexKind> kinds(numVertices, VertexKind::Free);
+	std::vector<uint8_t> numOpenEdges(numVertices, 0);
+	for (size_t i = 0; i < edges.size(); ++i)
+	{
+		uint32_t a = static_cast<uint32_t>(edges[i] >> 32), b = static_cast<uint32_t>(edges[i]);
+		if (i + 1 < edges.size() && edges[i + 1] == edges[i])
+		{
+			kinds[a] = kinds[b] = VertexKind::Locked;
+		}
+		else if (!hasEdge(b, a))
+		{
+			if (numOpenEdges[a] < 255)  ++numOpenEdges[a];
+			if (numOpenEdges[b] < 255)  ++numOpenEdges[b];
+		}
+	}
+	for (uint32_t v = 0; v < numVertices; ++v)
+	{
+		if (point[v] != v || kinds[v] == VertexKind::Locked)  continue;
+
+		// A border vertex lies on exactly two open edges and isn't also on a seam. Seam vertices can have at most two copies
+		if (numOpenEdges[v] == 0 && numWedges[v] <= 2)       kinds[v] = VertexKind::Free;
+		else if (numOpenEdges[v] == 2 && numWedges[v] == 1)  kinds[v] = VertexKind::Border;
+		else                                                 kinds[v] = VertexKind::Locked;
+	}
+
+	// Open edges also get a plane through the edge at right angles to its triangle, so moving away from the edge costs
+	for (unsigned int i = 0; i < numIndices; i += 3)
+	{
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			uint32_t a = point[result[i + corner]];
+			uint32_t b = point[result[i + (corner + 1) % 3]];
+			if (a == b || hasEdge(b, a))  continue;
+
+			uint32_t c = point[result[i + (corner + 2) % 3]];
+			CVector3 edge = positions[b] - positions[a];
+			CVector3 normal = Cross(edge, Cross(edge, positions[c] - positions[a]));
+			float length = Length(normal);
+			if (length == 0)  continue;
+
+			normal = normal * (1.0f / length);
+			Quadric q = PlaneQuadric(normal, -Dot(normal, positions[a]), Dot(edge, edge) * BORDER_WEIGHT);
+			q.weight = 0; // Doesn't add to the surface area
+			AddQuadric(quadrics[a], q);
+			AddQuadric(quadrics[b], q);
+		}
+	}
+
+
+	//-----------------------------------
+	// Collapse passes
+
+	std::vector<uint32_t> triangleStarts(numVertices + 1);
+	std::vector<uint32_t> triangles(numIndices);
+	std::vector<uint32_t> remap(numVertices);
+	std::vector<uint8_t>  touched(numVertices);
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> partners;
+	float maxError = 0;
+
+	// Get the corners of a triangle, taking the collapses made so far in this pass into account
+	auto getTriangle = [&](uint32_t triangle, uint32_t corners[3])
+	{
+		for (int i = 0; i < 3; ++i)  corners[i] = remap[result[triangle * 3 + i]];
+	};
+
+	// Find the copy of point "to" that each copy of point "from" will collapse onto, stored in partners (one entry per
+	// copy of "from" in ring order). Each copy must share a triangle with exactly one copy of "to", and different copies
+	// need different partners, otherwise the collapse would join up different sides of a seam
+	auto findPartners = [&](uint32_t from, uint32_t to)
+	{
+		partners.clear();
+		uint32_t wedge = from;
+		do
+		{
+			uint32_t partner = UINT32_MAX;
+			for (uint32_t t = triangleStarts[wedge]; t < triangleStarts[wedge + 1]; ++t)
+			{
+				uint32_t corners[3];
+				getTriangle(triangles[t], corners);
+				for (uint32_t corner : corners)
+				{
+					if (point[corner] != to)  continue;
+					if (partner != UINT32_MAX && partner != corner)  return false;
+					partner = corner;
+				}
+			}
+			if (partner == UINT32_MAX && triangleStarts[wedge] != triangleStarts[wedge + 1])  return false;
+			for (uint32_t other : partners)  if (other == partner && partner != UINT32_MAX)  return false;
+			partners.push_back(partner);
+
+			wedge = wedgeNext[wedge];
+		} while (wedge != from);
+		return true;
+	};
+
+	// Check if moving point "from" to point "to" would flip any triangle around "from" (triangles containing both will be
+	// removed so are ignored)
+	auto collapseFlips = [&](uint32_t from, uint32_t to)
+	{
+		uint32_t wedge = from;
+		do
+		{
+			for (uint32_t t = triangleStarts[wedge]; t < triangleStarts[wedge + 1]; ++t)
+			{
+				uint32_t corners[3];
+				getTriangle(triangles[t], corners);
+				uint32_t p[3] = { point[corners[0]], point[corners[1]], point[corners[2]] };
+				if (p[0] == to || p[1] == to || p[2] == to || p[0] == p[1] || p[1] == p[2] || p[2] == p[0])  continue;
+
+				CVector3 oldNormal = Cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+				for (int i = 0; i < 3; ++i)  if (p[i] == from)  p[i] = to;
+				CVector3 newNormal = Cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+				if (Dot(oldNormal, oldNormal) > 0 && Dot(oldNormal, newNormal) <= 0)  return true;
+			}
+			wedge = wedgeNext[wedge];
+		} while (wedge != from);
+		return false;
+	};
+
+	while (numIndices > targetNumIndices)
+	{
+		// Triangles around each vertex, for finding seams and flips
+		std::fill(triangleStarts.begin(), triangleStarts.end(), 0);
+		for (unsigned int i = 0; i < numIndices; ++i)  ++triangleStarts[result[i] + 1];
+		for (uint32_t v = 0; v < numVertices; ++v)  triangleStarts[v + 1] += triangleStarts[v];
+		for (unsigned int i = 0; i < numIndices; ++i)  triangles[triangleStarts[result[i]]++] = i / 3;
+		for (uint32_t v = numVertices; v > 0; --v)  triangleStarts[v] = triangleStarts[v - 1];
+		triangleStarts[0] = 0;
+
+		// Cost of every edge, collapsing in whichever allowed direction is cheapest. Each edge is seen from both of its
+		// triangles (or once if it is open), only the first is used
+		collectEdges(numIndices);
+		collapses.clear();
+		for (size_t i = 0; i < edges.size(); ++i)
+		{
+			if (i > 0 && edges[i] == edges[i - 1])  continue;
+			uint32_t a = static_cast<uint32_t>(edges[i] >> 32), b = static_cast<uint32_t>(edges[i]);
+			bool open = !hasEdge(b, a);
+			if (!open && a > b)  continue;
+
+			Collapse best = { 0, UINT32_MAX, UINT32_MAX };
+			for (int direction = 0; direction < 2; ++direction)
+			{
+				uint32_t from = direction ? b : a;
+				uint32_t to   = direction ? a : b;
+				if (kinds[from] == VertexKind::Locked || (kinds[from] == VertexKind::Border && !open))  continue;
+
+				float cost = CollapseError(quadrics[from], quadrics[to], positions[to]);
+				if (best.from == UINT32_MAX || cost < best.cost)  best = { cost, from, to };
+			}
+			if (best.from != UINT32_MAX)  collapses.push_back(best);
+		}
+		if (collapses.empty())  break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+		// Each collapse removes about two triangles. Don't go much past the target in a single pass. Collapses that turn
+		// out to be invalid move the cost limit on, so they don't hold back the pass (they are often the cheapest edges)
+		size_t goal = std::min<size_t>((numIndices - targetNumIndices) / 6 + 1, collapses.size());
+		size_t limitIndex = goal - 1;
+		float costLimit = collapses[limitIndex].cost * PASS_COST_LIMIT;
+
+		for (uint32_t v = 0; v < numVertices; ++v)  remap[v] = v;
+		std::fill(touched.begin(), touched.end(), 0);
+		size_t numCollapsed = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (numCollapsed >= goal || collapse.cost > costLimit)  break;
+			if (touched[collapse.from] || touched[collapse.to])  continue;
+			if (!findPartners(collapse.from, collapse.to) || collapseFlips(collapse.from, collapse.to))
+			{
+				if (limitIndex + 1 < collapses.size())  costLimit = collapses[++limitIndex].cost * PASS_COST_LIMIT;
+				continue;
+			}
+
+			// Move every copy of the point onto its partner
+			uint32_t wedge = collapse.from;
+			for (uint32_t partner : partners)
+			{
+				if (partner != UINT32_MAX)  remap[wedge] = partner;
+				wedge = wedgeNext[wedge];
+			}
+			AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			touched[collapse.from] = touched[collapse.to] = 1;
+			maxError = std::max(maxError, collapse.cost);
+			++numCollapsed;
+		}
+		if (numCollapsed == 0)  break;
+
+		// Apply the collapses and remove the triangles that have become degenerate
+		unsigned int newNumIndices = 0;
+		for (unsigned int i = 0; i < numIndices; i += 3)
+		{
+			uint32_t corners[3];
+			getTriangle(i / 3, corners);
+			uint32_t p0 = point[corners[0]], p1 = point[corners[1]], p2 = point[corners[2]];
+			if (p0 == p1 || p1 == p2 || p2 == p0)  continue;
+
+			result[newNumIndices++] = corners[0];
+			result[newNumIndices++] = corners[1];
+			result[newNumIndices++] = corners[2];
+		}
+		numIndices = newNumIndices;
+	}
+
+	if (resultError)  *resultError = std::sqrt(maxError);
+	return numIndices;
+}
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// Mesh simplification - reduce the triangle count of a mesh for distant levels of detail
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Uses the quadric error metric (Garland & Heckbert): every vertex gets a quadric that measures the sum of squared
+// distances to the planes of the triangles around it. Edges are collapsed one end onto the other, cheapest first, and
+// the quadrics of the two ends are added together so the error keeps measuring the distance to the original surface.
+//
+// - Only the index list changes: every edge collapse moves one vertex onto an existing vertex, so the simplified mesh
+//   uses the same vertex buffer as the original, and several levels of detail can share it
+// - Vertices with the same position but different normals or UVs (seams) are treated as one point. A seam vertex can
+//   only slide along its seam, with each copy of the vertex collapsing onto the copy on the same side of the seam
+// - Vertices on open edges can only slide along the edge, and open edges are given extra error so holes and
+//   silhouettes such as the edge of the ground keep their shape. Corners and more complex junctions never move
+// - A collapse that would flip any triangle over is rejected
+// - Collapses are done in passes. Each pass finds the cost of every edge, then collapses the cheapest edges that don't
+//   share a vertex with any other collapse in the pass. Passes stop when the target is reached or nothing can collapse
+
+#ifndef _MESH_SIMPLIFIER_H_INCLUDED_
+#define _MESH_SIMPLIFIER_H_INCLUDED_
+
+#include "CVector3.h"
+
+#include <stdint.h>
+
+
+// Simplify a triangle list down to about the target number of indices (three per triangle). The result is written to
+// the given array, which must have space for numIndices, and the number of indices in the result is returned. The
+// result can have more indices than the target if the mesh can't be simplified that far (e.g. most vertices are on
+// seams or borders). The result refers to the same vertices as the original
+// Optionally returns the largest error of any collapse made, as an approximate distance from the original surface
+unsigned int SimplifyMesh(const CVector3* positions, unsigned int numVertices,
+                          const uint32_t* indices, unsigned int numIndices,
+                          unsigned int targetNumIndices, uint32_t* result, float* resultError = nullptr);
+
+
+#endif //_MESH_SIMPLIFIER_H_INCLUDED_
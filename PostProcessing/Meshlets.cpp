@@ -0,0 +1,282 @@
+//--------------------------------------------------------------------------------------
+// Meshlets - small clusters of triangles that can be culled separately
+//--------------------------------------------------------------------------------------
+
+#include "Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// When growing a meshlet, each new vertex a triangle needs costs 1, and a triangle facing a different way to the
+// meshlet costs up to twice this (facing the opposite way). Higher values give narrower cones but more meshlets
+const float CONE_WEIGHT = 0.5f;
+
+// When no triangle touching a meshlet fits (e.g. the mesh is in separate pieces), the nearest of this many unused
+// triangles is added instead, so meshes made of many small pieces don't give many tiny meshlets. Only triangles facing
+// close to the meshlet's direction are added this way (dot product of normals at least the given value), so the normal
+// cone stays narrow enough to cull
+const unsigned int NEAREST_SEARCH_LIMIT = 1024;
+const float        NEAREST_MIN_NORMAL_DOT = 0.7f;
+
+
+// Split a triangle list into meshlets. The triangles are reordered in place so each meshlet's triangles are together.
+// The new meshlets are added to the given vector, with index ranges relative to the start of the given indices
+void BuildMeshlets(const CVector3* positions, unsigned int numVertices, uint32_t* indices, unsigned int numIndices,
+                   std::vector<Meshlet>& meshlets)
+{
+	unsigned int numTriangles = numIndices / 3;
+	if (numTriangles == 0)  return;
+
+	// Unit normal of each triangle (zero for degenerate triangles)
+	std::vector<CVector3> normals(numTriangles);
+	for (unsigned int t = 0; t < numTriangles; ++t)
+	{
+		const CVector3& p0 = positions[indices[t * 3]];
+		CVector3 normal = Cross(positions[indices[t * 3 + 1]] - p0, positions[indices[t * 3 + 2]] - p0);
+		float length = Length(normal);
+		normals[t] = (length > 0) ? normal * (1.0f / length) : CVector3{ 0, 0, 0 };
+	}
+
+	// Triangles using each vertex: triangles[triangleStarts[v]] to triangles[triangleStarts[v + 1] - 1]
+	std::vector<uint32_t> triangleStarts(numVertices + 1, 0);
+	std::vector<uint32_t> triangles(numTriangles * 3);
+	for (unsigned int i = 0; i < numTriangles * 3; ++i)  ++triangleStarts[indices[i] + 1];
+	for (unsigned int v = 0; v < numVertices; ++v)  triangleStarts[v + 1] += triangleStarts[v];
+	for (unsigned int i = 0; i < numTriangles * 3; ++i)  triangles[triangleStarts[indices[i]]++] = i / 3;
+	for (unsigned int v = numVertices; v > 0; --v)  triangleStarts[v] = triangleStarts[v - 1];
+	triangleStarts[0] = 0;
+
+
+	std::vector<uint8_t>  used(numTriangles, 0);
+	std::vector<uint32_t> vertexMeshlet(numVertices, UINT32_MAX); // Last meshlet each vertex was added to
+	std::vector<uint32_t> reordered;
+	reordered.reserve(numTriangles * 3);
+
+	uint32_t     meshletVertices[MAX_MESHLET_VERTICES];
+	unsigned int numMeshletVertices = 0;
+	uint32_t     meshletTriangles[MAX_MESHLET_TRIANGLES];
+	unsigned int numMeshletTriangles = 0;
+	CVector3     normalSum = { 0, 0, 0 };
+	CVector3     positionSum = { 0, 0, 0 }; // Of the meshlet's vertices
+	uint32_t     meshletId = static_cast<uint32_t>(meshlets.size());
+	unsigned int nextUnused = 0; // All triangles before this one are used
+
+	// Number of vertices a triangle would add to the current meshlet
+	auto newVertices = [&](uint32_t t)
+	{
+		return (vertexMeshlet[indices[t * 3]]     != meshletId ? 1u : 0u) +
+		       (vertexMeshlet[indices[t * 3 + 1]] != meshletId ? 1u : 0u) +
+		       (vertexMeshlet[indices[t * 3 + 2]] != meshletId ? 1u : 0u);
+	};
+
+	// Add the current meshlet to the list with its bounds and cone, and start a new empty one
+	auto finishMeshlet = [&]()
+	{
+		Meshlet meshlet;
+		meshlet.firstIndex = static_cast<uint32_t>(reordered.size());
+		meshlet.numIndices = numMeshletTriangles * 3;
+
+		CVector3 points[MAX_MESHLET_VERTICES];
+		AABB box;
+		for (unsigned int i = 0; i < numMeshletVertices; ++i)
+		{
+			points[i] = positions[meshletVertices[i]];
+			box.Add(points[i]);
+		}
+		BoundingSphere sphere = BoundingSphereFromPoints(points, numMeshletVertices, sizeof(CVector3), box);
+		meshlet.centre = sphere.centre;
+		meshlet.radius = sphere.radius;
+
+		// The cone axis is the average normal, and the spread is the largest angle between it and any triangle normal.
+		// The cutoff is the sine of the spread, if the spread is 90 degrees or more the meshlet can't be back-facing
+		meshlet.coneAxis = { 0, 0, 0 };
+		meshlet.coneCutoff = 1.0f;
+		float axisLength = Length(normalSum);
+		if (axisLength > 0)
+		{
+			meshlet.coneAxis = normalSum * (1.0f / axisLength);
+			float minDot = 1.0f;
+			for (unsigned int i = 0; i < numMeshletTriangles; ++i)
+			{
+				const CVector3& normal = normals[meshletTriangles[i]];
+				if (normal.x != 0 || normal.y != 0 || normal.z != 0)  minDot = std::min(minDot, Dot(normal, meshlet.coneAxis));
+			}
+			if (minDot > 0)  meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+		}
+
+		for (unsigned int i = 0; i < numMeshletTriangles; ++i)
+		{
+			uint32_t t = meshletTriangles[i];
+			reordered.push_back(indices[t * 3]);
+			reordered.push_back(indices[t * 3 + 1]);
+			reordered.push_back(indices[t * 3 + 2]);
+		}
+		meshlets.push_back(meshlet);
+
+		++meshletId;
+		numMeshletVertices = 0;
+		numMeshletTriangles = 0;
+		normalSum = { 0, 0, 0 };
+		positionSum = { 0, 0, 0 };
+	};
+
+	// Add a triangle to the current meshlet
+	auto addTriangle = [&](uint32_t t)
+	{
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			uint32_t v = indices[t * 3 + corner];
+			if (vertexMeshlet[v] != meshletId)
+			{
+				vertexMeshlet[v] = meshletId;
+				meshletVertices[numMeshletVertices++] = v;
+				positionSum = positionSum + positions[v];
+			}
+		}
+		meshletTriangles[numMeshletTriangles++] = t;
+		normalSum = normalSum + normals[t];
+		used[t] = 1;
+	};
+
+	uint32_t lastVertices[MAX_MESHLET_VERTICES]; // Vertices of the last finished meshlet, to start the next one nearby
+	unsigned int numLastVertices = 0;
+	for (unsigned int numAdded = 0; numAdded < numTriangles; ++numAdded)
+	{
+		// Find the best unused triangle touching the meshlet that fits
+		uint32_t best = UINT32_MAX;
+		float bestScore = 0;
+		CVector3 meshletNormal = (Length(normalSum) > 0) ? Normalise(normalSum) : CVector3{ 0, 0, 0 };
+		for (unsigned int i = 0; i < numMeshletVertices; ++i)
+		{
+			uint32_t v = meshletVertices[i];
+			for (uint32_t j = triangleStarts[v]; j < triangleStarts[v + 1]; ++j)
+			{
+				uint32_t t = triangles[j];
+				if (used[t])  continue;
+
+				unsigned int extraVertices = newVertices(t);
+				if (numMeshletVertices + extraVertices > MAX_MESHLET_VERTICES)  continue;
+
+				float score = extraVertices + CONE_WEIGHT * (1.0f - Dot(normals[t], meshletNormal));
+				if (best == UINT32_MAX || score < bestScore)
+				{
+					best = t;
+					bestScore = score;
+				}
+			}
+		}
+
+		// If no neighbouring triangle fits, try the nearest unused triangle
+		if (best == UINT32_MAX && numMeshletTriangles > 0 && numMeshletVertices + 3 <= MAX_MESHLET_VERTICES)
+		{
+			CVector3 centre = positionSum * (1.0f / numMeshletVertices);
+			float nearestDistance = 0;
+			unsigned int numSearched = 0;
+			for (unsigned int t = nextUnused; t < numTriangles && numSearched < NEAREST_SEARCH_LIMIT; ++t)
+			{
+				if (used[t])  continue;
+				++numSearched;
+				if (Dot(normals[t], meshletNormal) < NEAREST_MIN_NORMAL_DOT)  continue;
+
+				CVector3 triangleCentre = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) * (1.0f / 3);
+				float distance = Length(triangleCentre - centre);
+				if (best == UINT32_MAX || distance < nearestDistance)
+				{
+					best = t;
+					nearestDistance = distance;
+				}
+			}
+		}
+
+		// If nothing fits, the meshlet is finished. Start the next one next to the meshlet just finished if possible,
+		// otherwise at the first unused triangle
+		if (best == UINT32_MAX)
+		{
+			if (numMeshletTriangles > 0)
+			{
+				std::copy(meshletVertices, meshletVertices + numMeshletVertices, lastVertices);
+				numLastVertices = numMeshletVertices;
+				finishMeshlet();
+			}
+			for (unsigned int i = 0; i < numLastVertices && best == UINT32_MAX; ++i)
+			{
+				uint32_t v = lastVertices[i];
+				for (uint32_t j = triangleStarts[v]; j < triangleStarts[v + 1] && best == UINT32_MAX; ++j)
+				{
+					if (!used[triangles[j]])  best = triangles[j];
+				}
+			}
+			if (best == UINT32_MAX)
+			{
+				while (used[nextUnused])  ++nextUnused;
+				best = nextUnused;
+			}
+		}
+
+		addTriangle(best);
+		if (numMeshletTriangles == MAX_MESHLET_TRIANGLES)
+		{
+			std::copy(meshletVertices, meshletVertices + numMeshletVertices, lastVertices);
+			numLastVertices = numMeshletVertices;
+			finishMeshlet();
+		}
+	}
+	if (numMeshletTriangles > 0)  finishMeshlet();
+
+	std::copy(reordered.begin(), reordered.end(), indices);
+}
+
+
+// Move a camera's position and frustum into the space of a mesh with the given world matrix
+MeshletCamera MeshletCameraFromWorld(const CMatrix4x4& worldMatrix, const CVector3& cameraPosition, const Frustum& frustum)
+{
+	MeshletCamera camera;
+
+	// The camera position is moved by the inverse of the world matrix
+	CMatrix4x4 inverse = InverseAffine(worldMatrix);
+	camera.position = inverse.GetXAxis() * cameraPosition.x + inverse.GetYAxis() * cameraPosition.y +
+	                  inverse.GetZAxis() * cameraPosition.z + inverse.GetPosition();
+
+	// A point p in the mesh's space is at p * worldMatrix in the world, so a world plane n.p + d becomes a plane with
+	// normal (x axis.n, y axis.n, z axis.n) and distance position.n + d. Planes are normalised so sphere radii in the
+	// mesh's space can be compared to plane distances
+	CVector3 xAxis = worldMatrix.GetXAxis();
+	CVector3 yAxis = worldMatrix.GetYAxis();
+	CVector3 zAxis = worldMatrix.GetZAxis();
+	CVector3 position = worldMatrix.GetPosition();
+	for (int i = 0; i < 6; ++i)
+	{
+		CVector3 normal = { frustum.normalX[i], frustum.normalY[i], frustum.normalZ[i] };
+		CVector3 localNormal = { Dot(xAxis, normal), Dot(yAxis, normal), Dot(zAxis, normal) };
+		float localD = Dot(position, normal) + frustum.d[i];
+		float length = Length(localNormal);
+		float scale = (length > 0) ? 1.0f / length : 0.0f;
+		camera.frustum.normalX[i] = localNormal.x * scale;
+		camera.frustum.normalY[i] = localNormal.y * scale;
+		camera.frustum.normalZ[i] = localNormal.z * scale;
+		camera.frustum.d[i] = localD * scale;
+	}
+	return camera;
+}
+
+
+// Whether any of a meshlet might be visible from a camera (in the mesh's space). Back-facing meshlets are only culled
+// if the mesh is drawn with back-face culling
+bool MeshletVisible(const Meshlet& meshlet, const MeshletCamera& camera, bool cullBackFaces)
+{
+	const Frustum& frustum = camera.frustum;
+	for (int i = 0; i < 6; ++i)
+	{
+		float distance = frustum.normalX[i] * meshlet.centre.x + frustum.normalY[i] * meshlet.centre.y +
+		                 frustum.normalZ[i] * meshlet.centre.z + frustum.d[i];
+		if (distance < -meshlet.radius)  return false;
+	}
+
+	if (cullBackFaces && meshlet.coneCutoff < 1.0f)
+	{
+		CVector3 toMeshlet = meshlet.centre - camera.position;
+		if (Dot(toMeshlet, meshlet.coneAxis) >= meshlet.coneCutoff * Length(toMeshlet) + meshlet.radius)  return false;
+	}
+	return true;
+}
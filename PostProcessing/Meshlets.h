@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// Meshlets - small clusters of triangles that can be culled separately
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// A dense mesh is split into meshlets of up to 64 vertices and 124 triangles. Each meshlet has a bounding sphere and a
+// normal cone (an axis and spread that contain the normals of all its triangles). Before a mesh is drawn, meshlets
+// outside the view frustum are skipped, as are meshlets whose cone shows every triangle faces away from the camera.
+// The triangles of each meshlet are contiguous in the index buffer, so what remains is drawn as a few index ranges.
+//
+// - Meshlets are grown from a starting triangle by adding the neighbouring triangle that needs the fewest new vertices,
+//   preferring triangles facing the same way so the normal cones stay narrow
+// - Culling is done in the mesh's own space: the camera position and frustum are moved into it once per model, rather
+//   than moving every meshlet into the world
+
+#ifndef _MESHLETS_H_INCLUDED_
+#define _MESHLETS_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "BoundingVolumes.h"
+
+#include <vector>
+#include <stdint.h>
+
+
+// Size limits for a meshlet
+const unsigned int MAX_MESHLET_VERTICES  = 64;
+const unsigned int MAX_MESHLET_TRIANGLES = 124;
+
+
+// A cluster of triangles, stored as a range of the mesh's indices
+struct Meshlet
+{
+	uint32_t firstIndex;
+	uint32_t numIndices;
+
+	// Bounding sphere in the mesh's space
+	CVector3 centre;
+	float    radius;
+
+	// Normal cone. Every triangle faces away from a camera at position p if
+	// dot(centre - p, coneAxis) >= coneCutoff * length(centre - p) + radius
+	// A cutoff of 1 or more means the triangles face too many ways for the meshlet to ever be back-facing
+	CVector3 coneAxis;
+	float    coneCutoff;
+};
+
+
+// A camera moved into the space of a mesh for culling its meshlets
+struct MeshletCamera
+{
+	CVector3 position;
+	Frustum  frustum; // Planes are normalised in the mesh's space
+};
+
+
+// Split a triangle list into meshlets. The triangles are reordered in place so each meshlet's triangles are together.
+// The new meshlets are added to the given vector, with index ranges relative to the start of the given indices
+void BuildMeshlets(const CVector3* positions, unsigned int numVertices, uint32_t* indices, unsigned int numIndices,
+                   std::vector<Meshlet>& meshlets);
+
+// Move a camera's position and frustum into the space of a mesh with the given world matrix
+MeshletCamera MeshletCameraFromWorld(const CMatrix4x4& worldMatrix, const CVector3& cameraPosition, const Frustum& frustum);
+
+// Whether any of a meshlet might be visible from a camera (in the mesh's space). Back-facing meshlets are only culled
+// if the mesh is drawn with back-face culling
+bool MeshletVisible(const Meshlet& meshlet, const MeshletCamera& camera, bool cullBackFaces);
+
+
+#endif //_MESHLETS_H_INCLUDED_
@@ -0,0 +1,280 @@
+//--------------------------------------------------------------------------------------
+// Mip generation for textures on the CPU
+//--------------------------------------------------------------------------------------
+
+#include "MipGenerator.h"
+#include "ThreadPool.h" // Rows of each mip are filtered in parallel
+
+#include <xmmintrin.h> // SSE intrinsics
+#include <algorithm>
+#include <cmath>
+
+
+// Kaiser filter: how far it reaches either side of a pixel (in pixels of the smaller mip), and the shape of its window.
+// A larger alpha gives less ringing around sharp edges but a slightly softer result
+const float KAISER_RADIUS = 2.0f;
+const float KAISER_ALPHA  = 4.0f;
+
+// Size of the table converting linear values back to sRGB. Fine enough that every output value can be reached
+const unsigned int LINEAR_TO_SRGB_STEPS = 4096;
+
+
+// The filter for one pixel of the smaller mip along one axis: pixels of the larger mip it reads and their weights. The
+// filters are separable, so the same taps are used for every row (or column)
+struct FilterTap
+{
+	unsigned int pixel;
+	float        weight;
+};
+
+struct FilterTaps
+{
+	std::vector<FilterTap>    taps;
+	std::vector<unsigned int> first; // Taps for pixel i are from first[i] to first[i + 1]
+};
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+// Conversion between sRGB values (0-255) and linear values (0-1). Tables are built on first use
+struct ColourTables
+{
+	float   sRGBToLinear[256];
+	uint8_t linearToSRGB[LINEAR_TO_SRGB_STEPS];
+
+	ColourTables()
+	{
+		for (unsigned int i = 0; i < 256; ++i)
+		{
+			float value = i / 255.0f;
+			sRGBToLinear[i] = (value <= 0.04045f) ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+		}
+		for (unsigned int i = 0; i < LINEAR_TO_SRGB_STEPS; ++i)
+		{
+			float value = i / static_cast<float>(LINEAR_TO_SRGB_STEPS - 1);
+			float sRGB = (value <= 0.0031308f) ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+			linearToSRGB[i] = static_cast<uint8_t>(sRGB * 255.0f + 0.5f);
+		}
+	}
+};
+
+static const ColourTables& GetColourTables()
+{
+	static ColourTables tables;
+	return tables;
+}
+
+
+static float Sinc(float x)
+{
+	if (std::abs(x) < 1e-5f)  return 1.0f;
+	x *= 3.14159265f;
+	return std::sin(x) / x;
+}
+
+// Zeroth order modified Bessel function of the first kind, used by the Kaiser window
+static float BesselI0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (unsigned int k = 1; k < 32; ++k)
+	{
+		float factor = x / (2.0f * k);
+		term *= factor * factor;
+		sum += term;
+		if (term < sum * 1e-8f)  break;
+	}
+	return sum;
+}
+
+// Kaiser windowed sinc at a distance from the centre of a pixel, in pixels of the smaller mip
+static float Kaiser(float x)
+{
+	if (std::abs(x) >= KAISER_RADIUS)  return 0.0f;
+	float t = x / KAISER_RADIUS;
+	return Sinc(x) * BesselI0(KAISER_ALPHA * std::sqrt(1.0f - t * t)) / BesselI0(KAISER_ALPHA);
+}
+
+
+// Build the taps to filter an axis of the given size down to a smaller size
+static void MakeTaps(unsigned int size, unsigned int smallerSize, const MipSettings& settings, FilterTaps& result)
+{
+	result.taps.clear();
+	result.first.clear();
+
+	float scale = static_cast<float>(size) / smallerSize;
+	float radius = (settings.filter == MipFilter::Box ? 0.5f : KAISER_RADIUS) * scale; // In pixels of the larger mip
+	for (unsigned int i = 0; i < smallerSize; ++i)
+	{
+		size_t firstTap = result.taps.size();
+		result.first.push_back(static_cast<unsigned int>(firstTap));
+
+		float centre = (i + 0.5f) * scale;
+		int begin = static_cast<int>(std::floor(centre - radius));
+		int end   = static_cast<int>(std::ceil(centre + radius));
+		float total = 0.0f;
+		for (int p = begin; p < end; ++p)
+		{
+			// Box filters weight each pixel by how much of it they cover, which handles odd sizes correctly
+			float weight = (settings.filter == MipFilter::Box) ?
+			               std::min(p + 1.0f, centre + radius) - std::max(static_cast<float>(p), centre - radius) :
+			               Kaiser((p + 0.5f - centre) / scale);
+			if (weight == 0.0f)  continue;
+
+			int n = static_cast<int>(size);
+			int pixel = settings.wrap ? ((p % n) + n) % n : std::min(std::max(p, 0), n - 1);
+			result.taps.push_back({ static_cast<unsigned int>(pixel), weight });
+			total += weight;
+		}
+		for (size_t t = firstTap; t < result.taps.size(); ++t)  result.taps[t].weight /= total;
+	}
+	result.first.push_back(static_cast<unsigned int>(result.taps.size()));
+}
+
+
+// Filter an image of float RGBA pixels down to a smaller size, first along the rows then the columns. Each pixel is an
+// SSE vector, rows are spread over the thread pool
+static void FilterImage(const std::vector<float>& image, unsigned int width, unsigned int height,
+                        unsigned int smallerWidth, unsigned int smallerHeight, const MipSettings& settings,
+                        std::vector<float>& result)
+{
+	FilterTaps tapsX, tapsY;
+	MakeTaps(width,  smallerWidth,  settings, tapsX);
+	MakeTaps(height, smallerHeight, settings, tapsY);
+
+	// Rows: width -> smallerWidth
+	std::vector<float> rowsFiltered(static_cast<size_t>(smallerWidth) * height * 4);
+	ParallelFor(height, 16, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int y = begin; y < end; ++y)
+		{
+			const float* row = &image[static_cast<size_t>(y) * width * 4];
+			float* output = &rowsFiltered[static_cast<size_t>(y) * smallerWidth * 4];
+			for (unsigned int x = 0; x < smallerWidth; ++x)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (unsigned int t = tapsX.first[x]; t < tapsX.first[x + 1]; ++t)
+				{
+					const FilterTap& tap = tapsX.taps[t];
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&row[tap.pixel * 4]), _mm_set1_ps(tap.weight)));
+				}
+				_mm_storeu_ps(&output[x * 4], sum);
+			}
+		}
+	});
+
+	// Columns: height -> smallerHeight. Whole rows are accumulated so memory is read in order
+	result.assign(static_cast<size_t>(smallerWidth) * smallerHeight * 4, 0.0f);
+	ParallelFor(smallerHeight, 8, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int y = begin; y < end; ++y)
+		{
+			float* output = &result[static_cast<size_t>(y) * smallerWidth * 4];
+			for (unsigned int t = tapsY.first[y]; t < tapsY.first[y + 1]; ++t)
+			{
+				const FilterTap& tap = tapsY.taps[t];
+				const float* row = &rowsFiltered[static_cast<size_t>(tap.pixel) * smallerWidth * 4];
+				__m128 weight = _mm_set1_ps(tap.weight);
+				for (unsigned int x = 0; x < smallerWidth; ++x)
+				{
+					_mm_storeu_ps(&output[x * 4], _mm_add_ps(_mm_loadu_ps(&output[x * 4]), _mm_mul_ps(_mm_loadu_ps(&row[x * 4]), weight)));
+				}
+			}
+		}
+	});
+}
+
+
+// Fraction of pixels with alpha above the reference after scaling it
+static float AlphaCoverage(const std::vector<float>& image, float alphaScale, float reference)
+{
+	size_t numPixels = image.size() / 4;
+	size_t covered = 0;
+	for (size_t p = 0; p < numPixels; ++p)
+	{
+		if (std::min(image[p * 4 + 3] * alphaScale, 1.0f) > reference)  ++covered;
+	}
+	return static_cast<float>(covered) / numPixels;
+}
+
+// Find the alpha scale that gives a mip the closest coverage to that wanted. Coverage only increases with the scale, so
+// search for where it crosses the wanted value. Small mips have few pixels so may not be able to match it exactly
+static float AlphaScaleForCoverage(const std::vector<float>& image, float coverage, float reference)
+{
+	float low = 0.0f, high = 1.0f;
+	while (AlphaCoverage(image, high, reference) < coverage && high < 256.0f)  high *= 2.0f;
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		float middle = (low + high) * 0.5f;
+		if (AlphaCoverage(image, middle, reference) < coverage)  low = middle;  else  high = middle;
+	}
+	float lowError  = coverage - AlphaCoverage(image, low,  reference);
+	float highError = AlphaCoverage(image, high, reference) - coverage;
+	return (lowError < highError) ? low : high;
+}
+
+
+// Convert float RGBA pixels (linear if gamma correct) to RGBA8, scaling the alpha
+static void ConvertToBytes(const std::vector<float>& image, const MipSettings& settings, float alphaScale,
+                           std::vector<uint8_t>& result)
+{
+	const ColourTables& tables = GetColourTables();
+	size_t numPixels = image.size() / 4;
+	result.resize(numPixels * 4);
+	for (size_t p = 0; p < numPixels; ++p)
+	{
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			float value = std::min(std::max(image[p * 4 + c], 0.0f), 1.0f); // Kaiser filters can overshoot
+			result[p * 4 + c] = settings.gammaCorrect ? tables.linearToSRGB[static_cast<unsigned int>(value * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f)] :
+			                                            static_cast<uint8_t>(value * 255.0f + 0.5f);
+		}
+		float alpha = std::min(std::max(image[p * 4 + 3] * alphaScale, 0.0f), 1.0f);
+		result[p * 4 + 3] = static_cast<uint8_t>(alpha * 255.0f + 0.5f);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+// Make every mip of an RGBA8 image after the first, in order from half size down to 1x1
+std::vector<MipLevel> GenerateMips(const uint8_t* pixels, unsigned int width, unsigned int height, const MipSettings& settings)
+{
+	// Work in floats, linear space for gamma corrected colours
+	const ColourTables& tables = GetColourTables();
+	size_t numPixels = static_cast<size_t>(width) * height;
+	std::vector<float> image(numPixels * 4);
+	for (size_t p = 0; p < numPixels; ++p)
+	{
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			image[p * 4 + c] = settings.gammaCorrect ? tables.sRGBToLinear[pixels[p * 4 + c]] : pixels[p * 4 + c] / 255.0f;
+		}
+		image[p * 4 + 3] = pixels[p * 4 + 3] / 255.0f;
+	}
+
+	bool preserveCoverage = (settings.alphaCoverageReference >= 0.0f);
+	float coverage = preserveCoverage ? AlphaCoverage(image, 1.0f, settings.alphaCoverageReference) : 0.0f;
+
+	// Each mip is filtered from the one before, the alpha scale for coverage is only applied to the output so it doesn't
+	// build up from one mip to the next
+	std::vector<MipLevel> mips;
+	std::vector<float> smaller;
+	while (width > 1 || height > 1)
+	{
+		unsigned int smallerWidth  = std::max(width  / 2, 1u);
+		unsigned int smallerHeight = std::max(height / 2, 1u);
+		FilterImage(image, width, height, smallerWidth, smallerHeight, settings, smaller);
+		image.swap(smaller);
+		width  = smallerWidth;
+		height = smallerHeight;
+
+		float alphaScale = preserveCoverage ? AlphaScaleForCoverage(image, coverage, settings.alphaCoverageReference) : 1.0f;
+		mips.push_back({ width, height, {} });
+		ConvertToBytes(image, settings, alphaScale, mips.back().pixels);
+	}
+	return mips;
+}
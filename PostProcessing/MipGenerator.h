@@ -0,0 +1,57 @@
+//--------------------------------------------------------------------------------------
+// Mip generation for textures on the CPU
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Each mip is made from the one before it, halving the size until 1x1. Different filters give different quality:
+// - Box: each pixel is the average of the 2x2 pixels it covers. Quick, but lets fine detail through as aliasing
+//   (shimmering patterns when a detailed texture is far away)
+// - Kaiser: a windowed sinc filter over a wider area. Removes the detail that can't be shown at the smaller size while
+//   keeping the rest sharp, the usual choice for high quality mips
+//
+// Colour textures are stored in sRGB (gamma) space, where a value of 128 is much less than half as bright as 255.
+// Averaging the stored values makes mips too dark wherever there is contrast, so colours are converted to linear space
+// to be filtered and back again afterwards. Alpha and data textures (e.g. noise, normals) are filtered as they are
+//
+// Textures drawn with alpha testing lose coverage in smaller mips as the alpha is averaged down, so they fade away in
+// the distance. Coverage preservation scales each mip's alpha so the same fraction of pixels passes the test
+//
+// Pixels are processed as SSE vectors of 4 channels, and each level is split into rows over the thread pool
+
+#ifndef _MIP_GENERATOR_H_INCLUDED_
+#define _MIP_GENERATOR_H_INCLUDED_
+
+#include <vector>
+#include <stdint.h>
+
+
+enum class MipFilter
+{
+	Box,
+	Kaiser,
+};
+
+struct MipSettings
+{
+	MipFilter filter = MipFilter::Kaiser;
+	bool gammaCorrect = true; // RGB are sRGB colours, filter them in linear space. Turn off for data textures
+	bool wrap         = true; // Filter across the edges as if the texture repeats, otherwise the edge pixels are repeated
+
+	// Scale the alpha of each mip so the fraction of pixels with alpha above this matches the full size image. For
+	// alpha tested textures, pass the alpha test's reference value (0-1). Negative for no change
+	float alphaCoverageReference = -1.0f;
+};
+
+// One mip of an RGBA8 image
+struct MipLevel
+{
+	unsigned int width;
+	unsigned int height;
+	std::vector<uint8_t> pixels;
+};
+
+
+// Make every mip of an RGBA8 image after the first, in order from half size down to 1x1
+std::vector<MipLevel> GenerateMips(const uint8_t* pixels, unsigned int width, unsigned int height, const MipSettings& settings);
+
+
+#endif //_MIP_GENERATOR_H_INCLUDED_
@@ -10,13 +10,16 @@
 #include "Common.h"
 
 
+// Models use level of detail n + 1 once their bounding sphere covers less than LOD_SCREEN_SIZES[n] of the screen height
+const float LOD_SCREEN_SIZES[Mesh::MaxLods - 1] = { 0.4f, 0.2f, 0.08f };
+
+// Models change to a simpler level when this fraction smaller than the threshold, and back when this fraction bigger
+const float LOD_HYSTERESIS = 0.1f;
+
+
 Model::Model(Mesh* mesh, CVector3 position /*= { 0,0,0 }*/, CVector3 rotation /*= { 0,0,0 }*/, float scale /*= 1*/)
-    : mMesh(mesh)
+    : mMesh(mesh), mTransforms(mesh) // Transform hierarchy takes default matrices from mesh
 {
-    // Set default matrices from mesh
-    mWorldMatrices.resize(mesh->NumberNodes());
-    for (int i = 0; i < mWorldMatrices.size(); ++i)
-        mWorldMatrices[i] = mesh->GetNodeDefaultMatrix(i);
 }
 
 
@@ -25,7 +28,76 @@ Model::Model(Mesh* mesh, CVector3 position /*= { 0,0,0 }*/, CVector3 rotation /*
 // All other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
 void Model::Render()
 {
-    mMesh->Render(mWorldMatrices);
+    mMesh->Render(mTransforms, mBonePaletteOffset, mLod);
+}
+
+// Skinned models write their bone matrices to the bone palette, must be called each frame before rendering
+// Does nothing for models without skinning
+void Model::UpdateBones()
+{
+    mBonePaletteOffset = mMesh->WriteBonePalette(mTransforms);
+}
+
+
+// Add this model to the occlusion buffer as an occluder. The mesh must have been loaded with occluder geometry
+void Model::AddToOcclusionBuffer(OcclusionBuffer& occlusionBuffer)
+{
+    mMesh->AddToOcclusionBuffer(mTransforms, occlusionBuffer);
+}
+
+
+// World space box around the whole model. Only recalculated when the model's matrices have changed
+const AABB& Model::WorldBounds()
+{
+    mTransforms.Update();
+    if (mTransforms.Version() != mBoundsVersion)
+    {
+        mWorldBounds = mMesh->CalculateWorldBounds(mTransforms);
+        mBoundsVersion = mTransforms.Version();
+    }
+    return mWorldBounds;
+}
+
+
+// Choose the level of detail to draw from the model's size on screen. Pass the camera position and the vertical scale
+// of its projection (1 / tan of half the vertical field of view). Call each frame for models that are drawn. The
+// level only changes when the size is clearly past a threshold so models don't flicker between two levels
+void Model::SelectLod(const CVector3& cameraPosition, float projectionScale)
+{
+    unsigned int numLods = mMesh->NumLods();
+    if (numLods <= 1)
+    {
+        mLod = 0;
+        return;
+    }
+
+    // A camera inside the bounding sphere always sees full detail
+    float screenSize = ScreenSize(cameraPosition, projectionScale);
+
+    // Find the level with the thresholds moved down (to change to a simpler level) and up (to change back to more detail).
+    // Between the two the current level is kept
+    auto lodForSize = [&](float thresholdScale)
+    {
+        unsigned int lod = 0;
+        while (lod + 1 < numLods && screenSize < LOD_SCREEN_SIZES[lod] * thresholdScale)  ++lod;
+        return lod;
+    };
+    unsigned int simplerLod  = lodForSize(1.0f - LOD_HYSTERESIS);
+    unsigned int detailedLod  = lodForSize(1.0f + LOD_HYSTERESIS);
+    if      (simplerLod  > mLod)  mLod = simplerLod;
+    else if (detailedLod < mLod)  mLod = detailedLod;
+}
+
+
+// Fraction of the screen height covered by the model's bounding sphere. Pass the camera position and the vertical scale
+// of its projection (1 / tan of half the vertical field of view)
+float Model::ScreenSize(const CVector3& cameraPosition, float projectionScale)
+{
+    const AABB& bounds = WorldBounds();
+    float radius = Length(bounds.Extents());
+    float distance = Length(bounds.Centre() - cameraPosition);
+    if (distance <= radius)  return 3.4e38f; // Camera inside the sphere
+    return radius * projectionScale / distance;
 }
 
 
@@ -33,7 +105,11 @@ void Model::Render()
 void Model::Control(int node, float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
                                                KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward)
 {
-    auto& matrix = mWorldMatrices[node]; // Use reference to node matrix to make code below more readable
+    // Work on a copy of the node matrix, only writing it back (which marks it for update) if a key was used
+    CMatrix4x4 matrix = mTransforms.LocalMatrix(node);
+    bool moved = KeyHeld(turnUp) || KeyHeld(turnDown) || KeyHeld(turnLeft) || KeyHeld(turnRight) ||
+                 KeyHeld(turnCW) || KeyHeld(turnCCW) || KeyHeld(moveForward) || KeyHeld(moveBackward);
+    if (!moved)  return;
 
 	if (KeyHeld( turnUp ))
 	{
@@ -71,4 +147,6 @@ void Model::Control(int node, float frameTime, KeyCode turnUp, KeyCode turnDown,
 	{
 		matrix.SetRow(3, matrix.GetRow(3) - localZDir * MOVEMENT_SPEED * frameTime);
 	}
+
+    mTransforms.SetLocalMatrix(node, matrix);
 }
@@ -6,6 +6,8 @@
 
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "TransformHierarchy.h"
+#include "BoundingVolumes.h"
 #include "Input.h"
 
 #include <vector>
@@ -14,6 +16,7 @@
 #define _MODEL_H_INCLUDED_
 
 class Mesh;
+class OcclusionBuffer;
 
 class Model
 {
@@ -29,6 +32,22 @@ public:
     // All other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
     void Render();
 
+    // Skinned models write their bone matrices to the bone palette, must be called each frame before rendering
+    // Does nothing for models without skinning
+    void UpdateBones();
+
+    // Add this model to the occlusion buffer as an occluder. The mesh must have been loaded with occluder geometry
+    void AddToOcclusionBuffer(OcclusionBuffer& occlusionBuffer);
+
+    // Choose the level of detail to draw from the model's size on screen. Pass the camera position and the vertical scale
+    // of its projection (1 / tan of half the vertical field of view). Call each frame for models that are drawn. The
+    // level only changes when the size is clearly past a threshold so models don't flicker between two levels
+    void SelectLod(const CVector3& cameraPosition, float projectionScale);
+
+    // Fraction of the screen height covered by the model's bounding sphere, parameters as SelectLod. Exact for a sphere
+    // in the middle of the view, close enough elsewhere. Very large if the camera is inside the sphere
+    float ScreenSize(const CVector3& cameraPosition, float projectionScale);
+
 
 	// Control a given node in the model using keys provided. Amount of motion performed depends on frame time
 	void Control(int node, float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,  
@@ -44,35 +63,55 @@ public:
     // The hierarchy is stored in depth-first order
 
 	// Getters - model only stores matrices. Position, rotation and scale are extracted if requested.
-	CVector3 Position(int node = 0)  { return mWorldMatrices[node].GetRow(3); }         // Position is on bottom row of matrix
-	CVector3 Rotation(int node = 0)  { return mWorldMatrices[node].GetEulerAngles(); }  // Getting angles from a matrix is complex - see .cpp file
-	CVector3 Scale(int node = 0)     { return { Length(mWorldMatrices[node].GetRow(0)),
-                                                Length(mWorldMatrices[node].GetRow(1)), 
-                                                Length(mWorldMatrices[node].GetRow(2)) }; } // Scale is length of rows 0-2 in matrix
-	CMatrix4x4 WorldMatrix(int node = 0)  { return mWorldMatrices[node]; }
+	CVector3 Position(int node = 0)  { return mTransforms.LocalMatrix(node).GetRow(3); }              // Position is on bottom row of matrix
+	CVector3 Rotation(int node = 0)  { return CMatrix4x4(mTransforms.LocalMatrix(node)).GetEulerAngles(); } // Getting angles from a matrix is complex - see .cpp file
+	CVector3 Scale(int node = 0)     { return mTransforms.LocalMatrix(node).GetScale(); }                // Scale is length of rows 0-2 in matrix
+	CMatrix4x4 WorldMatrix(int node = 0)  { return mTransforms.LocalMatrix(node); }
+
+	Mesh* GetMesh()  { return mMesh; }
+
+	// Level of detail chosen by SelectLod, 0 is full detail (see Mesh::NumLods)
+	unsigned int Lod()  { return mLod; }
+
+	// Matrix for every node in world space (the matrices above are relative to their parent). Brings them up to date first
+	const CMatrix4x4* AbsoluteMatrices()  { mTransforms.Update();  return mTransforms.AbsoluteMatrices(); }
+
+	// World space box around the whole model. Only recalculated when the model's matrices have changed
+	const AABB& WorldBounds();
+
+	// Changes whenever the world bounds change, so users keeping a copy of them can tell when to update (see SceneBVH)
+	uint32_t BoundsVersion()  { return mBoundsVersion; }
 
     // Setters - model only stores matricies , so if user sets position, rotation or scale, just update those aspects of the matrix
-	void SetPosition(CVector3 position, int node = 0)  { mWorldMatrices[node].SetRow(3, position); }
+    // Any change marks the node (and its children) for update at the next render
+	void SetPosition(CVector3 position, int node = 0)
+    {
+        CMatrix4x4 matrix = mTransforms.LocalMatrix(node);
+        matrix.SetRow(3, position);
+        mTransforms.SetLocalMatrix(node, matrix);
+    }
 
 	void SetRotation(CVector3 rotation, int node = 0)
     {
         // To put rotation angles into a matrix we need to build the matrix from scratch to make sure we retain existing scaling and position
-        mWorldMatrices[node] = MatrixScaling(Scale(node)) *
-                               MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) * MatrixRotationY(rotation.y) *
-                               MatrixTranslation(Position(node));
+        mTransforms.SetLocalMatrix(node, MatrixScaling(Scale(node)) *
+                                         MatrixRotationZ(rotation.z) * MatrixRotationX(rotation.x) * MatrixRotationY(rotation.y) *
+                                         MatrixTranslation(Position(node)));
     }
 
 	// Two ways to set scale: x,y,z separately, or all to the same value
     // To set scale without affecting rotation, normalise each row, then multiply it by the scale value.
 	void SetScale(CVector3 scale, int node = 0)
     {
-        mWorldMatrices[node].SetRow(0, Normalise(mWorldMatrices[node].GetRow(0)) * scale.x); 
-        mWorldMatrices[node].SetRow(1, Normalise(mWorldMatrices[node].GetRow(1)) * scale.y); 
-        mWorldMatrices[node].SetRow(2, Normalise(mWorldMatrices[node].GetRow(2)) * scale.z); 
+        CMatrix4x4 matrix = mTransforms.LocalMatrix(node);
+        matrix.SetRow(0, Normalise(matrix.GetRow(0)) * scale.x); 
+        matrix.SetRow(1, Normalise(matrix.GetRow(1)) * scale.y); 
+        matrix.SetRow(2, Normalise(matrix.GetRow(2)) * scale.z); 
+        mTransforms.SetLocalMatrix(node, matrix);
     }
 	void SetScale(float scale)  { SetScale({ scale, scale, scale });}
 
-    void SetWorldMatrix(CMatrix4x4 matrix, int node = 0)  { mWorldMatrices[node] = matrix; }
+    void SetWorldMatrix(CMatrix4x4 matrix, int node = 0)  { mTransforms.SetLocalMatrix(node, matrix); }
 
 
 	//-------------------------------------
@@ -84,7 +123,15 @@ private:
 	// World matrices for the model
     // Now that meshes have multiple parts, we need multiple matrices. The root matrix (the first one) is the world matrix
     // for the entire model. The remaining matrices are relative to their parent part. The hierarchy is defined in the mesh (nodes)
-	std::vector<CMatrix4x4> mWorldMatrices;
+    // The transform hierarchy also caches the absolute matrices, only recalculating parts of the model that have moved
+	TransformHierarchy mTransforms;
+
+	unsigned int mBonePaletteOffset = 0; // Where this model's bones are in the bone palette this frame
+	unsigned int mLod = 0;               // Level of detail to draw, see SelectLod
+
+	// Cached world bounds, valid when the version matches the transform hierarchy's (which is never 0 once updated)
+	AABB     mWorldBounds;
+	uint32_t mBoundsVersion = 0;
 };
 
 
@@ -0,0 +1,349 @@
+//--------------------------------------------------------------------------------------
+// Small CPU depth buffer for occlusion culling
+//--------------------------------------------------------------------------------------
+
+#include "OcclusionBuffer.h"
+#include "ThreadPool.h" // Bands of rows are rasterised in parallel
+
+#include <xmmintrin.h> // SSE intrinsics
+#include <algorithm>
+#include <cmath>
+
+
+// Number of rows of the depth buffer rasterised by each task
+const unsigned int ROWS_PER_BAND = 8;
+
+
+OcclusionBuffer::OcclusionBuffer()
+{
+	// Work out where each hierarchical-Z level starts, halving the size each time down to a single row
+	unsigned int offset = 0;
+	unsigned int levelWidth  = Width;
+	unsigned int levelHeight = Height;
+	while (true)
+	{
+		mLevelOffsets.push_back(offset);
+		offset += levelWidth * levelHeight;
+		if (levelWidth == 1 || levelHeight == 1)  break;
+		levelWidth  /= 2;
+		levelHeight /= 2;
+	}
+	mNumLevels = static_cast<unsigned int>(mLevelOffsets.size());
+	mHierarchicalZ.resize(offset, 1.0f);
+}
+
+
+// Start a new frame for the given camera, removes all occluders
+void OcclusionBuffer::Begin(const CMatrix4x4& viewProjectionMatrix)
+{
+	mViewProjectionMatrix = viewProjectionMatrix;
+	mTriangles.clear();
+}
+
+
+// Add an occluder, a triangle list with vertex positions in model space and the model's world matrix. Triangles
+// are culled the same way as the GPU does by default (counter-clockwise triangles face away)
+void OcclusionBuffer::AddOccluder(const CVector3* positions, unsigned int numVertices, const uint32_t* indices,
+                                  unsigned int numIndices, const CMatrix4x4& worldMatrix)
+{
+	// Transform all vertices to clip space first (vertices are shared between triangles), one SSE multiply-add per row
+	CMatrix4x4 worldViewProjection;
+	MatrixMultiply(worldViewProjection, worldMatrix, mViewProjectionMatrix);
+	__m128 row0 = _mm_loadu_ps(&worldViewProjection.e00);
+	__m128 row1 = _mm_loadu_ps(&worldViewProjection.e10);
+	__m128 row2 = _mm_loadu_ps(&worldViewProjection.e20);
+	__m128 row3 = _mm_loadu_ps(&worldViewProjection.e30);
+
+	mClipVertices.resize(numVertices * 4);
+	for (unsigned int v = 0; v < numVertices; ++v)
+	{
+		__m128 clip =                  _mm_mul_ps(_mm_set1_ps(positions[v].x), row0);
+		clip = _mm_add_ps(clip, _mm_mul_ps(_mm_set1_ps(positions[v].y), row1));
+		clip = _mm_add_ps(clip, _mm_mul_ps(_mm_set1_ps(positions[v].z), row2));
+		clip = _mm_add_ps(clip, row3);
+		_mm_storeu_ps(&mClipVertices[v * 4], clip);
+	}
+
+	for (unsigned int i = 0; i + 2 < numIndices; i += 3)
+	{
+		const float* v[3] = { &mClipVertices[indices[i] * 4], &mClipVertices[indices[i + 1] * 4], &mClipVertices[indices[i + 2] * 4] };
+
+		// Skip triangles entirely outside one of the frustum planes (a point is inside if -w <= x,y <= w and 0 <= z <= w)
+		if ((v[0][0] < -v[0][3] && v[1][0] < -v[1][3] && v[2][0] < -v[2][3]) ||
+		    (v[0][0] >  v[0][3] && v[1][0] >  v[1][3] && v[2][0] >  v[2][3]) ||
+		    (v[0][1] < -v[0][3] && v[1][1] < -v[1][3] && v[2][1] < -v[2][3]) ||
+		    (v[0][1] >  v[0][3] && v[1][1] >  v[1][3] && v[2][1] >  v[2][3]) ||
+		    (v[0][2] >  v[0][3] && v[1][2] >  v[1][3] && v[2][2] >  v[2][3]))  continue;
+
+		int numInFront = (v[0][2] >= 0) + (v[1][2] >= 0) + (v[2][2] >= 0);
+		if (numInFront == 3)
+		{
+			AddTriangle(v[0], v[1], v[2]);
+		}
+		else if (numInFront > 0)
+		{
+			// Triangle crosses the near clip plane (z = 0), which would give invalid screen positions for the vertices
+			// behind it. Clip it, keeping the part in front. This gives 3 or 4 vertices, drawn as 1 or 2 triangles
+			float clipped[4][4];
+			int numClipped = 0;
+			for (int edge = 0; edge < 3; ++edge)
+			{
+				const float* a = v[edge];
+				const float* b = v[(edge + 1) % 3];
+				if (a[2] >= 0)
+				{
+					std::copy(a, a + 4, clipped[numClipped++]);
+				}
+				if ((a[2] >= 0) != (b[2] >= 0))
+				{
+					float t = a[2] / (a[2] - b[2]);
+					for (int c = 0; c < 4; ++c)  clipped[numClipped][c] = a[c] + (b[c] - a[c]) * t;
+					++numClipped;
+				}
+			}
+			AddTriangle(clipped[0], clipped[1], clipped[2]);
+			if (numClipped == 4)  AddTriangle(clipped[0], clipped[2], clipped[3]);
+		}
+	}
+}
+
+
+// Rasterise all the occluders and build the hierarchical-Z buffer, call after adding occluders and before testing
+void OcclusionBuffer::Rasterise()
+{
+	// Each band of rows is independent, so the bands can be shared between threads with no locking
+	ParallelFor(Height / ROWS_PER_BAND, 1, [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int band = begin; band < end; ++band)
+		{
+			RasteriseRows(band * ROWS_PER_BAND, (band + 1) * ROWS_PER_BAND);
+		}
+	});
+
+	BuildHierarchicalZ();
+}
+
+
+// Test whether a world space box might be visible. Returns false only if the box is entirely behind occluders (or
+// off-screen). Boxes crossing the near clip plane are always visible
+bool OcclusionBuffer::IsVisible(const AABB& box)
+{
+	// Transform the eight corners of the box to the screen, four at a time. Corners 0-3 are on the near z side of the
+	// box, corners 4-7 on the far side
+	const CMatrix4x4& m = mViewProjectionMatrix;
+	__m128 x = _mm_setr_ps(box.min.x, box.max.x, box.min.x, box.max.x);
+	__m128 y = _mm_setr_ps(box.min.y, box.min.y, box.max.y, box.max.y);
+
+	__m128 minScreenX = _mm_set1_ps( 3.4e38f);
+	__m128 minScreenY = _mm_set1_ps( 3.4e38f);
+	__m128 maxScreenX = _mm_set1_ps(-3.4e38f);
+	__m128 maxScreenY = _mm_set1_ps(-3.4e38f);
+	__m128 minDepth   = _mm_set1_ps( 3.4e38f);
+	for (int side = 0; side < 2; ++side)
+	{
+		__m128 z = _mm_set1_ps(side == 0 ? box.min.z : box.max.z);
+
+		__m128 clipX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.e00)), _mm_mul_ps(y, _mm_set1_ps(m.e10))),
+		                          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.e20)), _mm_set1_ps(m.e30)));
+		__m128 clipY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.e01)), _mm_mul_ps(y, _mm_set1_ps(m.e11))),
+		                          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.e21)), _mm_set1_ps(m.e31)));
+		__m128 clipZ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.e02)), _mm_mul_ps(y, _mm_set1_ps(m.e12))),
+		                          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.e22)), _mm_set1_ps(m.e32)));
+		__m128 clipW = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.e03)), _mm_mul_ps(y, _mm_set1_ps(m.e13))),
+		                          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.e23)), _mm_set1_ps(m.e33)));
+
+		// Any corner in front of the near clip plane means the box is too close to test, assume it is visible
+		if (_mm_movemask_ps(_mm_cmplt_ps(clipZ, _mm_setzero_ps())) != 0)  return true;
+
+		__m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), clipW);
+		__m128 screenX = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(clipX, invW), _mm_set1_ps( 0.5f)), _mm_set1_ps(0.5f)), _mm_set1_ps(static_cast<float>(Width)));
+		__m128 screenY = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(clipY, invW), _mm_set1_ps(-0.5f)), _mm_set1_ps(0.5f)), _mm_set1_ps(static_cast<float>(Height)));
+
+		minScreenX = _mm_min_ps(minScreenX, screenX);
+		minScreenY = _mm_min_ps(minScreenY, screenY);
+		maxScreenX = _mm_max_ps(maxScreenX, screenX);
+		maxScreenY = _mm_max_ps(maxScreenY, screenY);
+		minDepth   = _mm_min_ps(minDepth, _mm_mul_ps(clipZ, invW));
+	}
+
+	// Reduce to a single screen rectangle and nearest depth
+	alignas(16) float minXs[4], minYs[4], maxXs[4], maxYs[4], depths[4];
+	_mm_store_ps(minXs, minScreenX);
+	_mm_store_ps(minYs, minScreenY);
+	_mm_store_ps(maxXs, maxScreenX);
+	_mm_store_ps(maxYs, maxScreenY);
+	_mm_store_ps(depths, minDepth);
+	float minX  = std::min(std::min(minXs[0],  minXs[1]),  std::min(minXs[2],  minXs[3]));
+	float minY  = std::min(std::min(minYs[0],  minYs[1]),  std::min(minYs[2],  minYs[3]));
+	float maxX  = std::max(std::max(maxXs[0],  maxXs[1]),  std::max(maxXs[2],  maxXs[3]));
+	float maxY  = std::max(std::max(maxYs[0],  maxYs[1]),  std::max(maxYs[2],  maxYs[3]));
+	float depth = std::min(std::min(depths[0], depths[1]), std::min(depths[2], depths[3]));
+	depth = std::min(depth, 1.0f); // A box reaching past the far clip plane is still visible where nothing is in front
+
+	if (maxX < 0 || maxY < 0 || minX >= Width || minY >= Height)  return false; // Off-screen
+
+	int left   = std::max(static_cast<int>(minX), 0);
+	int top    = std::max(static_cast<int>(minY), 0);
+	int right  = std::min(static_cast<int>(maxX), static_cast<int>(Width)  - 1);
+	int bottom = std::min(static_cast<int>(maxY), static_cast<int>(Height) - 1);
+
+	// Pick the level where the rectangle covers no more than 3x3 texels. Each texel holds the furthest occluder depth
+	// over the pixels it covers, so if the box is behind all of them then it is behind every pixel it covers
+	unsigned int size = static_cast<unsigned int>(std::max(right - left, bottom - top)) + 1;
+	unsigned int level = 0;
+	while (level + 1 < mNumLevels && (size >> level) > 2)  ++level;
+
+	const float* levelDepth = mHierarchicalZ.data() + mLevelOffsets[level];
+	unsigned int levelWidth = Width >> level;
+	for (int row = top >> level; row <= (bottom >> level); ++row)
+	{
+		for (int col = left >> level; col <= (right >> level); ++col)
+		{
+			if (depth <= levelDepth[row * levelWidth + col])  return true;
+		}
+	}
+	return false;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helper functions
+//--------------------------------------------------------------------------------------
+
+// Project a clip space triangle to the screen and add it to the triangle list if it faces the camera
+void OcclusionBuffer::AddTriangle(const float* v0, const float* v1, const float* v2)
+{
+	Triangle triangle;
+	const float* v[3] = { v0, v1, v2 };
+	for (int i = 0; i < 3; ++i)
+	{
+		float invW = 1.0f / v[i][3];
+		triangle.x[i] = (v[i][0] * invW *  0.5f + 0.5f) * Width;
+		triangle.y[i] = (v[i][1] * invW * -0.5f + 0.5f) * Height; // Screen y is down
+		triangle.z[i] = v[i][2] * invW;
+	}
+
+	// Twice the triangle's area, which is positive for triangles that are clockwise on the screen (front facing)
+	float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+	             (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+	if (area <= 0)  return; // Back facing or zero area
+
+	mTriangles.push_back(triangle);
+}
+
+
+// Rasterise all triangles into the rows [firstRow, endRow) of the depth buffer
+void OcclusionBuffer::RasteriseRows(unsigned int firstRow, unsigned int endRow)
+{
+	float* depthBuffer = mHierarchicalZ.data();
+	std::fill(depthBuffer + firstRow * Width, depthBuffer + endRow * Width, 1.0f);
+
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f); // Centres of four pixels in a row
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one  = _mm_set1_ps(1.0f);
+
+	for (auto& triangle : mTriangles)
+	{
+		const float* x = triangle.x;
+		const float* y = triangle.y;
+		const float* z = triangle.z;
+
+		// Bounding rectangle of the triangle within this band. Columns start on a multiple of 4 so groups of four pixels
+		// never cross the end of a row (the width is a multiple of 4)
+		float minY = std::min(std::min(y[0], y[1]), y[2]);
+		float maxY = std::max(std::max(y[0], y[1]), y[2]);
+		float minX = std::min(std::min(x[0], x[1]), x[2]);
+		float maxX = std::max(std::max(x[0], x[1]), x[2]);
+		int rowStart = std::max(static_cast<int>(std::floor(minY)), static_cast<int>(firstRow));
+		int rowEnd   = std::min(static_cast<int>(std::ceil (maxY)), static_cast<int>(endRow));
+		int colStart = std::max(static_cast<int>(std::floor(minX)), 0) & ~3;
+		int colEnd   = std::min(static_cast<int>(std::ceil (maxX)), static_cast<int>(Width));
+		if (rowStart >= rowEnd || colStart >= colEnd)  continue;
+
+		// Edge functions: for each edge, a linear function of the pixel position that is positive on the inside of the
+		// edge. Edge i is opposite vertex i, and divided by the triangle's area it gives the weight of vertex i at the
+		// pixel (barycentric coordinates). A pixel is inside the triangle if all three are positive
+		float edgeA[3], edgeB[3], edgeC[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			int a = (i + 1) % 3;
+			int b = (i + 2) % 3;
+			edgeA[i] = y[a] - y[b];
+			edgeB[i] = x[b] - x[a];
+			edgeC[i] = x[a] * y[b] - y[a] * x[b];
+		}
+
+		// Depth is linear in screen space, so is also a linear function of pixel position, from the vertex weights
+		float invArea = 1.0f / (edgeC[0] + edgeC[1] + edgeC[2]);
+		float depthA = (edgeA[0] * z[0] + edgeA[1] * z[1] + edgeA[2] * z[2]) * invArea;
+		float depthB = (edgeB[0] * z[0] + edgeB[1] * z[1] + edgeB[2] * z[2]) * invArea;
+		float depthC = (edgeC[0] * z[0] + edgeC[1] * z[1] + edgeC[2] * z[2]) * invArea;
+
+		__m128 edgeA0 = _mm_set1_ps(edgeA[0]), edgeA1 = _mm_set1_ps(edgeA[1]), edgeA2 = _mm_set1_ps(edgeA[2]);
+		__m128 depthAs = _mm_set1_ps(depthA);
+
+		for (int row = rowStart; row < rowEnd; ++row)
+		{
+			// Parts of the functions that are constant along the row
+			float pixelY = row + 0.5f;
+			__m128 edgeRow0 = _mm_set1_ps(edgeB[0] * pixelY + edgeC[0]);
+			__m128 edgeRow1 = _mm_set1_ps(edgeB[1] * pixelY + edgeC[1]);
+			__m128 edgeRow2 = _mm_set1_ps(edgeB[2] * pixelY + edgeC[2]);
+			__m128 depthRow = _mm_set1_ps(depthB * pixelY + depthC);
+
+			float* depthPixels = depthBuffer + row * Width;
+			for (int col = colStart; col < colEnd; col += 4)
+			{
+				__m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(col)), pixelOffsets);
+				__m128 edge0 = _mm_add_ps(_mm_mul_ps(edgeA0, pixelX), edgeRow0);
+				__m128 edge1 = _mm_add_ps(_mm_mul_ps(edgeA1, pixelX), edgeRow1);
+				__m128 edge2 = _mm_add_ps(_mm_mul_ps(edgeA2, pixelX), edgeRow2);
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+				if (_mm_movemask_ps(inside) == 0)  continue;
+
+				// Keep the nearest depth at each pixel inside the triangle
+				__m128 depth = _mm_add_ps(_mm_mul_ps(depthAs, pixelX), depthRow);
+				depth = _mm_min_ps(_mm_max_ps(depth, zero), one);
+				__m128 oldDepth = _mm_loadu_ps(depthPixels + col);
+				__m128 newDepth = _mm_min_ps(oldDepth, depth);
+				_mm_storeu_ps(depthPixels + col, _mm_or_ps(_mm_and_ps(inside, newDepth), _mm_andnot_ps(inside, oldDepth)));
+			}
+		}
+	}
+}
+
+
+// Build each level of the hierarchical-Z pyramid from the one above
+void OcclusionBuffer::BuildHierarchicalZ()
+{
+	for (unsigned int level = 1; level < mNumLevels; ++level)
+	{
+		const float* source = mHierarchicalZ.data() + mLevelOffsets[level - 1];
+		float* dest = mHierarchicalZ.data() + mLevelOffsets[level];
+		unsigned int sourceWidth = Width  >> (level - 1);
+		unsigned int destWidth   = Width  >> level;
+		unsigned int destHeight  = Height >> level;
+
+		for (unsigned int row = 0; row < destHeight; ++row)
+		{
+			const float* source0 = source + row * 2 * sourceWidth;
+			const float* source1 = source0 + sourceWidth;
+			float* destRow = dest + row * destWidth;
+
+			// Four texels at a time: take the furthest of each vertical pair, then the furthest of each horizontal pair
+			unsigned int col = 0;
+			for (; col + 4 <= destWidth; col += 4)
+			{
+				__m128 a = _mm_max_ps(_mm_loadu_ps(source0 + col * 2),     _mm_loadu_ps(source1 + col * 2));
+				__m128 b = _mm_max_ps(_mm_loadu_ps(source0 + col * 2 + 4), _mm_loadu_ps(source1 + col * 2 + 4));
+				_mm_storeu_ps(destRow + col, _mm_max_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+				                                        _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+			}
+			for (; col < destWidth; ++col)
+			{
+				destRow[col] = std::max(std::max(source0[col * 2], source0[col * 2 + 1]),
+				                        std::max(source1[col * 2], source1[col * 2 + 1]));
+			}
+		}
+	}
+}
@@ -0,0 +1,95 @@
+//--------------------------------------------------------------------------------------
+// Small CPU depth buffer for occlusion culling
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Each frame a few large models that hide a lot of the scene (occluders, e.g. walls) are rasterised on the CPU into
+// a low resolution depth buffer. Each model's bounding box can then be tested against that buffer, and models that are
+// entirely behind occluders are not sent to the GPU at all.
+//
+// - Occluder triangles are transformed to clip space, clipped to the near plane and back-face culled on the main thread
+// - The buffer is split into bands of rows, each band rasterised on a worker thread so no locking is needed. Pixels are
+//   processed four at a time with SSE edge functions. Only depth is stored - the nearest occluder at each pixel
+// - A hierarchical-Z pyramid is built, each level storing the furthest depth of 2x2 texels from the level above, so a
+//   box of any size can be tested by reading only a few texels
+
+#ifndef _OCCLUSION_BUFFER_H_INCLUDED_
+#define _OCCLUSION_BUFFER_H_INCLUDED_
+
+#include "CMatrix4x4.h"
+#include "BoundingVolumes.h"
+
+#include <vector>
+#include <stdint.h>
+
+class OcclusionBuffer
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Size of the depth buffer in pixels. Width must be a multiple of 8 and both must be powers of 2
+	static const unsigned int Width  = 256;
+	static const unsigned int Height = 128;
+
+	OcclusionBuffer();
+
+	// Start a new frame for the given camera, removes all occluders
+	void Begin(const CMatrix4x4& viewProjectionMatrix);
+
+	// Add an occluder, a triangle list with vertex positions in model space and the model's world matrix. Triangles
+	// are culled the same way as the GPU does by default (counter-clockwise triangles face away)
+	void AddOccluder(const CVector3* positions, unsigned int numVertices, const uint32_t* indices, unsigned int numIndices,
+	                 const CMatrix4x4& worldMatrix);
+
+	// Rasterise all the occluders and build the hierarchical-Z buffer, call after adding occluders and before testing
+	void Rasterise();
+
+	// Test whether a world space box might be visible. Returns false only if the box is entirely behind occluders (or
+	// off-screen). Boxes crossing the near clip plane are always visible
+	bool IsVisible(const AABB& box);
+
+
+	// Statistics for the current frame
+	unsigned int NumOccluderTriangles()  { return static_cast<unsigned int>(mTriangles.size()); }
+
+	// Depth at each pixel after Rasterise (0 = near clip, 1 = far clip or no occluder), Width * Height values
+	const float* Depth()  { return mHierarchicalZ.data(); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// A triangle ready for rasterising: screen space pixel coordinates (y down) and depth (0 to 1)
+	struct Triangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+	};
+
+	// Project a clip space triangle to the screen and add it to the triangle list if it faces the camera
+	void AddTriangle(const float* v0, const float* v1, const float* v2);
+
+	// Rasterise all triangles into the rows [firstRow, endRow) of the depth buffer
+	void RasteriseRows(unsigned int firstRow, unsigned int endRow);
+
+	// Build each level of the hierarchical-Z pyramid from the one above
+	void BuildHierarchicalZ();
+
+
+	CMatrix4x4 mViewProjectionMatrix;
+
+	std::vector<float>    mClipVertices; // Occluder vertices in clip space (x, y, z, w), reused for each occluder
+	std::vector<Triangle> mTriangles;    // All occluder triangles this frame, ready to rasterise
+
+	// Depth buffer (Width x Height) and hierarchical-Z levels stored one after another. Level 0 is the depth buffer
+	// itself, each level after is half the size in each dimension
+	std::vector<float>        mHierarchicalZ;
+	std::vector<unsigned int> mLevelOffsets;
+	unsigned int              mNumLevels;
+};
+
+
+#endif //_OCCLUSION_BUFFER_H_INCLUDED_
@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// Pack tool - writes the asset files into a pack for the app to load
+//--------------------------------------------------------------------------------------
+// Usage: PackTool <pack file> <file or folder> [<file or folder> ...]
+//
+// Run from the app's folder so the names in the pack match the names the app loads, e.g.
+//     PackTool Assets.pak . TextureCache
+// Files named on the command line are always added. Folders are searched recursively for asset files (see
+// ASSET_EXTENSIONS), so source code and build output in the same folder are left out. See PackFile.h for the format
+
+#include "PackFile.h"
+
+#define NOMINMAX // Stop Windows headers defining "min" and "max"
+#include <windows.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <set>
+
+
+// Files of these types found in folders are added to the pack. Includes the texture cache's DDS files (see
+// TextureCache.h) and the compiled shaders
+const char* const ASSET_EXTENSIONS[] = { ".x", ".fbx", ".obj", ".dds", ".jpg", ".jpeg", ".png", ".bmp", ".tga", ".cso" };
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+static bool IsAssetFile(const std::string& filename)
+{
+	std::string name = NormaliseFilename(filename);
+	for (const char* extension : ASSET_EXTENSIONS)
+	{
+		size_t length = std::strlen(extension);
+		if (name.size() >= length && name.compare(name.size() - length, length, extension) == 0)  return true;
+	}
+	return false;
+}
+
+
+// Add the asset files in a folder and its subfolders
+static void AddFolder(const std::string& folder, std::vector<PackInput>& files)
+{
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA((folder + "/*").c_str(), &found);
+	if (find == INVALID_HANDLE_VALUE)  return;
+	do
+	{
+		std::string name = found.cFileName;
+		if (name == "." || name == "..")  continue;
+
+		std::string path = (folder == ".") ? name : folder + "/" + name;
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)  AddFolder(path, files);
+		else if (IsAssetFile(path))                              files.push_back({ path, path });
+	} while (FindNextFileA(find, &found));
+	FindClose(find);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Entry point
+//--------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::printf("Usage: PackTool <pack file> <file or folder> [<file or folder> ...]\n");
+		return 1;
+	}
+
+	std::vector<PackInput> files;
+	for (int arg = 2; arg < argc; ++arg)
+	{
+		std::string path = argv[arg];
+		DWORD attributes = GetFileAttributesA(path.c_str());
+		if (attributes == INVALID_FILE_ATTRIBUTES)
+		{
+			std::printf("Can't find %s\n", path.c_str());
+			return 1;
+		}
+		if (attributes & FILE_ATTRIBUTE_DIRECTORY)  AddFolder(path, files);
+		else                                         files.push_back({ path, path });
+	}
+
+	// The same file may be named more than once, e.g. a file and its folder. Also leave out the pack itself
+	std::set<std::string> names;
+	std::vector<PackInput> uniqueFiles;
+	std::string packName = NormaliseFilename(argv[1]);
+	for (auto& file : files)
+	{
+		std::string name = NormaliseFilename(file.name);
+		if (name != packName && names.insert(name).second)  uniqueFiles.push_back(file);
+	}
+
+	std::string error;
+	if (!WritePackFile(argv[1], uniqueFiles, error))
+	{
+		std::printf("%s\n", error.c_str());
+		return 1;
+	}
+
+	// Report what was packed
+	PackFile pack;
+	if (!pack.Open(argv[1]))
+	{
+		std::printf("Can't read back %s\n", argv[1]);
+		return 1;
+	}
+	uint64_t totalSize = 0, totalStored = 0;
+	unsigned int numCompressed = 0;
+	for (unsigned int entry = 0; entry < pack.NumEntries(); ++entry)
+	{
+		const PackEntry& packEntry = pack.Entry(entry);
+		totalSize   += packEntry.size;
+		totalStored += packEntry.storedSize;
+		if (packEntry.compression != PackCompression::None)  ++numCompressed;
+		std::printf("%10llu -> %10llu  %s\n", static_cast<unsigned long long>(packEntry.size),
+		            static_cast<unsigned long long>(packEntry.storedSize), pack.Name(entry).c_str());
+	}
+	std::printf("%u files (%u compressed), %llu bytes stored in %llu\n", pack.NumEntries(), numCompressed,
+	            static_cast<unsigned long long>(totalSize), static_cast<unsigned long long>(totalStored));
+	return 0;
+}
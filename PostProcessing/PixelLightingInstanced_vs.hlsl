@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// Per-Pixel Lighting Vertex Shader - Instanced
+//--------------------------------------------------------------------------------------
+// Same as PixelLighting_vs but draws many copies of a mesh in one draw call, each copy taking its world matrix from
+// the instance buffer. Sends world normal and position of vertex on to the pixel shader so lighting can be calculated per pixel.
+
+#include "Common.hlsli" // Shaders can also use include files - note the extension
+
+
+//--------------------------------------------------------------------------------------
+// Shader code
+//--------------------------------------------------------------------------------------
+
+// Vertex shader gets vertices from the mesh one at a time, along with the index of the instance being drawn
+LightingPixelShaderInput main(BasicVertex modelVertex, uint instanceID : SV_InstanceID)
+{
+    LightingPixelShaderInput output; // This is the data the pixel shader requires from this vertex shader
+
+    // Get the world matrix for this copy of the mesh
+    float4x4 worldMatrix = gInstances[gInstanceOffset + instanceID].worldMatrix;
+
+    // Input position is x,y,z only - need a 4th element to multiply by a 4x4 matrix. Use 1 for a point (0 for a vector) - recall lectures
+    float4 modelPosition = float4(modelVertex.position, 1); 
+
+    // Transform the vertex by the instance's world matrix, then the usual view and projection matrices
+    // The position is "precise" so it exactly matches the depth pre-pass (DepthOnlyInstanced_vs), which is required
+    // because the depth test after the pre-pass only accepts equal depths
+    precise float4 worldPosition     = mul(worldMatrix,       modelPosition);
+    precise float4 viewPosition      = mul(gViewMatrix,       worldPosition);
+    output.projectedPosition = mul(gProjectionMatrix, viewPosition);
+
+    // Also transform model normals into world space using the instance's world matrix - lighting will be calculated in world space
+    float4 modelNormal = float4(modelVertex.normal, 0);     // For normals add a 0 in the 4th element to indicate it is a vector
+    output.worldNormal = mul(worldMatrix, modelNormal).xyz;
+    output.worldPosition = worldPosition.xyz; // Also pass world position to pixel shader for lighting
+
+    // Pass texture coordinates (UVs) on to the pixel shader, the vertex shader doesn't need them
+    output.uv = modelVertex.uv;
+
+    // Where this copy's texture is in the texture array
+    output.textureSlot = gInstances[gInstanceOffset + instanceID].textureSlot;
+
+    return output; // Ouput data sent down the pipeline (to the pixel shader)
+}
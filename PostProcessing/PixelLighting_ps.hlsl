@@ -14,8 +14,40 @@
 // Here we allow the shader access to a texture that has been loaded from the C++ side and stored in GPU memory.
 // Note that textures are often called maps (because texture mapping describes wrapping a texture round a mesh).
 // Get used to people using the word "texture" and "map" interchangably.
-Texture2D DiffuseSpecularMap : register(t0); // Textures here can contain a diffuse map (main colour) in their rgb channels and a specular map (shininess) in the a channel
-SamplerState TexSampler      : register(s0); // A sampler is a filter for a texture like bilinear, trilinear or anisotropic - this is the sampler used for the texture above
+// The texture is one of the layers of a texture array (see TextureArrays.h in the C++ code), the model's texture slot says which
+Texture2DArray DiffuseSpecularMaps : register(t0); // Textures here can contain a diffuse map (main colour) in their rgb channels and a specular map (shininess) in the a channel
+SamplerState TexSampler            : register(s0); // A sampler is a filter for a texture like bilinear, trilinear or anisotropic - this is the sampler used for the texture above
+
+// Cube shadow maps for the shadow casting lights, one cube for each light (see ShadowMaps.h in the C++ code). The sampler
+// compares a depth against the shadow map rather than reading it
+TextureCubeArray       ShadowMaps    : register(t13);
+SamplerComparisonState ShadowSampler : register(s1);
+
+
+//--------------------------------------------------------------------------------------
+// Shadows
+//--------------------------------------------------------------------------------------
+
+// How much of a light reaches a point in the world, from 0 (fully in shadow) to 1 (fully lit)
+float ShadowFactor(int shadowMap, float3 worldPosition)
+{
+    if (shadowMap < 0)  return 1.0f; // Light doesn't cast shadows
+
+    // Vector from where the shadow map was rendered to the point. The cube face it is in looks along its largest axis,
+    // which gives the depth of the point in that face. Move the point a little towards the light so surfaces don't
+    // shadow themselves
+    float4 origin = gShadowOrigins[shadowMap]; // xyz = position, w = far clip
+    float3 shadowVector = worldPosition - origin.xyz;
+    float  faceDepth = max(abs(shadowVector.x), max(abs(shadowVector.y), abs(shadowVector.z)));
+    faceDepth -= 0.2f + faceDepth * 0.01f;
+
+    // Convert to a depth buffer value (0 to 1) using the same projection as the shadow map faces
+    float scaleZ = origin.w / (origin.w - gShadowNearClip);
+    float depth = scaleZ - gShadowNearClip * scaleZ / faceDepth;
+
+    return ShadowMaps.SampleCmpLevelZero(ShadowSampler, float4(shadowVector, shadowMap), depth);
+}
+
 
 
 //--------------------------------------------------------------------------------------
@@ -35,37 +67,47 @@ float4 main(LightingPixelShaderInput input) : SV_Target
     // Direction from pixel to camera
     float3 cameraDirection = normalize(gCameraPosition - input.worldPosition);
 
-	//// Light 1 ////
-
-	// Direction and distance from pixel to light
-	float3 light1Direction = normalize(gLight1Position - input.worldPosition);
-    float3 light1Dist = length(gLight1Position - input.worldPosition);
-    
-    // Equations from lighting lecture
-    float3 diffuseLight1 = gLight1Colour * max(dot(input.worldNormal, light1Direction), 0) / light1Dist; 
-    float3 halfway = normalize(light1Direction + cameraDirection);
-    float3 specularLight1 =  diffuseLight1 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower); // Multiplying by diffuseLight instead of light colour - my own personal preference
-
-
-	//// Light 2 ////
-
-	float3 light2Direction = normalize(gLight2Position - input.worldPosition);
-    float3 light2Dist = length(gLight2Position - input.worldPosition);
-    float3 diffuseLight2 = gLight2Colour * max(dot(input.worldNormal, light2Direction), 0) / light2Dist; 
-    halfway = normalize(light2Direction + cameraDirection);
-    float3 specularLight2 =  diffuseLight2 * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower);
-
-
-	// Sum the effect of the lights - add the ambient at this stage rather than for each light (or we will get too much ambient)
-	float3 diffuseLight = gAmbientColour + diffuseLight1 + diffuseLight2;
-	float3 specularLight = specularLight1 + specularLight2;
+	//// Point lights ////
+
+    // Find the light cluster this pixel is in: the tile from its position on screen and the depth slice from its
+    // distance in front of the camera. Must match LightClusters::ClusterIndex in the C++ code
+    float viewDepth = mul(float4(input.worldPosition, 1.0f), gViewMatrix).z;
+    uint3 cluster;
+    cluster.xy = uint2(input.projectedPosition.xy / float2(gViewportWidth, gViewportHeight) * float2(gClusterTilesX, gClusterTilesY));
+    cluster.z  = uint(max(log2(viewDepth) * gClusterSliceScale + gClusterSliceBias, 0.0f));
+    cluster    = min(cluster, uint3(gClusterTilesX, gClusterTilesY, gClusterSlices) - 1);
+    uint2 lightList = gLightClusters[(cluster.z * gClusterTilesY + cluster.y) * gClusterTilesX + cluster.x];
+
+    // Sum the effect of the lights in the cluster - start with the ambient rather than adding it for each light (or we will get too much ambient)
+    float3 diffuseLight  = gAmbientColour;
+    float3 specularLight = 0;
+    for (uint i = 0; i < lightList.y; ++i)
+    {
+        PointLight light = gPointLights[gLightIndices[lightList.x + i]];
+
+        // Direction and distance from pixel to light
+        float3 lightVector = light.position - input.worldPosition;
+        float  lightDist = length(lightVector);
+        float3 lightDirection = lightVector / lightDist;
+
+        // Fade the light out smoothly to nothing at its radius so it only needs to be in the clusters it reaches
+        float fade = saturate(1.0f - pow(lightDist / light.radius, 4));
+        fade *= fade;
+
+        // Equations from lighting lecture
+        float3 diffuse = light.colour * max(dot(input.worldNormal, lightDirection), 0) / lightDist * fade;
+        diffuse *= ShadowFactor(light.shadowMap, input.worldPosition);
+        float3 halfway = normalize(lightDirection + cameraDirection);
+        diffuseLight  += diffuse;
+        specularLight += diffuse * pow(max(dot(input.worldNormal, halfway), 0), gSpecularPower); // Multiplying by diffuseLight instead of light colour - my own personal preference
+    }
 
 
 	////////////////////
 	// Combine lighting and textures
 
     // Sample diffuse material and specular material colour for this pixel from a texture using a given sampler that you set up in the C++ code
-    float4 textureColour = DiffuseSpecularMap.Sample(TexSampler, input.uv);
+    float4 textureColour = SampleTextureSlot(DiffuseSpecularMaps, TexSampler, input.textureSlot, input.uv);
     float3 diffuseMaterialColour = textureColour.rgb; // Diffuse material colour in texture RGB (base colour of model)
     float specularMaterialColour = textureColour.a;   // Specular material colour in texture A (shininess of the surface)
 
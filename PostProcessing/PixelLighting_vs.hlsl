@@ -37,6 +37,7 @@ LightingPixelShaderInput main(BasicVertex modelVertex)
 
     // Pass texture coordinates (UVs) on to the pixel shader, the vertex shader doesn't need them
     output.uv = modelVertex.uv;
+    output.textureSlot = 0; // The whole texture, non-instanced draws don't use texture arrays
 
     return output; // Ouput data sent down the pipeline (to the pixel shader)
 }
@@ -0,0 +1,278 @@
+//--------------------------------------------------------------------------------------
+// Sort-keyed render queue
+//--------------------------------------------------------------------------------------
+
+#include "RenderQueue.h"
+#include "Mesh.h"
+#include "Common.h" // For gD3DContext
+
+#include <cstring>
+#include <algorithm>
+
+
+// Remove all draws, call before submitting draws for a new camera / frame. The draws are kept in frame memory (see
+// FrameAllocator.h) so the queue must be executed in the frame it is filled
+void RenderQueue::Clear()
+{
+	NewFrameStorage(mDraws);
+	NewFrameStorage(mKeys);
+	NewFrameStorage(mOrder);
+	NewFrameStorage(mSortKeys);
+	NewFrameStorage(mSortOrder);
+	NewFrameStorage(mBlendStates);
+	NewFrameStorage(mVertexShaders);
+	NewFrameStorage(mPixelShaders);
+	NewFrameStorage(mTextures);
+	mNumStateChanges = 0;
+}
+
+
+// Small id for a GPU object, used in the sort key. Ids are given out in the order objects are first seen since the last
+// Clear and are limited to the given number of bits (objects beyond that share the last id, which only affects grouping)
+// A frame only uses a handful of different states, shaders and textures so a linear search is quickest
+uint32_t RenderQueue::ObjectId(FrameVector<const void*>& objects, const void* object, uint32_t bits)
+{
+	uint32_t numObjects = static_cast<uint32_t>(objects.size());
+	for (uint32_t id = 0; id < numObjects; ++id)
+	{
+		if (objects[id] == object)  return id;
+	}
+
+	// Once every id is in use the list stops growing and all new objects share the last id
+	uint32_t maxId = (1u << bits) - 1;
+	if (numObjects > maxId)  return maxId;
+	objects.push_back(object);
+	return numObjects;
+}
+
+
+// Submit an instanced draw of one node of a mesh at a level of detail (see Mesh::RenderInstanced). Depth is the
+// distance from the camera used for ordering, e.g. distance to the nearest instance. Optionally draw only the given
+// index ranges of the node (see Mesh::CullMeshlets), which must stay valid until the queue is executed
+void RenderQueue::Submit(const Material* material, float depth, Mesh* mesh, unsigned int node, unsigned int lod,
+                         unsigned int instanceOffset, unsigned int numInstances,
+                         const MeshDrawRange* ranges /*= nullptr*/, unsigned int numRanges /*= 0*/)
+{
+	// State parts of the key
+	uint64_t pass    = static_cast<uint64_t>(material->pass) & 0xf;
+	uint64_t blend   = ObjectId(mBlendStates, material->blendState, 4);
+	uint64_t shader  = (ObjectId(mVertexShaders, material->vertexShader, 4) << 8) |
+	                    ObjectId(mPixelShaders,  material->pixelShader,  8);
+	uint64_t texture = ObjectId(mTextures, material->texture, 12);
+
+	// The bit pattern of a positive float increases with its value, so it can be used directly as an integer key
+	if (!(depth > 0.0f))  depth = 0.0f; // Also catches NaN
+	uint32_t depthBits;
+	std::memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	uint64_t key;
+	if (material->pass == RenderPass::Blended)
+	{
+		// Back-to-front: invert depth so further draws come first, and put it above the state so it takes priority
+		key = (pass << 60) | (static_cast<uint64_t>(~depthBits) << 28) | (blend << 24) | (shader << 12) | texture;
+	}
+	else
+	{
+		// State first so draws sharing state are grouped, then front-to-back within each group
+		key = (pass << 60) | (blend << 56) | (shader << 44) | (texture << 32) | depthBits;
+	}
+
+	mDraws.push_back({ material, mesh, node, lod, instanceOffset, numInstances, ranges, numRanges });
+	mKeys.push_back(key);
+}
+
+
+// Sort the draws by key, call after all draws are submitted
+// LSD radix sort, 8 bits per pass. The sort is stable so equal keys keep their submission order. Passes where every
+// key has the same digit are skipped, which is common since many key bits are identical within a frame
+void RenderQueue::Sort()
+{
+	uint32_t count = static_cast<uint32_t>(mKeys.size());
+	mOrder.resize(count);
+	for (uint32_t i = 0; i < count; ++i)  mOrder[i] = i;
+	if (count < 2)  return;
+
+	mSortKeys.resize(count);
+	mSortOrder.resize(count);
+	uint64_t* keys     = mKeys.data();
+	uint32_t* order    = mOrder.data();
+	uint64_t* keysOut  = mSortKeys.data();
+	uint32_t* orderOut = mSortOrder.data();
+
+	// Count all the digits for every pass in a single read of the keys
+	uint32_t histograms[8][256] = {};
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint64_t key = keys[i];
+		for (int pass = 0; pass < 8; ++pass)
+		{
+			++histograms[pass][(key >> (pass * 8)) & 0xff];
+		}
+	}
+
+	for (int pass = 0; pass < 8; ++pass)
+	{
+		uint32_t* histogram = histograms[pass];
+		unsigned int shift = pass * 8;
+
+		// Skip this pass if all keys have the same digit
+		if (histogram[(keys[0] >> shift) & 0xff] == count)  continue;
+
+		// Turn counts into starting positions for each digit
+		uint32_t total = 0;
+		for (int digit = 0; digit < 256; ++digit)
+		{
+			uint32_t digitCount = histogram[digit];
+			histogram[digit] = total;
+			total += digitCount;
+		}
+
+		// Scatter keys (and draw indexes) into their new positions
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t position = histogram[(keys[i] >> shift) & 0xff]++;
+			keysOut[position]  = keys[i];
+			orderOut[position] = order[i];
+		}
+
+		std::swap(keys, keysOut);
+		std::swap(order, orderOut);
+	}
+
+	// Result may have ended up in the scratch arrays
+	if (order != mOrder.data())
+	{
+		mKeys.swap(mSortKeys);
+		mOrder.swap(mSortOrder);
+	}
+}
+
+
+// Execute the sorted draws, changing state only when necessary
+void RenderQueue::Execute()
+{
+	ExecuteRange(0, static_cast<uint32_t>(mOrder.size()), nullptr);
+}
+
+
+// Execute the sorted draws for a single pass. Optionally replace the depth state of every draw, e.g. to draw
+// opaque models with an equal depth test after a depth pre-pass
+void RenderQueue::Execute(RenderPass pass, ID3D11DepthStencilState* depthStateOverride /*= nullptr*/)
+{
+	uint32_t first, end;
+	PassRange(pass, first, end);
+	ExecuteRange(first, end, depthStateOverride);
+}
+
+
+// Draw the opaque draws into the depth buffer only, using the given position-only vertex shader and no pixel
+// shader. The vertex shader must calculate positions exactly as the materials' vertex shaders do. Optionally
+// replace the rasterizer state of every draw, e.g. to draw both sides of models into shadow maps
+void RenderQueue::ExecuteDepthOnly(ID3D11VertexShader* depthOnlyVertexShader, ID3D11RasterizerState* rasterizerStateOverride /*= nullptr*/)
+{
+	uint32_t first, end;
+	PassRange(RenderPass::Opaque, first, end);
+	if (first == end)  return;
+
+	// Without a pixel shader nothing is written to the render target, only the depth buffer
+	gD3DContext->VSSetShader(depthOnlyVertexShader, nullptr, 0);
+	gD3DContext->PSSetShader(nullptr, nullptr, 0);
+	mNumStateChanges += 2;
+
+	// Only the states that affect depth are needed. Opaque draws are grouped by state so these rarely change
+	ID3D11DepthStencilState* depthState = nullptr;
+	ID3D11RasterizerState* rasterizerState = nullptr;
+	for (uint32_t i = first; i < end; ++i)
+	{
+		const Draw& draw = mDraws[mOrder[i]];
+		if (draw.material->depthState != depthState || i == first)
+		{
+			depthState = draw.material->depthState;
+			gD3DContext->OMSetDepthStencilState(depthState, 0);
+			++mNumStateChanges;
+		}
+		ID3D11RasterizerState* drawRasterizerState = rasterizerStateOverride ? rasterizerStateOverride : draw.material->rasterizerState;
+		if (drawRasterizerState != rasterizerState || i == first)
+		{
+			rasterizerState = drawRasterizerState;
+			gD3DContext->RSSetState(rasterizerState);
+			++mNumStateChanges;
+		}
+
+		draw.mesh->RenderInstanced(draw.node, draw.lod, draw.instanceOffset, draw.numInstances, true, draw.ranges, draw.numRanges);
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helper functions
+//--------------------------------------------------------------------------------------
+
+// Range of sorted draws [first, end) that belong to a pass
+void RenderQueue::PassRange(RenderPass pass, uint32_t& first, uint32_t& end)
+{
+	// The pass is the top 4 bits of the key, and the keys are sorted, so each pass is a contiguous range
+	uint64_t passKey = static_cast<uint64_t>(pass) << 60;
+	uint64_t nextPassKey = (static_cast<uint64_t>(pass) + 1) << 60;
+	first = static_cast<uint32_t>(std::lower_bound(mKeys.begin(), mKeys.end(), passKey) - mKeys.begin());
+	end = static_cast<uint32_t>(std::lower_bound(mKeys.begin() + first, mKeys.end(), nextPassKey) - mKeys.begin());
+}
+
+
+// Execute the sorted draws in the range [first, end), see Execute
+void RenderQueue::ExecuteRange(uint32_t first, uint32_t end, ID3D11DepthStencilState* depthStateOverride)
+{
+	// The previous draw's material. Draws sharing a material need no state changes at all
+	const Material* current = nullptr;
+	Material state; // Current GPU state, starts unknown (all null) so the first draw sets everything
+
+	for (uint32_t i = first; i < end; ++i)
+	{
+		const Draw& draw = mDraws[mOrder[i]];
+		const Material* material = draw.material;
+		if (material != current)
+		{
+			if (material->vertexShader != state.vertexShader || current == nullptr)
+			{
+				gD3DContext->VSSetShader(material->vertexShader, nullptr, 0);
+				++mNumStateChanges;
+			}
+			if (material->pixelShader != state.pixelShader || current == nullptr)
+			{
+				gD3DContext->PSSetShader(material->pixelShader, nullptr, 0);
+				++mNumStateChanges;
+			}
+			if (material->texture != state.texture || current == nullptr)
+			{
+				gD3DContext->PSSetShaderResources(0, 1, &material->texture); // First parameter must match texture slot number in the shader
+				++mNumStateChanges;
+			}
+			if (material->sampler != state.sampler || current == nullptr)
+			{
+				gD3DContext->PSSetSamplers(0, 1, &material->sampler);
+				++mNumStateChanges;
+			}
+			if (material->blendState != state.blendState || current == nullptr)
+			{
+				gD3DContext->OMSetBlendState(material->blendState, nullptr, 0xffffff);
+				++mNumStateChanges;
+			}
+			ID3D11DepthStencilState* depthState = depthStateOverride ? depthStateOverride : material->depthState;
+			if (depthState != state.depthState || current == nullptr)
+			{
+				gD3DContext->OMSetDepthStencilState(depthState, 0);
+				++mNumStateChanges;
+			}
+			if (material->rasterizerState != state.rasterizerState || current == nullptr)
+			{
+				gD3DContext->RSSetState(material->rasterizerState);
+				++mNumStateChanges;
+			}
+			state = *material;
+			state.depthState = depthState;
+			current = material;
+		}
+
+		draw.mesh->RenderInstanced(draw.node, draw.lod, draw.instanceOffset, draw.numInstances, false, draw.ranges, draw.numRanges);
+	}
+}
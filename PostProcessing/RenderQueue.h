@@ -0,0 +1,137 @@
+//--------------------------------------------------------------------------------------
+// Sort-keyed render queue
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Rather than hand-ordering draw calls, each draw is submitted with its material and distance from the camera. The
+// queue builds a 64-bit sort key for each draw, sorts all the keys with a radix sort and then executes the draws in
+// order, only changing GPU state when it differs from the previous draw:
+// - Passes are drawn in order (opaque, sky, blended)
+// - Opaque draws are grouped by state (blend, shaders, texture) and then drawn front-to-back to reduce overdraw
+// - Blended draws are drawn strictly back-to-front so blending is correct
+//
+// Key layout (most significant bits first):
+//   Opaque / sky: | pass 4 | blend 4 | shader 12 | texture 12 | depth 32           |
+//   Blended:      | pass 4 | inverted depth 32    | blend 4 | shader 12 | texture 12 |
+
+#ifndef _RENDER_QUEUE_H_INCLUDED_
+#define _RENDER_QUEUE_H_INCLUDED_
+
+#include "FrameAllocator.h" // Draws only last for the frame
+#include <d3d11.h>
+#include <vector>
+#include <stdint.h>
+
+class Mesh;
+struct MeshDrawRange;
+
+
+// Render passes in the order they are drawn
+enum class RenderPass
+{
+	Opaque  = 0,
+	Sky     = 1, // Drawn after opaque models so only the pixels they don't cover are drawn
+	Blended = 2,
+};
+
+
+// Everything needed to draw something apart from the geometry. Draws using the same material share GPU state
+struct Material
+{
+	RenderPass                pass = RenderPass::Opaque;
+	ID3D11VertexShader*       vertexShader    = nullptr; // Must be an instanced vertex shader (see InstanceBatcher.h)
+	ID3D11PixelShader*        pixelShader     = nullptr;
+	ID3D11ShaderResourceView* texture         = nullptr; // A texture array, or a texture viewed as an array of one layer
+	unsigned int              textureSlot     = 0;       // Which texture in the array (see TextureArrays.h)
+	ID3D11SamplerState*       sampler         = nullptr;
+	ID3D11BlendState*         blendState      = nullptr;
+	ID3D11DepthStencilState*  depthState      = nullptr;
+	ID3D11RasterizerState*    rasterizerState = nullptr;
+};
+
+
+class RenderQueue
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Remove all draws, call before submitting draws for a new camera / frame. The draws are kept in frame memory (see
+	// FrameAllocator.h) so the queue must be executed in the frame it is filled
+	void Clear();
+
+	// Submit an instanced draw of one node of a mesh at a level of detail (see Mesh::RenderInstanced). Depth is the
+	// distance from the camera used for ordering, e.g. distance to the nearest instance. Optionally draw only the given
+	// index ranges of the node (see Mesh::CullMeshlets), which must stay valid until the queue is executed
+	void Submit(const Material* material, float depth, Mesh* mesh, unsigned int node, unsigned int lod,
+	            unsigned int instanceOffset, unsigned int numInstances,
+	            const MeshDrawRange* ranges = nullptr, unsigned int numRanges = 0);
+
+	// Sort the draws by key, call after all draws are submitted
+	void Sort();
+
+	// Execute the sorted draws, changing state only when necessary
+	void Execute();
+
+	// Execute the sorted draws for a single pass. Optionally replace the depth state of every draw, e.g. to draw
+	// opaque models with an equal depth test after a depth pre-pass
+	void Execute(RenderPass pass, ID3D11DepthStencilState* depthStateOverride = nullptr);
+
+	// Draw the opaque draws into the depth buffer only, using the given position-only vertex shader and no pixel
+	// shader. The vertex shader must calculate positions exactly as the materials' vertex shaders do. Optionally
+	// replace the rasterizer state of every draw, e.g. to draw both sides of models into shadow maps
+	void ExecuteDepthOnly(ID3D11VertexShader* depthOnlyVertexShader, ID3D11RasterizerState* rasterizerStateOverride = nullptr);
+
+
+	// Statistics since the last Clear
+	unsigned int NumDraws()         { return static_cast<unsigned int>(mDraws.size()); }
+	unsigned int NumStateChanges()  { return mNumStateChanges; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Range of sorted draws [first, end) that belong to a pass
+	void PassRange(RenderPass pass, uint32_t& first, uint32_t& end);
+
+	// Execute the sorted draws in the range [first, end), see Execute
+	void ExecuteRange(uint32_t first, uint32_t end, ID3D11DepthStencilState* depthStateOverride);
+
+	// Small id for a GPU object, used in the sort key. Ids are given out in the order objects are first seen since the last
+	// Clear and are limited to the given number of bits (objects beyond that share the last id, which only affects grouping)
+	uint32_t ObjectId(FrameVector<const void*>& objects, const void* object, uint32_t bits);
+
+	// What is needed to execute a draw, kept small so sorting and executing stay cache-friendly
+	struct Draw
+	{
+		const Material*      material;
+		Mesh*                mesh;
+		unsigned int         node;
+		unsigned int         lod;
+		unsigned int         instanceOffset;
+		unsigned int         numInstances;
+		const MeshDrawRange* ranges; // Index ranges left after meshlet culling, null to draw the whole node
+		unsigned int         numRanges;
+	};
+
+	FrameVector<Draw>     mDraws;
+	FrameVector<uint64_t> mKeys;        // Sort key for each draw
+	FrameVector<uint32_t> mOrder;       // Draw indexes in sorted order
+
+	// Scratch space for the radix sort
+	FrameVector<uint64_t> mSortKeys;
+	FrameVector<uint32_t> mSortOrder;
+
+	// Objects used in the sort keys since the last Clear, an object's id is its position in the list. The lists start
+	// again on each Clear, so objects that are gone (e.g. texture views replaced by the texture streamer) don't build up
+	FrameVector<const void*> mBlendStates;
+	FrameVector<const void*> mVertexShaders; // Shader part of the key is vertex shader id (4 bits)...
+	FrameVector<const void*> mPixelShaders;  // ...then pixel shader id (8 bits)
+	FrameVector<const void*> mTextures;
+
+	unsigned int mNumStateChanges = 0;
+};
+
+
+#endif //_RENDER_QUEUE_H_INCLUDED_
@@ -0,0 +1,160 @@
+//--------------------------------------------------------------------------------------
+// Tests for DDS file layout
+//--------------------------------------------------------------------------------------
+
+#include "Tests.h"
+#include "DDSLayout.h"
+
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+
+// A DDS file in memory with the given header, optional DX10 header and the given number of bytes of pixel data
+static std::vector<uint8_t> MakeFile(const DDSHeader& header, const DDSHeaderDX10* headerDX10, size_t dataBytes)
+{
+	size_t headerBytes = sizeof(DDS_MAGIC) + sizeof(header) + (headerDX10 ? sizeof(*headerDX10) : 0);
+	std::vector<uint8_t> file(headerBytes + dataBytes);
+	std::memcpy(file.data(), &DDS_MAGIC, sizeof(DDS_MAGIC));
+	std::memcpy(file.data() + sizeof(DDS_MAGIC), &header, sizeof(header));
+	if (headerDX10)  std::memcpy(file.data() + sizeof(DDS_MAGIC) + sizeof(header), headerDX10, sizeof(*headerDX10));
+	return file;
+}
+
+// Header for an older style file with the given pixel format
+static DDSHeader LegacyHeader(unsigned int width, unsigned int height, unsigned int numMips, const DDSPixelFormat& pixelFormat)
+{
+	DDSHeader header = {};
+	header.size   = sizeof(DDSHeader);
+	header.flags  = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | (numMips > 0 ? DDSD_MIPMAPCOUNT : 0);
+	header.width  = width;
+	header.height = height;
+	header.mipMapCount = numMips;
+	header.pixelFormat = pixelFormat;
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.caps = DDSCAPS_TEXTURE;
+	return header;
+}
+
+static bool Parse(const std::vector<uint8_t>& file, DDSFileInfo& info)
+{
+	return ParseDDSHeader(file.data(), file.size(), file.size(), info);
+}
+
+// The layout D3D11_SUBRESOURCE_DATA has, for DDSSubresourceData
+struct SubresourceData
+{
+	const void*  data;
+	unsigned int pitch;
+	unsigned int slicePitch;
+};
+
+
+void TestDDSLayout()
+{
+	// Format sizes
+	bool blockCompressed = false;
+	CHECK(FormatSize(DXGI_FORMAT_BC1_UNORM, blockCompressed) == 8 && blockCompressed);
+	CHECK(FormatSize(DXGI_FORMAT_BC4_SNORM, blockCompressed) == 8 && blockCompressed);
+	CHECK(FormatSize(DXGI_FORMAT_BC7_UNORM_SRGB, blockCompressed) == 16 && blockCompressed);
+	CHECK(FormatSize(DXGI_FORMAT_B8G8R8X8_UNORM, blockCompressed) == 4 && !blockCompressed);
+	CHECK(FormatSize(DXGI_FORMAT_R16G16B16A16_FLOAT, blockCompressed) == 8 && !blockCompressed);
+	CHECK(FormatSize(DXGI_FORMAT_UNKNOWN, blockCompressed) == 0);
+
+	// Headers made for a BC7 texture with a full mip chain parse back to the same texture, with every mip's position and
+	// size. 200 x 52 has partial blocks, and the width and height reach 1 at different mips
+	std::vector<uint8_t> header;
+	CHECK(MakeDDSHeader(DXGI_FORMAT_BC7_UNORM, 200, 52, 8, header));
+	CHECK(header.size() == DDS_MAX_HEADER_BYTES);
+	const unsigned int expectedBlocksX[] = { 50, 25, 13, 7, 3, 2, 1, 1 };
+	const unsigned int expectedBlocksY[] = { 13, 7, 4, 2, 1, 1, 1, 1 };
+	uint64_t dataBytes = 0;
+	for (unsigned int mip = 0; mip < 8; ++mip)  dataBytes += expectedBlocksX[mip] * expectedBlocksY[mip] * 16;
+	std::vector<uint8_t> file = header;
+	file.resize(header.size() + dataBytes);
+
+	DDSFileInfo info;
+	CHECK(Parse(file, info));
+	CHECK(info.format == DXGI_FORMAT_BC7_UNORM && info.width == 200 && info.height == 52);
+	CHECK(info.mips.size() == 8);
+	uint64_t offset = DDS_MAX_HEADER_BYTES;
+	for (unsigned int mip = 0; mip < 8 && mip < info.mips.size(); ++mip)
+	{
+		CHECK(info.mips[mip].offset == offset);
+		CHECK(info.mips[mip].pitch == expectedBlocksX[mip] * 16);
+		CHECK(info.mips[mip].size == expectedBlocksX[mip] * expectedBlocksY[mip] * 16);
+		offset += info.mips[mip].size;
+	}
+
+	// Only the headers need to be passed, but the file must be large enough for every mip
+	CHECK(ParseDDSHeader(file.data(), DDS_MAX_HEADER_BYTES, file.size(), info));
+	CHECK(!ParseDDSHeader(file.data(), file.size(), file.size() - 1, info));
+	CHECK(!ParseDDSHeader(file.data(), DDS_MAX_HEADER_BYTES - 1, file.size(), info)); // DX10 header cut off
+	CHECK(!MakeDDSHeader(DXGI_FORMAT_UNKNOWN, 16, 16, 1, header));
+
+	// Mip data for creating the texture, from a given mip down
+	std::vector<SubresourceData> subresources;
+	Parse(file, info);
+	DDSSubresourceData(info, file.data(), 2, subresources);
+	CHECK(subresources.size() == 6);
+	CHECK(subresources.size() == 6 && subresources[0].data == file.data() + info.mips[2].offset &&
+	      subresources[0].pitch == info.mips[2].pitch && subresources[5].slicePitch == info.mips[7].size);
+
+	// Older style headers: fourCC block compressed formats and 32 bit RGB masks. Without a mip count there is one mip,
+	// and a count larger than the full chain stops at 1 x 1
+	DDSPixelFormat dxt1 = {};
+	dxt1.flags  = DDPF_FOURCC;
+	dxt1.fourCC = FourCC('D', 'X', 'T', '1');
+	file = MakeFile(LegacyHeader(10, 6, 0, dxt1), nullptr, 3 * 2 * 8);
+	CHECK(Parse(file, info));
+	CHECK(info.format == DXGI_FORMAT_BC1_UNORM && info.mips.size() == 1);
+	CHECK(info.mips.size() == 1 && info.mips[0].offset == 4 + sizeof(DDSHeader) && info.mips[0].pitch == 3 * 8);
+
+	DDSPixelFormat bgra = {};
+	bgra.flags = DDPF_RGB | DDPF_ALPHAPIXELS;
+	bgra.rgbBitCount = 32;
+	bgra.rBitMask = 0x00ff0000;  bgra.gBitMask = 0x0000ff00;  bgra.bBitMask = 0x000000ff;  bgra.aBitMask = 0xff000000;
+	file = MakeFile(LegacyHeader(4, 2, 10, bgra), nullptr, (4 * 2 + 2 * 1 + 1 * 1) * 4);
+	CHECK(Parse(file, info));
+	CHECK(info.format == DXGI_FORMAT_B8G8R8A8_UNORM && info.mips.size() == 3);
+	CHECK(info.mips.size() == 3 && info.mips[2].size == 4 && info.mips[0].pitch == 16);
+	bgra.flags = DDPF_RGB;
+	file = MakeFile(LegacyHeader(4, 2, 1, bgra), nullptr, 4 * 2 * 4);
+	CHECK(Parse(file, info) && info.format == DXGI_FORMAT_B8G8R8X8_UNORM);
+	std::swap(bgra.rBitMask, bgra.bBitMask);
+	file = MakeFile(LegacyHeader(4, 2, 1, bgra), nullptr, 4 * 2 * 4);
+	CHECK(Parse(file, info) && info.format == DXGI_FORMAT_R8G8B8A8_UNORM);
+
+	// Files that can't be read
+	file = MakeFile(LegacyHeader(16, 16, 1, dxt1), nullptr, 128);
+	CHECK(Parse(file, info));
+	std::vector<uint8_t> bad = file;
+	bad[0] = 'X';
+	CHECK(!Parse(bad, info)); // Not a DDS file
+
+	DDSHeader cube = LegacyHeader(16, 16, 1, dxt1);
+	cube.caps2 = DDSCAPS2_CUBEMAP;
+	CHECK(!Parse(MakeFile(cube, nullptr, 128 * 6), info));
+	DDSHeader volume = LegacyHeader(16, 16, 1, dxt1);
+	volume.caps2 = DDSCAPS2_VOLUME;
+	CHECK(!Parse(MakeFile(volume, nullptr, 128 * 16), info));
+	CHECK(!Parse(MakeFile(LegacyHeader(0, 16, 1, dxt1), nullptr, 128), info));
+	CHECK(!Parse(MakeFile(LegacyHeader(DDS_MAX_TEXTURE_SIZE * 2, 4, 1, dxt1), nullptr, DDS_MAX_TEXTURE_SIZE / 2 * 8), info));
+
+	DDSPixelFormat unsupported = dxt1;
+	unsupported.fourCC = FourCC('A', 'B', 'C', 'D');
+	CHECK(!Parse(MakeFile(LegacyHeader(16, 16, 1, unsupported), nullptr, 128), info));
+
+	DDSPixelFormat dx10 = dxt1;
+	dx10.fourCC = FourCC('D', 'X', '1', '0');
+	DDSHeaderDX10 array = {};
+	array.dxgiFormat = DXGI_FORMAT_BC1_UNORM;
+	array.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	array.arraySize = 1;
+	CHECK(Parse(MakeFile(LegacyHeader(16, 16, 1, dx10), &array, 128), info));
+	array.arraySize = 2;
+	CHECK(!Parse(MakeFile(LegacyHeader(16, 16, 1, dx10), &array, 256), info));
+	array.arraySize = 1;
+	array.resourceDimension = DDS_DIMENSION_TEXTURE2D + 1;
+	CHECK(!Parse(MakeFile(LegacyHeader(16, 16, 1, dx10), &array, 128), info));
+}
@@ -0,0 +1,135 @@
+//--------------------------------------------------------------------------------------
+// Tests for clustered lighting
+//--------------------------------------------------------------------------------------
+
+#include "Tests.h"
+#include "LightClusters.h"
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+
+// Squared distance from a point to a box, 0 if inside
+static float DistanceSquared(const CVector3& p, const AABB& box)
+{
+	float dx = std::max(std::max(box.min.x - p.x, p.x - box.max.x), 0.0f);
+	float dy = std::max(std::max(box.min.y - p.y, p.y - box.max.y), 0.0f);
+	float dz = std::max(std::max(box.min.z - p.z, p.z - box.max.z), 0.0f);
+	return dx * dx + dy * dy + dz * dz;
+}
+
+static bool ClusterHasLight(LightClusters& clusters, unsigned int cluster, uint32_t light)
+{
+	const LightClusters::Cluster& c = clusters.Clusters()[cluster];
+	const uint32_t* indices = clusters.LightIndices() + c.offset;
+	return std::find(indices, indices + c.count, light) != indices + c.count;
+}
+
+
+void TestLightClusters()
+{
+	const float fovX = 1.2f, aspectRatio = 16.0f / 9.0f, nearClip = 0.5f, farClip = 500.0f;
+	const unsigned int numTilesX = LightClusters::NumTilesX, numTilesY = LightClusters::NumTilesY;
+	const unsigned int numSlices = LightClusters::NumSlices;
+
+	// A camera away from the origin and turned, so the lights must be moved into view space correctly
+	CMatrix4x4 cameraMatrix = MatrixRotationX(0.3f) * MatrixRotationY(0.8f) * MatrixTranslation({ 20, 10, -30 });
+	CMatrix4x4 viewMatrix = InverseAffine(cameraMatrix);
+
+	// Lights of many sizes scattered around in front of the camera, with some behind it
+	uint32_t seed = 12345;
+	std::vector<PointLight> lights;
+	for (int i = 0; i < 600; ++i)
+	{
+		CVector3 viewPosition = { (RandomFloat(seed) - 0.5f) * 300, (RandomFloat(seed) - 0.5f) * 150, RandomFloat(seed) * 520 - 20 };
+		float radius = 0.2f + RandomFloat(seed) * RandomFloat(seed) * 40;
+		lights.push_back({ TransformPoint(viewPosition, cameraMatrix), radius, { 1, 1, 1 }, -1 });
+	}
+
+	LightClusters clusters;
+	clusters.Build(viewMatrix, fovX, aspectRatio, nearClip, farClip, lights.data(), static_cast<unsigned int>(lights.size()));
+
+	// Every list is within the index array and holds valid lights, each only once
+	unsigned int maxCount = 0;
+	for (unsigned int cluster = 0; cluster < LightClusters::NumClusters; ++cluster)
+	{
+		const LightClusters::Cluster& c = clusters.Clusters()[cluster];
+		CHECK(c.offset + c.count <= clusters.NumLightIndices());
+		std::vector<uint32_t> list(clusters.LightIndices() + c.offset, clusters.LightIndices() + c.offset + c.count);
+		std::sort(list.begin(), list.end());
+		CHECK(std::adjacent_find(list.begin(), list.end()) == list.end());
+		CHECK(list.empty() || list.back() < lights.size());
+		maxCount = std::max(maxCount, c.count);
+	}
+	CHECK(clusters.MaxLightsPerCluster() == maxCount);
+	CHECK(maxCount > 0);
+
+	// Brute force reference: the box of each cluster, found from the slice formula the shader uses, tested against every
+	// light's sphere. Lights clearly touching the box must be in the list, lights clearly apart from it must not
+	float tanHalfFOVx = std::tan(fovX * 0.5f);
+	float tanHalfFOVy = tanHalfFOVx / aspectRatio;
+	unsigned int numMissed = 0, numExtra = 0;
+	for (unsigned int slice = 0; slice < numSlices; ++slice)
+	{
+		float sliceNear = (slice == 0)             ? nearClip : std::exp2((slice     - clusters.SliceBias()) / clusters.SliceScale());
+		float sliceFar  = (slice == numSlices - 1) ? farClip  : std::exp2((slice + 1 - clusters.SliceBias()) / clusters.SliceScale());
+		for (unsigned int tileY = 0; tileY < numTilesY; ++tileY)
+		{
+			for (unsigned int tileX = 0; tileX < numTilesX; ++tileX)
+			{
+				float left   = -1.0f + 2.0f * tileX       / numTilesX;
+				float right  = -1.0f + 2.0f * (tileX + 1) / numTilesX;
+				float top    =  1.0f - 2.0f * tileY       / numTilesY;
+				float bottom =  1.0f - 2.0f * (tileY + 1) / numTilesY;
+				AABB box;
+				for (float depth : { sliceNear, sliceFar })
+				{
+					box.Add({ left  * tanHalfFOVx * depth, top    * tanHalfFOVy * depth, depth });
+					box.Add({ right * tanHalfFOVx * depth, bottom * tanHalfFOVy * depth, depth });
+				}
+
+				unsigned int cluster = (slice * numTilesY + tileY) * numTilesX + tileX;
+				for (uint32_t light = 0; light < lights.size(); ++light)
+				{
+					float distanceSq = DistanceSquared(TransformPoint(lights[light].position, viewMatrix), box);
+					float radiusSq = lights[light].radius * lights[light].radius;
+					bool listed = ClusterHasLight(clusters, cluster, light);
+					if (!listed && distanceSq < radiusSq * 0.999f)          ++numMissed;
+					if ( listed && distanceSq > radiusSq * 1.001f + 1e-4f)  ++numExtra;
+				}
+			}
+		}
+	}
+	CHECK(numMissed == 0);
+	CHECK(numExtra == 0);
+
+	// What the shader sees: a point anywhere in the view finds its cluster with ClusterIndex, and that cluster must list
+	// every light that reaches the point
+	unsigned int numPointsMissed = 0;
+	for (int i = 0; i < 20000; ++i)
+	{
+		float screenX = RandomFloat(seed), screenY = RandomFloat(seed);
+		float depth = nearClip + (farClip - nearClip) * RandomFloat(seed) * RandomFloat(seed);
+		CVector3 point = { (screenX * 2 - 1) * tanHalfFOVx * depth, (1 - screenY * 2) * tanHalfFOVy * depth, depth };
+		unsigned int cluster = clusters.ClusterIndex(screenX, screenY, depth);
+		CHECK(cluster < LightClusters::NumClusters);
+
+		for (uint32_t light = 0; light < lights.size(); ++light)
+		{
+			CVector3 offset = TransformPoint(lights[light].position, viewMatrix) - point;
+			float distanceSq = offset.x * offset.x + offset.y * offset.y + offset.z * offset.z;
+			if (distanceSq < lights[light].radius * lights[light].radius * 0.999f && !ClusterHasLight(clusters, cluster, light))
+			{
+				++numPointsMissed;
+			}
+		}
+	}
+	CHECK(numPointsMissed == 0);
+
+	// Building again with no lights leaves every cluster empty
+	clusters.Build(viewMatrix, fovX, aspectRatio, nearClip, farClip, nullptr, 0);
+	CHECK(clusters.NumLightIndices() == 0);
+	CHECK(clusters.MaxLightsPerCluster() == 0);
+	CHECK(clusters.Clusters()[0].count == 0 && clusters.Clusters()[LightClusters::NumClusters - 1].count == 0);
+}
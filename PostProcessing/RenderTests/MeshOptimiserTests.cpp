@@ -0,0 +1,178 @@
+//--------------------------------------------------------------------------------------
+// Tests for triangle and vertex order optimisation
+//--------------------------------------------------------------------------------------
+
+#include "Tests.h"
+#include "MeshOptimiser.h"
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+
+// Size of the vertices when measuring vertex fetch (position, normal and UVs)
+const unsigned int TEST_VERTEX_SIZE = 32;
+
+
+// Shuffle the triangles of a triangle list, keeping each triangle's corners in order
+static void ShuffleTriangles(std::vector<uint32_t>& indices, uint32_t seed)
+{
+	unsigned int numTriangles = static_cast<unsigned int>(indices.size() / 3);
+	for (unsigned int t = numTriangles - 1; t > 0; --t)
+	{
+		unsigned int other = std::min(static_cast<unsigned int>(RandomFloat(seed) * (t + 1)), t);
+		std::swap_ranges(&indices[t * 3], &indices[t * 3 + 3], &indices[other * 3]);
+	}
+}
+
+// Average over a range of triangles of how far each is in front of a point along its own normal
+static float AverageFacing(const std::vector<CVector3>& positions, const std::vector<uint32_t>& indices,
+                           unsigned int firstTriangle, unsigned int numTriangles, const CVector3& centre)
+{
+	float sum = 0;
+	for (unsigned int t = firstTriangle; t < firstTriangle + numTriangles; ++t)
+	{
+		const CVector3& p0 = positions[indices[t * 3]];
+		const CVector3& p1 = positions[indices[t * 3 + 1]];
+		const CVector3& p2 = positions[indices[t * 3 + 2]];
+		CVector3 normal = Normalise(Cross(p1 - p0, p2 - p0));
+		sum += Dot((p0 + p1 + p2) * (1.0f / 3) - centre, normal);
+	}
+	return sum / numTriangles;
+}
+
+
+void TestMeshOptimiser()
+{
+	// A strip of quads along two rows of vertices, top row even and bottom row odd, used in order. Every vertex misses
+	// the cache once, and the vertices are fetched in order so each cache line is read once
+	const unsigned int numQuads = 10;
+	std::vector<uint32_t> strip;
+	for (uint32_t quad = 0; quad < numQuads; ++quad)
+	{
+		uint32_t top = quad * 2, bottom = quad * 2 + 1;
+		strip.insert(strip.end(), { top, top + 2, bottom,  bottom, top + 2, bottom + 2 });
+	}
+	unsigned int numStripVertices = numQuads * 2 + 2;
+	IndexOrderStats stats = AnalyseIndexOrder(strip.data(), static_cast<unsigned int>(strip.size()), numStripVertices, TEST_VERTEX_SIZE);
+	CHECK(stats.numTriangles == 20 && stats.numVertices == 22 && stats.numVertexShaderRuns == 22);
+	CHECK_NEAR(stats.ACMR(), 1.1f, 1e-6f);
+	CHECK_NEAR(stats.ATVR(), 1.0f, 1e-6f);
+	CHECK(stats.numVertexBytes == 22 * TEST_VERTEX_SIZE && stats.numBytesFetched == 22 * TEST_VERTEX_SIZE);
+	CHECK_NEAR(stats.Overfetch(), 1.0f, 1e-6f);
+
+	// Drawing the first triangle again at the end misses for all three vertices, which have left the 16 vertex cache
+	strip.insert(strip.end(), { 0, 2, 1 });
+	stats = AnalyseIndexOrder(strip.data(), static_cast<unsigned int>(strip.size()), numStripVertices, 0);
+	CHECK(stats.numTriangles == 21 && stats.numVertexShaderRuns == 25);
+	CHECK_NEAR(stats.ATVR(), 25.0f / 22, 1e-6f);
+	CHECK(stats.numBytesFetched == 0);
+
+	// The cache holds the last 16 vertices that missed: after 18 vertices the third is still there but the second isn't
+	std::vector<uint32_t> fifo;
+	for (uint32_t v = 0; v < 18; ++v)  fifo.push_back(v);
+	fifo.insert(fifo.end(), { 2, 18, 19 });
+	CHECK(AnalyseIndexOrder(fifo.data(), 21, 20, 0).numVertexShaderRuns == 20);
+	fifo[18] = 1;
+	CHECK(AnalyseIndexOrder(fifo.data(), 21, 20, 0).numVertexShaderRuns == 21);
+
+
+	// A torus with its triangles shuffled runs the vertex shader for almost every corner. The vertex cache order brings
+	// that down to near the best possible (0.5 for a mesh with twice as many triangles as vertices), without changing
+	// the triangles
+	std::vector<CVector3> positions;
+	std::vector<uint32_t> original;
+	BuildTorus(96, 64, 10.0f, 3.0f, positions, original);
+	unsigned int numVertices = static_cast<unsigned int>(positions.size());
+	unsigned int numIndices  = static_cast<unsigned int>(original.size());
+	std::vector<uint32_t> indices = original;
+	ShuffleTriangles(indices, 9);
+	float shuffledACMR = AnalyseIndexOrder(indices.data(), numIndices, numVertices, 0).ACMR();
+	CHECK(shuffledACMR > 2.5f);
+
+	OptimiseVertexCache(indices.data(), numIndices, numVertices);
+	IndexOrderStats cacheStats = AnalyseIndexOrder(indices.data(), numIndices, numVertices, 0);
+	CHECK(cacheStats.ACMR() < 0.8f);
+	CHECK(cacheStats.ATVR() < 1.6f);
+	CHECK(SortedTriangles(indices) == SortedTriangles(original));
+
+	// The overdraw order moves whole clusters, keeping most of the cache reuse, and draws the triangles facing out from
+	// the middle of the mesh (the outside of the torus) before those facing in
+	std::vector<uint32_t> cacheOrder = indices;
+	OptimiseOverdraw(positions.data(), numVertices, indices.data(), numIndices);
+	CHECK(SortedTriangles(indices) == SortedTriangles(original));
+	CHECK(indices != cacheOrder);
+	CHECK(AnalyseIndexOrder(indices.data(), numIndices, numVertices, 0).ACMR() < cacheStats.ACMR() * 1.1f);
+	unsigned int numTriangles = numIndices / 3, numTenth = numTriangles / 10;
+	CVector3 centre = { 0, 0, 0 };
+	float firstFacing = AverageFacing(positions, indices, 0, numTenth, centre);
+	float lastFacing  = AverageFacing(positions, indices, numTriangles - numTenth, numTenth, centre);
+	CHECK(firstFacing > lastFacing + 3.0f);
+	CHECK(AverageFacing(positions, cacheOrder, 0, numTenth, centre) < firstFacing);
+
+	// Overdraw order only reorders what it is given, a mesh that is all one cluster is left alone
+	std::vector<uint32_t> single = { 0, 2, 1 };
+	OptimiseOverdraw(positions.data(), numVertices, single.data(), 3);
+	CHECK((single == std::vector<uint32_t>{ 0, 2, 1 }));
+
+
+	// Vertex fetch: with the vertices stored in a random order, mixed with vertices no triangle uses, most vertices
+	// fetched read a cache line of their own. Reordering the vertices into first use order reads each line once, and
+	// drops the unused vertices. The triangles still use the same positions
+	uint32_t seed = 31;
+	const unsigned int numUnused = 500;
+	unsigned int numStored = numVertices + numUnused;
+	std::vector<uint32_t> storedAt(numStored);
+	for (uint32_t v = 0; v < numStored; ++v)  storedAt[v] = v;
+	for (uint32_t v = numStored - 1; v > 0; --v)  std::swap(storedAt[v], storedAt[std::min(static_cast<uint32_t>(RandomFloat(seed) * (v + 1)), v)]);
+	std::vector<CVector3> stored(numStored, CVector3{ 1e6f, 1e6f, 1e6f }); // Unused vertices are far from the torus
+	for (uint32_t v = 0; v < numVertices; ++v)  stored[storedAt[v]] = positions[v];
+	std::vector<uint32_t> scattered(numIndices);
+	for (unsigned int i = 0; i < numIndices; ++i)  scattered[i] = storedAt[indices[i]];
+
+	IndexOrderStats scatteredStats = AnalyseIndexOrder(scattered.data(), numIndices, numStored, TEST_VERTEX_SIZE);
+	CHECK(scatteredStats.numVertices == numVertices);
+	CHECK(scatteredStats.Overfetch() > 1.5f);
+
+	std::vector<uint32_t> remap(numStored);
+	unsigned int numUsed = OptimiseVertexFetchRemap(remap.data(), scattered.data(), numIndices, numStored);
+	CHECK(numUsed == numVertices);
+	unsigned int numUnusedFound = 0, numBadRemaps = 0;
+	for (uint32_t v = 0; v < numStored; ++v)
+	{
+		if (remap[v] == UINT32_MAX)  ++numUnusedFound;
+		else if (remap[v] >= numUsed)  ++numBadRemaps;
+	}
+	CHECK(numUnusedFound == numUnused && numBadRemaps == 0);
+
+	std::vector<uint32_t> remapped = scattered;
+	RemapIndices(remapped.data(), numIndices, remap.data());
+	std::vector<CVector3> remappedPositions(numUsed);
+	RemapVertices(remappedPositions.data(), stored.data(), numStored, sizeof(CVector3), remap.data());
+	unsigned int numMoved = 0, numOutOfOrder = 0;
+	uint32_t nextNew = 0;
+	for (unsigned int i = 0; i < numIndices; ++i)
+	{
+		if (Length(remappedPositions[remapped[i]] - stored[scattered[i]]) != 0)  ++numMoved;
+		if (remapped[i] > nextNew)  ++numOutOfOrder; // Each new vertex is the next one in the buffer
+		if (remapped[i] == nextNew)  ++nextNew;
+	}
+	CHECK(numMoved == 0);
+	CHECK(numOutOfOrder == 0);
+
+	// Fewer bytes are fetched. Not every byte is fetched only once: vertices that run the vertex shader again (ATVR is
+	// above 1) may have left the memory cache since their first use
+	IndexOrderStats remappedStats = AnalyseIndexOrder(remapped.data(), numIndices, numUsed, TEST_VERTEX_SIZE);
+	CHECK(remappedStats.numVertexShaderRuns == scatteredStats.numVertexShaderRuns);
+	CHECK(remappedStats.Overfetch() < scatteredStats.Overfetch() * 0.6f);
+	CHECK(remappedStats.Overfetch() < 1.5f);
+
+	// Where every vertex runs the vertex shader once, as in the strip, every byte is fetched once
+	std::vector<uint32_t> scatteredStrip(strip.begin(), strip.end() - 3);
+	for (uint32_t& index : scatteredStrip)  index = index * 7 + 3; // Vertices spread through a buffer of 160
+	remap.resize(160);
+	numUsed = OptimiseVertexFetchRemap(remap.data(), scatteredStrip.data(), static_cast<unsigned int>(scatteredStrip.size()), 160);
+	CHECK(numUsed == numStripVertices);
+	RemapIndices(scatteredStrip.data(), static_cast<unsigned int>(scatteredStrip.size()), remap.data());
+	CHECK_NEAR(AnalyseIndexOrder(scatteredStrip.data(), static_cast<unsigned int>(scatteredStrip.size()), numUsed, TEST_VERTEX_SIZE).Overfetch(), 1.0f, 1e-6f);
+}
@@ -0,0 +1,204 @@
+//--------------------------------------------------------------------------------------
+// Tests for mesh simplification
+//--------------------------------------------------------------------------------------
+
+#include "Tests.h"
+#include "MeshSimplifier.h"
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+
+// A flat square grid of quads on the xz plane, facing up (+y). Vertices numbered along x then z. If seamColumn is given
+// the vertices in that column are duplicated at the end of the vertex list, and the quads to the right of the column
+// use the copies, like a UV seam
+static void BuildGrid(unsigned int size, std::vector<CVector3>& positions, std::vector<uint32_t>& indices,
+                      unsigned int seamColumn = 0)
+{
+	positions.clear();
+	indices.clear();
+	for (unsigned int z = 0; z <= size; ++z)
+	{
+		for (unsigned int x = 0; x <= size; ++x)  positions.push_back({ static_cast<float>(x), 0, static_cast<float>(z) });
+	}
+
+	unsigned int gridVertices = static_cast<unsigned int>(positions.size());
+	if (seamColumn > 0)
+	{
+		for (unsigned int z = 0; z <= size; ++z)  positions.push_back(positions[z * (size + 1) + seamColumn]);
+	}
+
+	auto vertex = [&](unsigned int x, unsigned int z, bool rightOfSeam)
+	{
+		if (seamColumn > 0 && x == seamColumn && rightOfSeam)  return gridVertices + z;
+		return z * (size + 1) + x;
+	};
+	for (unsigned int z = 0; z < size; ++z)
+	{
+		for (unsigned int x = 0; x < size; ++x)
+		{
+			bool right = (seamColumn > 0 && x >= seamColumn);
+			uint32_t v00 = vertex(x, z, right), v10 = vertex(x + 1, z, right);
+			uint32_t v01 = vertex(x, z + 1, right), v11 = vertex(x + 1, z + 1, right);
+			indices.insert(indices.end(), { v00, v01, v11,  v00, v11, v10 });
+		}
+	}
+}
+
+// A sphere made by splitting the faces of an octahedron and pushing the vertices out to the given radius. Vertices on
+// shared edges are not merged so the mesh is welded afterwards
+static void BuildSphere(unsigned int divisions, float radius, std::vector<CVector3>& positions, std::vector<uint32_t>& indices)
+{
+	const CVector3 corners[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const int faces[8][3] = { { 0, 2, 4 }, { 4, 2, 1 }, { 1, 2, 5 }, { 5, 2, 0 }, { 4, 3, 0 }, { 1, 3, 4 }, { 5, 3, 1 }, { 0, 3, 5 } };
+
+	positions.clear();
+	indices.clear();
+	for (const auto& face : faces)
+	{
+		const CVector3& a = corners[face[0]];
+		const CVector3& b = corners[face[1]];
+		const CVector3& c = corners[face[2]];
+
+		// Rows of points across the face, row i has i + 1 points
+		std::vector<std::vector<uint32_t>> rows(divisions + 1);
+		for (unsigned int i = 0; i <= divisions; ++i)
+		{
+			for (unsigned int j = 0; j <= i; ++j)
+			{
+				float u = static_cast<float>(i) / divisions, v = (i > 0) ? static_cast<float>(j) / i : 0;
+				CVector3 p = a + (b - a) * u + (c - b) * (u * v);
+				CVector3 onSphere = Normalise(p) * radius;
+
+				// Weld with any identical point already made
+				uint32_t index = static_cast<uint32_t>(positions.size());
+				for (uint32_t k = 0; k < positions.size(); ++k)
+				{
+					if (Length(positions[k] - onSphere) < 1e-5f)  { index = k;  break; }
+				}
+				if (index == positions.size())  positions.push_back(onSphere);
+				rows[i].push_back(index);
+			}
+		}
+		for (unsigned int i = 0; i < divisions; ++i)
+		{
+			for (unsigned int j = 0; j <= i; ++j)
+			{
+				indices.insert(indices.end(), { rows[i][j], rows[i + 1][j], rows[i + 1][j + 1] });
+				if (j < i)  indices.insert(indices.end(), { rows[i][j], rows[i + 1][j + 1], rows[i][j + 1] });
+			}
+		}
+	}
+}
+
+// Unnormalised normal of a triangle, length is twice the area
+static CVector3 TriangleNormal(const std::vector<CVector3>& positions, const uint32_t* triangle)
+{
+	const CVector3& p0 = positions[triangle[0]];
+	return Cross(positions[triangle[1]] - p0, positions[triangle[2]] - p0);
+}
+
+
+void TestMeshSimplifier()
+{
+	std::vector<CVector3> positions;
+	std::vector<uint32_t> indices;
+
+	// Flat grid: simplifies to close to the target with no error. The corners stay, the borders only slide along
+	// themselves so the area is unchanged, and no triangle is flipped over
+	const unsigned int gridSize = 32;
+	BuildGrid(gridSize, positions, indices);
+	unsigned int numIndices = static_cast<unsigned int>(indices.size());
+	unsigned int target = numIndices / 8;
+	std::vector<uint32_t> result(numIndices);
+	float error = -1;
+	unsigned int numResult = SimplifyMesh(positions.data(), static_cast<unsigned int>(positions.size()), indices.data(),
+	                                      numIndices, target, result.data(), &error);
+	CHECK(numResult % 3 == 0);
+	CHECK(numResult <= target * 5 / 4);
+	CHECK(numResult < numIndices / 4);
+	CHECK(error >= 0 && error < 1e-3f);
+
+	float area = 0;
+	bool flipped = false, corners[4] = {};
+	for (unsigned int i = 0; i < numResult; i += 3)
+	{
+		CVector3 normal = TriangleNormal(positions, &result[i]);
+		area += Length(normal) * 0.5f;
+		if (normal.y <= 0)  flipped = true;
+		for (unsigned int j = 0; j < 3; ++j)
+		{
+			CHECK(result[i + j] < positions.size());
+			const CVector3& p = positions[result[i + j]];
+			if (p.x == 0        && p.z == 0)         corners[0] = true;
+			if (p.x == gridSize && p.z == 0)         corners[1] = true;
+			if (p.x == 0        && p.z == gridSize)  corners[2] = true;
+			if (p.x == gridSize && p.z == gridSize)  corners[3] = true;
+		}
+	}
+	CHECK_NEAR(area, static_cast<float>(gridSize * gridSize), 1e-2f);
+	CHECK(!flipped);
+	CHECK(corners[0] && corners[1] && corners[2] && corners[3]);
+
+	// A target at or above the current size leaves the mesh as it was
+	numResult = SimplifyMesh(positions.data(), static_cast<unsigned int>(positions.size()), indices.data(), numIndices,
+	                         numIndices, result.data(), &error);
+	CHECK(numResult == numIndices);
+	CHECK(std::equal(indices.begin(), indices.end(), result.begin()));
+	CHECK(error == 0);
+
+	// Seam down the middle of the grid: the mesh still simplifies, and every triangle only uses vertices from its own
+	// side of the seam, so the UVs are not mixed up
+	const unsigned int seamColumn = gridSize / 2;
+	BuildGrid(gridSize, positions, indices, seamColumn);
+	numIndices = static_cast<unsigned int>(indices.size());
+	unsigned int gridVertices = (gridSize + 1) * (gridSize + 1);
+	numResult = SimplifyMesh(positions.data(), static_cast<unsigned int>(positions.size()), indices.data(), numIndices,
+	                         numIndices / 8, result.data(), &error);
+	CHECK(numResult < numIndices / 2);
+
+	unsigned int numMixed = 0;
+	area = 0;
+	for (unsigned int i = 0; i < numResult; i += 3)
+	{
+		bool left = false, right = false;
+		for (unsigned int j = 0; j < 3; ++j)
+		{
+			uint32_t v = result[i + j];
+			if (v >= gridVertices)                        right = true;  // Right hand copy of a seam vertex
+			else if (positions[v].x > seamColumn)         right = true;
+			else if (positions[v].x < seamColumn)         left  = true;
+			else                                          left  = true;  // Left hand copy of a seam vertex
+		}
+		if (left && right)  ++numMixed;
+		area += Length(TriangleNormal(positions, &result[i])) * 0.5f;
+	}
+	CHECK(numMixed == 0);
+	CHECK_NEAR(area, static_cast<float>(gridSize * gridSize), 1e-2f);
+
+	// Sphere: the reported error is small compared to the size, and is a fair measure of how far the simplified surface
+	// moved. Every vertex kept is on the sphere, so the furthest the surface gets from it is inside the triangles
+	const float radius = 10.0f;
+	BuildSphere(16, radius, positions, indices);
+	numIndices = static_cast<unsigned int>(indices.size());
+	result.resize(numIndices);
+	numResult = SimplifyMesh(positions.data(), static_cast<unsigned int>(positions.size()), indices.data(), numIndices,
+	                         numIndices / 4, result.data(), &error);
+	CHECK(numResult <= numIndices / 4 * 5 / 4);
+	CHECK(error > 0 && error < radius * 0.05f);
+
+	float maxDeviation = 0;
+	flipped = false;
+	for (unsigned int i = 0; i < numResult; i += 3)
+	{
+		const CVector3& p0 = positions[result[i]];
+		const CVector3& p1 = positions[result[i + 1]];
+		const CVector3& p2 = positions[result[i + 2]];
+		CVector3 centre = (p0 + p1 + p2) * (1.0f / 3.0f);
+		maxDeviation = std::max(maxDeviation, radius - Length(centre));
+		if (Dot(TriangleNormal(positions, &result[i]), centre) <= 0)  flipped = true;
+	}
+	CHECK(!flipped);
+	CHECK(maxDeviation < error * 4);
+}
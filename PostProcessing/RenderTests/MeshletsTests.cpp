@@ -0,0 +1,170 @@
+//--------------------------------------------------------------------------------------
+// Tests for meshlet building and culling
+//--------------------------------------------------------------------------------------
+
+#include "Tests.h"
+#include "Meshlets.h"
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+
+void TestMeshlets()
+{
+	std::vector<CVector3> positions;
+	std::vector<uint32_t> original;
+	BuildTorus(64, 48, 10.0f, 3.0f, positions, original);
+	unsigned int numVertices = static_cast<unsigned int>(positions.size());
+	unsigned int numIndices  = static_cast<unsigned int>(original.size());
+
+	std::vector<uint32_t> indices = original;
+	std::vector<Meshlet> meshlets;
+	BuildMeshlets(positions.data(), numVertices, indices.data(), numIndices, meshlets);
+
+	// The meshlets cover the index list in order with no gaps, within the size limits, and hold the same triangles
+	// as before (reordered, but each with its winding kept)
+	CHECK(meshlets.size() >= numIndices / 3 / MAX_MESHLET_TRIANGLES);
+	CHECK(meshlets.size() < numIndices / 3 / 40);
+	uint32_t nextIndex = 0;
+	unsigned int numOverLimit = 0, numOutsideSphere = 0;
+	for (const Meshlet& meshlet : meshlets)
+	{
+		CHECK(meshlet.firstIndex == nextIndex);
+		CHECK(meshlet.numIndices > 0 && meshlet.numIndices % 3 == 0);
+		nextIndex = meshlet.firstIndex + meshlet.numIndices;
+		if (nextIndex > numIndices)  break;
+
+		std::vector<uint32_t> vertices(indices.begin() + meshlet.firstIndex, indices.begin() + nextIndex);
+		std::sort(vertices.begin(), vertices.end());
+		vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+		if (vertices.size() > MAX_MESHLET_VERTICES || meshlet.numIndices / 3 > MAX_MESHLET_TRIANGLES)  ++numOverLimit;
+
+		// The bounding sphere holds every vertex
+		for (uint32_t vertex : vertices)
+		{
+			if (Length(positions[vertex] - meshlet.centre) > meshlet.radius * 1.0001f + 1e-5f)  ++numOutsideSphere;
+		}
+	}
+	CHECK(nextIndex == numIndices);
+	CHECK(numOverLimit == 0);
+	CHECK(numOutsideSphere == 0);
+	CHECK(SortedTriangles(indices) == SortedTriangles(original));
+
+	// Normal cones: wherever the camera is, if the cone says a meshlet faces away then every one of its triangles does
+	// (the camera is behind the plane of each). Cameras all around the torus, near and far, must find some to cull. The
+	// frustum planes here have no normal so everything is inside them
+	uint32_t seed = 4321;
+	MeshletCamera coneCamera = {};
+	for (int i = 0; i < 6; ++i)  coneCamera.frustum.d[i] = 1.0f;
+	unsigned int numConeCulled = 0, numWronglyCulled = 0;
+	for (int i = 0; i < 200; ++i)
+	{
+		float distance = 5.0f + 60.0f * RandomFloat(seed);
+		CVector3 direction = { RandomFloat(seed) - 0.5f, RandomFloat(seed) - 0.5f, RandomFloat(seed) - 0.5f };
+		coneCamera.position = Normalise(direction) * distance;
+
+		for (const Meshlet& meshlet : meshlets)
+		{
+			if (meshlet.coneCutoff >= 1.0f)  continue;
+			CHECK_NEAR(Length(meshlet.coneAxis), 1.0f, 1e-4f);
+
+			if (MeshletVisible(meshlet, coneCamera, true))  continue;
+			++numConeCulled;
+
+			for (uint32_t index = meshlet.firstIndex; index < meshlet.firstIndex + meshlet.numIndices; index += 3)
+			{
+				const CVector3& p0 = positions[indices[index]];
+				CVector3 normal = Normalise(Cross(positions[indices[index + 1]] - p0, positions[indices[index + 2]] - p0));
+				if (Dot(normal, coneCamera.position - p0) > 1e-4f)  ++numWronglyCulled;
+			}
+		}
+	}
+	CHECK(numConeCulled > 0);
+	CHECK(numWronglyCulled == 0);
+
+	// Frustum: a camera close to the torus, looking across part of it. Each meshlet culled must be wholly outside one of
+	// the planes, and back-face culling only ever removes more
+	const float nearClip = 1.0f, farClip = 100.0f;
+	const float scaleZa = farClip / (farClip - nearClip);
+	CMatrix4x4 projectionMatrix = { 2.0f,  0.0f,    0.0f,              0.0f,
+	                                0.0f,  3.0f,    0.0f,              0.0f,
+	                                0.0f,  0.0f, scaleZa,              1.0f,
+	                                0.0f,  0.0f, -nearClip * scaleZa,  0.0f };
+	CMatrix4x4 cameraMatrix = MatrixRotationX(0.3f) * MatrixRotationY(0.7f) * MatrixTranslation({ -4, 5, -16 });
+	CVector3 cameraPosition = cameraMatrix.GetPosition();
+	Frustum frustum = FrustumFromViewProjection(InverseAffine(cameraMatrix) * projectionMatrix);
+	MeshletCamera camera = { cameraPosition, frustum };
+
+	unsigned int numFrustumCulled = 0, numBadlyCulled = 0, numBackFacesCulled = 0, numVisible = 0;
+	for (const Meshlet& meshlet : meshlets)
+	{
+		bool visible = MeshletVisible(meshlet, camera, false);
+		bool visibleCullingBackFaces = MeshletVisible(meshlet, camera, true);
+		CHECK(visible || !visibleCullingBackFaces);
+		if (visible)
+		{
+			++numVisible;
+			if (!visibleCullingBackFaces)  ++numBackFacesCulled;
+			continue;
+		}
+		++numFrustumCulled;
+
+		bool outsidePlane = false;
+		for (int plane = 0; plane < 6 && !outsidePlane; ++plane)
+		{
+			CVector3 normal = { frustum.normalX[plane], frustum.normalY[plane], frustum.normalZ[plane] };
+			bool allOutside = true;
+			for (uint32_t index = meshlet.firstIndex; index < meshlet.firstIndex + meshlet.numIndices; ++index)
+			{
+				if (Dot(normal, positions[indices[index]]) + frustum.d[plane] >= 0)  allOutside = false;
+			}
+			outsidePlane = allOutside;
+		}
+		if (!outsidePlane)  ++numBadlyCulled;
+	}
+	CHECK(numFrustumCulled > 0);
+	CHECK(numVisible > 0);
+	CHECK(numBackFacesCulled > 0);
+	CHECK(numBadlyCulled == 0);
+
+	// A meshlet straight ahead of a camera at the origin is culled only if its cone points away, and never if its cone
+	// is too wide to use
+	Meshlet ahead = {};
+	ahead.centre = { 0, 0, 50 };
+	ahead.radius = 1.0f;
+	ahead.coneAxis = { 0, 0, 1 };
+	ahead.coneCutoff = 0.5f;
+	MeshletCamera originCamera = { { 0, 0, 0 }, FrustumFromViewProjection(projectionMatrix) };
+	CHECK(!MeshletVisible(ahead, originCamera, true));
+	CHECK( MeshletVisible(ahead, originCamera, false));
+	ahead.coneAxis = { 0, 0, -1 };
+	CHECK( MeshletVisible(ahead, originCamera, true));
+	ahead.coneAxis = { 0, 0, 1 };
+	ahead.coneCutoff = 1.0f;
+	CHECK( MeshletVisible(ahead, originCamera, true));
+
+	// Moving the camera into the mesh's space gives the same answers as moving the meshlets into the world. The world
+	// matrix rotates, scales and moves the mesh
+	const float scale = 2.0f;
+	CMatrix4x4 worldMatrix = MatrixScaling(scale) * MatrixRotationY(1.1f) * MatrixRotationZ(0.2f) * MatrixTranslation({ 6, -2, 15 });
+	MeshletCamera localCamera = MeshletCameraFromWorld(worldMatrix, cameraPosition, frustum);
+	CVector3 worldPosition = TransformPoint(localCamera.position, worldMatrix);
+	CHECK(Length(worldPosition - cameraPosition) < 1e-3f);
+
+	MeshletCamera worldCamera = { cameraPosition, frustum };
+	unsigned int numDifferent = 0, numLocalVisible = 0;
+	for (const Meshlet& meshlet : meshlets)
+	{
+		Meshlet worldMeshlet = meshlet;
+		worldMeshlet.centre = TransformPoint(meshlet.centre, worldMatrix);
+		worldMeshlet.radius = meshlet.radius * scale;
+		worldMeshlet.coneAxis = Normalise(TransformPoint(meshlet.coneAxis, worldMatrix) - worldMatrix.GetPosition());
+
+		bool localVisible = MeshletVisible(meshlet, localCamera, true);
+		if (localVisible != MeshletVisible(worldMeshlet, worldCamera, true))  ++numDifferent;
+		if (localVisible)  ++numLocalVisible;
+	}
+	CHECK(numDifferent == 0);
+	CHECK(numLocalVisible > 0 && numLocalVisible < meshlets.size());
+}
@@ -0,0 +1,210 @@
+//--------------------------------------------------------------------------------------
+// Tests for mip generation
+//--------------------------------------------------------------------------------------
+
+#include "Tests.h"
+#include "MipGenerator.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <stdint.h>
+
+
+static std::vector<uint8_t> RandomImage(unsigned int width, unsigned int height, uint32_t seed)
+{
+	std::vector<uint8_t> pixels(width * height * 4);
+	for (uint8_t& value : pixels)  value = static_cast<uint8_t>(RandomFloat(seed) * 256.0f);
+	return pixels;
+}
+
+// An image where each pixel has the same value in every channel, given by a function of x and y
+template <typename Function>
+static std::vector<uint8_t> GreyImage(unsigned int width, unsigned int height, Function function)
+{
+	std::vector<uint8_t> pixels(width * height * 4);
+	for (unsigned int y = 0; y < height; ++y)
+	{
+		for (unsigned int x = 0; x < width; ++x)
+		{
+			float value = std::min(std::max(function(x, y), 0.0f), 255.0f);
+			for (unsigned int c = 0; c < 4; ++c)  pixels[(y * width + x) * 4 + c] = static_cast<uint8_t>(value + 0.5f);
+		}
+	}
+	return pixels;
+}
+
+// Mean and standard deviation of one channel of a mip
+static void ChannelStatistics(const MipLevel& mip, unsigned int channel, float& mean, float& deviation)
+{
+	double sum = 0, sumSquares = 0;
+	size_t numPixels = mip.pixels.size() / 4;
+	for (size_t p = 0; p < numPixels; ++p)
+	{
+		double value = mip.pixels[p * 4 + channel];
+		sum += value;
+		sumSquares += value * value;
+	}
+	mean = static_cast<float>(sum / numPixels);
+	deviation = static_cast<float>(std::sqrt(std::max(sumSquares / numPixels - (sum / numPixels) * (sum / numPixels), 0.0)));
+}
+
+// Fraction of a mip's pixels with alpha above a reference (0-255)
+static float Coverage(const MipLevel& mip, float reference)
+{
+	size_t numPixels = mip.pixels.size() / 4, covered = 0;
+	for (size_t p = 0; p < numPixels; ++p)
+	{
+		if (mip.pixels[p * 4 + 3] > reference)  ++covered;
+	}
+	return static_cast<float>(covered) / numPixels;
+}
+
+
+void TestMipGenerator()
+{
+	MipSettings box;
+	box.filter = MipFilter::Box;
+	box.gammaCorrect = false;
+	MipSettings kaiser;
+	kaiser.filter = MipFilter::Kaiser;
+	kaiser.gammaCorrect = false;
+
+	// Every level down to 1x1, each half the size of the one before (but never less than 1)
+	std::vector<uint8_t> image = RandomImage(64, 16, 1);
+	std::vector<MipLevel> mips = GenerateMips(image.data(), 64, 16, box);
+	CHECK(mips.size() == 6);
+	for (size_t i = 0; i < mips.size(); ++i)
+	{
+		CHECK(mips[i].width == std::max(64u >> (i + 1), 1u) && mips[i].height == std::max(16u >> (i + 1), 1u));
+		CHECK(mips[i].pixels.size() == mips[i].width * mips[i].height * 4);
+	}
+	std::vector<uint8_t> odd = RandomImage(13, 5, 2);
+	mips = GenerateMips(odd.data(), 13, 5, kaiser);
+	CHECK(mips.size() == 3);
+	CHECK(mips.size() == 3 && mips[0].width == 6 && mips[0].height == 2 && mips[1].width == 3 && mips[1].height == 1 &&
+	      mips[2].width == 1 && mips[2].height == 1);
+
+	// Box filter without gamma correction: every pixel of every level is the average of the square of full size pixels
+	// it covers, to within rounding at each level
+	mips = GenerateMips(image.data(), 64, 16, box);
+	unsigned int numWrong = 0;
+	for (size_t i = 0; i < mips.size(); ++i)
+	{
+		const MipLevel& mip = mips[i];
+		unsigned int sizeX = 64 / mip.width, sizeY = 16 / mip.height;
+		for (unsigned int y = 0; y < mip.height; ++y)
+		{
+			for (unsigned int x = 0; x < mip.width; ++x)
+			{
+				for (unsigned int c = 0; c < 4; ++c)
+				{
+					double sum = 0;
+					for (unsigned int sy = 0; sy < sizeY; ++sy)
+					{
+						for (unsigned int sx = 0; sx < sizeX; ++sx)  sum += image[((y * sizeY + sy) * 64 + x * sizeX + sx) * 4 + c];
+					}
+					double expected = sum / (sizeX * sizeY);
+					if (std::fabs(mip.pixels[(y * mip.width + x) * 4 + c] - expected) > 0.51)  ++numWrong;
+				}
+			}
+		}
+	}
+	CHECK(numWrong == 0);
+
+	// Gamma correction: black and white pixels average to the sRGB value of half brightness (188), not 128. Alpha is
+	// never gamma corrected
+	std::vector<uint8_t> checks = GreyImage(8, 8, [](unsigned int x, unsigned int y) { return ((x + y) & 1) ? 255.0f : 0.0f; });
+	MipSettings gammaBox = box;
+	gammaBox.gammaCorrect = true;
+	mips = GenerateMips(checks.data(), 8, 8, gammaBox);
+	CHECK(std::abs(mips[0].pixels[0] - 188) <= 1 && std::abs(mips.back().pixels[2] - 188) <= 1);
+	CHECK(std::abs(mips[0].pixels[3] - 128) <= 1);
+	mips = GenerateMips(checks.data(), 8, 8, box);
+	CHECK(std::abs(mips[0].pixels[0] - 128) <= 1);
+
+	// A flat image stays flat with either filter, wrapping or not, and gamma corrected or not: the weights always add
+	// up to one
+	std::vector<uint8_t> flat = GreyImage(32, 24, [](unsigned int, unsigned int) { return 77.0f; });
+	for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser })
+	{
+		for (int options = 0; options < 4; ++options)
+		{
+			MipSettings settings;
+			settings.filter = filter;
+			settings.wrap = (options & 1) != 0;
+			settings.gammaCorrect = (options & 2) != 0;
+			unsigned int numChanged = 0;
+			for (const MipLevel& mip : GenerateMips(flat.data(), 32, 24, settings))
+			{
+				for (uint8_t value : mip.pixels)  if (std::abs(value - 77) > 1)  ++numChanged;
+			}
+			CHECK(numChanged == 0);
+		}
+	}
+
+	// Kaiser filter: fine detail that can't be shown at half size (stripes 2.5 pixels apart) is mostly removed, much more
+	// than by the box filter, while broad detail (64 pixels apart) keeps its contrast. The average brightness is kept
+	const float pi = 3.14159265f;
+	std::vector<uint8_t> fine  = GreyImage(128, 8, [=](unsigned int x, unsigned int) { return 128 + 100 * std::sin(x * 2 * pi / 2.5f); });
+	std::vector<uint8_t> broad = GreyImage(128, 8, [=](unsigned int x, unsigned int) { return 128 + 100 * std::sin(x * 2 * pi / 64.0f); });
+	float fineMean, fineKaiser, fineBox, broadMean, broadKaiser, dummy;
+	ChannelStatistics(GenerateMips(fine.data(), 128, 8, kaiser)[0], 0, fineMean, fineKaiser);
+	ChannelStatistics(GenerateMips(fine.data(), 128, 8, box)[0], 0, dummy, fineBox);
+	ChannelStatistics(GenerateMips(broad.data(), 128, 8, kaiser)[0], 0, broadMean, broadKaiser);
+	CHECK(fineKaiser < fineBox * 0.5f);
+	CHECK(fineKaiser < 10.0f);
+	CHECK(broadKaiser > 100 * 0.7071f * 0.95f); // A sine's standard deviation is its amplitude / sqrt(2)
+	CHECK(std::fabs(fineMean - 128) < 1.0f && std::fabs(broadMean - 128) < 1.0f);
+
+	// Wrapping treats the image as repeating, so moving the image two pixels moves the mip one pixel. Without wrapping
+	// the edge pixels are repeated instead, so the ends of a ramp don't blend with each other
+	std::vector<uint8_t> shifted(image.size());
+	for (unsigned int y = 0; y < 16; ++y)
+	{
+		for (unsigned int x = 0; x < 64; ++x)
+		{
+			std::copy_n(&image[(y * 64 + x) * 4], 4, &shifted[(y * 64 + (x + 2) % 64) * 4]);
+		}
+	}
+	MipLevel original = GenerateMips(image.data(), 64, 16, kaiser)[0];
+	MipLevel moved    = GenerateMips(shifted.data(), 64, 16, kaiser)[0];
+	numWrong = 0;
+	for (unsigned int y = 0; y < 8; ++y)
+	{
+		for (unsigned int x = 0; x < 32; ++x)
+		{
+			for (unsigned int c = 0; c < 4; ++c)
+			{
+				if (std::abs(original.pixels[(y * 32 + x) * 4 + c] - moved.pixels[(y * 32 + (x + 1) % 32) * 4 + c]) > 1)  ++numWrong;
+			}
+		}
+	}
+	CHECK(numWrong == 0);
+
+	std::vector<uint8_t> ramp = GreyImage(32, 4, [](unsigned int x, unsigned int) { return x * 8.0f; });
+	MipSettings clamp = kaiser;
+	clamp.wrap = false;
+	MipLevel wrapped = GenerateMips(ramp.data(), 32, 4, kaiser)[0];
+	MipLevel clamped = GenerateMips(ramp.data(), 32, 4, clamp)[0];
+	CHECK(clamped.pixels[0] < 8 && clamped.pixels[0] + 10 < wrapped.pixels[0]);
+	CHECK(clamped.pixels[15 * 4] > 240 && clamped.pixels[15 * 4] > wrapped.pixels[15 * 4] + 10);
+
+	// Alpha coverage: sparse alpha tested pixels (like leaves) among mostly transparent ones fade away in the smaller mips
+	// as their alpha is averaged down, unless coverage is preserved, which keeps the fraction of pixels passing the test
+	// close to the original at every level. Colour is never changed by it
+	uint32_t seed = 3;
+	std::vector<uint8_t> sparse = GreyImage(64, 64, [&](unsigned int, unsigned int) { return RandomFloat(seed) < 0.3f ? 255.0f : RandomFloat(seed) * 100.0f; });
+	float originalCoverage = 0;
+	for (size_t p = 0; p < 64 * 64; ++p)  if (sparse[p * 4 + 3] > 127)  originalCoverage += 1.0f / (64 * 64);
+	MipSettings coverage = box;
+	coverage.alphaCoverageReference = 0.5f;
+	std::vector<MipLevel> faded     = GenerateMips(sparse.data(), 64, 64, box);
+	std::vector<MipLevel> preserved = GenerateMips(sparse.data(), 64, 64, coverage);
+	CHECK(Coverage(faded[3], 127.5f) < originalCoverage * 0.5f);
+	for (size_t i = 0; i < 4; ++i)
+	{
+		CHECK(std::fabs(Coverage(preserved[i], 127.5f) - originalCoverage) < 0.05f);
+		CHECK(preserved[i].pixels[0] == faded[i].pixels[0]);
+	}
+}
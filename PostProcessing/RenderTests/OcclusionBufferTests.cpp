@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// Tests for the CPU occlusion buffer
+//--------------------------------------------------------------------------------------
+
+#include "Tests.h"
+#include "OcclusionBuffer.h"
+
+
+// Camera at the origin looking down +z, with a projection built the same way as Camera::UpdateMatrices
+// 90 degree horizontal field of view and the same aspect ratio as the buffer (2:1)
+static const float NEAR_CLIP = 1.0f;
+static const float FAR_CLIP  = 100.0f;
+
+static CMatrix4x4 ProjectionMatrix()
+{
+	float scaleX = 1.0f;
+	float scaleY = static_cast<float>(OcclusionBuffer::Width) / OcclusionBuffer::Height;
+	float scaleZa = FAR_CLIP / (FAR_CLIP - NEAR_CLIP);
+	float scaleZb = -NEAR_CLIP * scaleZa;
+	return CMatrix4x4{ scaleX,   0.0f,    0.0f, 0.0f,
+	                     0.0f, scaleY,    0.0f, 0.0f,
+	                     0.0f,   0.0f, scaleZa, 1.0f,
+	                     0.0f,   0.0f, scaleZb, 0.0f };
+}
+
+// Depth buffer value for a point at the given distance from the camera
+static float ExpectedDepth(float z)
+{
+	return FAR_CLIP / (FAR_CLIP - NEAR_CLIP) * (1.0f - NEAR_CLIP / z);
+}
+
+static AABB Box(const CVector3& min, const CVector3& max)
+{
+	AABB box;
+	box.Add(min);
+	box.Add(max);
+	return box;
+}
+
+
+// A 10 x 5 wall 10 units in front of the camera, covering the middle half of the screen across and down. Two clockwise
+// triangles facing the camera, or facing away if reversed
+static const CVector3 WALL_POSITIONS[] = { { -5, -2.5f, 10 }, { -5, 2.5f, 10 }, { 5, 2.5f, 10 }, { 5, -2.5f, 10 } };
+static const uint32_t WALL_INDICES[]          = { 0, 1, 2,  0, 2, 3 };
+static const uint32_t WALL_INDICES_REVERSED[] = { 0, 2, 1,  0, 3, 2 };
+
+void TestOcclusionBuffer()
+{
+	OcclusionBuffer buffer;
+	const unsigned int width = OcclusionBuffer::Width, height = OcclusionBuffer::Height;
+
+	buffer.Begin(ProjectionMatrix());
+	buffer.AddOccluder(WALL_POSITIONS, 4, WALL_INDICES, 6, MatrixIdentity());
+	buffer.Rasterise();
+	CHECK(buffer.NumOccluderTriangles() == 2);
+
+	// The wall covers pixels width/4 to 3*width/4 across and height/4 to 3*height/4 down, at its own depth. Nothing
+	// else was drawn
+	const float* depth = buffer.Depth();
+	CHECK_NEAR(depth[(height / 2) * width + width / 2], ExpectedDepth(10), 1e-4f);
+	CHECK_NEAR(depth[(height / 4 + 1) * width + width / 4 + 1], ExpectedDepth(10), 1e-4f);
+	CHECK(depth[0] == 1.0f);
+	CHECK(depth[(height / 2) * width + width / 4 - 2] == 1.0f);
+	CHECK(depth[(height / 4 - 2) * width + width / 2] == 1.0f);
+
+	unsigned int numCovered = 0;
+	for (unsigned int i = 0; i < width * height; ++i)
+	{
+		if (depth[i] < 1.0f)  ++numCovered;
+	}
+	CHECK(numCovered >= (width / 2 - 2) * (height / 2 - 2) && numCovered <= (width / 2 + 2) * (height / 2 + 2));
+
+	// Boxes entirely behind the wall are hidden, anything in front of it, reaching past its edges or crossing the near
+	// clip plane might be seen
+	CHECK(!buffer.IsVisible(Box({ -1, -1, 20 }, { 1, 1, 22 })));
+	CHECK(!buffer.IsVisible(Box({ -8, -4, 50 }, { 8, 4, 60 })));
+	CHECK( buffer.IsVisible(Box({ -1, -1, 5 }, { 1, 1, 6 })));
+	CHECK( buffer.IsVisible(Box({ -1, -1, 8 }, { 1, 1, 20 })));  // Reaches in front of the wall
+	CHECK( buffer.IsVisible(Box({ 3, -1, 20 }, { 12, 1, 22 }))); // Reaches past the right edge
+	CHECK( buffer.IsVisible(Box({ -1, -1, -5 }, { 1, 1, 30 }))); // Crosses the near clip plane
+	CHECK(!buffer.IsVisible(Box({ -1, -1, 150 }, { 1, 1, 160 }))); // Behind the wall, reaching past the far clip
+
+	// Boxes off-screen are never visible
+	CHECK(!buffer.IsVisible(Box({ 100, -1, 20 }, { 110, 1, 22 })));
+	CHECK(!buffer.IsVisible(Box({ -1, 100, 20 }, { 1, 110, 22 })));
+
+	// The world matrix is applied to the occluder: moved 5 units right the wall only hides boxes right of the middle
+	buffer.Begin(ProjectionMatrix());
+	buffer.AddOccluder(WALL_POSITIONS, 4, WALL_INDICES, 6, MatrixTranslation({ 5, 0, 0 }));
+	buffer.Rasterise();
+	CHECK( buffer.IsVisible(Box({ -3, -1, 20 }, { -1, 1, 22 })));
+	CHECK(!buffer.IsVisible(Box({  3, -1, 20 }, {  5, 1, 22 })));
+
+	// Triangles facing away from the camera are culled, so hide nothing
+	buffer.Begin(ProjectionMatrix());
+	buffer.AddOccluder(WALL_POSITIONS, 4, WALL_INDICES_REVERSED, 6, MatrixIdentity());
+	buffer.Rasterise();
+	CHECK(buffer.NumOccluderTriangles() == 0);
+	CHECK(buffer.IsVisible(Box({ -1, -1, 20 }, { 1, 1, 22 })));
+
+	// Begin removes the occluders from the last frame
+	buffer.Begin(ProjectionMatrix());
+	buffer.Rasterise();
+	CHECK(buffer.NumOccluderTriangles() == 0);
+	CHECK(buffer.IsVisible(Box({ -1, -1, 20 }, { 1, 1, 22 })));
+}
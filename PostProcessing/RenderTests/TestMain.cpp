@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Render tests - checks the parts of the app that don't use DirectX
+//--------------------------------------------------------------------------------------
+// Usage: RenderTests [test name]
+//
+// Runs every test, or only the one named, and reports each failed check. Returns 0 if everything passed
+
+#include "Tests.h"
+
+#include <cstdio>
+#include <cstring>
+
+
+// Failed checks in the test being run
+static unsigned int sNumFailures = 0;
+
+// Report a failed check, used by the CHECK macros
+void ReportFailure(const char* file, int line, const char* expression)
+{
+	std::printf("  %s(%d): check failed: %s\n", file, line, expression);
+	++sNumFailures;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Entry point
+//--------------------------------------------------------------------------------------
+
+struct Test
+{
+	const char* name;
+	void      (*function)();
+};
+
+static const Test TESTS[] =
+{
+	{ "OcclusionBuffer", TestOcclusionBuffer },
+	{ "LightClusters",   TestLightClusters },
+	{ "MeshSimplifier",  TestMeshSimplifier },
+	{ "Meshlets",        TestMeshlets },
+	{ "TextureCompressor", TestTextureCompressor },
+	{ "MipGenerator",    TestMipGenerator },
+	{ "DDSLayout",       TestDDSLayout },
+	{ "XFileParser",     TestXFileParser },
+	{ "MeshOptimiser",   TestMeshOptimiser },
+};
+
+int main(int argc, char* argv[])
+{
+	const char* only = (argc > 1) ? argv[1] : nullptr;
+
+	unsigned int numFailedTests = 0, numRun = 0;
+	for (const Test& test : TESTS)
+	{
+		if (only != nullptr && std::strcmp(only, test.name) != 0)  continue;
+
+		std::printf("%s\n", test.name);
+		sNumFailures = 0;
+		test.function();
+		++numRun;
+		if (sNumFailures > 0)
+		{
+			std::printf("  FAILED (%u checks)\n", sNumFailures);
+			++numFailedTests;
+		}
+	}
+
+	if (numRun == 0)
+	{
+		std::printf("No test called %s\n", only);
+		return 1;
+	}
+	std::printf("%u of %u tests passed\n", numRun - numFailedTests, numRun);
+	return numFailedTests > 0 ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// Tests for the parts of the app that don't use DirectX
+//--------------------------------------------------------------------------------------
+// Code in .cpp files, one for each module tested
+// Each test function checks one module with CHECK, which reports any failure and carries on so one run shows every
+// problem. Neither the tests nor the modules they test use DirectX or Windows code, so they can be built and run on any
+// platform (see CMakeLists.txt)
+
+#ifndef _TESTS_H_INCLUDED_
+#define _TESTS_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+
+// Report a failed check, used by the CHECK macros
+void ReportFailure(const char* file, int line, const char* expression);
+
+#define CHECK(expression)  do { if (!(expression))  ReportFailure(__FILE__, __LINE__, #expression); } while (false)
+
+// Check two floating point values are within the given distance of each other
+#define CHECK_NEAR(a, b, tolerance)  CHECK(std::fabs((a) - (b)) <= (tolerance))
+
+
+// Repeatable random numbers from 0 to 1
+inline float RandomFloat(uint32_t& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) / 16777216.0f;
+}
+
+// Transform a point by a matrix (row vector times matrix, as in the shaders)
+inline CVector3 TransformPoint(const CVector3& p, const CMatrix4x4& m)
+{
+	return { p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30,
+	         p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31,
+	         p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32 };
+}
+
+// A torus around the y axis, made of quads split into clockwise triangles facing out. Not convex, so the triangles face
+// every way and some hide others
+inline void BuildTorus(unsigned int numRings, unsigned int numSegments, float radius, float tubeRadius,
+                       std::vector<CVector3>& positions, std::vector<uint32_t>& indices)
+{
+	const float twoPi = 6.28318530718f;
+	positions.clear();
+	indices.clear();
+	for (unsigned int ring = 0; ring < numRings; ++ring)
+	{
+		float u = twoPi * ring / numRings;
+		for (unsigned int segment = 0; segment < numSegments; ++segment)
+		{
+			float v = twoPi * segment / numSegments;
+			float distance = radius + tubeRadius * std::cos(v);
+			positions.push_back({ distance * std::cos(u), tubeRadius * std::sin(v), distance * std::sin(u) });
+		}
+	}
+	for (uint32_t ring = 0; ring < numRings; ++ring)
+	{
+		for (uint32_t segment = 0; segment < numSegments; ++segment)
+		{
+			uint32_t nextRing = (ring + 1) % numRings, nextSegment = (segment + 1) % numSegments;
+			uint32_t v00 = ring * numSegments + segment,  v01 = ring * numSegments + nextSegment;
+			uint32_t v10 = nextRing * numSegments + segment, v11 = nextRing * numSegments + nextSegment;
+			indices.insert(indices.end(), { v00, v01, v10,  v10, v01, v11 });
+		}
+	}
+}
+
+// The triangles of an index list, each rotated to start at its lowest index (keeping the winding), sorted
+inline std::vector<std::array<uint32_t, 3>> SortedTriangles(const std::vector<uint32_t>& indices)
+{
+	std::vector<std::array<uint32_t, 3>> triangles;
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		std::array<uint32_t, 3> t = { indices[i], indices[i + 1], indices[i + 2] };
+		std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+		triangles.push_back(t);
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+
+// The tests, each in the .cpp file of the same name
+void TestOcclusionBuffer();
+void TestLightClusters();
+void TestMeshSimplifier();
+void TestMeshlets();
+void TestTextureCompressor();
+void TestMipGenerator();
+void TestDDSLayout();
+void TestXFileParser();
+void TestMeshOptimiser();
+
+
+#endif //_TESTS_H_INCLUDED_
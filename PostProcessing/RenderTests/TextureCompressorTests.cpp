@@ -0,0 +1,363 @@
+//--------------------------------------------------------------------------------------
+// Tests for block compression
+//--------------------------------------------------------------------------------------
+// The compressed blocks are decoded here following the format specifications rather than the encoder's own code, so
+// a block the GPU would read differently from what the encoder intended shows up as error
+
+#include "Tests.h"
+#include "TextureCompressor.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+
+//--------------------------------------------------------------------------------------
+// Decoders
+//--------------------------------------------------------------------------------------
+
+// Read numBits of a block from the given bit position (from the lowest bit of the first byte), moving the position on
+static uint32_t ReadBits(const uint8_t* block, unsigned int& position, unsigned int numBits)
+{
+	uint32_t value = 0;
+	for (unsigned int bit = 0; bit < numBits; ++bit, ++position)
+	{
+		value |= ((block[position >> 3] >> (position & 7)) & 1u) << bit;
+	}
+	return value;
+}
+
+static void Expand565(uint32_t packed, int* colour)
+{
+	uint32_t r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+	colour[0] = (r << 3) | (r >> 2);
+	colour[1] = (g << 2) | (g >> 4);
+	colour[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 colour block to RGBA. In BC3 the colour block always uses four colours
+static void DecodeColourBlock(const uint8_t* block, bool alwaysFourColours, uint8_t* pixels)
+{
+	unsigned int position = 0;
+	uint32_t colour0 = ReadBits(block, position, 16);
+	uint32_t colour1 = ReadBits(block, position, 16);
+	int palette[4][4];
+	Expand565(colour0, palette[0]);
+	Expand565(colour1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+	for (int c = 0; c < 3; ++c)
+	{
+		if (colour0 > colour1 || alwaysFourColours)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	if (colour0 <= colour1 && !alwaysFourColours)  palette[3][3] = 0;
+
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		uint32_t index = ReadBits(block, position, 2);
+		for (int c = 0; c < 4; ++c)  pixels[p * 4 + c] = static_cast<uint8_t>(palette[index][c]);
+	}
+}
+
+// BC4 block to one channel of RGBA pixels
+static void DecodeChannelBlock(const uint8_t* block, unsigned int channel, uint8_t* pixels)
+{
+	unsigned int position = 0;
+	int end0 = ReadBits(block, position, 8);
+	int end1 = ReadBits(block, position, 8);
+	float palette[8] = { static_cast<float>(end0), static_cast<float>(end1) };
+	if (end0 > end1)
+	{
+		for (int i = 1; i < 7; ++i)  palette[i + 1] = ((7 - i) * end0 + i * end1) / 7.0f;
+	}
+	else
+	{
+		for (int i = 1; i < 5; ++i)  palette[i + 1] = ((5 - i) * end0 + i * end1) / 5.0f;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		pixels[p * 4 + channel] = static_cast<uint8_t>(palette[ReadBits(block, position, 3)] + 0.5f);
+	}
+}
+
+// BC7 block to RGBA. Only the modes the encoder uses (5 and 6) are decoded, returns false for any other
+static bool DecodeBC7Block(const uint8_t* block, uint8_t* pixels)
+{
+	static const int WEIGHTS2[4]  = { 0, 21, 43, 64 };
+	static const int WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	auto interpolate = [](int e0, int e1, int weight) { return static_cast<uint8_t>(((64 - weight) * e0 + weight * e1 + 32) >> 6); };
+
+	unsigned int mode = 0;
+	while (mode < 8 && !(block[0] & (1 << mode)))  ++mode;
+	unsigned int position = mode + 1;
+
+	if (mode == 6)
+	{
+		int end0[4], end1[4];
+		for (int c = 0; c < 4; ++c)
+		{
+			end0[c] = ReadBits(block, position, 7) << 1;
+			end1[c] = ReadBits(block, position, 7) << 1;
+		}
+		uint32_t p0 = ReadBits(block, position, 1), p1 = ReadBits(block, position, 1);
+		for (int c = 0; c < 4; ++c)  { end0[c] |= p0;  end1[c] |= p1; }
+		for (unsigned int p = 0; p < 16; ++p)
+		{
+			uint32_t index = ReadBits(block, position, p == 0 ? 3 : 4);
+			for (int c = 0; c < 4; ++c)  pixels[p * 4 + c] = interpolate(end0[c], end1[c], WEIGHTS4[index]);
+		}
+		return true;
+	}
+	if (mode == 5)
+	{
+		if (ReadBits(block, position, 2) != 0)  return false; // Channel rotation is not used
+		int end0[4], end1[4];
+		for (int c = 0; c < 3; ++c)
+		{
+			int e0 = ReadBits(block, position, 7), e1 = ReadBits(block, position, 7);
+			end0[c] = (e0 << 1) | (e0 >> 6);
+			end1[c] = (e1 << 1) | (e1 >> 6);
+		}
+		end0[3] = ReadBits(block, position, 8);
+		end1[3] = ReadBits(block, position, 8);
+		for (unsigned int p = 0; p < 16; ++p)
+		{
+			uint32_t index = ReadBits(block, position, p == 0 ? 1 : 2);
+			for (int c = 0; c < 3; ++c)  pixels[p * 4 + c] = interpolate(end0[c], end1[c], WEIGHTS2[index]);
+		}
+		for (unsigned int p = 0; p < 16; ++p)
+		{
+			uint32_t index = ReadBits(block, position, p == 0 ? 1 : 2);
+			pixels[p * 4 + 3] = interpolate(end0[3], end1[3], WEIGHTS2[index]);
+		}
+		return true;
+	}
+	return false;
+}
+
+// Decode a block of any format to 16 RGBA pixels. Channels the format doesn't store are left as they were
+static bool DecodeBlock(BlockFormat format, const uint8_t* block, uint8_t* pixels)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1:  DecodeColourBlock(block, false, pixels);  return true;
+	case BlockFormat::BC3:  DecodeColourBlock(block + 8, true, pixels);  DecodeChannelBlock(block, 3, pixels);  return true;
+	case BlockFormat::BC4:  DecodeChannelBlock(block, 0, pixels);  return true;
+	case BlockFormat::BC5:  DecodeChannelBlock(block, 0, pixels);  DecodeChannelBlock(block + 8, 1, pixels);  return true;
+	case BlockFormat::BC7:  return DecodeBC7Block(block, pixels);
+	}
+	return false;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Tests
+//--------------------------------------------------------------------------------------
+
+// Channels each format stores, as (first, count)
+static void FormatChannels(BlockFormat format, unsigned int& first, unsigned int& count)
+{
+	first = 0;
+	count = (format == BlockFormat::BC4) ? 1 : (format == BlockFormat::BC5) ? 2 : (format == BlockFormat::BC1) ? 3 : 4;
+}
+
+// Compress and decode an image, returning the root mean square error over the channels the format stores and
+// the largest error of any one value. Also checks every block decodes
+static float RoundTripError(BlockFormat format, const std::vector<uint8_t>& pixels, unsigned int width, unsigned int height,
+                            int* maxError = nullptr)
+{
+	std::vector<uint8_t> compressed(CompressedSize(format, width, height));
+	CompressImage(format, pixels.data(), width, height, compressed.data());
+
+	unsigned int first, count;
+	FormatChannels(format, first, count);
+	unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	double totalSquared = 0;
+	int largest = 0;
+	unsigned int numFailed = 0, numValues = 0;
+	for (unsigned int blockY = 0; blockY < blocksY; ++blockY)
+	{
+		for (unsigned int blockX = 0; blockX < blocksX; ++blockX)
+		{
+			uint8_t decoded[64] = {};
+			if (!DecodeBlock(format, &compressed[(blockY * blocksX + blockX) * BlockBytes(format)], decoded))  ++numFailed;
+
+			for (unsigned int y = 0; y < 4 && blockY * 4 + y < height; ++y)
+			{
+				for (unsigned int x = 0; x < 4 && blockX * 4 + x < width; ++x)
+				{
+					const uint8_t* original = &pixels[((blockY * 4 + y) * width + blockX * 4 + x) * 4];
+					for (unsigned int c = first; c < first + count; ++c)
+					{
+						int difference = static_cast<int>(decoded[(y * 4 + x) * 4 + c]) - original[c];
+						totalSquared += difference * difference;
+						largest = std::max(largest, std::abs(difference));
+						++numValues;
+					}
+				}
+			}
+		}
+	}
+	CHECK(numFailed == 0);
+	if (maxError)  *maxError = largest;
+	return static_cast<float>(std::sqrt(totalSquared / numValues));
+}
+
+// A smooth image, like a photo or painted texture: gradients and waves in each channel, with some fine noise on top
+static std::vector<uint8_t> TestImage(unsigned int width, unsigned int height, float noise, uint32_t seed)
+{
+	std::vector<uint8_t> pixels(width * height * 4);
+	for (unsigned int y = 0; y < height; ++y)
+	{
+		for (unsigned int x = 0; x < width; ++x)
+		{
+			float values[4] = { 128 + 100 * std::sin(x * 0.15f) * std::cos(y * 0.1f), 20.0f + x * 3.0f, 230.0f - y * 3.0f,
+			                    128 + 120 * std::cos((x + y) * 0.05f) };
+			for (unsigned int c = 0; c < 4; ++c)
+			{
+				float value = values[c] + (RandomFloat(seed) - 0.5f) * noise;
+				pixels[(y * width + x) * 4 + c] = static_cast<uint8_t>(std::min(std::max(value, 0.0f), 255.0f) + 0.5f);
+			}
+		}
+	}
+	return pixels;
+}
+
+
+void TestTextureCompressor()
+{
+	const BlockFormat formats[] = { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7 };
+
+	// Sizes
+	CHECK(BlockBytes(BlockFormat::BC1) == 8 && BlockBytes(BlockFormat::BC4) == 8);
+	CHECK(BlockBytes(BlockFormat::BC3) == 16 && BlockBytes(BlockFormat::BC5) == 16 && BlockBytes(BlockFormat::BC7) == 16);
+	CHECK(CompressedSize(BlockFormat::BC1, 64, 32) == 16 * 8 * 8);
+	CHECK(CompressedSize(BlockFormat::BC7, 13, 5) == 4 * 2 * 16);
+	CHECK(CompressedSize(BlockFormat::BC4, 1, 1) == 8);
+
+	// Round trip error on a smooth image, and one with noise that the formats can't follow exactly. The limits are a
+	// little above what the encoder manages now, so a change that makes it noticeably worse will fail. On the smooth
+	// image BC7 must beat BC3, which stores the same channels
+	std::vector<uint8_t> smooth = TestImage(64, 64, 0, 1);
+	std::vector<uint8_t> noisy  = TestImage(64, 64, 48, 2);
+	const float smoothLimits[] = { 3.3f, 2.9f, 1.4f, 1.0f, 2.5f };
+	const float noisyLimits[]  = { 12.0f, 10.5f, 2.5f, 2.2f, 10.5f };
+	float smoothErrors[5], noisyErrors[5];
+	for (unsigned int f = 0; f < 5; ++f)
+	{
+		smoothErrors[f] = RoundTripError(formats[f], smooth, 64, 64);
+		noisyErrors[f]  = RoundTripError(formats[f], noisy,  64, 64);
+		CHECK(smoothErrors[f] < smoothLimits[f]);
+		CHECK(noisyErrors[f]  < noisyLimits[f]);
+	}
+	CHECK(smoothErrors[4] < smoothErrors[1]);
+
+	// Blocks the formats can store exactly come back exactly: a single grey level in BC4/BC5, the two 8 bit values plus
+	// 0 and 255 in BC4's second mode, and two 565 colours in BC1
+	std::vector<uint8_t> exact(16 * 4);
+	int maxError = -1;
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		const uint8_t values[4] = { 0, 77, 200, 255 };
+		exact[p * 4 + 0] = values[p % 4];
+		exact[p * 4 + 1] = 93;
+		exact[p * 4 + 2] = 0;
+		exact[p * 4 + 3] = 255;
+	}
+	RoundTripError(BlockFormat::BC4, exact, 4, 4, &maxError);
+	CHECK(maxError == 0);
+	RoundTripError(BlockFormat::BC5, exact, 4, 4, &maxError);
+	CHECK(maxError == 0);
+
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		bool second = (p % 3 == 0);
+		exact[p * 4 + 0] = second ? 0x84 : 0xFF;  // 5 bit 16 and 31
+		exact[p * 4 + 1] = second ? 0x41 : 0xC3;  // 6 bit 16 and 48
+		exact[p * 4 + 2] = second ? 0x08 : 0x42;  // 5 bit 1 and 8
+	}
+	RoundTripError(BlockFormat::BC1, exact, 4, 4, &maxError);
+	CHECK(maxError == 0);
+
+	// A solid colour is close in every format, within the precision of the endpoints
+	const uint8_t solid[4] = { 200, 31, 117, 64 };
+	for (unsigned int p = 0; p < 16; ++p)  std::memcpy(&exact[p * 4], solid, 4);
+	const int solidLimits[] = { 3, 3, 0, 0, 1 };
+	for (unsigned int f = 0; f < 5; ++f)
+	{
+		RoundTripError(formats[f], exact, 4, 4, &maxError);
+		CHECK(maxError <= solidLimits[f]);
+	}
+
+	// Colours spread along one line in a random order, so the first pixel can be at either end of it (BC7 stores the
+	// first pixel's index with a bit less). The largest error is about half the gap between palette levels
+	uint32_t seed = 7;
+	const int lineLimits[] = { 36, 36, 16, 16, 12 };
+	int lineErrors[5] = {};
+	for (int i = 0; i < 100; ++i)
+	{
+		for (unsigned int p = 0; p < 16; ++p)
+		{
+			float t = RandomFloat(seed);
+			exact[p * 4 + 0] = static_cast<uint8_t>(40 + t * 200);
+			exact[p * 4 + 1] = static_cast<uint8_t>(250 - t * 180);
+			exact[p * 4 + 2] = static_cast<uint8_t>(t * 100);
+			exact[p * 4 + 3] = static_cast<uint8_t>(255 - t * 255);
+		}
+		for (unsigned int f = 0; f < 5; ++f)
+		{
+			RoundTripError(formats[f], exact, 4, 4, &maxError);
+			lineErrors[f] = std::max(lineErrors[f], maxError);
+		}
+	}
+	for (unsigned int f = 0; f < 5; ++f)  CHECK(lineErrors[f] <= lineLimits[f]);
+
+	// A whole image matches compressing each of its blocks alone, with partial blocks at the edges copying the edge
+	// pixels. Uses an odd size so there are partial blocks both ways
+	const unsigned int width = 13, height = 7;
+	std::vector<uint8_t> odd = TestImage(width, height, 64, 3);
+	for (BlockFormat format : formats)
+	{
+		std::vector<uint8_t> compressed(CompressedSize(format, width, height));
+		CompressImage(format, odd.data(), width, height, compressed.data());
+
+		unsigned int numDifferent = 0;
+		for (unsigned int blockY = 0; blockY < 2; ++blockY)
+		{
+			for (unsigned int blockX = 0; blockX < 4; ++blockX)
+			{
+				uint8_t blockPixels[64], block[16];
+				for (unsigned int p = 0; p < 16; ++p)
+				{
+					unsigned int x = std::min(blockX * 4 + p % 4, width - 1), y = std::min(blockY * 4 + p / 4, height - 1);
+					std::memcpy(&blockPixels[p * 4], &odd[(y * width + x) * 4], 4);
+				}
+				CompressBlock(format, blockPixels, block);
+				if (std::memcmp(block, &compressed[(blockY * 4 + blockX) * BlockBytes(format)], BlockBytes(format)) != 0)  ++numDifferent;
+			}
+		}
+		CHECK(numDifferent == 0);
+		CHECK(RoundTripError(format, odd, width, height) < 14.0f);
+	}
+
+	// Format choice
+	std::vector<uint8_t> opaque = smooth;
+	for (size_t p = 0; p < opaque.size(); p += 4)  opaque[p + 3] = 255;
+	CHECK(ChooseBlockFormat(smooth.data(), 64, 64, TextureChannels::R)          == BlockFormat::BC4);
+	CHECK(ChooseBlockFormat(smooth.data(), 64, 64, TextureChannels::RG)         == BlockFormat::BC5);
+	CHECK(ChooseBlockFormat(smooth.data(), 64, 64, TextureChannels::RGB)        == BlockFormat::BC1);
+	CHECK(ChooseBlockFormat(smooth.data(), 64, 64, TextureChannels::RGBA)       == BlockFormat::BC3);
+	CHECK(ChooseBlockFormat(opaque.data(), 64, 64, TextureChannels::RGBA)       == BlockFormat::BC1);
+	CHECK(ChooseBlockFormat(opaque.data(), 64, 64, TextureChannels::RGBA, true) == BlockFormat::BC7);
+}
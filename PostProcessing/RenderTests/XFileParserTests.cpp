@@ -0,0 +1,517 @@
+//--------------------------------------------------------------------------------------
+// Tests for the .x file parser
+//--------------------------------------------------------------------------------------
+// The same file contents are written as text and as binary with 32 and 64-bit floats, which must all read the same
+
+#include "Tests.h"
+#include "XFileParser.h"
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+
+//--------------------------------------------------------------------------------------
+// Writing files
+//--------------------------------------------------------------------------------------
+
+enum class XFormat
+{
+	Text,
+	Binary32,
+	Binary64,
+};
+
+// Writes the structure and data of a .x file in any of the formats. Text files separate every value with a comma or
+// semicolon, binary files hold each call's values in one list
+class XFileWriter
+{
+public:
+	XFileWriter(XFormat format) : mFormat(format)
+	{
+		Text((format == XFormat::Text) ? "xof 0303txt 0032\n" : (format == XFormat::Binary32) ? "xof 0303bin 0032" : "xof 0303bin 0064");
+	}
+
+	// Start an object of the given template, optionally with a name
+	void Object(const char* type, const std::string& name = "")
+	{
+		Name(type);
+		if (!name.empty())  Name(name);
+		if (mFormat == XFormat::Text)  Text("{\n");
+		else                           Binary<uint16_t>(10);
+	}
+
+	void End()
+	{
+		if (mFormat == XFormat::Text)  Text("}\n");
+		else                           Binary<uint16_t>(11);
+	}
+
+	void Ints(const std::vector<uint32_t>& values)
+	{
+		if (mFormat == XFormat::Text)
+		{
+			for (size_t i = 0; i < values.size(); ++i)  Text(std::to_string(values[i]) + (i + 1 < values.size() ? "," : ";\n"));
+			return;
+		}
+		Binary<uint16_t>(6);
+		Binary<uint32_t>(static_cast<uint32_t>(values.size()));
+		for (uint32_t value : values)  Binary(value);
+	}
+
+	void Floats(const std::vector<float>& values)
+	{
+		if (mFormat == XFormat::Text)
+		{
+			// 9 significant digits are enough for every float to read back exactly
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				char text[32];
+				std::snprintf(text, sizeof(text), "%.9g%s", values[i], (i + 1 < values.size()) ? ";" : ";;\n");
+				Text(text);
+			}
+			return;
+		}
+		Binary<uint16_t>(7);
+		Binary<uint32_t>(static_cast<uint32_t>(values.size()));
+		for (float value : values)
+		{
+			if (mFormat == XFormat::Binary64)  Binary(static_cast<double>(value));
+			else                               Binary(value);
+		}
+	}
+
+	void Matrix(const CMatrix4x4& m)
+	{
+		Floats(std::vector<float>(&m.e00, &m.e00 + 16));
+	}
+
+	void Text(const std::string& text)  { mData.insert(mData.end(), text.begin(), text.end()); }
+
+	std::vector<uint8_t>& Data()  { return mData; }
+
+private:
+	void Name(const std::string& name)
+	{
+		if (mFormat == XFormat::Text)
+		{
+			Text(name + " ");
+			return;
+		}
+		Binary<uint16_t>(1);
+		Binary<uint32_t>(static_cast<uint32_t>(name.size()));
+		Text(name);
+	}
+
+	template <typename T> void Binary(T value)
+	{
+		uint8_t bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		mData.insert(mData.end(), bytes, bytes + sizeof(T));
+	}
+
+	XFormat              mFormat;
+	std::vector<uint8_t> mData;
+};
+
+
+// A mesh as written in a file. Normals and UVs are optional
+struct XMesh
+{
+	std::vector<CVector3>              positions;
+	std::vector<std::vector<uint32_t>> faces;
+	std::vector<CVector3>              normals;
+	std::vector<std::vector<uint32_t>> normalFaces;
+	std::vector<CVector2>              uvs;
+};
+
+static std::vector<uint32_t> FaceList(const std::vector<std::vector<uint32_t>>& faces)
+{
+	std::vector<uint32_t> list = { static_cast<uint32_t>(faces.size()) };
+	for (const auto& face : faces)
+	{
+		list.push_back(static_cast<uint32_t>(face.size()));
+		list.insert(list.end(), face.begin(), face.end());
+	}
+	return list;
+}
+
+static std::vector<float> FloatList(const std::vector<CVector3>& vectors)
+{
+	std::vector<float> list;
+	for (const CVector3& v : vectors)  list.insert(list.end(), { v.x, v.y, v.z });
+	return list;
+}
+
+// Write a mesh object, with a material list the parser must skip
+static void WriteMesh(XFileWriter& file, const std::string& name, const XMesh& mesh)
+{
+	file.Object("Mesh", name);
+	file.Ints({ static_cast<uint32_t>(mesh.positions.size()) });
+	file.Floats(FloatList(mesh.positions));
+	file.Ints(FaceList(mesh.faces));
+
+	if (!mesh.normals.empty())
+	{
+		file.Object("MeshNormals");
+		file.Ints({ static_cast<uint32_t>(mesh.normals.size()) });
+		file.Floats(FloatList(mesh.normals));
+		file.Ints(FaceList(mesh.normalFaces));
+		file.End();
+	}
+	if (!mesh.uvs.empty())
+	{
+		file.Object("MeshTextureCoords");
+		file.Ints({ static_cast<uint32_t>(mesh.uvs.size()) });
+		std::vector<float> uvs;
+		for (const CVector2& uv : mesh.uvs)  uvs.insert(uvs.end(), { uv.x, uv.y });
+		file.Floats(uvs);
+		file.End();
+	}
+
+	file.Object("MeshMaterialList");
+	std::vector<uint32_t> materials = { 1, static_cast<uint32_t>(mesh.faces.size()) };
+	materials.resize(materials.size() + mesh.faces.size(), 0);
+	file.Ints(materials);
+	file.Object("Material");
+	file.Floats({ 1, 0.5f, 0.25f, 1, 8, 0, 0, 0, 0, 0, 0 });
+	file.End();
+	file.End();
+	file.End();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Test meshes
+//--------------------------------------------------------------------------------------
+
+// Cube from -1 to 1 with quad faces, clockwise seen from outside. Corner n has x, y and z positive where bits 0, 1 and 2
+// of n are set. Optionally with one normal per face and UVs
+static XMesh Cube(bool normals, bool uvs)
+{
+	XMesh cube;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		cube.positions.push_back({ (corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f });
+		if (uvs)  cube.uvs.push_back({ (corner & 1) ? 1.0f : 0.0f, (corner & 2) ? 0.0f : ((corner & 4) ? 0.5f : 1.0f) });
+	}
+	cube.faces = { { 2, 3, 1, 0 }, { 7, 6, 4, 5 }, { 6, 2, 0, 4 }, { 3, 7, 5, 1 }, { 6, 7, 3, 2 }, { 0, 1, 5, 4 } };
+	if (normals)
+	{
+		cube.normals = { { 0, 0, -1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 } };
+		for (uint32_t face = 0; face < 6; ++face)  cube.normalFaces.push_back({ face, face, face, face });
+	}
+	return cube;
+}
+
+// Separate triangles with random positions, each triangle a different size from 1e-6 to 1e9, to check numbers are read
+// exactly
+static XMesh RandomTriangles(unsigned int numTriangles, uint32_t seed)
+{
+	XMesh mesh;
+	float scale = 1;
+	for (uint32_t corner = 0; corner < numTriangles * 3; ++corner)
+	{
+		if (corner % 3 == 0)  scale = std::pow(10.0f, std::floor(RandomFloat(seed) * 16.0f) - 6.0f);
+		mesh.positions.push_back({ (RandomFloat(seed) * 2 - 1) * scale, (RandomFloat(seed) * 2 - 1) * scale, (RandomFloat(seed) * 2 - 1) * scale });
+		if (corner % 3 == 2)  mesh.faces.push_back({ corner - 2, corner - 1, corner });
+	}
+	return mesh;
+}
+
+static CMatrix4x4 RandomMatrix(uint32_t& seed)
+{
+	return MatrixRotationX(RandomFloat(seed) * 6) * MatrixRotationY(RandomFloat(seed) * 6) *
+	       MatrixTranslation({ RandomFloat(seed) * 100 - 50, RandomFloat(seed) * 100 - 50, RandomFloat(seed) * 100 - 50 });
+}
+
+
+// A frame hierarchy with meshes in two of the frames and one outside any frame:
+//   Root
+//     Arm   (ArmMesh: cube with normals and UVs)
+//       Hand
+//     Leg   (LegMesh: random triangles, no normals or UVs)
+//   Loose   (cube without normals or UVs)
+static std::vector<uint8_t> HierarchyFile(XFormat format, const std::vector<CMatrix4x4>& matrices, const XMesh& legMesh)
+{
+	XFileWriter file(format);
+	file.Object("Frame", "Root");
+	file.Object("FrameTransformMatrix");  file.Matrix(matrices[0]);  file.End();
+	file.Object("Frame", "Arm");
+	file.Object("FrameTransformMatrix");  file.Matrix(matrices[1]);  file.End();
+	WriteMesh(file, "ArmMesh", Cube(true, true));
+	file.Object("Frame", "Hand");
+	file.Object("FrameTransformMatrix");  file.Matrix(matrices[2]);  file.End();
+	file.End();
+	file.End();
+	file.Object("Frame", "Leg");
+	file.Object("FrameTransformMatrix");  file.Matrix(matrices[3]);  file.End();
+	WriteMesh(file, "LegMesh", legMesh);
+	file.End();
+	file.End();
+	WriteMesh(file, "Loose", Cube(false, false));
+	return file.Data();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Checking results
+//--------------------------------------------------------------------------------------
+
+template <typename T> static bool SameData(const std::vector<T>& a, const std::vector<T>& b)
+{
+	return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+static bool SameMesh(const ImportedMesh& a, const ImportedMesh& b)
+{
+	if (a.nodes.size() != b.nodes.size() || a.subMeshes.size() != b.subMeshes.size())  return false;
+	for (size_t n = 0; n < a.nodes.size(); ++n)
+	{
+		const ImportedNode& nodeA = a.nodes[n];
+		const ImportedNode& nodeB = b.nodes[n];
+		if (nodeA.name != nodeB.name || nodeA.parent != nodeB.parent || nodeA.subtreeEnd != nodeB.subtreeEnd ||
+		    std::memcmp(&nodeA.matrix, &nodeB.matrix, sizeof(CMatrix4x4)) != 0 || nodeA.subMeshes != nodeB.subMeshes)  return false;
+	}
+	for (size_t s = 0; s < a.subMeshes.size(); ++s)
+	{
+		const ImportedSubMesh& subMeshA = a.subMeshes[s];
+		const ImportedSubMesh& subMeshB = b.subMeshes[s];
+		if (subMeshA.name != subMeshB.name || !SameData(subMeshA.positions, subMeshB.positions) ||
+		    !SameData(subMeshA.normals, subMeshB.normals) || !SameData(subMeshA.tangents, subMeshB.tangents) ||
+		    !SameData(subMeshA.uvs, subMeshB.uvs) || !SameData(subMeshA.indices, subMeshB.indices) ||
+		    subMeshA.bones.size() != subMeshB.bones.size())  return false;
+	}
+	return true;
+}
+
+static bool Parse(const std::vector<uint8_t>& file, ImportedMesh& mesh, bool requireTangents = false)
+{
+	mesh = ImportedMesh();
+	std::string error;
+	bool parsed = ParseXFile(file.data(), file.size(), requireTangents, mesh, error);
+	return parsed && error.empty();
+}
+
+static bool Parse(const std::string& text, bool requireTangents = false)
+{
+	ImportedMesh mesh;
+	return Parse(std::vector<uint8_t>(text.begin(), text.end()), mesh, requireTangents);
+}
+
+// Every triangle of a cube sub-mesh lies on one face: its corners share one normal, which points along an axis out of
+// the cube (so the position along the normal is 1). Only allows for rounding if the normals were generated
+static bool CubeTrianglesOnFaces(const ImportedSubMesh& cube, float tolerance)
+{
+	for (size_t i = 0; i < cube.indices.size(); i += 3)
+	{
+		const CVector3& normal = cube.normals[cube.indices[i]];
+		for (size_t corner = i; corner < i + 3; ++corner)
+		{
+			uint32_t v = cube.indices[corner];
+			if (std::memcmp(&cube.normals[v], &normal, sizeof(CVector3)) != 0)  return false;
+			if (std::fabs(Dot(cube.positions[v], normal) - 1) > tolerance)  return false;
+		}
+	}
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Tests
+//--------------------------------------------------------------------------------------
+
+void TestXFileParser()
+{
+	uint32_t seed = 77;
+	std::vector<CMatrix4x4> matrices;
+	for (int i = 0; i < 4; ++i)  matrices.push_back(RandomMatrix(seed));
+	XMesh legMesh = RandomTriangles(30, 5);
+
+	// Text and binary files read the same, whether binary files have 32 or 64-bit floats
+	std::vector<uint8_t> textFile = HierarchyFile(XFormat::Text,     matrices, legMesh);
+	std::vector<uint8_t> binFile  = HierarchyFile(XFormat::Binary32, matrices, legMesh);
+	std::vector<uint8_t> bin64File = HierarchyFile(XFormat::Binary64, matrices, legMesh);
+	ImportedMesh text, binary, binary64;
+	CHECK(Parse(textFile, text));
+	CHECK(Parse(binFile, binary));
+	CHECK(Parse(bin64File, binary64));
+	CHECK(SameMesh(text, binary));
+	CHECK(SameMesh(text, binary64));
+
+	// The frames become the nodes in depth-first order, each with its matrix and the meshes inside it. The mesh outside
+	// any frame goes to the root
+	CHECK(text.nodes.size() == 4 && text.subMeshes.size() == 3);
+	if (text.nodes.size() != 4 || text.subMeshes.size() != 3)  return;
+	const char* names[] = { "Root", "Arm", "Hand", "Leg" };
+	const unsigned int parents[] = { 0, 0, 1, 0 };
+	const unsigned int subtreeEnds[] = { 4, 3, 3, 4 };
+	const std::vector<unsigned int> nodeSubMeshes[] = { { 2 }, { 0 }, {}, { 1 } };
+	for (unsigned int n = 0; n < 4; ++n)
+	{
+		const ImportedNode& node = text.nodes[n];
+		CHECK(node.name == names[n] && node.parent == parents[n] && node.subtreeEnd == subtreeEnds[n]);
+		CHECK(std::memcmp(&node.matrix, &matrices[n], sizeof(CMatrix4x4)) == 0);
+		CHECK(node.subMeshes == nodeSubMeshes[n]);
+	}
+
+	// Quads are split into two triangles, and the corners of each face share vertices: the cube has 4 vertices per face,
+	// with the file's normals and each position's UVs
+	const ImportedSubMesh& arm = text.subMeshes[0];
+	XMesh armMesh = Cube(true, true);
+	CHECK(arm.name == "ArmMesh");
+	CHECK(arm.indices.size() == 36 && arm.positions.size() == 24 && arm.normals.size() == 24 && arm.uvs.size() == 24);
+	CHECK(arm.tangents.empty() && arm.bones.empty());
+	CHECK(CubeTrianglesOnFaces(arm, 0));
+	unsigned int numWrongUVs = 0;
+	for (size_t v = 0; v < arm.positions.size() && v < arm.uvs.size(); ++v)
+	{
+		const CVector3& p = arm.positions[v];
+		int corner = (p.x > 0 ? 1 : 0) | (p.y > 0 ? 2 : 0) | (p.z > 0 ? 4 : 0);
+		if (arm.uvs[v].x != armMesh.uvs[corner].x || arm.uvs[v].y != armMesh.uvs[corner].y)  ++numWrongUVs;
+	}
+	CHECK(numWrongUVs == 0);
+
+	// Text numbers read exactly as written, so every corner of the random triangles is where it was in the file, in the
+	// same order. With no normals in the file they are generated
+	const ImportedSubMesh& leg = text.subMeshes[1];
+	CHECK(leg.indices.size() == legMesh.positions.size() && leg.positions.size() == legMesh.positions.size());
+	CHECK(leg.uvs.empty() && leg.normals.size() == leg.positions.size());
+	unsigned int numMoved = 0, numBadNormals = 0;
+	for (size_t i = 0; i < leg.indices.size() && i < legMesh.positions.size(); ++i)
+	{
+		if (std::memcmp(&leg.positions[leg.indices[i]], &legMesh.positions[i], sizeof(CVector3)) != 0)  ++numMoved;
+		if (std::fabs(Length(leg.normals[leg.indices[i]]) - 1) > 1e-5f)  ++numBadNormals;
+	}
+	CHECK(numMoved == 0);
+	CHECK(numBadNormals == 0);
+
+	// Without normals or UVs in the file, corners are still joined into one vertex per face corner, with normals
+	// generated from the faces (the cube's faces are too far apart to smooth together)
+	const ImportedSubMesh& loose = text.subMeshes[2];
+	CHECK(loose.name == "Loose");
+	CHECK(loose.indices.size() == 36 && loose.positions.size() == 24 && loose.normals.size() == 24 && loose.uvs.empty());
+	CHECK(CubeTrianglesOnFaces(loose, 1e-6f));
+
+	// Tangents are perpendicular to the normals. They need UVs
+	ImportedMesh tangents;
+	CHECK(Parse(textFile, tangents, true) == false);
+	XFileWriter armOnly(XFormat::Binary32);
+	WriteMesh(armOnly, "ArmMesh", armMesh);
+	CHECK(Parse(armOnly.Data(), tangents, true));
+	CHECK(tangents.subMeshes.size() == 1 && tangents.subMeshes[0].tangents.size() == 24);
+	unsigned int numBadTangents = 0;
+	for (const ImportedSubMesh& subMesh : tangents.subMeshes)
+	{
+		for (size_t v = 0; v < subMesh.tangents.size(); ++v)
+		{
+			if (std::fabs(Length(subMesh.tangents[v]) - 1) > 1e-5f || std::fabs(Dot(subMesh.tangents[v], subMesh.normals[v])) > 1e-5f)
+				++numBadTangents;
+		}
+	}
+	CHECK(numBadTangents == 0);
+
+	// A single mesh is given a root node, as are several top-level frames
+	ImportedMesh mesh;
+	CHECK(Parse(armOnly.Data(), mesh));
+	CHECK(mesh.nodes.size() == 1 && mesh.nodes[0].name == "$dummy_node" && mesh.nodes[0].subMeshes == std::vector<unsigned int>{ 0 });
+	XFileWriter twoFrames(XFormat::Text);
+	twoFrames.Object("Frame", "A");
+	WriteMesh(twoFrames, "M", armMesh);
+	twoFrames.End();
+	twoFrames.Object("Frame", "B");
+	twoFrames.Object("Frame", "C");
+	twoFrames.End();
+	twoFrames.End();
+	CHECK(Parse(twoFrames.Data(), mesh));
+	CHECK(mesh.nodes.size() == 4);
+	if (mesh.nodes.size() == 4)
+	{
+		CHECK(mesh.nodes[0].name == "$dummy_root" && mesh.nodes[0].subtreeEnd == 4 && mesh.nodes[0].subMeshes.empty());
+		CHECK(mesh.nodes[1].name == "A" && mesh.nodes[1].parent == 0 && mesh.nodes[1].subtreeEnd == 2 && mesh.nodes[1].subMeshes.size() == 1);
+		CHECK(mesh.nodes[2].name == "B" && mesh.nodes[2].parent == 0 && mesh.nodes[2].subtreeEnd == 4);
+		CHECK(mesh.nodes[3].name == "C" && mesh.nodes[3].parent == 2 && mesh.nodes[3].subtreeEnd == 4);
+	}
+
+	// Numbers can have signs, exponents and no digits before the point
+	std::string numbers = "xof 0303txt 0032 Mesh { 3; 1.5e+3;-2.5E-2;+.5;, 25e-1;0;0;, 0;1;-0.;; 1; 3;0,1,2;; }";
+	CHECK(Parse(std::vector<uint8_t>(numbers.begin(), numbers.end()), mesh));
+	if (mesh.subMeshes.size() == 1 && mesh.subMeshes[0].positions.size() == 3)
+	{
+		const CVector3& p = mesh.subMeshes[0].positions[mesh.subMeshes[0].indices[0]];
+		CHECK(p.x == 1500.0f && p.y == -0.025f && p.z == 0.5f);
+		CHECK(mesh.subMeshes[0].positions[mesh.subMeshes[0].indices[1]].x == 2.5f);
+	}
+
+	// Text files can have comments, templates and references to objects, none of which change the result
+	XFileWriter plain(XFormat::Text);
+	WriteMesh(plain, "ArmMesh", armMesh);
+	std::string plainText(plain.Data().begin(), plain.Data().end());
+	std::string commented = plainText;
+	commented.insert(commented.find("MeshMaterialList {"), "{ Red } // Reference\n");
+	commented.insert(17, "// Comment\n"
+	                     "template Mesh {\n <3D82AB44-62DA-11cf-AB39-0020AF71E433>\n DWORD nVertices;\n"
+	                     " array Vector vertices[nVertices]; # Comment\n [...]\n}\n"
+	                     "Material Red { 1;0;0;1;; 0; 0;0;0;; 0;0;0;; }\n");
+	ImportedMesh withExtras;
+	CHECK(Parse(std::vector<uint8_t>(plainText.begin(), plainText.end()), mesh));
+	CHECK(Parse(std::vector<uint8_t>(commented.begin(), commented.end()), withExtras));
+	CHECK(SameMesh(mesh, withExtras));
+
+
+	// Files that can't be read. The parser fails so assimp can be used instead
+	CHECK(!Parse(std::string("xof 0303txt")));
+	CHECK(!Parse(std::string("xyz 0303txt 0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;1;0;; 1; 3;0,1,2;; }")));
+	CHECK(!Parse(std::string("xof 0303tzip0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;1;0;; 1; 3;0,1,2;; }"))); // Compressed
+	CHECK( Parse(std::string("xof 0303txt 0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;1;0;; 1; 3;0,1,2;; }")));
+	CHECK(!Parse(std::string("xof 0303txt 0032 Frame A { }")));                                          // No meshes
+	CHECK(!Parse(std::string("xof 0303txt 0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;1;0;; 1; 3;0,1,3;; }")));    // Position out of range
+	CHECK(!Parse(std::string("xof 0303txt 0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;0;0;; 1; 3;0,1,2;; }")));    // Only a degenerate triangle
+	CHECK(!Parse(std::string("xof 0303txt 0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;x;0;; 1; 3;0,1,2;; }")));    // Not a number
+	CHECK(!Parse(std::string("xof 0303txt 0032 Mesh { 99999999; 0;0;0;, 1;0;0;, 0;1;0;; 1; 3;0,1,2;; }"))); // Count too large
+	CHECK(!Parse(std::string("xof 0303txt 0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;1;0;; 1; 3;0,1,2;; "
+	                         "MeshNormals { 1; 0;0;1;; 2; 3;0,0,0;, 3;0,0,0;; } }")));                      // Normal faces don't match
+	CHECK(!Parse(std::string("xof 0303txt 0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;1;0;; 1; 3;0,1,2;; "
+	                         "MeshNormals { 1; 0;0;1;; 1; 3;0,0,1;; } }")));                               // Normal out of range
+	CHECK(!Parse(std::string("xof 0303txt 0032 Mesh { 3; 0;0;0;, 1;0;0;, 0;1;0;; 1; 3;0,1,2;; "
+	                         "MeshTextureCoords { 2; 0;0;, 1;0;; } }")));                                  // Too few UVs
+
+	// Files cut short are rejected wherever they are cut, except between the two top-level objects, which leaves a file
+	// without the last mesh (the files end with the last object's closing brace)
+	unsigned int numTruncatedRead = 0, numWronglyRead = 0;
+	for (const std::vector<uint8_t>* file : { &textFile, &binFile, &bin64File })
+	{
+		size_t end = file->size() - ((file == &textFile) ? 1 : 0);
+		for (size_t size = 0; size < end; ++size)
+		{
+			if (!Parse(std::vector<uint8_t>(file->begin(), file->begin() + size), mesh))  continue;
+			++numTruncatedRead;
+			if (mesh.subMeshes.size() != 2 || mesh.nodes.size() != 4)  ++numWronglyRead;
+		}
+	}
+	CHECK(numTruncatedRead <= 3 * 2);
+	CHECK(numWronglyRead == 0);
+
+	// Damaged binary files are either rejected or give a mesh whose indices are all in range
+	unsigned int numDamagedRead = 0, numBadIndices = 0;
+	for (int i = 0; i < 2000; ++i)
+	{
+		std::vector<uint8_t> damaged = binFile;
+		for (int b = 0; b < 3; ++b)
+		{
+			size_t position = 16 + static_cast<size_t>(RandomFloat(seed) * (damaged.size() - 16));
+			damaged[position] = static_cast<uint8_t>(RandomFloat(seed) * 256);
+		}
+		if (!Parse(damaged, mesh))  continue;
+		++numDamagedRead;
+		for (const ImportedSubMesh& subMesh : mesh.subMeshes)
+		{
+			if (subMesh.normals.size() != subMesh.positions.size())  ++numBadIndices;
+			for (uint32_t index : subMesh.indices)  if (index >= subMesh.positions.size())  ++numBadIndices;
+		}
+	}
+	CHECK(numDamagedRead > 0);
+	CHECK(numBadIndices == 0);
+}
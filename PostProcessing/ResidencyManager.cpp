@@ -0,0 +1,184 @@
+//--------------------------------------------------------------------------------------
+// GPU memory residency - accounting for every GPU resource, with a budget and eviction
+//--------------------------------------------------------------------------------------
+
+#include "ResidencyManager.h"
+#include "DDSLayout.h" // For the sizes of texture formats
+
+#include <algorithm>
+
+
+// The manager used for all the scene's resources
+ResidencyManager gResidency;
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+// Add a resource using the given bytes of GPU memory, returns its id. Resources with an evict function can be evicted
+// when over budget. A new resource counts as used this frame
+unsigned int ResidencyManager::Register(ResourceClass type, uint64_t bytes, EvictFunction evict /*= nullptr*/)
+{
+	unsigned int id;
+	if (!mFreeIds.empty())
+	{
+		id = mFreeIds.back();
+		mFreeIds.pop_back();
+	}
+	else
+	{
+		id = static_cast<unsigned int>(mResources.size());
+		mResources.emplace_back();
+	}
+
+	Resource& resource = mResources[id];
+	resource.type          = type;
+	resource.bytes         = bytes;
+	resource.evict         = std::move(evict);
+	resource.lastUsedFrame = mFrame;
+	resource.registered    = true;
+	resource.evicted       = false;
+	Account(type, static_cast<int64_t>(bytes));
+	return id;
+}
+
+
+// Change the memory used by a resource, e.g. when mips are loaded or dropped
+void ResidencyManager::Resize(unsigned int id, uint64_t bytes)
+{
+	if (id == NoResource)  return;
+	Resource& resource = mResources[id];
+	Account(resource.type, static_cast<int64_t>(bytes) - static_cast<int64_t>(resource.bytes));
+	resource.bytes = bytes;
+}
+
+
+// Remove a resource when it is released
+void ResidencyManager::Unregister(unsigned int id)
+{
+	if (id == NoResource || !mResources[id].registered)  return;
+	Resource& resource = mResources[id];
+	Account(resource.type, -static_cast<int64_t>(resource.bytes));
+	resource.bytes      = 0;
+	resource.evict      = nullptr;
+	resource.registered = false;
+	mFreeIds.push_back(id);
+}
+
+
+// Note that a resource is used this frame, so it won't be evicted at the end of the frame. An evicted resource can be
+// evicted again after it has been used
+void ResidencyManager::Touch(unsigned int id)
+{
+	if (id == NoResource)  return;
+	Resource& resource = mResources[id];
+	resource.lastUsedFrame = mFrame;
+	resource.evicted       = false;
+}
+
+
+// Evict resources not used this frame, least recently used first, until the memory in use is within the budget. Then
+// start a new frame. Call once at the end of each frame
+void ResidencyManager::EndFrame()
+{
+	if (mBudget > 0 && mTotalBytes > mBudget)
+	{
+		mCandidates.clear();
+		for (unsigned int id = 0; id < mResources.size(); ++id)
+		{
+			const Resource& resource = mResources[id];
+			if (resource.registered && resource.evict && !resource.evicted && resource.bytes > 0 &&
+			    resource.lastUsedFrame < mFrame)
+			{
+				mCandidates.push_back(id);
+			}
+		}
+		std::sort(mCandidates.begin(), mCandidates.end(), [this](unsigned int a, unsigned int b)
+		{
+			return mResources[a].lastUsedFrame < mResources[b].lastUsedFrame;
+		});
+
+		// The evict function calls Resize with the memory it has left. Nothing left to free is not counted as an eviction
+		for (unsigned int id : mCandidates)
+		{
+			if (mTotalBytes <= mBudget)  break;
+
+			uint64_t bytes = mResources[id].bytes;
+			EvictFunction evict = mResources[id].evict; // Copied in case the function registers resources
+			evict();
+			mResources[id].evicted = true;
+			if (mResources[id].bytes < bytes)  ++mNumEvictions;
+		}
+	}
+
+	++mFrame;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private members
+//--------------------------------------------------------------------------------------
+
+// Add bytes to the totals, or remove them if negative
+void ResidencyManager::Account(ResourceClass type, int64_t bytes)
+{
+	mClassBytes[static_cast<unsigned int>(type)] += bytes;
+	mTotalBytes += bytes;
+	mPeakBytes = std::max(mPeakBytes, mTotalBytes);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Resource sizes
+//--------------------------------------------------------------------------------------
+
+// GPU memory used by a 2D texture with all its mips and array layers (an estimate for unusual formats)
+uint64_t TextureBytes(ID3D11Texture2D* texture)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+
+	// Depth and render target formats aren't in FormatSize, assume 4 bytes per pixel for them and others not listed
+	bool blockCompressed;
+	unsigned int formatSize = FormatSize(desc.Format, blockCompressed);
+	if (formatSize == 0)  formatSize = 4;
+
+	// 0 mip levels means a full chain down to 1x1
+	unsigned int numMips = desc.MipLevels;
+	if (numMips == 0)
+	{
+		numMips = 1;
+		while ((desc.Width >> numMips) > 0 || (desc.Height >> numMips) > 0)  ++numMips;
+	}
+
+	uint64_t bytes = 0;
+	for (unsigned int mip = 0; mip < numMips; ++mip)
+	{
+		uint64_t width  = std::max(desc.Width  >> mip, 1u);
+		uint64_t height = std::max(desc.Height >> mip, 1u);
+		bytes += blockCompressed ? ((width + 3) / 4) * ((height + 3) / 4) * formatSize : width * height * formatSize;
+	}
+	return bytes * desc.ArraySize * std::max(desc.SampleDesc.Count, 1u);
+}
+
+
+// As above for a resource that may be a 2D texture or a buffer, e.g. from LoadTexture. Returns 0 for other resources
+uint64_t ResourceBytes(ID3D11Resource* resource)
+{
+	if (resource == nullptr)  return 0;
+
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+	if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		return TextureBytes(static_cast<ID3D11Texture2D*>(resource));
+	}
+	if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+	{
+		D3D11_BUFFER_DESC desc;
+		static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+		return desc.ByteWidth;
+	}
+	return 0;
+}
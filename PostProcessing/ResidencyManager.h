@@ -0,0 +1,131 @@
+//--------------------------------------------------------------------------------------
+// GPU memory residency - accounting for every GPU resource, with a budget and eviction
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Each GPU resource is registered here with its size and class (texture, mesh etc.), so the memory in use is known in
+// one place. Resources are marked as used each frame they are drawn. A budget can be set, and at the end of each frame
+// if more memory than the budget is in use, resources that can be evicted are evicted least recently used first until
+// the total is back under the budget.
+//
+// - Only resources registered with an evict function can be evicted: streamed textures drop to their mip tail (see
+//   TextureStreamer.h) and meshes release their vertex and index buffers (see Mesh.h). Evicted resources are reloaded
+//   by their owner the next time they are used, so eviction never changes what is drawn, only how soon
+// - Resources used in the current frame are never evicted, so the budget can still be exceeded if everything in view
+//   needs more memory than it allows. Render targets and constant buffers can't be evicted, they are only counted
+// - The owner of a resource calls Resize when its memory use changes (including in its evict function) and
+//   Unregister when it is released. Use from the main thread only
+
+#ifndef _RESIDENCY_MANAGER_H_INCLUDED_
+#define _RESIDENCY_MANAGER_H_INCLUDED_
+
+#include <d3d11.h>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+
+// Classes of resource, memory use is reported for each
+enum class ResourceClass
+{
+	Texture,
+	Mesh,
+	RenderTarget,
+	Buffer,
+	NumClasses
+};
+
+
+class ResidencyManager
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Frees as much of a resource's GPU memory as possible, calling Resize with what is left
+	using EvictFunction = std::function<void()>;
+
+	// Returned by Register for no resource, can be passed to the other functions and is ignored
+	static const unsigned int NoResource = ~0u;
+
+	// No budget to begin with
+	ResidencyManager() {}
+
+
+	// Add a resource using the given bytes of GPU memory, returns its id. Resources with an evict function can be evicted
+	// when over budget. A new resource counts as used this frame
+	unsigned int Register(ResourceClass type, uint64_t bytes, EvictFunction evict = nullptr);
+
+	// Change the memory used by a resource, e.g. when mips are loaded or dropped
+	void Resize(unsigned int resource, uint64_t bytes);
+
+	// Remove a resource when it is released
+	void Unregister(unsigned int resource);
+
+	// Note that a resource is used this frame, so it won't be evicted at the end of the frame. An evicted resource
+	// can be evicted again after it has been used
+	void Touch(unsigned int resource);
+
+
+	// Most GPU memory to use, 0 for no limit
+	void     SetBudget(uint64_t bytes)  { mBudget = bytes; }
+	uint64_t Budget()                   { return mBudget; }
+
+	// Evict resources not used this frame, least recently used first, until the memory in use is within the budget. Then
+	// start a new frame. Call once at the end of each frame
+	void EndFrame();
+
+
+	// Statistics: memory in use for each class and in total, the most in use at any one time, and how many times a
+	// resource has been evicted
+	uint64_t     Bytes(ResourceClass type)  { return mClassBytes[static_cast<unsigned int>(type)]; }
+	uint64_t     TotalBytes()               { return mTotalBytes; }
+	uint64_t     PeakBytes()                { return mPeakBytes;  }
+	unsigned int NumEvictions()             { return mNumEvictions; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Resource
+	{
+		ResourceClass type;
+		uint64_t      bytes = 0;
+		EvictFunction evict;
+		uint64_t      lastUsedFrame = 0;
+		bool          registered = false;
+		bool          evicted    = false; // Evicted and not used since, there is nothing more to free
+	};
+
+	// Add bytes to the totals, or remove them if negative
+	void Account(ResourceClass type, int64_t bytes);
+
+
+	std::vector<Resource>     mResources;  // Indexed by id
+	std::vector<unsigned int> mFreeIds;    // Ids of unregistered resources, reused first
+
+	std::vector<unsigned int> mCandidates; // Resources that could be evicted this frame, kept to avoid reallocating
+
+	uint64_t mFrame  = 1;
+	uint64_t mBudget = 0;
+
+	uint64_t     mClassBytes[static_cast<unsigned int>(ResourceClass::NumClasses)] = {};
+	uint64_t     mTotalBytes   = 0;
+	uint64_t     mPeakBytes    = 0;
+	unsigned int mNumEvictions = 0;
+};
+
+
+// GPU memory used by a 2D texture with all its mips and array layers (an estimate for unusual formats)
+uint64_t TextureBytes(ID3D11Texture2D* texture);
+
+// As above for a resource that may be a 2D texture or a buffer, e.g. from LoadTexture. Returns 0 for other resources
+uint64_t ResourceBytes(ID3D11Resource* resource);
+
+
+// The manager used for all the scene's resources
+extern ResidencyManager gResidency;
+
+
+#endif //_RESIDENCY_MANAGER_H_INCLUDED_
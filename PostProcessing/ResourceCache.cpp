@@ -0,0 +1,184 @@
+//--------------------------------------------------------------------------------------
+// Resource cache - shared, reference counted meshes, textures and shaders
+//--------------------------------------------------------------------------------------
+
+#include "ResourceCache.h"
+#include "ResidencyManager.h" // Textures count their GPU memory
+#include "Shader.h"           // Shader loading
+#include "FileSystem.h"       // Files are hashed where they are, in a pack or mapped from disk
+#include "Hash.h"
+
+#include <algorithm>
+
+
+// The cache used for all the scene's resources
+ResourceCache gResourceCache;
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+// Hash of a file's contents and the settings it is loaded with. Returns false if the file can't be read
+static bool HashFile(const std::string& filename, uint32_t settings, uint64_t& hash)
+{
+	AssetFile file;
+	if (!file.Open(filename))  return false;
+	hash = HashBytes(file.Data(), static_cast<size_t>(file.Size()));
+	hash = HashBytes(&settings, sizeof(settings), hash);
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Cached textures
+//--------------------------------------------------------------------------------------
+
+CachedTexture::CachedTexture(ID3D11Resource* resource, ID3D11ShaderResourceView* srv) : resource(resource), srv(srv)
+{
+	residencyId = gResidency.Register(ResourceClass::Texture, ResourceBytes(resource));
+}
+
+CachedTexture::~CachedTexture()
+{
+	gResidency.Unregister(residencyId);
+	if (srv)       srv     ->Release();
+	if (resource)  resource->Release();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+// Load a mesh, with the same options as the Mesh constructor. Will throw a std::runtime_error exception on failure
+MeshHandle ResourceCache::LoadMesh(const std::string& filename, bool requireTangents /*= false*/,
+                                   bool keepOccluderGeometry /*= false*/)
+{
+	uint32_t settings = (requireTangents ? 1 : 0) | (keepOccluderGeometry ? 2 : 0);
+	return Find(mMeshes, filename, settings, [&]()
+	{
+		return std::make_shared<Mesh>(filename, requireTangents, keepOccluderGeometry);
+	});
+}
+
+
+// Load a texture, with the same options as LoadTexture. Returns null on failure
+TextureHandle ResourceCache::LoadTexture(const std::string& filename, TextureCompression compression /*= TextureCompression::Standard*/,
+                                         TextureChannels channels /*= TextureChannels::RGBA*/)
+{
+	uint32_t settings = static_cast<uint32_t>(compression) | (static_cast<uint32_t>(channels) << 8);
+	return Find(mTextures, filename, settings, [&]()
+	{
+		ID3D11Resource*           resource = nullptr;
+		ID3D11ShaderResourceView* srv      = nullptr;
+		if (!::LoadTexture(filename, &resource, &srv, compression, channels))  return TextureHandle();
+		return std::make_shared<CachedTexture>(resource, srv);
+	});
+}
+
+
+// Load a compiled shader, pass the name without the extension as for LoadVertexShader / LoadPixelShader in Shader.h.
+// Returns null on failure
+VertexShaderHandle ResourceCache::LoadVertexShader(const std::string& shaderName)
+{
+	return Find(mVertexShaders, shaderName + ".cso", 0, [&]()
+	{
+		ID3D11VertexShader* shader = ::LoadVertexShader(shaderName);
+		if (shader == nullptr)  return VertexShaderHandle();
+		return VertexShaderHandle(shader, [](ID3D11VertexShader* shader) { shader->Release(); });
+	});
+}
+
+PixelShaderHandle ResourceCache::LoadPixelShader(const std::string& shaderName)
+{
+	return Find(mPixelShaders, shaderName + ".cso", 0, [&]()
+	{
+		ID3D11PixelShader* shader = ::LoadPixelShader(shaderName);
+		if (shader == nullptr)  return PixelShaderHandle();
+		return PixelShaderHandle(shader, [](ID3D11PixelShader* shader) { shader->Release(); });
+	});
+}
+
+
+// Number of resources currently loaded
+unsigned int ResourceCache::NumLoaded()
+{
+	return NumLoaded(mMeshes) + NumLoaded(mTextures) + NumLoaded(mVertexShaders) + NumLoaded(mPixelShaders);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private members
+//--------------------------------------------------------------------------------------
+
+// Find a resource already loaded from the file or from identical contents, otherwise load it by calling the given
+// function, which returns a new handle or null on failure
+template <class T, class LoadFunction>
+std::shared_ptr<T> ResourceCache::Find(Table<T>& table, const std::string& filename, uint32_t settings, LoadFunction load)
+{
+	// The same file with the same settings, no need to read it. Filenames differing only in case or slashes are the same
+	// file (see NormaliseFilename)
+	std::string filenameKey = NormaliseFilename(filename) + "|" + std::to_string(settings);
+	auto foundFilename = table.byFilename.find(filenameKey);
+	if (foundFilename != table.byFilename.end())
+	{
+		if (auto resource = foundFilename->second.lock())
+		{
+			++mNumFilenameHits;
+			return resource;
+		}
+	}
+
+	// Identical contents loaded from another file. If the file can't be read here, leave the load to report the error
+	uint64_t contentKey = 0;
+	bool hashed = HashFile(filename, settings, contentKey);
+	if (hashed)
+	{
+		auto foundContent = table.byContent.find(contentKey);
+		if (foundContent != table.byContent.end())
+		{
+			if (auto resource = foundContent->second.lock())
+			{
+				table.byFilename[filenameKey] = resource;
+				++mNumContentHits;
+				return resource;
+			}
+		}
+	}
+
+	// A new resource. Loads are rare so tidy the table now
+	std::shared_ptr<T> resource = load();
+	if (!resource)  return resource;
+	Prune(table);
+	table.byFilename[filenameKey] = resource;
+	if (hashed)  table.byContent[contentKey] = resource;
+	return resource;
+}
+
+
+// Remove the entries for resources that have been released
+template <class T>
+void ResourceCache::Prune(Table<T>& table)
+{
+	for (auto entry = table.byFilename.begin(); entry != table.byFilename.end(); )
+	{
+		entry = entry->second.expired() ? table.byFilename.erase(entry) : std::next(entry);
+	}
+	for (auto entry = table.byContent.begin(); entry != table.byContent.end(); )
+	{
+		entry = entry->second.expired() ? table.byContent.erase(entry) : std::next(entry);
+	}
+}
+
+
+// Count the resources still loaded
+template <class T>
+unsigned int ResourceCache::NumLoaded(Table<T>& table)
+{
+	// Every loaded resource has exactly one content entry, unless its file couldn't be hashed (then it only has filename
+	// entries, possibly several)
+	unsigned int count = 0;
+	for (auto& entry : table.byContent)  if (!entry.second.expired())  ++count;
+	return count;
+}
@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------------------
+// Resource cache - shared, reference counted meshes, textures and shaders
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Resources are loaded through the cache, which hands out shared handles (std::shared_ptr). Everything using a resource
+// holds a handle, and the resource is released when the last handle goes, so nothing needs releasing by hand. The cache
+// itself only holds weak references, it never keeps a resource alive.
+//
+// Loading a file that is already loaded gives another handle to the same resource rather than a copy. Resources are
+// found first by filename, then by a hash of the file's contents (see Hash.h), so identical files under different names
+// also share one resource. The load settings (e.g. texture compression) are part of both keys, as they change the
+// resource made from the file. Handles to resources that have been released are dropped from the cache on later loads.
+//
+// - Textures register their GPU memory with the residency manager while loaded (see ResidencyManager.h), meshes
+//   register themselves
+// - Use from the main thread only
+
+#ifndef _RESOURCE_CACHE_H_INCLUDED_
+#define _RESOURCE_CACHE_H_INCLUDED_
+
+#include "Mesh.h"
+#include "GraphicsHelpers.h"
+
+#include <d3d11.h>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <stdint.h>
+
+
+// A texture loaded with LoadTexture (see GraphicsHelpers.h), released with its last handle
+struct CachedTexture
+{
+	ID3D11Resource*           resource = nullptr;
+	ID3D11ShaderResourceView* srv      = nullptr;
+	unsigned int              residencyId;
+
+	CachedTexture(ID3D11Resource* resource, ID3D11ShaderResourceView* srv);
+	~CachedTexture();
+
+	// Prevent copying - owns GPU resources
+	CachedTexture(const CachedTexture&) = delete;
+	CachedTexture& operator=(const CachedTexture&) = delete;
+};
+
+using MeshHandle         = std::shared_ptr<Mesh>;
+using TextureHandle      = std::shared_ptr<CachedTexture>;
+using VertexShaderHandle = std::shared_ptr<ID3D11VertexShader>;
+using PixelShaderHandle  = std::shared_ptr<ID3D11PixelShader>;
+
+
+class ResourceCache
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	ResourceCache() {}
+
+	// Prevent copying - handles refer to the cache's entries
+	ResourceCache(const ResourceCache&) = delete;
+	ResourceCache& operator=(const ResourceCache&) = delete;
+
+
+	// Load a mesh, with the same options as the Mesh constructor. Will throw a std::runtime_error exception on failure
+	MeshHandle LoadMesh(const std::string& filename, bool requireTangents = false, bool keepOccluderGeometry = false);
+
+	// Load a texture, with the same options as LoadTexture. Returns null on failure
+	TextureHandle LoadTexture(const std::string& filename, TextureCompression compression = TextureCompression::Standard,
+	                          TextureChannels channels = TextureChannels::RGBA);
+
+	// Load a compiled shader, pass the name without the extension as for LoadVertexShader / LoadPixelShader in Shader.h.
+	// Returns null on failure
+	VertexShaderHandle LoadVertexShader(const std::string& shaderName);
+	PixelShaderHandle  LoadPixelShader (const std::string& shaderName);
+
+
+	// Statistics: resources currently loaded, loads that found a resource already loaded from the same file, and loads
+	// that found one loaded from another file with identical contents
+	unsigned int NumLoaded();
+	unsigned int NumFilenameHits()  { return mNumFilenameHits; }
+	unsigned int NumContentHits()   { return mNumContentHits;  }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// The loaded resources of one type, by filename and by content hash. Both keys include the load settings
+	template <class T>
+	struct Table
+	{
+		std::unordered_map<std::string, std::weak_ptr<T>> byFilename;
+		std::unordered_map<uint64_t,    std::weak_ptr<T>> byContent;
+	};
+
+	// Find a resource already loaded from the file or from identical contents, otherwise load it by calling the given
+	// function, which returns a new handle or null on failure
+	template <class T, class LoadFunction>
+	std::shared_ptr<T> Find(Table<T>& table, const std::string& filename, uint32_t settings, LoadFunction load);
+
+	// Remove the entries for resources that have been released
+	template <class T>
+	static void Prune(Table<T>& table);
+
+	// Count the resources still loaded
+	template <class T>
+	static unsigned int NumLoaded(Table<T>& table);
+
+
+	Table<Mesh>               mMeshes;
+	Table<CachedTexture>      mTextures;
+	Table<ID3D11VertexShader> mVertexShaders;
+	Table<ID3D11PixelShader>  mPixelShaders;
+
+	unsigned int mNumFilenameHits = 0;
+	unsigned int mNumContentHits  = 0;
+};
+
+
+// The cache used for all the scene's resources
+extern ResourceCache gResourceCache;
+
+
+#endif //_RESOURCE_CACHE_H_INCLUDED_
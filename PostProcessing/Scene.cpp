@@ -17,11 +17,29 @@
 #include "CMatrix4x4.h"
 #include "MathHelpers.h"     // Helper functions for maths
 #include "GraphicsHelpers.h" // Helper functions to unclutter the code here
+#include "FrameAllocator.h"  // Per-frame memory, reset after Present
+#include "BonePalette.h"     // Bone matrices for skinned models
+#include "InstanceBatcher.h" // Models sharing a mesh are drawn together
+#include "RenderQueue.h"     // Draws are sorted by state and depth
+#include "SceneBVH.h"        // Models outside the camera's view are culled
+#include "OcclusionBuffer.h" // Models hidden behind the walls are culled
+#include "DepthPrePass.h"    // Depth is drawn first when there is a lot of overdraw
+#include "LightClusters.h"   // Point lights are sorted into a grid over the view for the lighting shader
+#include "DynamicStructuredBuffer.h"
+#include "ShadowMaps.h"      // Shadows for the lights, static shadows are cached
+#include "TextureStreamer.h"  // Texture mips are loaded as they become visible
+#include "TextureArrays.h"    // Textures are grouped into arrays so draws share one binding
+#include "ResidencyManager.h" // GPU memory is counted and kept within a budget
+#include "UploadRing.h"        // Mesh data is uploaded through staging buffers
+#include "ResourceCache.h"     // Meshes, textures and shaders are shared through the cache
+#include "FileSystem.h"        // Assets are loaded from a pack
 #include "ColourRGBA.h" 
 
-#include <sstream>
+#include <cstdio>
 #include <memory>
 #include <array>
+#include <vector>
+#include <algorithm>
 
 
 //--------------------------------------------------------------------------------------
@@ -52,6 +70,9 @@ enum class PostProcess
 auto gCurrentPostProcess = PostProcess::None;
 
 
+// Pack holding the scene's assets, optional
+const char* const ASSET_PACK = "Assets.pak";
+
 // Constants controlling speed of movement/rotation (measured in units per second because we're using frame time)
 const float ROTATION_SPEED = 1.5f;  // Radians per second for rotation
 const float MOVEMENT_SPEED = 50.0f; // Units per second for movement (what a unit of length is depends on 3D model - i.e. an artist decision usually)
@@ -60,15 +81,76 @@ const float MOVEMENT_SPEED = 50.0f; // Units per second for movement (what a uni
 bool lockFPS = true;
 
 // Meshes, models and cameras, same meaning as TL-Engine. Meshes prepared in InitGeometry function, Models & camera in InitScene
-Mesh* gStarsMesh;
-Mesh* gGroundMesh;
-Mesh* gCubeMesh;
-Mesh* gCrateMesh;
-Mesh* gTrollMesh;
-Mesh* gLightMesh;
-Mesh* gTeapotMesh;
-Mesh* gWall1Mesh;
-Mesh* gWall2Mesh;
+// Meshes are shared handles from the resource cache, released when the last handle goes
+MeshHandle gStarsMesh;
+MeshHandle gGroundMesh;
+MeshHandle gCubeMesh;
+MeshHandle gCrateMesh;
+MeshHandle gTrollMesh;
+MeshHandle gLightMesh;
+MeshHandle gTeapotMesh;
+MeshHandle gWall1Mesh;
+MeshHandle gWall2Mesh;
+
+// Models are collected into the batcher each frame and drawn with instancing, one draw per mesh and material rather
+// than per model. The draws go through the render queue, which orders them to minimise state changes and overdraw
+InstanceBatcher gSceneBatch;
+RenderQueue     gRenderQueue;
+
+// Shaders, textures and states used by each model, set up in InitScene
+Material gGroundMaterial;
+Material gCrateMaterial;
+Material gCubeMaterial;
+Material gTrollMaterial;
+Material gTeapotMaterial;
+Material gWallMaterial;
+Material gStarsMaterial;
+Material gLightMaterial;
+
+// How a model casts shadows. Static casters are only drawn into the cached shadow maps when a light moves (or they
+// do), dynamic casters are drawn into the shadow maps every frame
+enum class ShadowCaster
+{
+	None,
+	Static,
+	Dynamic,
+};
+
+// Every model in the scene along with how to draw it. Each model is added to the BVH in the same order, so the
+// indexes returned when culling are indexes into this list. Set up at the end of InitScene
+struct SceneObject
+{
+	Model*          model;
+	const Material* material;
+	CVector3        colour; // Tint colour, only used by some shaders
+	ShadowCaster    shadow;
+};
+std::vector<SceneObject>  gSceneObjects;
+SceneBVH                  gSceneBVH;
+FrameVector<unsigned int> gVisibleObjects; // Objects at least partly inside the camera's view this frame
+
+// Cube shadow maps for the lights with models. The objects casting shadows are listed by index into gSceneObjects
+const unsigned int        SHADOW_MAP_SIZE = 512;
+ShadowMaps                gShadowMaps;
+std::vector<unsigned int> gStaticShadowCasters;
+std::vector<unsigned int> gDynamicShadowCasters;
+FrameVector<AABB>         gDynamicShadowCasterBounds; // Updated each frame
+InstanceBatcher           gShadowBatch; // Shadow casters are drawn with instancing and a render queue like the main scene
+RenderQueue               gShadowQueue;
+
+// Small CPU depth buffer that the walls are rasterised into each frame. Models entirely behind the walls are not drawn
+// Press 'o' to toggle occlusion culling
+OcclusionBuffer gOcclusionBuffer;
+bool            gOcclusionCulling = true;
+
+// Opaque models are drawn to the depth buffer before being lit when they overlap a lot on screen
+DepthPrePass gDepthPrePass;
+
+// Culling statistics for the last frame, shown in the window title
+unsigned int gNumVisibleModels    = 0;
+unsigned int gNumCulledModels     = 0; // Outside the camera's view
+unsigned int gNumOccludedModels   = 0; // Inside the view but hidden behind occluders
+unsigned int gNumSimplifiedModels = 0; // Visible models drawn at a simpler level of detail
 
 
 Model* gStars;
@@ -93,6 +175,28 @@ struct Light
 };
 Light gLights[NUM_LIGHTS];
 
+// Light strength falls off with distance, a light's radius is the distance where its strength has dropped to this level
+const float LIGHT_CUTOFF = 0.05f;
+
+// Small extra lights floating over the ground, without models. Press 'k' to change how many are used
+const unsigned int MAX_EXTRA_LIGHTS = 4096;
+struct ExtraLight
+{
+	CVector3 centre; // Each light moves in a small circle around this point
+	CVector3 colour; // Colour multiplied by strength
+	float    phase;
+};
+std::vector<ExtraLight> gExtraLights;
+unsigned int            gNumExtraLights = 0;
+float                   gExtraLightTime = 0;
+
+// Every point light in the scene, gathered each frame and sorted into clusters for the lighting pixel shader
+FrameVector<PointLight> gPointLights;
+LightClusters           gLightClusters;
+DynamicStructuredBuffer gPointLightBuffer(sizeof(PointLight));
+DynamicStructuredBuffer gLightClusterBuffer(sizeof(LightClusters::Cluster));
+DynamicStructuredBuffer gLightIndexBuffer(sizeof(uint32_t));
+
 
 // Additional light information
 CVector3 gAmbientColour = { 0.3f, 0.3f, 0.4f }; // Background level of light (slightly bluish to match the far background, which is dark blue)
@@ -129,25 +233,34 @@ ID3D11Buffer*           gPostProcessingConstantBuffer; // --"--
 //--------------------------------------------------------------------------------------
 
 // DirectX objects controlling textures used in this lab
-ID3D11Resource*           gStarsDiffuseSpecularMap     = nullptr;
-ID3D11ShaderResourceView* gStarsDiffuseSpecularMapSRV  = nullptr;
-ID3D11Resource*           gGroundDiffuseSpecularMap    = nullptr;
-ID3D11ShaderResourceView* gGroundDiffuseSpecularMapSRV = nullptr;
-ID3D11Resource*           gCrateDiffuseSpecularMap     = nullptr;
-ID3D11ShaderResourceView* gCrateDiffuseSpecularMapSRV  = nullptr;
-ID3D11Resource*           gTrollDiffuseSpecularMap     = nullptr;
-ID3D11ShaderResourceView* gTrollDiffuseSpecularMapSRV  = nullptr;
-ID3D11Resource*           gTeapotDiffuseSpecularMap    = nullptr;
-ID3D11ShaderResourceView* gTeapotDiffuseSpecularMapSRV = nullptr;
-ID3D11Resource*           gCubeDiffuseSpecularMap      = nullptr;
-ID3D11ShaderResourceView* gCubeDiffuseSpecularMapSRV   = nullptr;
-ID3D11Resource*           gWall1DiffuseSpecularMap     = nullptr;
-ID3D11ShaderResourceView* gWall1DiffuseSpecularMapSRV  = nullptr;
 ID3D11Resource*           gWall2DiffuseSpecularMap     = nullptr;
 ID3D11ShaderResourceView* gWall2DiffuseSpecularMapSRV  = nullptr;
 
-ID3D11Resource*           gLightDiffuseMap             = nullptr;
-ID3D11ShaderResourceView* gLightDiffuseMapSRV          = nullptr;
+// The model textures that aren't streamed are grouped into texture arrays, with small ones packed into atlases, so
+// draws using them share a texture binding. Each texture has a slot saying where it is in its array
+TextureArrays gTextureArrays;
+unsigned int  gStarsTextureSlot  = TextureArrays::NoSlot;
+unsigned int  gTeapotTextureSlot = TextureArrays::NoSlot;
+unsigned int  gWall1TextureSlot  = TextureArrays::NoSlot;
+unsigned int  gLightTextureSlot  = TextureArrays::NoSlot;
+
+// The DDS textures are streamed, only keeping the mips that are visible. A streamed texture's view changes as mips are
+// loaded and dropped, so each material using one is listed here to be updated
+TextureStreamer gTextureStreamer;
+struct StreamedMaterial
+{
+	Material*    material;
+	unsigned int texture; // Id in gTextureStreamer
+};
+std::vector<StreamedMaterial> gStreamedMaterials;
+
+// GPU memory is counted by the residency manager, and when over the budget the least recently used streamed textures
+// and meshes are evicted. B cycles through these budgets (0 for none). The other resources created here are counted
+// too but can't be evicted, their ids are kept to unregister them when released
+const uint64_t VRAM_BUDGETS[] = { 256 * 1048576ull, 64 * 1048576ull, 16 * 1048576ull, 0 };
+const unsigned int NUM_VRAM_BUDGETS = sizeof(VRAM_BUDGETS) / sizeof(VRAM_BUDGETS[0]);
+unsigned int gVramBudget = 0;
+std::vector<unsigned int> gSceneResources;
 
 
 //****************************
@@ -164,12 +277,9 @@ ID3D11RenderTargetView*   gSceneRenderTarget2 = nullptr; // This object is used
 ID3D11ShaderResourceView* gSceneTextureSRV2   = nullptr; // This object is used to give shaders access to the texture above (SRV = shader resource view)
 
 // Additional textures used for specific post-processes
-ID3D11Resource*           gNoiseMap      = nullptr;
-ID3D11ShaderResourceView* gNoiseMapSRV   = nullptr;
-ID3D11Resource*           gBurnMap       = nullptr;
-ID3D11ShaderResourceView* gBurnMapSRV    = nullptr;
-ID3D11Resource*           gDistortMap    = nullptr;
-ID3D11ShaderResourceView* gDistortMapSRV = nullptr;
+TextureHandle gNoiseMap;
+TextureHandle gBurnMap;
+TextureHandle gDistortMap;
 
 
 //****************************
@@ -252,18 +362,22 @@ bool InitGeometry()
 {
 	////--------------- Load meshes ---------------////
 
+	// Assets are read from the pack if there is one (made with the pack tool, see PackFile.h), otherwise from loose files.
+	// Files missing from the pack are still read from disk
+	gFileSystem.Mount(ASSET_PACK);
+
 	// Load mesh geometry data, just like TL-Engine this doesn't create anything in the scene. Create a Model for that.
 	try
 	{
-		gStarsMesh  = new Mesh("Stars.x");
-		gGroundMesh = new Mesh("Ground.x");
-		gCubeMesh   = new Mesh("Cube.x");
-		gCrateMesh  = new Mesh("CargoContainer.x");
-		gTrollMesh  = new Mesh("Troll.x");
-		gTeapotMesh = new Mesh("Teapot.x");
-		gLightMesh  = new Mesh("Light.x");
-		gWall1Mesh  = new Mesh("Wall1.x");
-		gWall2Mesh  = new Mesh("Wall2.x");
+		gStarsMesh  = gResourceCache.LoadMesh("Stars.x");
+		gGroundMesh = gResourceCache.LoadMesh("Ground.x");
+		gCubeMesh   = gResourceCache.LoadMesh("Cube.x");
+		gCrateMesh  = gResourceCache.LoadMesh("CargoContainer.x");
+		gTrollMesh  = gResourceCache.LoadMesh("Troll.x");
+		gTeapotMesh = gResourceCache.LoadMesh("Teapot.x");
+		gLightMesh  = gResourceCache.LoadMesh("Light.x");
+		gWall1Mesh  = gResourceCache.LoadMesh("Wall1.x", false, true); // Walls are occluders, so keep a CPU-side copy of their geometry
+		gWall2Mesh  = gResourceCache.LoadMesh("Wall2.x", false, true);
 	}
 	catch (std::runtime_error e)  // Constructors cannot return error messages so use exceptions to catch mesh errors (fairly standard approach this)
 	{
@@ -271,28 +385,53 @@ bool InitGeometry()
 		return false;
 	}
 
+	// The meshes' vertex and index data is queued in the upload ring, send it all now rather than a budget a frame so
+	// every mesh can be drawn in the first frame
+	gUploadRing.Flush();
+
 	////--------------- Load / prepare textures & GPU states ---------------////
 
 	// Load textures and create DirectX objects for them
-	// The LoadTexture function requires you to pass a ID3D11Resource* (e.g. &gCubeDiffuseMap), which manages the GPU memory for the
-	// texture and also a ID3D11ShaderResourceView* (e.g. &gCubeDiffuseMapSRV), which allows us to use the texture in shaders
-	// The function will fill in these pointers with usable data. The variables used here are globals found near the top of the file.
-	if (!LoadTexture("Stars.jpg",                &gStarsDiffuseSpecularMap,  &gStarsDiffuseSpecularMapSRV)  ||
-		!LoadTexture("GrassDiffuseSpecular.dds", &gGroundDiffuseSpecularMap, &gGroundDiffuseSpecularMapSRV) ||
-		!LoadTexture("StoneDiffuseSpecular.dds", &gCubeDiffuseSpecularMap,   &gCubeDiffuseSpecularMapSRV)   ||
-		!LoadTexture("CargoA.dds",               &gCrateDiffuseSpecularMap,  &gCrateDiffuseSpecularMapSRV)  ||
-		!LoadTexture("TrollDiffuseSpecular.dds", &gTrollDiffuseSpecularMap,  &gTrollDiffuseSpecularMapSRV)  ||
-		!LoadTexture("tiles1.jpg",               &gTeapotDiffuseSpecularMap, &gTeapotDiffuseSpecularMapSRV) ||
-		!LoadTexture("Flare.jpg",                &gLightDiffuseMap,          &gLightDiffuseMapSRV)          ||
-		!LoadTexture("Noise.png",                &gNoiseMap,                 &gNoiseMapSRV)                 ||
-		!LoadTexture("Burn.png",                 &gBurnMap,                  &gBurnMapSRV)                  ||
-		!LoadTexture("Distort.png",              &gDistortMap,               &gDistortMapSRV)               ||
-		!LoadTexture("brick_35.jpg",             &gWall1DiffuseSpecularMap,  &gWall1DiffuseSpecularMapSRV))
+	// The resource cache returns a handle holding the ID3D11Resource*, which manages the GPU memory for the texture, and the
+	// ID3D11ShaderResourceView*, which allows us to use the texture in shaders. The handles are globals found near the top of the file.
+	// Images are block compressed and cached the first time they are loaded. The noise and burn maps are only read as .r
+	// so use a one channel format. The distortion map is per-pixel noise that doesn't survive compression, so is left as it is
+	gNoiseMap   = gResourceCache.LoadTexture("Noise.png",   TextureCompression::Standard, TextureChannels::R);
+	gBurnMap    = gResourceCache.LoadTexture("Burn.png",    TextureCompression::Standard, TextureChannels::R);
+	gDistortMap = gResourceCache.LoadTexture("Distort.png", TextureCompression::None);
+	if (!gNoiseMap || !gBurnMap || !gDistortMap)
 	{
 		gLastError = "Error loading textures";
 		return false;
 	}
 
+	// Model textures go into texture arrays (also block compressed and cached). The teapot and wall textures are the
+	// same size so share an array, the flare is small enough for an atlas
+	gStarsTextureSlot  = gTextureArrays.Add("Stars.jpg");
+	gTeapotTextureSlot = gTextureArrays.Add("tiles1.jpg");
+	gWall1TextureSlot  = gTextureArrays.Add("brick_35.jpg");
+	gLightTextureSlot  = gTextureArrays.Add("Flare.jpg");
+	if (gStarsTextureSlot == TextureArrays::NoSlot || gTeapotTextureSlot == TextureArrays::NoSlot ||
+		gWall1TextureSlot == TextureArrays::NoSlot || gLightTextureSlot  == TextureArrays::NoSlot || !gTextureArrays.Create())
+	{
+		gLastError = "Error loading textures";
+		return false;
+	}
+
+	// The DDS textures are streamed, only their smallest mips are loaded now. Materials are given their textures below
+	gStreamedMaterials = { { &gGroundMaterial, gTextureStreamer.Add("GrassDiffuseSpecular.dds") },
+	                       { &gCubeMaterial,   gTextureStreamer.Add("StoneDiffuseSpecular.dds") },
+	                       { &gCrateMaterial,  gTextureStreamer.Add("CargoA.dds")               },
+	                       { &gTrollMaterial,  gTextureStreamer.Add("TrollDiffuseSpecular.dds") } };
+	for (auto& streamed : gStreamedMaterials)
+	{
+		if (streamed.texture == TextureStreamer::NoTexture)
+		{
+			gLastError = "Error loading textures";
+			return false;
+		}
+	}
+
 
 	// Create all filtering modes, blending modes etc. used by the app (see State.cpp/.h)
 	if (!CreateStates())
@@ -384,6 +523,14 @@ bool InitGeometry()
 		return false;
 	}
 
+	// Count the resources created above with the residency manager, the meshes, streamed textures and cached textures
+	// count their own
+	gSceneResources = { gResidency.Register(ResourceClass::Texture, gTextureArrays.Bytes()),
+	                    gResidency.Register(ResourceClass::RenderTarget, TextureBytes(gSceneTexture1) + TextureBytes(gSceneTexture2)),
+	                    gResidency.Register(ResourceClass::Buffer, ResourceBytes(gPerFrameConstantBuffer) + ResourceBytes(gPerModelConstantBuffer) +
+	                                                               ResourceBytes(gPostProcessingConstantBuffer)) };
+	gResidency.SetBudget(VRAM_BUDGETS[gVramBudget]);
+
 	return true;
 }
 
@@ -396,14 +543,14 @@ bool InitScene()
 
 	// Models
 
-	gStars  = new Model(gStarsMesh);
-	gGround = new Model(gGroundMesh);
-	gCube   = new Model(gCubeMesh);
-	gCrate  = new Model(gCrateMesh);
-	gTroll  = new Model(gTrollMesh);
-	gTeapot = new Model(gTeapotMesh);
-	gWall1  = new Model(gWall1Mesh);
-	gWall2  = new Model(gWall2Mesh);
+	gStars  = new Model(gStarsMesh.get());
+	gGround = new Model(gGroundMesh.get());
+	gCube   = new Model(gCubeMesh.get());
+	gCrate  = new Model(gCrateMesh.get());
+	gTroll  = new Model(gTrollMesh.get());
+	gTeapot = new Model(gTeapotMesh.get());
+	gWall1  = new Model(gWall1Mesh.get());
+	gWall2  = new Model(gWall2Mesh.get());
 
 	// Positions
 	gCube   ->SetPosition( {  42.0f, 5.0f, -10.0f } );
@@ -436,7 +583,7 @@ bool InitScene()
 	// Light set-up - using an array this time
 	for (int i = 0; i < NUM_LIGHTS; ++i)
 	{
-		gLights[i].model = new Model(gLightMesh);
+		gLights[i].model = new Model(gLightMesh.get());
 	}
 
 	gLights[0].colour = { 0.8f, 0.8f, 1.0f };
@@ -449,12 +596,92 @@ bool InitScene()
 	gLights[1].model->SetPosition({ -70, 30, 100 });
 	gLights[1].model->SetScale(pow(gLights[1].strength, 0.7f));
 
+	// Extra lights are scattered over the ground in random colours
+	gExtraLights.resize(MAX_EXTRA_LIGHTS);
+	for (auto& light : gExtraLights)
+	{
+		light.centre = { Random(-150.0f, 150.0f), Random(2.0f, 12.0f), Random(-150.0f, 150.0f) };
+		light.colour = CVector3{ Random(0.2f, 1.0f), Random(0.2f, 1.0f), Random(0.2f, 1.0f) } * 1.5f;
+		light.phase  = Random(0.0f, 2 * PI);
+	}
+
 	////--------------- Set up camera ---------------////
 
 	gCamera = new Camera();
 	gCamera->SetPosition({ -100, 80, -100 });
 	gCamera->SetRotation({ ToRadians(30.0f), ToRadians(40.0f), 0.0f });
 
+	////--------------- Set up materials ---------------////
+
+	// Lit models - no blending, normal depth buffer and back-face culling (standard set-up for opaque models)
+	Material litMaterial;
+	litMaterial.pass            = RenderPass::Opaque;
+	litMaterial.vertexShader    = gPixelLightingInstancedVertexShader;
+	litMaterial.pixelShader     = gPixelLightingPixelShader;
+	litMaterial.sampler         = gAnisotropic4xSampler;
+	litMaterial.blendState      = gNoBlendingState;
+	litMaterial.depthState      = gUseDepthBufferState;
+	litMaterial.rasterizerState = gCullBackState;
+
+	gGroundMaterial = litMaterial;
+	gCrateMaterial  = litMaterial;
+	gCubeMaterial   = litMaterial;
+	gTrollMaterial  = litMaterial;
+	gTeapotMaterial = litMaterial;  gTeapotMaterial.texture = gTextureArrays.SRV(gTeapotTextureSlot);  gTeapotMaterial.textureSlot = gTeapotTextureSlot;
+	gWallMaterial   = litMaterial;  gWallMaterial  .texture = gTextureArrays.SRV(gWall1TextureSlot);   gWallMaterial  .textureSlot = gWall1TextureSlot;
+	for (auto& streamed : gStreamedMaterials)  streamed.material->texture = gTextureStreamer.SRV(streamed.texture);
+
+	// Sky - tinted texture (tint is white), stars point inwards so no culling
+	gStarsMaterial = litMaterial;
+	gStarsMaterial.pass            = RenderPass::Sky;
+	gStarsMaterial.vertexShader    = gBasicTransformInstancedVertexShader;
+	gStarsMaterial.pixelShader     = gTintedTexturePixelShader;
+	gStarsMaterial.texture         = gTextureArrays.SRV(gStarsTextureSlot);
+	gStarsMaterial.textureSlot     = gStarsTextureSlot;
+	gStarsMaterial.rasterizerState = gCullNoneState;
+
+	// Lights - tinted by the light colour, additive blending, read-only depth buffer and no culling (standard set-up for blending)
+	gLightMaterial = gStarsMaterial;
+	gLightMaterial.pass        = RenderPass::Blended;
+	gLightMaterial.texture     = gTextureArrays.SRV(gLightTextureSlot);
+	gLightMaterial.textureSlot = gLightTextureSlot;
+	gLightMaterial.blendState  = gAdditiveBlendingState;
+	gLightMaterial.depthState  = gDepthReadOnlyState;
+
+	////--------------- Set up scene objects ---------------////
+
+	// Every model with its material, also added to the BVH for culling. The order doesn't matter, the render queue
+	// decides the draw order
+	gSceneObjects = { { gGround, &gGroundMaterial, { 1, 1, 1 }, ShadowCaster::Static  },
+	                  { gCrate,  &gCrateMaterial,  { 1, 1, 1 }, ShadowCaster::Static  },
+	                  { gCube,   &gCubeMaterial,   { 1, 1, 1 }, ShadowCaster::Dynamic },
+	                  { gTroll,  &gTrollMaterial,  { 1, 1, 1 }, ShadowCaster::Dynamic },
+	                  { gTeapot, &gTeapotMaterial, { 1, 1, 1 }, ShadowCaster::Dynamic },
+	                  { gWall1,  &gWallMaterial,   { 1, 1, 1 }, ShadowCaster::Static  },
+	                  { gWall2,  &gWallMaterial,   { 1, 1, 1 }, ShadowCaster::Static  },
+	                  { gStars,  &gStarsMaterial,  { 1, 1, 1 }, ShadowCaster::None    } };
+	for (int i = 0; i < NUM_LIGHTS; ++i)  gSceneObjects.push_back({ gLights[i].model, &gLightMaterial, gLights[i].colour, ShadowCaster::None });
+
+	gSceneBVH.Clear();
+	gStaticShadowCasters.clear();
+	gDynamicShadowCasters.clear();
+	for (unsigned int i = 0; i < gSceneObjects.size(); ++i)
+	{
+		gSceneBVH.Add(gSceneObjects[i].model);
+		if      (gSceneObjects[i].shadow == ShadowCaster::Static)   gStaticShadowCasters .push_back(i);
+		else if (gSceneObjects[i].shadow == ShadowCaster::Dynamic)  gDynamicShadowCasters.push_back(i);
+	}
+
+	// Each light with a model casts shadows
+	if (!gShadowMaps.Init(NUM_LIGHTS, SHADOW_MAP_SIZE))
+	{
+		gLastError = "Error creating shadow maps";
+		return false;
+	}
+
+	// Reserve space for stacked post-processes up front so adding one mid-frame doesn't normally touch the heap
+	postProcessEffectList.reserve(32);
+
 	return true;
 }
 
@@ -471,31 +698,27 @@ void ReleaseResources()
 	if (gSceneRenderTarget2) gSceneRenderTarget2 ->Release();
 	if (gSceneTexture2)      gSceneTexture2      ->Release();
 
-	if (gDistortMapSRV) gDistortMapSRV ->Release();
-	if (gDistortMap)    gDistortMap    ->Release();
-	if (gBurnMapSRV)    gBurnMapSRV    ->Release();
-	if (gBurnMap)       gBurnMap       ->Release();
-	if (gNoiseMapSRV)   gNoiseMapSRV   ->Release();
-	if (gNoiseMap)      gNoiseMap      ->Release();
-
-	if (gLightDiffuseMapSRV)          gLightDiffuseMapSRV          ->Release();
-	if (gLightDiffuseMap)             gLightDiffuseMap             ->Release();
-	if (gCrateDiffuseSpecularMapSRV)  gCrateDiffuseSpecularMapSRV  ->Release();
-	if (gCrateDiffuseSpecularMap)     gCrateDiffuseSpecularMap     ->Release();
-	if (gCubeDiffuseSpecularMapSRV)   gCubeDiffuseSpecularMapSRV   ->Release();
-	if (gCubeDiffuseSpecularMap)      gCubeDiffuseSpecularMap      ->Release();
-	if (gGroundDiffuseSpecularMapSRV) gGroundDiffuseSpecularMapSRV ->Release();
-	if (gGroundDiffuseSpecularMap)    gGroundDiffuseSpecularMap    ->Release();
-	if (gStarsDiffuseSpecularMapSRV)  gStarsDiffuseSpecularMapSRV  ->Release();
-	if (gStarsDiffuseSpecularMap)     gStarsDiffuseSpecularMap     ->Release();
-	if (gTrollDiffuseSpecularMap)     gTrollDiffuseSpecularMap     ->Release();
-	if (gTrollDiffuseSpecularMapSRV)  gTrollDiffuseSpecularMapSRV  ->Release();
-	if (gTeapotDiffuseSpecularMap)    gTeapotDiffuseSpecularMap    ->Release();
-	if (gTeapotDiffuseSpecularMapSRV) gTeapotDiffuseSpecularMapSRV ->Release();
-	if (gWall1DiffuseSpecularMap)     gWall1DiffuseSpecularMap     ->Release();
-	if (gWall1DiffuseSpecularMapSRV)  gWall1DiffuseSpecularMapSRV  ->Release();
+	gDistortMap = nullptr;
+	gBurnMap    = nullptr;
+	gNoiseMap   = nullptr;
+
+	for (unsigned int resource : gSceneResources)  gResidency.Unregister(resource);
+	gSceneResources.clear();
+	gTextureArrays.Release();
+	gStreamedMaterials.clear();
+	gTextureStreamer.Release();
 
 	if (gPostProcessingConstantBuffer)  gPostProcessingConstantBuffer ->Release();
+	gShadowMaps.Release();
+	gShadowBatch.Release();
+	gPointLightBuffer.Release();
+	gLightClusterBuffer.Release();
+	gLightIndexBuffer.Release();
+	gBonePalette.Release();
+	gSceneBatch.Release();
+	gDepthPrePass.Release();
+	gSceneBVH.Clear();
+	gSceneObjects.clear();
 	if (gPerModelConstantBuffer)        gPerModelConstantBuffer       ->Release();
 	if (gPerFrameConstantBuffer)        gPerFrameConstantBuffer       ->Release();
 
@@ -517,13 +740,22 @@ void ReleaseResources()
 	delete gWall2;  gWall2  = nullptr;
 
 
-	delete gLightMesh;  gLightMesh  = nullptr;
-	delete gCrateMesh;  gCrateMesh  = nullptr;
-	delete gCubeMesh;   gCubeMesh   = nullptr;
-	delete gGroundMesh; gGroundMesh = nullptr;
-	delete gStarsMesh;  gStarsMesh  = nullptr;
-	delete gWall1Mesh;  gWall1Mesh  = nullptr;
-	delete gWall2Mesh;  gWall2Mesh = nullptr;
+	// Dropping the last handles releases the meshes
+	gLightMesh  = nullptr;
+	gCrateMesh  = nullptr;
+	gCubeMesh   = nullptr;
+	gGroundMesh = nullptr;
+	gStarsMesh  = nullptr;
+	gTrollMesh  = nullptr;
+	gTeapotMesh = nullptr;
+	gWall1Mesh  = nullptr;
+	gWall2Mesh  = nullptr;
+
+	// After the meshes, which cancel any uploads still queued for their buffers
+	gUploadRing.Release();
+
+	// Last, nothing is loading now
+	gFileSystem.UnmountAll();
 }
 
 
@@ -532,6 +764,62 @@ void ReleaseResources()
 // Scene Rendering
 //--------------------------------------------------------------------------------------
 
+// Draw the given shadow casters that are at least partly inside a frustum into the current depth buffer, depth only
+void RenderShadowCasters(const std::vector<unsigned int>& casters, const Frustum& frustum, const CVector3& lightPosition)
+{
+	gShadowBatch.Reset();
+	for (unsigned int index : casters)
+	{
+		const SceneObject& object = gSceneObjects[index];
+		if (FrustumTestAABB(frustum, object.model->WorldBounds()))  gShadowBatch.Add(object.model, object.material);
+	}
+	if (gShadowBatch.NumInstances() == 0 || !gShadowBatch.Prepare())  return;
+	gShadowBatch.SetVertexShaderResource(9); // Must match register in Common.hlsli
+
+	// Both sides of each model are drawn so models that aren't closed (e.g. the walls) still cast shadows
+	gShadowQueue.Clear();
+	gShadowBatch.Submit(gShadowQueue, lightPosition);
+	gShadowQueue.Sort();
+	gShadowQueue.ExecuteDepthOnly(gDepthOnlyInstancedVertexShader, gCullNoneState);
+}
+
+
+// Bring the shadow maps for the lights with models up to date. The static shadow casters are only drawn when a light's
+// cached shadows are out of date, the dynamic casters are drawn every frame into the cube faces they appear in
+void RenderShadowMaps()
+{
+	// The shadow maps are about to be drawn to so must not be bound as a texture
+	ID3D11ShaderResourceView* nullSRV = nullptr;
+	gD3DContext->PSSetShaderResources(13, 1, &nullSRV);
+
+	// Drawing uses the per-frame and per-model constants in the vertex shader only
+	gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
+	gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+	gD3DContext->GSSetShader(nullptr, nullptr, 0);
+
+	// Model bounds versions only ever increase, so the total changes when any static caster moves
+	uint32_t staticVersion = 0;
+	for (unsigned int index : gStaticShadowCasters)  staticVersion += gSceneObjects[index].model->BoundsVersion();
+
+	NewFrameStorage(gDynamicShadowCasterBounds);
+	for (unsigned int index : gDynamicShadowCasters)  gDynamicShadowCasterBounds.push_back(gSceneObjects[index].model->WorldBounds());
+
+	gShadowMaps.ResetStatistics();
+	for (unsigned int i = 0; i < NUM_LIGHTS; ++i)
+	{
+		CVector3 lightPosition = gPointLights[i].position;
+		gShadowMaps.Update(i, lightPosition, gPointLights[i].radius, staticVersion,
+		                   gDynamicShadowCasterBounds.data(), static_cast<unsigned int>(gDynamicShadowCasterBounds.size()),
+		                   [&](const Frustum& frustum) { RenderShadowCasters(gStaticShadowCasters,  frustum, lightPosition); },
+		                   [&](const Frustum& frustum) { RenderShadowCasters(gDynamicShadowCasters, frustum, lightPosition); });
+
+		// The lighting shader must look up shadows from where the shadow map was rendered
+		gPerFrameConstants.shadowOrigins[i] = { gShadowMaps.Origin(i), gShadowMaps.FarClip(i) };
+	}
+	gPerFrameConstants.shadowNearClip = ShadowMaps::NearClip;
+}
+
+
 // Render everything in the scene from the given camera
 void RenderSceneFromCamera(Camera* camera)
 {
@@ -547,78 +835,57 @@ void RenderSceneFromCamera(Camera* camera)
 	gD3DContext->GSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
 	gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
 
-	gD3DContext->PSSetShader(gPixelLightingPixelShader, nullptr, 0);
-
-	////--------------- Render ordinary models ---------------///
-
-	// Select which shaders to use next
-	gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gPixelLightingPixelShader, nullptr, 0);
-	gD3DContext->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
-
-	// States - no blending, normal depth buffer and back-face culling (standard set-up for opaque models)
-	gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-	gD3DContext->RSSetState(gCullBackState);
-
-	// Render lit models, only change textures for each onee
-	gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
-
-	gD3DContext->PSSetShaderResources(0, 1, &gGroundDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gGround->Render();
-
-	gD3DContext->PSSetShaderResources(0, 1, &gCrateDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gCrate->Render();
+	// The per-model buffer is updated for each draw, but the buffer itself doesn't change so it only needs to be
+	// selected once here. Post-processing uses slot 1 for its own buffer so this must be done each frame
+	gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+	gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
 
-	gD3DContext->PSSetShaderResources(0, 1, &gCubeDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gCube->Render();
+	// Bone matrices for all skinned models, already uploaded for this frame (see RenderScene)
+	gBonePalette.SetVertexShaderResource(8); // Must match register in Common.hlsli
 
-	gD3DContext->PSSetShaderResources(0, 1, &gTrollDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gTroll->Render();
+	// World matrices and colours for every model, already uploaded for this frame (see RenderScene)
+	gSceneBatch.SetVertexShaderResource(9); // Must match register in Common.hlsli
 
-	gD3DContext->PSSetShaderResources(0, 1, &gTeapotDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gTeapot->Render();
+	// Point lights and their clusters, already uploaded for this frame (see RenderScene)
+	ID3D11ShaderResourceView* lightSRVs[] = { gPointLightBuffer.SRV(), gLightClusterBuffer.SRV(), gLightIndexBuffer.SRV() };
+	gD3DContext->PSSetShaderResources(10, 3, lightSRVs); // Must match registers in Common.hlsli
 
-	gD3DContext->PSSetShaderResources(0, 1, &gWall1DiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-	gWall1->Render();
-	gWall2->Render();
+	// Shadow maps for the lights, already rendered this frame (see RenderShadowMaps)
+	ID3D11ShaderResourceView* shadowMapsSRV = gShadowMaps.SRV();
+	gD3DContext->PSSetShaderResources(13, 1, &shadowMapsSRV); // Must match register in PixelLighting_ps.hlsl
+	gD3DContext->PSSetSamplers(1, 1, &gShadowSampler);
 
-	////--------------- Render sky ---------------////
+	// Where each texture is in the texture arrays, model textures are looked up with their instance's slot
+	ID3D11ShaderResourceView* textureSlotsSRV = gTextureArrays.SlotsSRV();
+	gD3DContext->PSSetShaderResources(14, 1, &textureSlotsSRV); // Must match register in Common.hlsli
 
-	// Select which shaders to use next
-	gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gTintedTexturePixelShader, nullptr, 0);
-
-	// Using a pixel shader that tints the texture - don't need a tint on the sky so set it to white
-	gPerModelConstants.objectColour = { 1, 1, 1 };
-
-	// Stars point inwards
-	gD3DContext->RSSetState(gCullNoneState);
-
-	// Render sky
-	gD3DContext->PSSetShaderResources(0, 1, &gStarsDiffuseSpecularMapSRV);
-	gStars->Render();
-
-	////--------------- Render lights ---------------////
+	gD3DContext->GSSetShader(nullptr, nullptr, 0);  // Switch off geometry shader when not using it (pass nullptr for first parameter)
 
-	// Select which shaders to use next (actually same as before, so we could skip this)
-	gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-	gD3DContext->PSSetShader(gTintedTexturePixelShader, nullptr, 0);
+	////--------------- Render models ---------------///
 
-	// Select the texture and sampler to use in the pixel shader
-	gD3DContext->PSSetShaderResources(0, 1, &gLightDiffuseMapSRV); // First parameter must match texture slot number in the shaer
+	// Each batch of models is submitted to the render queue with its material and distance from the camera. The queue
+	// sorts the draws so opaque models are drawn front-to-back grouped by state, then the sky, then blended models
+	// (the lights) back-to-front. States, shaders and textures are only changed when needed
+	gRenderQueue.Clear();
+	gSceneBatch.Submit(gRenderQueue, camera->Position());
+	gRenderQueue.Sort();
 
-	// States - additive blending, read-only depth buffer and no culling (standard set-up for blending)
-	gD3DContext->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
-	gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-	gD3DContext->RSSetState(gCullNoneState);
-
-	// Render all the lights in the array
-	for (int i = 0; i < NUM_LIGHTS; ++i)
+	// When there is a lot of overdraw, draw the opaque models to the depth buffer first (positions only, no pixel
+	// shader), then light them with an equal depth test so each pixel is only lit once
+	bool depthPrePass = gDepthPrePass.BeginFrame();
+	if (depthPrePass)
 	{
-		gPerModelConstants.objectColour = gLights[i].colour; // Set any per-model constants apart from the world matrix just before calling render (light colour here)
-		gLights[i].model->Render();
+		gDepthPrePass.BeginDepthPass();
+		gRenderQueue.ExecuteDepthOnly(gDepthOnlyInstancedVertexShader);
+		gDepthPrePass.EndDepthPass();
 	}
+
+	gDepthPrePass.BeginColourPass();
+	gRenderQueue.Execute(RenderPass::Opaque, depthPrePass ? gDepthEqualReadOnlyState : nullptr);
+	gDepthPrePass.EndColourPass();
+
+	gRenderQueue.Execute(RenderPass::Sky);
+	gRenderQueue.Execute(RenderPass::Blended);
 }
 
 //**************************
@@ -668,7 +935,7 @@ void PostProcessing(ID3D11RenderTargetView* RenderTarget, ID3D11ShaderResourceVi
 		gPostProcessingConstants.noiseOffset = { Random(0.0f, 1.0f), Random(0.0f, 1.0f) };
 
 		// Give pixel shader access to the noise texture
-		gD3DContext->PSSetShaderResources(1, 1, &gNoiseMapSRV);
+		gD3DContext->PSSetShaderResources(1, 1, &gNoiseMap->srv);
 		gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
 	}
 	else if (gCurrentPostProcess == PostProcess::Burn)
@@ -680,7 +947,7 @@ void PostProcessing(ID3D11RenderTargetView* RenderTarget, ID3D11ShaderResourceVi
 		gPostProcessingConstants.burnHeight = fmod(gPostProcessingConstants.burnHeight + burnSpeed * frameTime, 1.0f);
 
 		// Give pixel shader access to the burn texture (basically a height map that the burn level ascends)
-		gD3DContext->PSSetShaderResources(1, 1, &gBurnMapSRV);
+		gD3DContext->PSSetShaderResources(1, 1, &gBurnMap->srv);
 		gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
 	}
 	else if (gCurrentPostProcess == PostProcess::Distort)
@@ -691,7 +958,7 @@ void PostProcessing(ID3D11RenderTargetView* RenderTarget, ID3D11ShaderResourceVi
 		gPostProcessingConstants.distortLevel = 0.03f;
 
 		// Give pixel shader access to the distortion texture (containts 2D vectors (in R & G) to shift the texture UVs to give a cut-glass impression)
-		gD3DContext->PSSetShaderResources(1, 1, &gDistortMapSRV);
+		gD3DContext->PSSetShaderResources(1, 1, &gDistortMap->srv);
 		gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
 	}
 	else if (gCurrentPostProcess == PostProcess::Spiral)
@@ -766,7 +1033,7 @@ void PostProcessing(ID3D11RenderTargetView* RenderTarget, ID3D11ShaderResourceVi
 //**************************
 // Perform an post process from "scene texture" to back buffer within the given four-point polygon and a world matrix to position/rotate/scale the polygon
 
-void PolygonPostProcess(ID3D11PixelShader* postProcess, std::array<CVector3, 4> points, CMatrix4x4 worldMatrix, float frameTime)
+void PolygonPostProcess(ID3D11PixelShader* postProcess, const std::array<CVector3, 4>& points, const CMatrix4x4& worldMatrix, float frameTime)
 {
 	// Select the back buffer to use for rendering. Not going to clear the back-buffer because we're going to overwrite it all
 	gD3DContext->OMSetRenderTargets(1, &gCurrentTarget, gDepthStencil);
@@ -813,7 +1080,7 @@ void PolygonPostProcess(ID3D11PixelShader* postProcess, std::array<CVector3, 4>
 		gPostProcessingConstants.noiseOffset = { Random(0.0f, 1.0f), Random(0.0f, 1.0f) };
 
 		// Give pixel shader access to the noise texture
-		gD3DContext->PSSetShaderResources(1, 1, &gNoiseMapSRV);
+		gD3DContext->PSSetShaderResources(1, 1, &gNoiseMap->srv);
 		gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
 	}
 	else if (gCurrentPostProcess == PostProcess::Burn)
@@ -825,7 +1092,7 @@ void PolygonPostProcess(ID3D11PixelShader* postProcess, std::array<CVector3, 4>
 		gPostProcessingConstants.burnHeight = fmod(gPostProcessingConstants.burnHeight + burnSpeed * frameTime, 1.0f);
 
 		// Give pixel shader access to the burn texture (basically a height map that the burn level ascends)
-		gD3DContext->PSSetShaderResources(1, 1, &gBurnMapSRV);
+		gD3DContext->PSSetShaderResources(1, 1, &gBurnMap->srv);
 		gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
 	}
 	else if (gCurrentPostProcess == PostProcess::Distort)
@@ -836,7 +1103,7 @@ void PolygonPostProcess(ID3D11PixelShader* postProcess, std::array<CVector3, 4>
 		gPostProcessingConstants.distortLevel = 0.03f;
 
 		// Give pixel shader access to the distortion texture (containts 2D vectors (in R & G) to shift the texture UVs to give a cut-glass impression)
-		gD3DContext->PSSetShaderResources(1, 1, &gDistortMapSRV);
+		gD3DContext->PSSetShaderResources(1, 1, &gDistortMap->srv);
 		gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
 	}
 	else if (gCurrentPostProcess == PostProcess::Spiral)
@@ -922,14 +1189,42 @@ void PolygonPostProcess(ID3D11PixelShader* postProcess, std::array<CVector3, 4>
 // Rendering the scene
 void RenderScene(float frameTime)
 {
+	// Send this frame's share of the queued mesh data to the GPU, e.g. for meshes being reloaded after eviction
+	gUploadRing.Update();
+
 	//// Common settings ////
 
+	// Gather all the point lights: the lights with models, then the extra lights. Per-frame lists like this one are kept in
+	// frame memory (see FrameAllocator.h), which is reset after Present
+	NewFrameStorage(gPointLights);
+	for (int i = 0; i < NUM_LIGHTS; ++i)
+	{
+		gPointLights.push_back({ gLights[i].model->Position(), gLights[i].strength / LIGHT_CUTOFF, gLights[i].colour * gLights[i].strength, i });
+	}
+	const float extraLightStrength = 1.5f; // Matches the scale of the extra lights' colours
+	for (unsigned int i = 0; i < gNumExtraLights; ++i)
+	{
+		const ExtraLight& light = gExtraLights[i];
+		float angle = gExtraLightTime + light.phase;
+		CVector3 position = light.centre + CVector3{ cos(angle) * 4.0f, sin(angle * 2.0f), sin(angle) * 4.0f };
+		gPointLights.push_back({ position, extraLightStrength / LIGHT_CUTOFF, light.colour, -1 }); // No shadows
+	}
+
+	// Sort the lights into clusters over the camera's view, then send the lights and clusters to the GPU
+	gLightClusters.Build(gCamera->ViewMatrix(), gCamera->FOV(), gCamera->AspectRatio(), gCamera->NearClip(), gCamera->FarClip(),
+	                     gPointLights.data(), static_cast<unsigned int>(gPointLights.size()));
+	gPointLightBuffer  .Upload(gPointLights.data(), static_cast<unsigned int>(gPointLights.size()));
+	gLightClusterBuffer.Upload(gLightClusters.Clusters(), LightClusters::NumClusters);
+	gLightIndexBuffer  .Upload(gLightClusters.LightIndices(), gLightClusters.NumLightIndices());
+
 	// Set up the light information in the constant buffer
 	// Don't send to the GPU yet, the function RenderSceneFromCamera will do that
-	gPerFrameConstants.light1Colour   = gLights[0].colour * gLights[0].strength;
-	gPerFrameConstants.light1Position = gLights[0].model->Position();
-	gPerFrameConstants.light2Colour   = gLights[1].colour * gLights[1].strength;
-	gPerFrameConstants.light2Position = gLights[1].model->Position();
+	gPerFrameConstants.clusterSliceScale = gLightClusters.SliceScale();
+	gPerFrameConstants.clusterSliceBias  = gLightClusters.SliceBias();
+	gPerFrameConstants.clusterTilesX     = LightClusters::NumTilesX;
+	gPerFrameConstants.clusterTilesY     = LightClusters::NumTilesY;
+	gPerFrameConstants.clusterSlices     = LightClusters::NumSlices;
+	gPerFrameConstants.numLights         = static_cast<unsigned int>(gPointLights.size());
 
 	gPerFrameConstants.ambientColour  = gAmbientColour;
 	gPerFrameConstants.specularPower  = gSpecularPower;
@@ -940,6 +1235,74 @@ void RenderScene(float frameTime)
 
 	gPerFrameConstants.frameTime = frameTime;
 
+	// Each skinned model writes its bone matrices into the bone palette, which is then sent to the GPU in one go
+	gBonePalette.Reset();
+	for (Model* model : { gStars, gGround, gCube, gCrate, gTroll, gTeapot, gWall1, gWall2 })  model->UpdateBones();
+	for (int i = 0; i < NUM_LIGHTS; ++i)  gLights[i].model->UpdateBones();
+	gBonePalette.Upload();
+
+	// Find the models inside the camera's view. The BVH first updates the boxes of any models that have moved, then whole
+	// groups of models outside the view are skipped at once
+	gSceneBVH.Refit();
+	NewFrameStorage(gVisibleObjects);
+	CMatrix4x4 viewProjectionMatrix = gCamera->ViewProjectionMatrix();
+	Frustum viewFrustum = FrustumFromViewProjection(viewProjectionMatrix);
+	gNumVisibleModels = gSceneBVH.Cull(viewFrustum, gVisibleObjects);
+	gNumCulledModels  = gSceneBVH.NumModels() - gNumVisibleModels;
+
+	// Rasterise the walls into the CPU depth buffer then remove the models that are entirely behind them. The walls
+	// themselves are never behind their own depth so they stay visible
+	gNumOccludedModels = 0;
+	if (gOcclusionCulling)
+	{
+		gOcclusionBuffer.Begin(viewProjectionMatrix);
+		gWall1->AddToOcclusionBuffer(gOcclusionBuffer);
+		gWall2->AddToOcclusionBuffer(gOcclusionBuffer);
+		gOcclusionBuffer.Rasterise();
+
+		auto visibleEnd = std::remove_if(gVisibleObjects.begin(), gVisibleObjects.end(), [](unsigned int index)
+		{
+			return !gOcclusionBuffer.IsVisible(gSceneObjects[index].model->WorldBounds());
+		});
+		gNumOccludedModels = static_cast<unsigned int>(gVisibleObjects.end() - visibleEnd);
+		gNumVisibleModels -= gNumOccludedModels;
+		gVisibleObjects.erase(visibleEnd, gVisibleObjects.end());
+	}
+
+	// Choose the level of detail of each visible model from its size on screen, then collect them into batches by mesh,
+	// material and level of detail. Their world matrices are sent to the GPU in one go. Models drawn into the shadow maps
+	// use the same level, models that aren't visible keep the last level they were given
+	CVector3 cameraPosition = gCamera->Position();
+	float projectionScale = gCamera->ProjectionMatrix().e11;
+	gNumSimplifiedModels = 0;
+	gSceneBatch.Reset();
+	for (unsigned int index : gVisibleObjects)
+	{
+		const SceneObject& object = gSceneObjects[index];
+		object.model->SelectLod(cameraPosition, projectionScale);
+		if (object.model->Lod() > 0)  ++gNumSimplifiedModels;
+		gSceneBatch.Add(object.model, object.material, object.colour);
+
+		// The size on screen also decides how much detail the model's texture needs (if it is streamed)
+		float screenPixels = object.model->ScreenSize(cameraPosition, projectionScale) * gViewportHeight;
+		gTextureStreamer.Request(object.material->texture, screenPixels);
+	}
+	gSceneBatch.Prepare();
+
+	// Swap in texture mips loaded since last frame and queue the loads needed for this one. Materials must use the new
+	// views before anything is drawn
+	if (gTextureStreamer.Update())
+	{
+		for (auto& streamed : gStreamedMaterials)  streamed.material->texture = gTextureStreamer.SRV(streamed.texture);
+	}
+
+	// Dense meshes are split into meshlets, skip the meshlets that are off-screen or facing away from the camera. The
+	// depth pre-pass draws the same ranges. Shadow maps draw whole meshes as they see them from other directions
+	gSceneBatch.CullMeshlets(cameraPosition, viewFrustum);
+
+	// Shadow maps for the lights, static shadows are only rendered again when a light moves far enough
+	RenderShadowMaps();
+
 	////--------------- Main scene rendering ---------------////
 
 	// Set the target for rendering and select the main depth buffer.
@@ -1004,6 +1367,13 @@ void RenderScene(float frameTime)
 	// When drawing to the off-screen back buffer is complete, we "present" the image to the front buffer (the screen)
 	// Set first parameter to 1 to lock to vsync
 	gSwapChain->Present(lockFPS ? 1 : 0, 0);
+
+	// Everything allocated from frame memory is finished with once the frame is presented
+	gFrameAllocator.Reset();
+
+	// Evict the least recently used textures and meshes if over the GPU memory budget. Evicted textures have new views
+	gResidency.EndFrame();
+	for (auto& streamed : gStreamedMaterials)  streamed.material->texture = gTextureStreamer.SRV(streamed.texture);
 }
 
 
@@ -1028,6 +1398,10 @@ void UpdateScene(float frameTime)
 	static bool go = true;
 	gLights[0].model->SetPosition({ 20 + cos(lightRotate) * gLightOrbitRadius, 10, 20 + sin(lightRotate) * gLightOrbitRadius });
 	if (go)  lightRotate -= gLightOrbitSpeed * frameTime;
+	if (go)  gExtraLightTime += frameTime;
+
+	// Change the number of extra lights: none, then more and more up to the maximum
+	if (KeyHit(Key_K))  gNumExtraLights = (gNumExtraLights == 0) ? 256 : (gNumExtraLights >= MAX_EXTRA_LIGHTS ? 0 : gNumExtraLights * 4);
 	if (KeyHit(Key_L))  go = !go;
 
 	// Control of camera
@@ -1036,6 +1410,16 @@ void UpdateScene(float frameTime)
 	// Toggle FPS limiting
 	if (KeyHit(Key_P))  lockFPS = !lockFPS;
 
+	// Toggle occlusion culling
+	if (KeyHit(Key_O))  gOcclusionCulling = !gOcclusionCulling;
+
+	// Cycle through the GPU memory budgets
+	if (KeyHit(Key_B))
+	{
+		gVramBudget = (gVramBudget + 1) % NUM_VRAM_BUDGETS;
+		gResidency.SetBudget(VRAM_BUDGETS[gVramBudget]);
+	}
+
 	// Show frame time / FPS in the window title //
 	const float fpsUpdateTime = 0.5f; // How long between updates (in seconds)
 	static float totalFrameTime = 0;
@@ -1045,13 +1429,19 @@ void UpdateScene(float frameTime)
 	if (totalFrameTime > fpsUpdateTime)
 	{
 		// Displays FPS rounded to nearest int, and frame time (more useful for developers) in milliseconds to 2 decimal places
+		// Title is built in a fixed buffer rather than with strings / streams so it doesn't use the heap mid-frame
 		float avgFrameTime = totalFrameTime / frameCount;
-		std::ostringstream frameTimeMs;
-		frameTimeMs.precision(2);
-		frameTimeMs << std::fixed << avgFrameTime * 1000;
-		std::string windowTitle = "Post Processing Assignment - Frame Time: " + frameTimeMs.str() +
-			"ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f));
-		SetWindowTextA(gHWnd, windowTitle.c_str());
+		unsigned int numMeshletIndices = gSceneBatch.NumMeshletIndices();
+		float meshletCulledPercent = numMeshletIndices == 0 ? 0.0f :
+			100.0f * (numMeshletIndices - gSceneBatch.NumMeshletIndicesDrawn()) / numMeshletIndices;
+		char windowTitle[560];
+		std::snprintf(windowTitle, sizeof(windowTitle), "Post Processing Assignment - Frame Time: %.2fms, FPS: %d, Models: %u visible (%u simplified), %u culled, %u occluded, Meshlet triangles culled: %.0f%%, Textures: %.1fMB of %.1fMB, Overdraw: %.2f (pre-pass %s), Lights: %u (max %u per cluster), Shadow faces: %u static, %u dynamic, GPU memory: %.1fMB (peak %.1fMB, budget %.0fMB), %u evictions",
+			avgFrameTime * 1000, static_cast<int>(1 / avgFrameTime + 0.5f), gNumVisibleModels, gNumSimplifiedModels, gNumCulledModels, gNumOccludedModels,
+			meshletCulledPercent, gTextureStreamer.ResidentBytes() / 1048576.0f, gTextureStreamer.FullBytes() / 1048576.0f, gDepthPrePass.Overdraw(), gDepthPrePass.Enabled() ? "on" : "off",
+			static_cast<unsigned int>(gPointLights.size()), gLightClusters.MaxLightsPerCluster(),
+			gShadowMaps.NumStaticFacesRendered(), gShadowMaps.NumDynamicFacesRendered(),
+			gResidency.TotalBytes() / 1048576.0f, gResidency.PeakBytes() / 1048576.0f, gResidency.Budget() / 1048576.0f, gResidency.NumEvictions());
+		SetWindowTextA(gHWnd, windowTitle);
 		totalFrameTime = 0;
 		frameCount = 0;
 	}
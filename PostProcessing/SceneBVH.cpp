@@ -0,0 +1,242 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume hierarchy of models, used to cull models outside the camera's view
+//--------------------------------------------------------------------------------------
+
+#include "SceneBVH.h"
+#include "Model.h"
+
+#include <algorithm>
+
+
+// Add a model to the hierarchy, returns its index (used in the results of Cull). The tree is rebuilt on the next Refit
+unsigned int SceneBVH::Add(Model* model)
+{
+	mItems.push_back({ model, 0, 0, 0 });
+	mNeedsBuild = true;
+	return static_cast<unsigned int>(mItems.size() - 1);
+}
+
+
+// Remove all models
+void SceneBVH::Clear()
+{
+	mItems.clear();
+	mNodes.clear();
+	mDirty.clear();
+	mNeedsBuild = false;
+}
+
+
+// Bring the tree up to date with the models' current positions, call once per frame before culling
+void SceneBVH::Refit()
+{
+	unsigned int numItems = NumModels();
+
+	if (mNeedsBuild)
+	{
+		// Build from scratch, top-down. Each model's bounds are copied first so they are only fetched once
+		mItemBounds.resize(numItems);
+		mBuildItems.resize(numItems);
+		for (unsigned int i = 0; i < numItems; ++i)
+		{
+			mItemBounds[i] = mItems[i].model->WorldBounds();
+			mItems[i].boundsVersion = mItems[i].model->BoundsVersion();
+			mBuildItems[i] = i;
+		}
+
+		mNodes.clear();
+		if (numItems > 0)  Build(0, numItems, 0, 0);
+		mDirty.assign(mNodes.size(), 0);
+		mNeedsBuild = false;
+		return;
+	}
+
+	if (mNodes.empty())  return;
+
+	// Update the boxes of models that have moved. Models that haven't moved just return their cached bounds
+	for (auto& item : mItems)
+	{
+		const AABB& bounds = item.model->WorldBounds();
+		if (item.model->BoundsVersion() == item.boundsVersion)  continue;
+
+		item.boundsVersion = item.model->BoundsVersion();
+		SetChildBounds(mNodes[item.node], item.slot, bounds);
+		mDirty[item.node] = 1;
+	}
+
+	// Pass changes up the tree. Children are always stored after their parents, so going backwards through the nodes
+	// finishes every child before its parent, and each changed box is only recalculated once
+	for (unsigned int n = static_cast<unsigned int>(mNodes.size()) - 1; n > 0; --n)
+	{
+		if (!mDirty[n])  continue;
+
+		const Node& node = mNodes[n];
+		SetChildBounds(mNodes[node.parent], node.parentSlot, NodeBounds(node));
+		mDirty[node.parent] = 1;
+		mDirty[n] = 0;
+	}
+	mDirty[0] = 0;
+}
+
+
+// Find the models at least partly inside the frustum, their indexes (as returned from Add) are added to the
+// visible list. Returns the number of models found
+unsigned int SceneBVH::Cull(const Frustum& frustum, FrameVector<unsigned int>& visible)
+{
+	if (mNodes.empty())  return 0;
+
+	size_t numVisibleBefore = visible.size();
+
+	mStack.clear();
+	mStack.push_back(0);
+	while (!mStack.empty())
+	{
+		const Node& node = mNodes[mStack.back()];
+		mStack.pop_back();
+
+		// Test the four child boxes together. Unused slots have empty boxes, which are always outside, but are masked
+		// off anyway
+		unsigned int insideMask;
+		unsigned int visibleMask = FrustumTest4AABBs(frustum, node.minX, node.minY, node.minZ,
+		                                                      node.maxX, node.maxY, node.maxZ, &insideMask);
+		visibleMask &= (1u << node.numChildren) - 1;
+
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			if (!(visibleMask & (1u << i)))  continue;
+
+			int32_t child = node.children[i];
+			if (child < 0)                    visible.push_back(~child);
+			else if (insideMask & (1u << i))  AddAll(child, visible); // No need to test anything inside this box
+			else                              mStack.push_back(child);
+		}
+	}
+
+	return static_cast<unsigned int>(visible.size() - numVisibleBefore);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helper functions
+//--------------------------------------------------------------------------------------
+
+// Build a node for the items in mBuildItems[begin, end), recursive. Returns the index of the node
+unsigned int SceneBVH::Build(unsigned int begin, unsigned int end, unsigned int parent, unsigned int parentSlot)
+{
+	// Nodes are added depth-first, so this node comes before all of its children. Note that mNodes may grow during
+	// the recursion below so this node is always accessed by index rather than by reference
+	unsigned int nodeIndex = static_cast<unsigned int>(mNodes.size());
+	mNodes.emplace_back();
+	mNodes[nodeIndex].parent = parent;
+	mNodes[nodeIndex].parentSlot = parentSlot;
+	for (unsigned int slot = 0; slot < 4; ++slot)
+	{
+		SetChildBounds(mNodes[nodeIndex], slot, AABB()); // Unused slots have empty boxes
+		mNodes[nodeIndex].children[slot] = 0;
+	}
+
+	// Split the items into (up to) four groups, one for each child. Up to four items each get their own slot, otherwise
+	// split in half and then split each half again
+	unsigned int groups[5];
+	unsigned int numGroups;
+	if (end - begin <= 4)
+	{
+		numGroups = end - begin;
+		for (unsigned int i = 0; i <= numGroups; ++i)  groups[i] = begin + i;
+	}
+	else
+	{
+		unsigned int middle = Split(begin, end);
+		groups[0] = begin;
+		groups[1] = Split(begin, middle);
+		groups[2] = middle;
+		groups[3] = Split(middle, end);
+		groups[4] = end;
+		numGroups = 4;
+	}
+
+	for (unsigned int group = 0; group < numGroups; ++group)
+	{
+		unsigned int groupBegin = groups[group];
+		unsigned int groupEnd   = groups[group + 1];
+
+		AABB box;
+		for (unsigned int i = groupBegin; i < groupEnd; ++i)  box.Add(mItemBounds[mBuildItems[i]]);
+
+		int32_t child;
+		if (groupEnd - groupBegin == 1)
+		{
+			unsigned int item = mBuildItems[groupBegin];
+			mItems[item].node = nodeIndex;
+			mItems[item].slot = group;
+			child = ~static_cast<int32_t>(item);
+		}
+		else
+		{
+			child = static_cast<int32_t>(Build(groupBegin, groupEnd, nodeIndex, group));
+		}
+
+		mNodes[nodeIndex].children[group] = child;
+		SetChildBounds(mNodes[nodeIndex], group, box);
+	}
+	mNodes[nodeIndex].numChildren = numGroups;
+
+	return nodeIndex;
+}
+
+
+// Split mBuildItems[begin, end) in half along the longest axis of the items' centres, returns the split point
+unsigned int SceneBVH::Split(unsigned int begin, unsigned int end)
+{
+	AABB centres;
+	for (unsigned int i = begin; i < end; ++i)  centres.Add(mItemBounds[mBuildItems[i]].Centre());
+
+	CVector3 size = centres.max - centres.min;
+	int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+
+	// Only need the items on the correct side of the middle, not fully sorted
+	unsigned int middle = begin + (end - begin) / 2;
+	std::nth_element(mBuildItems.begin() + begin, mBuildItems.begin() + middle, mBuildItems.begin() + end,
+		[&](unsigned int a, unsigned int b)
+		{
+			CVector3 centreA = mItemBounds[a].Centre();
+			CVector3 centreB = mItemBounds[b].Centre();
+			return (&centreA.x)[axis] < (&centreB.x)[axis];
+		});
+	return middle;
+}
+
+
+// Store a box in a child slot of a node
+void SceneBVH::SetChildBounds(Node& node, unsigned int slot, const AABB& box)
+{
+	node.minX[slot] = box.min.x;  node.minY[slot] = box.min.y;  node.minZ[slot] = box.min.z;
+	node.maxX[slot] = box.max.x;  node.maxY[slot] = box.max.y;  node.maxZ[slot] = box.max.z;
+}
+
+
+// Box around all the children of a node
+AABB SceneBVH::NodeBounds(const Node& node)
+{
+	AABB box;
+	for (unsigned int slot = 0; slot < node.numChildren; ++slot)
+	{
+		AABB childBox;
+		childBox.min = { node.minX[slot], node.minY[slot], node.minZ[slot] };
+		childBox.max = { node.maxX[slot], node.maxY[slot], node.maxZ[slot] };
+		box.Add(childBox); // Skips empty boxes
+	}
+	return box;
+}
+
+
+// Add every model below a node to the visible list (used when a node is entirely inside the frustum)
+void SceneBVH::AddAll(unsigned int node, FrameVector<unsigned int>& visible)
+{
+	for (unsigned int i = 0; i < mNodes[node].numChildren; ++i)
+	{
+		int32_t child = mNodes[node].children[i];
+		if (child < 0)  visible.push_back(~child);
+		else            AddAll(child, visible);
+	}
+}
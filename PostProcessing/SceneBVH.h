@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume hierarchy of models, used to cull models outside the camera's view
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The hierarchy is a tree of boxes, each node holding the boxes of up to four children, so a whole node can be tested
+// against the view frustum in one SSE test (see FrustumTest4AABBs). If a box is outside the frustum, everything in it
+// is skipped without being looked at; if it is entirely inside, everything in it is visible without further tests.
+//
+// The tree is dynamic: each frame Refit checks which models have moved (using Model::BoundsVersion) and updates their
+// boxes and the boxes above them, which is much cheaper than rebuilding. The tree is only rebuilt when models are added,
+// or on request. Models that move a long way make the tree less efficient (but never give wrong results), so a scene
+// with lots of movement could call Rebuild occasionally
+
+#ifndef _SCENE_BVH_H_INCLUDED_
+#define _SCENE_BVH_H_INCLUDED_
+
+#include "BoundingVolumes.h"
+#include "FrameAllocator.h"
+
+#include <vector>
+#include <stdint.h>
+
+class Model;
+
+class SceneBVH
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Add a model to the hierarchy, returns its index (used in the results of Cull). The tree is rebuilt on the next Refit
+	unsigned int Add(Model* model);
+
+	// Remove all models
+	void Clear();
+
+	// Rebuild the tree from scratch on the next Refit
+	void Rebuild()  { mNeedsBuild = true; }
+
+	// Bring the tree up to date with the models' current positions, call once per frame before culling
+	void Refit();
+
+	// Find the models at least partly inside the frustum, their indexes (as returned from Add) are added to the
+	// visible list. Returns the number of models found
+	unsigned int Cull(const Frustum& frustum, FrameVector<unsigned int>& visible);
+
+
+	unsigned int NumModels()  { return static_cast<unsigned int>(mItems.size()); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// A node in the tree holds the boxes of up to four children. Boxes are stored as separate arrays of each component
+	// so they can be loaded straight into SSE registers. A child is either another node or a model (a leaf)
+	struct alignas(16) Node
+	{
+		float minX[4], minY[4], minZ[4];
+		float maxX[4], maxY[4], maxZ[4];
+		int32_t      children[4]; // Node index, or ~item index for a leaf (i.e. negative)
+		unsigned int numChildren;
+		unsigned int parent;      // Where this node's box is stored in its parent (unused for the root)
+		unsigned int parentSlot;
+	};
+
+	// A model in the tree and where its box is stored
+	struct Item
+	{
+		Model*       model;
+		uint32_t     boundsVersion; // Bounds version when the box was last stored
+		unsigned int node;
+		unsigned int slot;
+	};
+
+	// Build a node for the items in mBuildItems[begin, end), recursive. Returns the index of the node
+	unsigned int Build(unsigned int begin, unsigned int end, unsigned int parent, unsigned int parentSlot);
+
+	// Split mBuildItems[begin, end) in half along the longest axis of the items' centres, returns the split point
+	unsigned int Split(unsigned int begin, unsigned int end);
+
+	// Store a box in a child slot of a node
+	void SetChildBounds(Node& node, unsigned int slot, const AABB& box);
+
+	// Box around all the children of a node
+	AABB NodeBounds(const Node& node);
+
+	// Add every model below a node to the visible list (used when a node is entirely inside the frustum)
+	void AddAll(unsigned int node, FrameVector<unsigned int>& visible);
+
+
+	std::vector<Node>          mNodes;        // Root is node 0, nodes are stored depth-first so children follow parents
+	std::vector<Item>          mItems;
+	std::vector<AABB>          mItemBounds;   // Copy of each model's world bounds, only used while building
+	std::vector<unsigned int>  mBuildItems;   // Item indexes, reordered while building
+	std::vector<unsigned char> mDirty;        // Nodes that need their box updating in their parent during Refit
+	std::vector<unsigned int>  mStack;        // Nodes still to visit while culling
+	bool mNeedsBuild = false;
+};
+
+
+#endif //_SCENE_BVH_H_INCLUDED_
@@ -5,9 +5,11 @@
 
 #include "Shader.h"
 #include "Common.h"
+#include "ResourceCache.h" // Shaders are shared through the cache
+#include "FileSystem.h"    // Shaders may be in a pack
 #include <d3dcompiler.h>
-#include <fstream>
 #include <vector>
+#include <memory>
 
 //--------------------------------------------------------------------------------------
 // Global Variables
@@ -23,6 +25,11 @@ ID3D11PixelShader*    gPixelLightingPixelShader     = nullptr;
 ID3D11PixelShader*    gCopyPixelShader              = nullptr;
 ID3D11VertexShader*   g2DPolygonVertexShader        = nullptr;
 
+// Instanced versions of the vertex shaders above, world matrices and colours come from the instance buffer
+ID3D11VertexShader*   gBasicTransformInstancedVertexShader = nullptr;
+ID3D11VertexShader*   gPixelLightingInstancedVertexShader  = nullptr;
+ID3D11VertexShader*   gDepthOnlyInstancedVertexShader      = nullptr;
+
 
 //*******************************
 //**** Post-processing shader DirectX objects
@@ -50,35 +57,58 @@ ID3D11PixelShader*  gBloomPostProcess           = nullptr;
 // Shader creation / destruction
 //--------------------------------------------------------------------------------------
 
+// Handles to the shaders loaded by LoadShaders, which keep them loaded. The globals above point to the same shaders
+static std::vector<std::shared_ptr<void>> gShaderHandles;
+
+// Load a shader through the resource cache, keeping its handle, and return the shader. Returns nullptr on failure
+static ID3D11VertexShader* CachedVertexShader(const std::string& shaderName)
+{
+	VertexShaderHandle shader = gResourceCache.LoadVertexShader(shaderName);
+	gShaderHandles.push_back(shader);
+	return shader.get();
+}
+
+static ID3D11PixelShader* CachedPixelShader(const std::string& shaderName)
+{
+	PixelShaderHandle shader = gResourceCache.LoadPixelShader(shaderName);
+	gShaderHandles.push_back(shader);
+	return shader.get();
+}
+
+
 // Load shaders required for this app, returns true on success
 bool LoadShaders()
 {
 	// Shaders must be added to the Visual Studio project to be compiled, they use the extension ".hlsl".
 	// To load them for use, include them here without the extension. Use the correct function for each.
-	// Ensure you release the shaders in the ShutdownDirect3D function below
-	gBasicTransformVertexShader   = LoadVertexShader ("BasicTransform_vs"  );
-	gPixelLightingVertexShader    = LoadVertexShader ("PixelLighting_vs"   );
-	gTintedTexturePixelShader     = LoadPixelShader  ("TintedTexture_ps"   );
-	gPixelLightingPixelShader     = LoadPixelShader  ("PixelLighting_ps"   );
-	gCopyPixelShader              = LoadPixelShader  ("CopyPixelShader_ps" );
+	// They are loaded through the resource cache, which releases them when ReleaseShaders drops the handles
+	gBasicTransformVertexShader   = CachedVertexShader("BasicTransform_vs"  );
+	gPixelLightingVertexShader    = CachedVertexShader("PixelLighting_vs"   );
+	gTintedTexturePixelShader     = CachedPixelShader ("TintedTexture_ps"   );
+	gPixelLightingPixelShader     = CachedPixelShader ("PixelLighting_ps"   );
+	gCopyPixelShader              = CachedPixelShader ("CopyPixelShader_ps" );
+
+	gBasicTransformInstancedVertexShader = CachedVertexShader("BasicTransformInstanced_vs");
+	gPixelLightingInstancedVertexShader  = CachedVertexShader("PixelLightingInstanced_vs" );
+	gDepthOnlyInstancedVertexShader      = CachedVertexShader("DepthOnlyInstanced_vs"     );
 
 	//***************************************
 	//**** Post processing shaders
 
-	g2DPolygonVertexShader      = LoadVertexShader ("2DPolygon_pp");
-	gFullScreenQuadVertexShader = LoadVertexShader ("2DQuad_pp");
-	gTintPostProcess            = LoadPixelShader  ("Tint_pp");
-	gGreyNoisePostProcess       = LoadPixelShader  ("GreyNoise_pp");
-	gBurnPostProcess            = LoadPixelShader  ("Burn_pp");
-	gDistortPostProcess         = LoadPixelShader  ("Distort_pp");
-	gSpiralPostProcess          = LoadPixelShader  ("Spiral_pp");
-	gVColourGradientPostProcess = LoadPixelShader  ("VColourGradient_pp");
-	gFullScreenBlurPostProcess  = LoadPixelShader  ("FullScreenBlur_pp");
-	gUnderWaterPostProcess      = LoadPixelShader  ("UnderWater_pp");
-	gHLSGradientPostProcess     = LoadPixelShader  ("HLSGradient_pp");
-	gRetroPostProcess           = LoadPixelShader  ("Retro_pp");
-	gGaussianBlurPostProcess    = LoadPixelShader  ("GaussianBlur_pp");
-	gBloomPostProcess           = LoadPixelShader  ("Bloom_pp");
+	g2DPolygonVertexShader      = CachedVertexShader("2DPolygon_pp");
+	gFullScreenQuadVertexShader = CachedVertexShader("2DQuad_pp");
+	gTintPostProcess            = CachedPixelShader ("Tint_pp");
+	gGreyNoisePostProcess       = CachedPixelShader ("GreyNoise_pp");
+	gBurnPostProcess            = CachedPixelShader ("Burn_pp");
+	gDistortPostProcess         = CachedPixelShader ("Distort_pp");
+	gSpiralPostProcess          = CachedPixelShader ("Spiral_pp");
+	gVColourGradientPostProcess = CachedPixelShader ("VColourGradient_pp");
+	gFullScreenBlurPostProcess  = CachedPixelShader ("FullScreenBlur_pp");
+	gUnderWaterPostProcess      = CachedPixelShader ("UnderWater_pp");
+	gHLSGradientPostProcess     = CachedPixelShader ("HLSGradient_pp");
+	gRetroPostProcess           = CachedPixelShader ("Retro_pp");
+	gGaussianBlurPostProcess    = CachedPixelShader ("GaussianBlur_pp");
+	gBloomPostProcess           = CachedPixelShader ("Bloom_pp");
 
 	if (gBasicTransformVertexShader == nullptr || gPixelLightingVertexShader  == nullptr ||
 		gTintedTexturePixelShader   == nullptr || gPixelLightingPixelShader   == nullptr ||
@@ -89,7 +119,8 @@ bool LoadShaders()
 		gFullScreenBlurPostProcess  == nullptr || gUnderWaterPostProcess      == nullptr ||
 		gHLSGradientPostProcess     == nullptr || gRetroPostProcess           == nullptr ||
 		gGaussianBlurPostProcess    == nullptr || g2DPolygonVertexShader      == nullptr ||
-		gBloomPostProcess           == nullptr)
+		gBloomPostProcess           == nullptr || gBasicTransformInstancedVertexShader == nullptr ||
+		gPixelLightingInstancedVertexShader == nullptr || gDepthOnlyInstancedVertexShader == nullptr)
 	{
 		gLastError = "Error loading shaders";
 		return false;
@@ -99,27 +130,18 @@ bool LoadShaders()
 }
 
 
+// Release shaders used by the app
 void ReleaseShaders()
 {
-	if (gCopyPixelShader)               gCopyPixelShader            ->Release();
-	if (g2DPolygonVertexShader)         g2DPolygonVertexShader      ->Release();
-	if (gSpiralPostProcess)             gSpiralPostProcess          ->Release();
-	if (gDistortPostProcess)            gDistortPostProcess         ->Release();
-	if (gBurnPostProcess)               gBurnPostProcess            ->Release();
-	if (gGreyNoisePostProcess)          gGreyNoisePostProcess       ->Release();
-	if (gTintPostProcess)               gTintPostProcess            ->Release();
-	if (gFullScreenQuadVertexShader)    gFullScreenQuadVertexShader ->Release();
-	if (gPixelLightingPixelShader)      gPixelLightingPixelShader   ->Release();
-	if (gTintedTexturePixelShader)      gTintedTexturePixelShader   ->Release();
-	if (gPixelLightingVertexShader)     gPixelLightingVertexShader  ->Release();
-	if (gBasicTransformVertexShader)    gBasicTransformVertexShader ->Release(); 
-	if (gVColourGradientPostProcess)    gVColourGradientPostProcess ->Release();
-	if (gFullScreenBlurPostProcess)     gFullScreenBlurPostProcess  ->Release();
-	if (gUnderWaterPostProcess)         gUnderWaterPostProcess      ->Release();
-	if (gHLSGradientPostProcess)        gHLSGradientPostProcess     ->Release();
-	if (gRetroPostProcess)              gRetroPostProcess           ->Release();
-	if (gGaussianBlurPostProcess)       gGaussianBlurPostProcess    ->Release();
-	if (gBloomPostProcess)              gBloomPostProcess           ->Release();
+	// Shaders are released with their last handle. Clear the globals too, they would be left pointing at released shaders
+	gShaderHandles.clear();
+
+	gBasicTransformVertexShader = gPixelLightingVertexShader = g2DPolygonVertexShader = gFullScreenQuadVertexShader = nullptr;
+	gBasicTransformInstancedVertexShader = gPixelLightingInstancedVertexShader = gDepthOnlyInstancedVertexShader = nullptr;
+	gTintedTexturePixelShader = gPixelLightingPixelShader = gCopyPixelShader = nullptr;
+	gTintPostProcess = gGreyNoisePostProcess = gBurnPostProcess = gDistortPostProcess = gSpiralPostProcess = nullptr;
+	gVColourGradientPostProcess = gFullScreenBlurPostProcess = gUnderWaterPostProcess = gHLSGradientPostProcess = nullptr;
+	gRetroPostProcess = gGaussianBlurPostProcess = gBloomPostProcess = nullptr;
 }
 
 
@@ -128,26 +150,18 @@ void ReleaseShaders()
 // to this function. The returned pointer needs to be released before quitting. Returns nullptr on failure. 
 ID3D11VertexShader* LoadVertexShader(std::string shaderName)
 {
-	// Open compiled shader object file
-	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
-	if (!shaderFile.is_open())
-	{
-		return nullptr;
-	}
-
-	// Read file into vector of chars
-	std::streamoff fileSize = shaderFile.tellg();
-	shaderFile.seekg(0, std::ios::beg);
-	std::vector<char> byteCode(fileSize);
-	shaderFile.read(&byteCode[0], fileSize);
-	if (shaderFile.fail())
+	// Open compiled shader object file, from a pack or disk (see FileSystem.h). The byte code is used where it is
+	AssetFile shaderFile;
+	if (!shaderFile.Open(shaderName + ".cso"))
 	{
 		return nullptr;
 	}
+	const uint8_t* byteCode = shaderFile.Data();
+	size_t byteCodeSize = static_cast<size_t>(shaderFile.Size());
 
 	// Create shader object from loaded file (we will use the object later when rendering)
 	ID3D11VertexShader* shader;
-	HRESULT hr = gD3DDevice->CreateVertexShader(byteCode.data(), byteCode.size(), nullptr, &shader);
+	HRESULT hr = gD3DDevice->CreateVertexShader(byteCode, byteCodeSize, nullptr, &shader);
 	if (FAILED(hr))
 	{
 		return nullptr;
@@ -162,26 +176,18 @@ ID3D11VertexShader* LoadVertexShader(std::string shaderName)
 // Basically the same code as above but for pixel shaders
 ID3D11GeometryShader* LoadGeometryShader(std::string shaderName)
 {
-	// Open compiled shader object file
-	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
-	if (!shaderFile.is_open())
-	{
-		return nullptr;
-	}
-
-	// Read file into vector of chars
-	std::streamoff fileSize = shaderFile.tellg();
-	shaderFile.seekg(0, std::ios::beg);
-	std::vector<char>byteCode(fileSize);
-	shaderFile.read(&byteCode[0], fileSize);
-	if (shaderFile.fail())
+	// Open compiled shader object file, from a pack or disk (see FileSystem.h). The byte code is used where it is
+	AssetFile shaderFile;
+	if (!shaderFile.Open(shaderName + ".cso"))
 	{
 		return nullptr;
 	}
+	const uint8_t* byteCode = shaderFile.Data();
+	size_t byteCodeSize = static_cast<size_t>(shaderFile.Size());
 
 	// Create shader object from loaded file (we will use the object later when rendering)
 	ID3D11GeometryShader* shader;
-	HRESULT hr = gD3DDevice->CreateGeometryShader(byteCode.data(), byteCode.size(), nullptr, &shader);
+	HRESULT hr = gD3DDevice->CreateGeometryShader(byteCode, byteCodeSize, nullptr, &shader);
 	if (FAILED(hr))
 	{
 		return nullptr;
@@ -196,26 +202,18 @@ ID3D11GeometryShader* LoadGeometryShader(std::string shaderName)
 // The returned pointer needs to be released before quitting. Returns nullptr on failure. 
 ID3D11GeometryShader* LoadStreamOutGeometryShader(std::string shaderName, D3D11_SO_DECLARATION_ENTRY* soDecl, unsigned int soNumEntries, unsigned int soStride)
 {
-	// Open compiled shader object file
-	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
-	if (!shaderFile.is_open())
-	{
-		return nullptr;
-	}
-
-	// Read file into vector of chars
-	std::streamoff fileSize = shaderFile.tellg();
-	shaderFile.seekg(0, std::ios::beg);
-	std::vector<char>byteCode(fileSize);
-	shaderFile.read(&byteCode[0], fileSize);
-	if (shaderFile.fail())
+	// Open compiled shader object file, from a pack or disk (see FileSystem.h). The byte code is used where it is
+	AssetFile shaderFile;
+	if (!shaderFile.Open(shaderName + ".cso"))
 	{
 		return nullptr;
 	}
+	const uint8_t* byteCode = shaderFile.Data();
+	size_t byteCodeSize = static_cast<size_t>(shaderFile.Size());
 
 	// Create shader object from loaded file (we will use the object later when rendering)
 	ID3D11GeometryShader* shader;
-	HRESULT hr = gD3DDevice->CreateGeometryShaderWithStreamOutput(byteCode.data(), byteCode.size(),
+	HRESULT hr = gD3DDevice->CreateGeometryShaderWithStreamOutput(byteCode, byteCodeSize,
 		                                                          soDecl, soNumEntries, &soStride, 1, D3D11_SO_NO_RASTERIZED_STREAM, nullptr, &shader);
 	if(FAILED(hr))
 	{
@@ -231,26 +229,18 @@ ID3D11GeometryShader* LoadStreamOutGeometryShader(std::string shaderName, D3D11_
 // Basically the same code as above but for pixel shaders
 ID3D11PixelShader* LoadPixelShader(std::string shaderName)
 {
-	// Open compiled shader object file
-	std::ifstream shaderFile(shaderName + ".cso", std::ios::in | std::ios::binary | std::ios::ate);
-	if (!shaderFile.is_open())
-	{
-		return nullptr;
-	}
-
-	// Read file into vector of chars
-	std::streamoff fileSize = shaderFile.tellg();
-	shaderFile.seekg(0, std::ios::beg);
-	std::vector<char>byteCode(fileSize);
-	shaderFile.read(&byteCode[0], fileSize);
-	if (shaderFile.fail())
+	// Open compiled shader object file, from a pack or disk (see FileSystem.h). The byte code is used where it is
+	AssetFile shaderFile;
+	if (!shaderFile.Open(shaderName + ".cso"))
 	{
 		return nullptr;
 	}
+	const uint8_t* byteCode = shaderFile.Data();
+	size_t byteCodeSize = static_cast<size_t>(shaderFile.Size());
 
 	// Create shader object from loaded file (we will use the object later when rendering)
 	ID3D11PixelShader* shader;
-	HRESULT hr = gD3DDevice->CreatePixelShader(byteCode.data(), byteCode.size(), nullptr, &shader);
+	HRESULT hr = gD3DDevice->CreatePixelShader(byteCode, byteCodeSize, nullptr, &shader);
 	if (FAILED(hr))
 	{
 		return nullptr;
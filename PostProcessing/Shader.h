@@ -21,6 +21,9 @@ extern ID3D11VertexShader*   gPixelLightingVertexShader;
 extern ID3D11PixelShader*    gTintedTexturePixelShader;
 extern ID3D11PixelShader*    gPixelLightingPixelShader;
 extern ID3D11PixelShader*    gCopyPixelShader;
+extern ID3D11VertexShader*   gBasicTransformInstancedVertexShader;
+extern ID3D11VertexShader*   gPixelLightingInstancedVertexShader;
+extern ID3D11VertexShader*   gDepthOnlyInstancedVertexShader;
 
 
 //*******************************
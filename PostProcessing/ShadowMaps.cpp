@@ -0,0 +1,209 @@
+//--------------------------------------------------------------------------------------
+// Cached cube shadow maps for point lights
+//--------------------------------------------------------------------------------------
+
+#include "ShadowMaps.h"
+#include "CMatrix4x4.h"
+#include "Common.h"          // For gD3DDevice, gD3DContext and the per-frame constants
+#include "GraphicsHelpers.h" // For UpdateConstantBuffer
+
+
+const float ShadowMaps::NearClip = 1.0f;
+
+// The cached static shadows are rendered again when a light moves further than this from where they were rendered
+const float CACHE_MOVE_THRESHOLD = 2.0f;
+
+// Direction each cube face looks along and its up direction, in the DirectX cube map face order (+X, -X, +Y, -Y, +Z, -Z)
+const CVector3 FACE_DIRECTIONS[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1,  0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+const CVector3 FACE_UPS[6]        = { { 0, 1, 0 }, {  0, 1, 0 }, { 0, 0, -1 }, { 0,  0, 1 }, { 0, 1, 0 }, { 0, 1,  0 } };
+
+
+// Create cube shadow maps for the given number of lights (up to MaxLights), each face size x size pixels
+// Returns false on failure
+bool ShadowMaps::Init(unsigned int numLights, unsigned int size)
+{
+	Release();
+	if (numLights == 0 || numLights > MaxLights)  return false;
+
+	mSize = size;
+	mLights.assign(numLights, LightCache());
+
+	// Shadow maps and cache are identical so faces can be copied between them. The typeless format allows the texture to
+	// be used as both a depth buffer and a texture
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = size;
+	textureDesc.Height = size;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = numLights * 6; // Six faces for each light
+	textureDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, &mShadowTexture)) ||
+	    FAILED(gD3DDevice->CreateTexture2D(&textureDesc, nullptr, &mCacheTexture)))
+	{
+		Release();
+		return false;
+	}
+
+	// A depth buffer view for each face
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+	dsvDesc.Texture2DArray.MipSlice = 0;
+	dsvDesc.Texture2DArray.ArraySize = 1;
+	mShadowDSVs.assign(numLights * 6, nullptr);
+	mCacheDSVs .assign(numLights * 6, nullptr);
+	for (unsigned int i = 0; i < numLights * 6; ++i)
+	{
+		dsvDesc.Texture2DArray.FirstArraySlice = i;
+		if (FAILED(gD3DDevice->CreateDepthStencilView(mShadowTexture, &dsvDesc, &mShadowDSVs[i])) ||
+		    FAILED(gD3DDevice->CreateDepthStencilView(mCacheTexture,  &dsvDesc, &mCacheDSVs[i])))
+		{
+			Release();
+			return false;
+		}
+	}
+
+	// The lighting shader reads the shadow maps as an array of cube maps
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+	srvDesc.TextureCubeArray.MostDetailedMip = 0;
+	srvDesc.TextureCubeArray.MipLevels = 1;
+	srvDesc.TextureCubeArray.First2DArrayFace = 0;
+	srvDesc.TextureCubeArray.NumCubes = numLights;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(mShadowTexture, &srvDesc, &mShadowSRV)))
+	{
+		Release();
+		return false;
+	}
+
+	return true;
+}
+
+
+// Bring a light's shadow map up to date. Pass the light's position and radius (the far clip of the shadow map), a
+// number that changes whenever a static caster moves, and the world bounds of the dynamic casters. The given
+// functions draw the static or dynamic casters. The shadow maps must not be bound to a shader when this is called.
+// Changes the render target, viewport and per-frame constants
+void ShadowMaps::Update(unsigned int light, const CVector3& position, float radius, uint32_t staticVersion,
+                        const AABB* dynamicBounds, unsigned int numDynamic,
+                        const RenderFunction& renderStatic, const RenderFunction& renderDynamic)
+{
+	LightCache& cache = mLights[light];
+
+	// Decide if the cached static shadows are out of date
+	bool updateCache = !cache.valid || Length(position - cache.origin) > CACHE_MOVE_THRESHOLD ||
+	                   radius != cache.radius || staticVersion != cache.staticVersion;
+	if (updateCache)
+	{
+		cache.valid = true;
+		cache.origin = position;
+		cache.radius = radius;
+		cache.staticVersion = staticVersion;
+	}
+
+	D3D11_VIEWPORT vp;
+	vp.Width  = static_cast<FLOAT>(mSize);
+	vp.Height = static_cast<FLOAT>(mSize);
+	vp.MinDepth = 0.0f;
+	vp.MaxDepth = 1.0f;
+	vp.TopLeftX = 0;
+	vp.TopLeftY = 0;
+	gD3DContext->RSSetViewports(1, &vp);
+
+	uint32_t dynamicFaces = 0;
+	for (unsigned int face = 0; face < 6; ++face)
+	{
+		unsigned int slice = light * 6 + face;
+		Frustum frustum = SetFaceCamera(cache, face);
+
+		// Render the static casters into the cache
+		if (updateCache)
+		{
+			gD3DContext->OMSetRenderTargets(0, nullptr, mCacheDSVs[slice]);
+			gD3DContext->ClearDepthStencilView(mCacheDSVs[slice], D3D11_CLEAR_DEPTH, 1.0f, 0);
+			renderStatic(frustum);
+			++mNumStaticFaces;
+		}
+
+		// Find if any dynamic casters are in this face
+		bool hasDynamic = false;
+		for (unsigned int i = 0; i < numDynamic && !hasDynamic; ++i)  hasDynamic = FrustumTestAABB(frustum, dynamicBounds[i]);
+
+		// Start from the static shadows if the cache has changed, or dynamic casters are drawn on top now or were last
+		// time (to remove them). Otherwise the face is already correct
+		bool hadDynamic = (cache.dynamicFaces & (1u << face)) != 0;
+		if (updateCache || hasDynamic || hadDynamic)
+		{
+			gD3DContext->CopySubresourceRegion(mShadowTexture, slice, 0, 0, 0, mCacheTexture, slice, nullptr);
+		}
+
+		if (hasDynamic)
+		{
+			gD3DContext->OMSetRenderTargets(0, nullptr, mShadowDSVs[slice]);
+			renderDynamic(frustum);
+			dynamicFaces |= 1u << face;
+			++mNumDynamicFaces;
+		}
+	}
+	cache.dynamicFaces = dynamicFaces;
+
+	gD3DContext->OMSetRenderTargets(0, nullptr, nullptr);
+}
+
+
+// Release GPU resources
+void ShadowMaps::Release()
+{
+	if (mShadowSRV)  mShadowSRV->Release();
+	for (auto dsv : mShadowDSVs)  if (dsv)  dsv->Release();
+	for (auto dsv : mCacheDSVs)   if (dsv)  dsv->Release();
+	if (mShadowTexture)  mShadowTexture->Release();
+	if (mCacheTexture)   mCacheTexture ->Release();
+
+	mShadowSRV = nullptr;
+	mShadowDSVs.clear();
+	mCacheDSVs.clear();
+	mShadowTexture = nullptr;
+	mCacheTexture = nullptr;
+	mLights.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helper functions
+//--------------------------------------------------------------------------------------
+
+// Set the per-frame constants to the camera for a cube face, returns the face's frustum
+Frustum ShadowMaps::SetFaceCamera(const LightCache& cache, unsigned int face)
+{
+	// A camera at the light looking out of the face, in the same way as the Camera class
+	CVector3 look  = FACE_DIRECTIONS[face];
+	CVector3 up    = FACE_UPS[face];
+	CVector3 right = Cross(up, look);
+	CMatrix4x4 worldMatrix = {    right.x,         right.y,         right.z,      0.0f,
+	                                 up.x,            up.y,            up.z,      0.0f,
+	                               look.x,          look.y,          look.z,      0.0f,
+	                          cache.origin.x,  cache.origin.y,  cache.origin.z,  1.0f };
+
+	// 90 degree field of view, square. The far clip is the light's radius, nothing beyond that is lit by the light
+	float scaleZa = cache.radius / (cache.radius - NearClip);
+	float scaleZb = -NearClip * scaleZa;
+	CMatrix4x4 projectionMatrix = { 1.0f, 0.0f,    0.0f, 0.0f,
+	                                0.0f, 1.0f,    0.0f, 0.0f,
+	                                0.0f, 0.0f, scaleZa, 1.0f,
+	                                0.0f, 0.0f, scaleZb, 0.0f };
+
+	gPerFrameConstants.cameraMatrix = worldMatrix;
+	gPerFrameConstants.viewMatrix = InverseAffine(worldMatrix);
+	gPerFrameConstants.projectionMatrix = projectionMatrix;
+	gPerFrameConstants.viewProjectionMatrix = gPerFrameConstants.viewMatrix * projectionMatrix;
+	UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
+
+	return FrustumFromViewProjection(gPerFrameConstants.viewProjectionMatrix);
+}
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------------------
+// Cached cube shadow maps for point lights
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Each shadow casting light has a cube shadow map (six faces, each a 90 degree view from the light). Most of the scene
+// doesn't move, so the static shadow casters are rendered into a separate cached cube map, and only again when the
+// light moves more than a small distance (or a static caster moves). Each frame the cached faces are copied into the
+// shadow map used for lighting and the moving (dynamic) casters are drawn on top. Faces that no dynamic caster touches,
+// this frame or last, are left alone, so the cost each frame depends on the moving geometry and not the whole scene.
+//
+// While the light moves less than the threshold the shadow maps are still rendered from where the cache was made,
+// and the lighting shader looks up the shadows from that point too (see Origin), so the static and dynamic shadows
+// always match. The shadows lag the light very slightly until the cache is next updated.
+//
+// All the shadow maps are in a single cube map array, sampled in the lighting shader using the light's index
+
+#ifndef _SHADOW_MAPS_H_INCLUDED_
+#define _SHADOW_MAPS_H_INCLUDED_
+
+#include "CVector3.h"
+#include "BoundingVolumes.h"
+
+#include <d3d11.h>
+#include <functional>
+#include <vector>
+#include <stdint.h>
+
+class ShadowMaps
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Most lights that can have shadow maps. Must match the size of gShadowOrigins in Common.hlsli
+	static const unsigned int MaxLights = 4;
+
+	// Distance to the near clip plane of each face. Must match gShadowNearClip in the per-frame constants
+	static const float NearClip;
+
+	// GPU resources are created in Init so this can be declared before DirectX is set up
+	ShadowMaps() {}
+	~ShadowMaps()  { Release(); }
+
+	// Prevent copying - owns GPU resources
+	ShadowMaps(const ShadowMaps&) = delete;
+	ShadowMaps& operator=(const ShadowMaps&) = delete;
+
+	// Create cube shadow maps for the given number of lights (up to MaxLights), each face size x size pixels
+	// Returns false on failure
+	bool Init(unsigned int numLights, unsigned int size);
+
+	// Function to draw shadow casters into the current depth buffer. The camera matrices for the cube face are already
+	// in the per-frame constants, and the face's frustum is passed for culling
+	using RenderFunction = std::function<void(const Frustum&)>;
+
+	// Bring a light's shadow map up to date. Pass the light's position and radius (the far clip of the shadow map), a
+	// number that changes whenever a static caster moves, and the world bounds of the dynamic casters. The given
+	// functions draw the static or dynamic casters. The shadow maps must not be bound to a shader when this is called.
+	// Changes the render target, viewport and per-frame constants
+	void Update(unsigned int light, const CVector3& position, float radius, uint32_t staticVersion,
+	            const AABB* dynamicBounds, unsigned int numDynamic,
+	            const RenderFunction& renderStatic, const RenderFunction& renderDynamic);
+
+	// Cube map array of all the shadow maps (the cube at index i is light i)
+	ID3D11ShaderResourceView* SRV()  { return mShadowSRV; }
+
+	// Position a light's shadow map was rendered from, and its far clip distance. The lighting shader must use these
+	// rather than the light's current position
+	CVector3 Origin (unsigned int light)  { return mLights[light].origin; }
+	float    FarClip(unsigned int light)  { return mLights[light].radius; }
+
+	// Release GPU resources
+	void Release();
+
+
+	// Statistics for the last frame: number of faces whose cache was rendered, and faces with dynamic casters drawn
+	// Reset with ResetStatistics, typically at the start of each frame
+	unsigned int NumStaticFacesRendered()   { return mNumStaticFaces;  }
+	unsigned int NumDynamicFacesRendered()  { return mNumDynamicFaces; }
+	void ResetStatistics()  { mNumStaticFaces = mNumDynamicFaces = 0; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Cached state for one light
+	struct LightCache
+	{
+		bool     valid = false;    // False until the cache is first rendered
+		CVector3 origin;           // Where the cache was rendered from
+		float    radius = 0;
+		uint32_t staticVersion = 0;
+		uint32_t dynamicFaces  = 0; // Faces that had dynamic casters drawn in the last update (bit per face)
+	};
+
+	// Set the per-frame constants to the camera for a cube face, returns the face's frustum
+	Frustum SetFaceCamera(const LightCache& cache, unsigned int face);
+
+
+	unsigned int mSize = 0;
+	std::vector<LightCache> mLights;
+
+	// Shadow maps used for lighting, and the cached static shadows. One array slice per cube face
+	ID3D11Texture2D*                     mShadowTexture = nullptr;
+	ID3D11Texture2D*                     mCacheTexture  = nullptr;
+	std::vector<ID3D11DepthStencilView*> mShadowDSVs;
+	std::vector<ID3D11DepthStencilView*> mCacheDSVs;
+	ID3D11ShaderResourceView*            mShadowSRV = nullptr;
+
+	unsigned int mNumStaticFaces  = 0;
+	unsigned int mNumDynamicFaces = 0;
+};
+
+
+#endif //_SHADOW_MAPS_H_INCLUDED_
@@ -22,6 +22,7 @@
 ID3D11SamplerState* gPointSampler         = nullptr;
 ID3D11SamplerState* gTrilinearSampler     = nullptr;
 ID3D11SamplerState* gAnisotropic4xSampler = nullptr;
+ID3D11SamplerState* gShadowSampler        = nullptr; // Comparison sampler for shadow maps
 
 // Blend states allow us to switch between blending modes (none, additive, multiplicative etc.)
 ID3D11BlendState* gNoBlendingState       = nullptr;
@@ -37,6 +38,7 @@ ID3D11RasterizerState* gCullNoneState  = nullptr;
 // Depth-stencil states allow us change how the depth buffer is used
 ID3D11DepthStencilState* gUseDepthBufferState = nullptr;
 ID3D11DepthStencilState* gDepthReadOnlyState  = nullptr;
+ID3D11DepthStencilState* gDepthEqualReadOnlyState = nullptr;
 ID3D11DepthStencilState* gNoDepthBufferState  = nullptr;
 
 //--------------------------------------------------------------------------------------
@@ -106,6 +108,22 @@ bool CreateStates()
     }
 
 
+    ////-------- Shadow map comparison --------////
+    // Compares the given depth with the shadow map and returns how much of the 2x2 texels nearby pass (smooths shadow edges)
+    samplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+    samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+    samplerDesc.MaxAnisotropy = 1;
+    samplerDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL; // Lit if the depth is not further than the nearest caster
+
+    if (FAILED(gD3DDevice->CreateSamplerState(&samplerDesc, &gShadowSampler)))
+    {
+        gLastError = "Error creating shadow sampler";
+        return false;
+    }
+
+
     //--------------------------------------------------------------------------------------
     // Rasterizer States
     //--------------------------------------------------------------------------------------
@@ -262,6 +280,22 @@ bool CreateStates()
     }
 
 
+    ////-------- Depth buffer equal test, reads only --------////
+    // Used after a depth pre-pass: the depth buffer already holds the nearest surface at each pixel, so only the pixels
+    // of that surface pass, and each pixel is shaded once. No need to write depth, it is already correct
+    depthStencilDesc.DepthEnable = TRUE;
+    depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+    depthStencilDesc.DepthFunc = D3D11_COMPARISON_EQUAL;
+    depthStencilDesc.StencilEnable = FALSE;
+
+    // Create a DirectX object for the description above that can be used by a shader
+    if (FAILED(gD3DDevice->CreateDepthStencilState(&depthStencilDesc, &gDepthEqualReadOnlyState)))
+    {
+        gLastError = "Error creating depth-equal-read-only state";
+        return false;
+    }
+
+
     ////-------- Disable depth buffer --------////
     depthStencilDesc.DepthEnable = FALSE;
     depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
@@ -284,6 +318,7 @@ void ReleaseStates()
 {
     if (gUseDepthBufferState)   gUseDepthBufferState   ->Release();
     if (gDepthReadOnlyState)    gDepthReadOnlyState    ->Release();
+    if (gDepthEqualReadOnlyState) gDepthEqualReadOnlyState->Release();
     if (gNoDepthBufferState)    gNoDepthBufferState    ->Release();
     if (gCullBackState)         gCullBackState         ->Release();
     if (gCullFrontState)        gCullFrontState        ->Release();
@@ -291,6 +326,7 @@ void ReleaseStates()
     if (gNoBlendingState)       gNoBlendingState       ->Release();
     if (gAlphaBlendingState)    gAlphaBlendingState    ->Release();
     if (gAdditiveBlendingState) gAdditiveBlendingState ->Release();
+    if (gShadowSampler)         gShadowSampler         ->Release();
     if (gAnisotropic4xSampler)  gAnisotropic4xSampler  ->Release();
     if (gTrilinearSampler)      gTrilinearSampler      ->Release();
     if (gPointSampler)          gPointSampler          ->Release();
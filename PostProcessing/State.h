@@ -21,6 +21,7 @@
 extern ID3D11SamplerState* gPointSampler;
 extern ID3D11SamplerState* gTrilinearSampler;
 extern ID3D11SamplerState* gAnisotropic4xSampler;
+extern ID3D11SamplerState* gShadowSampler;
 
 extern ID3D11BlendState* gNoBlendingState;
 extern ID3D11BlendState* gAdditiveBlendingState;
@@ -32,6 +33,7 @@ extern ID3D11RasterizerState*   gCullNoneState;
 
 extern ID3D11DepthStencilState* gUseDepthBufferState;
 extern ID3D11DepthStencilState* gDepthReadOnlyState;
+extern ID3D11DepthStencilState* gDepthEqualReadOnlyState;
 extern ID3D11DepthStencilState* gNoDepthBufferState;
 
 
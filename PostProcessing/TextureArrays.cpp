@@ -0,0 +1,326 @@
+//--------------------------------------------------------------------------------------
+// Texture arrays and atlases - many textures shared through one texture binding
+//--------------------------------------------------------------------------------------
+
+#include "TextureArrays.h"
+#include "TextureCache.h"
+#include "FileSystem.h"
+#include "Common.h" // For gD3DDevice
+
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+static bool IsPowerOf2(unsigned int value)
+{
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+static unsigned int Log2(unsigned int value)
+{
+	unsigned int result = 0;
+	while (value > 1)
+	{
+		value >>= 1;
+		++result;
+	}
+	return result;
+}
+
+
+// Mips a texture of a given size can keep in an atlas, down to where it is one block (or pixel) across
+static unsigned int AtlasMips(const DDSFileInfo& file)
+{
+	bool blockCompressed;
+	FormatSize(file.format, blockCompressed);
+	unsigned int smallest = blockCompressed ? 4 : 1;
+	return std::min(static_cast<unsigned int>(file.mips.size()), Log2(file.width / smallest) + 1);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+// Add a texture from a file. Image files are block compressed through the texture cache first (see TextureCache.h),
+// DDS files are used as they are. Returns the texture's slot, or NoSlot on failure
+unsigned int TextureArrays::Add(const std::string& filename)
+{
+	std::string ddsFilename = filename;
+	std::string extension = filename.substr(filename.find_last_of('.') + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	if (extension != "dds")
+	{
+		ddsFilename = CompressedTextureFile(filename, TextureChannels::RGBA, false);
+		if (ddsFilename.empty())  return NoSlot;
+	}
+
+	Texture texture;
+	if (!ReadDDSFileInfo(ddsFilename, texture.file))  return NoSlot;
+	mTextures.push_back(texture);
+	return static_cast<unsigned int>(mTextures.size()); // Slot 0 is the whole texture slot
+}
+
+
+// Group the textures added into arrays and atlases and create them on the GPU. Returns false on failure
+bool TextureArrays::Create()
+{
+	// Pack the atlas textures largest first, so the free space is never split up by smaller textures earlier on
+	std::vector<unsigned int> atlasTextures;
+	for (unsigned int i = 0; i < mTextures.size(); ++i)
+	{
+		if (UseAtlas(mTextures[i].file))  atlasTextures.push_back(i);
+	}
+	std::stable_sort(atlasTextures.begin(), atlasTextures.end(), [&](unsigned int a, unsigned int b)
+	{
+		return mTextures[a].file.width > mTextures[b].file.width;
+	});
+	for (unsigned int texture : atlasTextures)  PlaceInAtlas(texture);
+
+	// Every other texture is a layer of the array for its size and format, as is each atlas page
+	for (unsigned int i = 0; i < mTextures.size(); ++i)
+	{
+		Texture& texture = mTextures[i];
+		if (texture.inAtlas)  continue;
+		const DDSFileInfo& file = texture.file;
+		texture.array = FindArray(file.format, file.width, file.height, static_cast<unsigned int>(file.mips.size()));
+		texture.layer = static_cast<unsigned int>(mArrays[texture.array].layers.size());
+		mArrays[texture.array].layers.push_back({ false, i });
+	}
+	for (unsigned int page = 0; page < mAtlasPages.size(); ++page)
+	{
+		unsigned int array = FindArray(mAtlasPages[page].format, AtlasSize, AtlasSize, mAtlasPages[page].numMips);
+		for (unsigned int texture : mAtlasPages[page].textures)
+		{
+			mTextures[texture].array = array;
+			mTextures[texture].layer = static_cast<unsigned int>(mArrays[array].layers.size());
+		}
+		mArrays[array].layers.push_back({ true, page });
+	}
+
+	// Create the arrays one at a time. Textures on their own are passed to DirectX straight from their mapped files, atlas
+	// pages are built in memory. Files are unmapped as soon as their array is created, so only one array's files are
+	// mapped at once however many textures there are
+	mBytes = 0;
+	for (auto& array : mArrays)
+	{
+		std::vector<AssetFile> mappedFiles(array.layers.size());
+		std::vector<std::vector<std::vector<uint8_t>>> atlasMips(array.layers.size());
+		std::vector<D3D11_SUBRESOURCE_DATA> initData, layerData;
+		for (size_t layer = 0; layer < array.layers.size(); ++layer)
+		{
+			const Array::Layer& arrayLayer = array.layers[layer];
+			if (arrayLayer.atlas)
+			{
+				if (!BuildAtlasPage(array, arrayLayer.index, atlasMips[layer]))  return false;
+				bool blockCompressed;
+				unsigned int formatSize = FormatSize(array.format, blockCompressed);
+				layerData.clear();
+				for (unsigned int mip = 0; mip < array.numMips; ++mip)
+				{
+					unsigned int width = AtlasSize >> mip;
+					unsigned int pitch = blockCompressed ? width / 4 * formatSize : width * formatSize;
+					layerData.push_back({ atlasMips[layer][mip].data(), pitch, static_cast<UINT>(atlasMips[layer][mip].size()) });
+				}
+			}
+			else
+			{
+				const DDSFileInfo& file = mTextures[arrayLayer.index].file;
+				if (!OpenTextureFile(file, mappedFiles[layer]))  return false;
+				DDSSubresourceData(file, mappedFiles[layer].Data(), 0, layerData);
+			}
+			initData.insert(initData.end(), layerData.begin(), layerData.end());
+		}
+
+		for (auto& data : initData)  mBytes += data.SysMemSlicePitch;
+		if (!CreateArray(array, initData))  return false;
+	}
+
+	// Slot 0 is the whole of layer 0, then one slot for each texture
+	std::vector<TextureSlot> slots;
+	slots.push_back({ { 1, 1 }, { 0, 0 }, 0, {} });
+	for (auto& texture : mTextures)
+	{
+		if (texture.inAtlas)
+		{
+			float scale = static_cast<float>(texture.file.width) / AtlasSize;
+			slots.push_back({ { scale, scale }, { static_cast<float>(texture.atlasX) / AtlasSize, static_cast<float>(texture.atlasY) / AtlasSize },
+			                  texture.layer, {} });
+		}
+		else
+		{
+			slots.push_back({ { 1, 1 }, { 0, 0 }, texture.layer, {} });
+		}
+	}
+	return mSlotBuffer.Upload(slots.data(), static_cast<unsigned int>(slots.size()));
+}
+
+
+// Release all GPU resources and textures
+void TextureArrays::Release()
+{
+	for (auto& array : mArrays)
+	{
+		if (array.srv)      array.srv    ->Release();
+		if (array.texture)  array.texture->Release();
+	}
+	mArrays.clear();
+	mAtlasPages.clear();
+	mTextures.clear();
+	mSlotBuffer.Release();
+	mBytes = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private helper functions
+//--------------------------------------------------------------------------------------
+
+// Should a texture be packed into an atlas
+bool TextureArrays::UseAtlas(const DDSFileInfo& file)
+{
+	return file.width == file.height && IsPowerOf2(file.width) && file.width >= AtlasMinSize && file.width <= AtlasMaxSize;
+}
+
+
+// Place a texture in an atlas page with space for it, making a new page if needed
+void TextureArrays::PlaceInAtlas(unsigned int textureIndex)
+{
+	Texture& texture = mTextures[textureIndex];
+	unsigned int size = texture.file.width;
+
+	// Use the smallest free square the texture fits in, on any page of the same format
+	AtlasPage* bestPage = nullptr;
+	size_t bestSquare = 0;
+	for (auto& page : mAtlasPages)
+	{
+		if (page.format != texture.file.format)  continue;
+		for (size_t square = 0; square < page.freeSquares.size(); ++square)
+		{
+			unsigned int squareSize = page.freeSquares[square].size;
+			if (squareSize >= size && (bestPage == nullptr || squareSize < bestPage->freeSquares[bestSquare].size))
+			{
+				bestPage = &page;
+				bestSquare = square;
+			}
+		}
+	}
+	if (bestPage == nullptr)
+	{
+		mAtlasPages.push_back({ texture.file.format, ~0u, {}, { { 0, 0, AtlasSize } } });
+		bestPage = &mAtlasPages.back();
+		bestSquare = 0;
+	}
+
+	// Split the square into quarters until it is the texture's size, the other quarters stay free
+	AtlasPage::Square square = bestPage->freeSquares[bestSquare];
+	bestPage->freeSquares.erase(bestPage->freeSquares.begin() + bestSquare);
+	while (square.size > size)
+	{
+		square.size /= 2;
+		bestPage->freeSquares.push_back({ square.x + square.size, square.y,               square.size });
+		bestPage->freeSquares.push_back({ square.x,               square.y + square.size, square.size });
+		bestPage->freeSquares.push_back({ square.x + square.size, square.y + square.size, square.size });
+	}
+
+	texture.inAtlas = true;
+	texture.atlasX = square.x;
+	texture.atlasY = square.y;
+	bestPage->textures.push_back(textureIndex);
+	bestPage->numMips = std::min(bestPage->numMips, AtlasMips(texture.file));
+}
+
+
+// The array for textures of the given size and format, adding a new one if there isn't one yet
+unsigned int TextureArrays::FindArray(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int numMips)
+{
+	for (unsigned int i = 0; i < mArrays.size(); ++i)
+	{
+		const Array& array = mArrays[i];
+		if (array.format == format && array.width == width && array.height == height && array.numMips == numMips)  return i;
+	}
+	mArrays.push_back({ format, width, height, numMips, {} });
+	return static_cast<unsigned int>(mArrays.size() - 1);
+}
+
+
+// Build the mips of an atlas page, copying each texture's mips from its mapped file into its area of the page
+bool TextureArrays::BuildAtlasPage(const Array& array, unsigned int page, std::vector<std::vector<uint8_t>>& mips)
+{
+	bool blockCompressed;
+	unsigned int formatSize = FormatSize(array.format, blockCompressed);
+	unsigned int blockSize = blockCompressed ? 4 : 1; // Pixels across each block (or pixel)
+
+	// Unused areas are left as zeros
+	mips.resize(array.numMips);
+	for (unsigned int mip = 0; mip < array.numMips; ++mip)
+	{
+		unsigned int pageBlocks = (AtlasSize >> mip) / blockSize;
+		mips[mip].assign(static_cast<size_t>(pageBlocks) * pageBlocks * formatSize, 0);
+	}
+
+	// Copied a row of blocks at a time
+	for (unsigned int textureIndex : mAtlasPages[page].textures)
+	{
+		const Texture& texture = mTextures[textureIndex];
+		AssetFile mappedFile;
+		if (!OpenTextureFile(texture.file, mappedFile))  return false;
+		for (unsigned int mip = 0; mip < array.numMips; ++mip)
+		{
+			const DDSFileInfo::Mip& fileMip = texture.file.mips[mip];
+			unsigned int pagePitch = (AtlasSize >> mip) / blockSize * formatSize;
+			unsigned int rows = (texture.file.height >> mip) / blockSize;
+			unsigned int x = (texture.atlasX >> mip) / blockSize;
+			unsigned int y = (texture.atlasY >> mip) / blockSize;
+			for (unsigned int row = 0; row < rows; ++row)
+			{
+				std::memcpy(&mips[mip][static_cast<size_t>(y + row) * pagePitch + x * formatSize],
+				            mappedFile.Data() + fileMip.offset + static_cast<size_t>(row) * fileMip.pitch, fileMip.pitch);
+			}
+		}
+	}
+	return true;
+}
+
+
+// Open a texture's file, checking it still holds all the mips found when it was added. Returns false on failure
+bool TextureArrays::OpenTextureFile(const DDSFileInfo& file, AssetFile& mappedFile)
+{
+	if (!mappedFile.Open(file.filename))  return false;
+	const DDSFileInfo::Mip& last = file.mips.back();
+	return mappedFile.Size() >= last.offset + last.size;
+}
+
+
+// Create an array on the GPU from the initial data for each of its subresources (ordered by layer then mip). Returns
+// false on failure
+bool TextureArrays::CreateArray(Array& array, const std::vector<D3D11_SUBRESOURCE_DATA>& initData)
+{
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width  = array.width;
+	textureDesc.Height = array.height;
+	textureDesc.MipLevels = array.numMips;
+	textureDesc.ArraySize = static_cast<UINT>(array.layers.size());
+	textureDesc.Format = array.format;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, initData.data(), &array.texture)))  return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = array.format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = array.numMips;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = textureDesc.ArraySize;
+	return SUCCEEDED(gD3DDevice->CreateShaderResourceView(array.texture, &srvDesc, &array.srv));
+}
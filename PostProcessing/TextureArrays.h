@@ -0,0 +1,174 @@
+//--------------------------------------------------------------------------------------
+// Texture arrays and atlases - many textures shared through one texture binding
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Binding a different texture for each model splits the render queue's state groups, and stops models with different
+// textures being drawn together. Instead textures are added here while loading, then Create groups them on the GPU:
+// - Textures with the same size, format and number of mips become the layers of one Texture2DArray
+// - Small square textures (power of 2 sizes from AtlasMinSize to AtlasMaxSize) are packed into atlas pages, which are
+//   themselves layers of an array. Textures are placed at a multiple of their size so block compressed data can be
+//   copied in directly, and pages only keep the mips where every texture in them is still at least one block
+//
+// Each texture added gets a slot: the layer it is in and the UV scale and offset of its area in that layer. All the
+// slots are in one structured buffer read by the shaders, and each model's slot is sent in its instance data (see
+// InstanceBatcher.h), so draws of models whose textures are in the same array don't change the texture binding.
+// Slot 0 is always the whole of layer 0, for textures that aren't in an array here (e.g. streamed textures, which are
+// viewed as arrays of one layer). Shaders sample a slot with SampleTextureSlot in Common.hlsli
+
+#ifndef _TEXTURE_ARRAYS_H_INCLUDED_
+#define _TEXTURE_ARRAYS_H_INCLUDED_
+
+#include "DDSFile.h"
+#include "DynamicStructuredBuffer.h"
+#include "CVector2.h"
+
+#include <d3d11.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class AssetFile;
+
+
+// Where a texture is in an array as the shaders see it. Must match the TextureSlot structure in Common.hlsli
+struct TextureSlot
+{
+	CVector2 uvScale;  // UV in the layer = model UV * scale + offset, after wrapping the model UV to 0-1
+	CVector2 uvOffset;
+	uint32_t layer;
+	uint32_t padding[3];
+};
+
+
+class TextureArrays
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Square textures with power of 2 sizes in this range are packed into atlases
+	static const unsigned int AtlasMinSize = 64;
+	static const unsigned int AtlasMaxSize = 256;
+
+	// Width and height of an atlas page
+	static const unsigned int AtlasSize = 1024;
+
+	// Slot for a whole texture that isn't in an array, the default for materials
+	static const unsigned int WholeTextureSlot = 0;
+
+	// Returned by Add on failure
+	static const unsigned int NoSlot = ~0u;
+
+	// The slot buffer is created in Create so the arrays can be declared before DirectX is set up
+	TextureArrays() : mSlotBuffer(sizeof(TextureSlot)) {}
+	~TextureArrays()  { Release(); }
+
+	// Prevent copying - owns GPU resources
+	TextureArrays(const TextureArrays&) = delete;
+	TextureArrays& operator=(const TextureArrays&) = delete;
+
+	// Add a texture from a file. Image files are block compressed through the texture cache first (see TextureCache.h),
+	// DDS files are used as they are. Returns the texture's slot, or NoSlot on failure. The texture isn't usable until
+	// Create has been called
+	unsigned int Add(const std::string& filename);
+
+	// Group the textures added into arrays and atlases and create them on the GPU. Returns false on failure
+	bool Create();
+
+	// View of the array holding the texture in a slot, use as the texture for materials using that slot
+	ID3D11ShaderResourceView* SRV(unsigned int slot)  { return (slot > 0 && slot <= mTextures.size()) ? mArrays[mTextures[slot - 1].array].srv : nullptr; }
+
+	// View of the buffer holding every slot, bind to the pixel shader at the register in Common.hlsli
+	ID3D11ShaderResourceView* SlotsSRV()  { return mSlotBuffer.SRV(); }
+
+	// Release all GPU resources and textures
+	void Release();
+
+
+	// Statistics for the last Create: number of textures, number of arrays they are in and GPU memory used
+	unsigned int NumTextures()  { return static_cast<unsigned int>(mTextures.size()); }
+	unsigned int NumArrays()    { return static_cast<unsigned int>(mArrays.size()); }
+	uint64_t     Bytes()        { return mBytes; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// A texture added, and where it ended up
+	struct Texture
+	{
+		DDSFileInfo  file;
+		unsigned int array = 0;
+		unsigned int layer = 0;
+		bool         inAtlas = false;
+		unsigned int atlasX  = 0; // Position in the atlas page (pixels of the top mip)
+		unsigned int atlasY  = 0;
+	};
+
+	// One atlas page, becomes a layer of an array
+	struct AtlasPage
+	{
+		struct Square
+		{
+			unsigned int x, y, size;
+		};
+
+		DXGI_FORMAT               format;
+		unsigned int              numMips;
+		std::vector<unsigned int> textures;    // Indexes into mTextures
+		std::vector<Square>       freeSquares; // Free space, as squares of power of 2 sizes at multiples of their size
+	};
+
+	// One texture array on the GPU
+	struct Array
+	{
+		DXGI_FORMAT  format;
+		unsigned int width;
+		unsigned int height;
+		unsigned int numMips;
+
+		// What goes in each layer: a texture (index into mTextures) or an atlas page (index into mAtlasPages)
+		struct Layer
+		{
+			bool         atlas;
+			unsigned int index;
+		};
+		std::vector<Layer> layers;
+
+		ID3D11Texture2D*          texture = nullptr;
+		ID3D11ShaderResourceView* srv     = nullptr;
+	};
+
+	// Should a texture be packed into an atlas
+	static bool UseAtlas(const DDSFileInfo& file);
+
+	// Place a texture in an atlas page with space for it, making a new page if needed
+	void PlaceInAtlas(unsigned int texture);
+
+	// The array for textures of the given size and format, adding a new one if there isn't one yet
+	unsigned int FindArray(DXGI_FORMAT format, unsigned int width, unsigned int height, unsigned int numMips);
+
+	// Build the mips of an atlas page, copying each texture's mips from its mapped file into its area of the page
+	bool BuildAtlasPage(const Array& array, unsigned int page, std::vector<std::vector<uint8_t>>& mips);
+
+	// Open a texture's file, checking it still holds all the mips found when it was added. Returns false on failure
+	static bool OpenTextureFile(const DDSFileInfo& file, AssetFile& mappedFile);
+
+	// Create an array on the GPU from the initial data for each of its subresources (ordered by layer then mip). Returns
+	// false on failure
+	bool CreateArray(Array& array, const std::vector<D3D11_SUBRESOURCE_DATA>& initData);
+
+
+	std::vector<Texture>   mTextures;   // Slot n is texture n - 1
+	std::vector<AtlasPage> mAtlasPages;
+	std::vector<Array>     mArrays;
+
+	DynamicStructuredBuffer mSlotBuffer;
+
+	uint64_t mBytes = 0;
+};
+
+
+#endif //_TEXTURE_ARRAYS_H_INCLUDED_
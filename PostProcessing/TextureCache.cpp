@@ -0,0 +1,162 @@
+//--------------------------------------------------------------------------------------
+// Cache of block compressed textures made from image files
+//--------------------------------------------------------------------------------------
+
+#include "TextureCache.h"
+#include "DDSFile.h"
+#include "MipGenerator.h"
+#include "Hash.h"
+#include "FileSystem.h" // Images may be in a pack
+#include "Common.h" // For gD3DDevice and gD3DContext
+
+#include <WICTextureLoader.h>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+
+// Change when the compressor's output changes, so existing cache files aren't used
+const uint32_t TEXTURE_CACHE_VERSION = 2;
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+static DXGI_FORMAT DXGIFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1:  return DXGI_FORMAT_BC1_UNORM;
+	case BlockFormat::BC3:  return DXGI_FORMAT_BC3_UNORM;
+	case BlockFormat::BC4:  return DXGI_FORMAT_BC4_UNORM;
+	case BlockFormat::BC5:  return DXGI_FORMAT_BC5_UNORM;
+	case BlockFormat::BC7:  return DXGI_FORMAT_BC7_UNORM;
+	}
+	return DXGI_FORMAT_UNKNOWN;
+}
+
+
+// Read an image file into RGBA8 pixels. DirectXTK decodes the image from memory into a texture the CPU can read, which is then
+// copied out in RGBA order. Channels missing from the image's format are filled the way the GPU would read them, so the
+// compressed texture looks the same to shaders. Returns false on failure or for unusual formats (e.g. 16-bit images)
+static bool ReadImage(const uint8_t* image, size_t imageSize, std::vector<uint8_t>& pixels, unsigned int& width, unsigned int& height)
+{
+	ID3D11Resource* resource = nullptr;
+	if (FAILED(DirectX::CreateWICTextureFromMemoryEx(gD3DDevice, image, imageSize, 0, D3D11_USAGE_STAGING, 0,
+	                                                 D3D11_CPU_ACCESS_READ, 0, DirectX::WIC_LOADER_IGNORE_SRGB, &resource, nullptr)))
+	{
+		return false;
+	}
+	ID3D11Texture2D* texture = nullptr;
+	HRESULT hr = resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&texture));
+	resource->Release();
+	if (FAILED(hr))  return false;
+
+	D3D11_TEXTURE2D_DESC textureDesc;
+	texture->GetDesc(&textureDesc);
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(texture, 0, D3D11_MAP_READ, 0, &mapped)))
+	{
+		texture->Release();
+		return false;
+	}
+
+	width  = textureDesc.Width;
+	height = textureDesc.Height;
+	pixels.resize(static_cast<size_t>(width) * height * 4);
+	bool supported = true;
+	for (unsigned int y = 0; y < height && supported; ++y)
+	{
+		const uint8_t* row = static_cast<const uint8_t*>(mapped.pData) + static_cast<size_t>(y) * mapped.RowPitch;
+		uint8_t* output = &pixels[static_cast<size_t>(y) * width * 4];
+		for (unsigned int x = 0; x < width; ++x, output += 4)
+		{
+			switch (textureDesc.Format)
+			{
+			case DXGI_FORMAT_R8G8B8A8_UNORM: case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+				std::memcpy(output, &row[x * 4], 4);
+				break;
+
+			case DXGI_FORMAT_B8G8R8A8_UNORM: case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+			case DXGI_FORMAT_B8G8R8X8_UNORM: case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+				output[0] = row[x * 4 + 2];
+				output[1] = row[x * 4 + 1];
+				output[2] = row[x * 4 + 0];
+				output[3] = (textureDesc.Format == DXGI_FORMAT_B8G8R8A8_UNORM ||
+				             textureDesc.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB) ? row[x * 4 + 3] : 255;
+				break;
+
+			case DXGI_FORMAT_R8_UNORM: // Greyscale images, shaders see the value in red only
+				output[0] = row[x];
+				output[1] = output[2] = 0;
+				output[3] = 255;
+				break;
+
+			case DXGI_FORMAT_A8_UNORM:
+				output[0] = output[1] = output[2] = 0;
+				output[3] = row[x];
+				break;
+
+			default:
+				supported = false;
+				break;
+			}
+		}
+	}
+
+	gD3DContext->Unmap(texture, 0);
+	texture->Release();
+	return supported;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+// Find the cached DDS file for an image file, compressing the image if there isn't one yet. Returns the DDS filename, or
+// an empty string on failure
+std::string CompressedTextureFile(const std::string& filename, TextureChannels channels, bool highQuality)
+{
+	// The cache filename is the image's name followed by a hash of its contents and the settings
+	AssetFile imageFile;
+	if (!imageFile.Open(filename))  return "";
+	uint64_t hash = HashBytes(imageFile.Data(), static_cast<size_t>(imageFile.Size()));
+	uint32_t settings[3] = { TEXTURE_CACHE_VERSION, static_cast<uint32_t>(channels), highQuality ? 1u : 0u };
+	hash = HashBytes(settings, sizeof(settings), hash);
+
+	std::string name = filename.substr(filename.find_last_of("/\\") + 1);
+	name = name.substr(0, name.find_last_of('.'));
+	char hashText[17];
+	std::snprintf(hashText, sizeof(hashText), "%016llx", static_cast<unsigned long long>(hash));
+	std::string cacheFilename = std::string(TEXTURE_CACHE_FOLDER) + "/" + name + "_" + hashText + ".dds";
+	if (gFileSystem.Exists(cacheFilename))  return cacheFilename;
+
+	// Not cached yet, compress the image and each mip down to 1x1
+	std::vector<uint8_t> pixels;
+	unsigned int width, height;
+	if (!ReadImage(imageFile.Data(), static_cast<size_t>(imageFile.Size()), pixels, width, height) || width % 4 != 0 || height % 4 != 0)  return "";
+
+	BlockFormat format = ChooseBlockFormat(pixels.data(), width, height, channels, highQuality);
+	std::vector<std::vector<uint8_t>> mips;
+	mips.emplace_back(CompressedSize(format, width, height));
+	CompressImage(format, pixels.data(), width, height, mips.back().data());
+
+	// Make the mips (see MipGenerator.h). Only colours are gamma corrected, single and two channel textures hold
+	// data. Filtering wraps around the edges to match the texture samplers. The alpha of colour textures here holds
+	// specular strength rather than coverage, so it is filtered like any other value
+	MipSettings mipSettings;
+	mipSettings.filter = MipFilter::Kaiser;
+	mipSettings.gammaCorrect = (channels == TextureChannels::RGB || channels == TextureChannels::RGBA);
+	mipSettings.wrap = true;
+	for (const MipLevel& mip : GenerateMips(pixels.data(), width, height, mipSettings))
+	{
+		mips.emplace_back(CompressedSize(format, mip.width, mip.height));
+		CompressImage(format, mip.pixels.data(), mip.width, mip.height, mips.back().data());
+	}
+
+	CreateDirectoryA(TEXTURE_CACHE_FOLDER, nullptr); // Fails harmlessly if the folder exists
+	if (!WriteDDSFile(cacheFilename, DXGIFormat(format), width, height, mips))  return "";
+	return cacheFilename;
+}
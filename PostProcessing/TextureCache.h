@@ -0,0 +1,28 @@
+//--------------------------------------------------------------------------------------
+// Cache of block compressed textures made from image files
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Image files (jpg, png etc.) load as 4 bytes per pixel and have their mips made at load time. The first time an image
+// is loaded it is compressed instead (see TextureCompressor.h) with a full set of mips and saved as a DDS file in the
+// cache folder. Later loads read the DDS file directly, and the texture uses 4-8 times less GPU memory
+// The cache file is named from a hash of the image file's contents and the compression settings, so changing either
+// gives a new cache file. Old cache files are never deleted, empty the folder to remove them
+
+#ifndef _TEXTURE_CACHE_H_INCLUDED_
+#define _TEXTURE_CACHE_H_INCLUDED_
+
+#include "TextureCompressor.h"
+
+#include <string>
+
+
+// Folder the compressed textures are stored in, relative to the working folder
+const char* const TEXTURE_CACHE_FOLDER = "TextureCache";
+
+
+// Find the cached DDS file for an image file, compressing the image if there isn't one yet. The image's size must be a
+// multiple of 4 (a requirement of block compressed textures). Returns the DDS filename, or an empty string on failure
+std::string CompressedTextureFile(const std::string& filename, TextureChannels channels, bool highQuality);
+
+
+#endif //_TEXTURE_CACHE_H_INCLUDED_
@@ -0,0 +1,669 @@
+//--------------------------------------------------------------------------------------
+// Block compression of textures (BC1, BC3, BC4, BC5, BC7) on the CPU
+//--------------------------------------------------------------------------------------
+
+#include "TextureCompressor.h"
+#include "ThreadPool.h" // Rows of blocks are compressed in parallel
+
+#include <emmintrin.h> // SSE2 intrinsics
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+// Times the endpoints are refined by least squares after the first fit. Each pass usually reduces the error a little,
+// most of the gain is in the first
+const unsigned int REFINE_ITERATIONS = 2;
+
+// Position along the line between the endpoints of each palette entry, in the order the formats store them
+const float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+const float BC4_WEIGHTS[8] = { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f };
+const int   BC7_WEIGHTS2[4]  = { 0, 21, 43, 64 }; // 64ths
+const int   BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+
+// The pixels of a block by channel (R, G, B, A), as floats so four pixels can be processed at once
+struct Block
+{
+	alignas(16) float channels[4][16];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+static void LoadBlock(const uint8_t* pixels, Block& block)
+{
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		for (unsigned int c = 0; c < 4; ++c)  block.channels[c][p] = pixels[p * 4 + c];
+	}
+}
+
+
+// Find the nearest palette entry to each pixel of a block, comparing numChannels channels from firstChannel (palette
+// channels start from 0). Pixels are processed four at a time with SSE. Writes an index for each pixel and returns the
+// total squared error
+static float FindIndices(const Block& block, unsigned int firstChannel, unsigned int numChannels,
+                         const float (*palette)[4], unsigned int numEntries, uint8_t* indices)
+{
+	__m128 totalError = _mm_setzero_ps();
+	for (unsigned int p = 0; p < 16; p += 4)
+	{
+		__m128  bestError = _mm_set1_ps(3.4e38f);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (unsigned int e = 0; e < numEntries; ++e)
+		{
+			__m128 error = _mm_setzero_ps();
+			for (unsigned int c = 0; c < numChannels; ++c)
+			{
+				__m128 difference = _mm_sub_ps(_mm_load_ps(&block.channels[firstChannel + c][p]), _mm_set1_ps(palette[e][c]));
+				error = _mm_add_ps(error, _mm_mul_ps(difference, difference));
+			}
+
+			// Keep the index of the first entry with the lowest error
+			__m128i better = _mm_castps_si128(_mm_cmplt_ps(error, bestError));
+			bestError = _mm_min_ps(error, bestError);
+			bestIndex = _mm_or_si128(_mm_andnot_si128(better, bestIndex), _mm_and_si128(better, _mm_set1_epi32(e)));
+		}
+		totalError = _mm_add_ps(totalError, bestError);
+
+		alignas(16) int32_t bestIndices[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(bestIndices), bestIndex);
+		for (unsigned int i = 0; i < 4; ++i)  indices[p + i] = static_cast<uint8_t>(bestIndices[i]);
+	}
+
+	alignas(16) float errors[4];
+	_mm_store_ps(errors, totalError);
+	return errors[0] + errors[1] + errors[2] + errors[3];
+}
+
+
+// Find the line through a block's pixels (numChannels channels from firstChannel) that fits them best: through their
+// mean along their principal axis. Returns the ends of the pixels' range along the line as initial endpoints
+static void FitLine(const Block& block, unsigned int firstChannel, unsigned int numChannels, float* end0, float* end1)
+{
+	float mean[4] = {};
+	for (unsigned int c = 0; c < numChannels; ++c)
+	{
+		for (unsigned int p = 0; p < 16; ++p)  mean[c] += block.channels[firstChannel + c][p];
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		float offset[4];
+		for (unsigned int c = 0; c < numChannels; ++c)  offset[c] = block.channels[firstChannel + c][p] - mean[c];
+		for (unsigned int i = 0; i < numChannels; ++i)
+		{
+			for (unsigned int j = 0; j < numChannels; ++j)  covariance[i][j] += offset[i] * offset[j];
+		}
+	}
+
+	// The principal axis is the eigenvector of the covariance with the largest eigenvalue, found by power iteration.
+	// Start from the row with the most variance, which is already close
+	unsigned int largest = 0;
+	for (unsigned int c = 1; c < numChannels; ++c)
+	{
+		if (covariance[c][c] > covariance[largest][largest])  largest = c;
+	}
+	float axis[4] = {};
+	for (unsigned int c = 0; c < numChannels; ++c)  axis[c] = covariance[largest][c];
+	for (unsigned int iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[4] = {};
+		float size = 0.0f;
+		for (unsigned int i = 0; i < numChannels; ++i)
+		{
+			for (unsigned int j = 0; j < numChannels; ++j)  next[i] += covariance[i][j] * axis[j];
+			size = std::max(size, std::abs(next[i]));
+		}
+		if (size == 0.0f)  break;
+		for (unsigned int c = 0; c < numChannels; ++c)  axis[c] = next[c] / size;
+	}
+	float length = 0.0f;
+	for (unsigned int c = 0; c < numChannels; ++c)  length += axis[c] * axis[c];
+	length = std::sqrt(length);
+
+	// All pixels the same
+	if (length == 0.0f)
+	{
+		for (unsigned int c = 0; c < numChannels; ++c)  end0[c] = end1[c] = mean[c];
+		return;
+	}
+	for (unsigned int c = 0; c < numChannels; ++c)  axis[c] /= length;
+
+	float minDistance = 3.4e38f;
+	float maxDistance = -3.4e38f;
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		float distance = 0.0f;
+		for (unsigned int c = 0; c < numChannels; ++c)  distance += (block.channels[firstChannel + c][p] - mean[c]) * axis[c];
+		minDistance = std::min(minDistance, distance);
+		maxDistance = std::max(maxDistance, distance);
+	}
+	for (unsigned int c = 0; c < numChannels; ++c)
+	{
+		end0[c] = std::min(std::max(mean[c] + minDistance * axis[c], 0.0f), 255.0f);
+		end1[c] = std::min(std::max(mean[c] + maxDistance * axis[c], 0.0f), 255.0f);
+	}
+}
+
+
+// Improve the endpoints for the palette indices chosen for each pixel by a least squares fit. weights gives the
+// position of each palette entry between the endpoints (0 is end0, 1 is end1). Returns false if the fit isn't possible
+// (every pixel uses the same position)
+static bool RefineEndpoints(const Block& block, unsigned int firstChannel, unsigned int numChannels, const uint8_t* indices,
+                            const float* weights, float* end0, float* end1)
+{
+	// Minimise the sum of ((1 - w) * end0 + w * end1 - pixel)^2 over the pixels, for each channel
+	float a = 0.0f, b = 0.0f, c = 0.0f;
+	float sum0[4] = {}, sum1[4] = {};
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		float w = weights[indices[p]];
+		a += (1.0f - w) * (1.0f - w);
+		b += (1.0f - w) * w;
+		c += w * w;
+		for (unsigned int ch = 0; ch < numChannels; ++ch)
+		{
+			sum0[ch] += (1.0f - w) * block.channels[firstChannel + ch][p];
+			sum1[ch] += w * block.channels[firstChannel + ch][p];
+		}
+	}
+	float determinant = a * c - b * b;
+	if (std::abs(determinant) < 1e-6f)  return false;
+
+	for (unsigned int ch = 0; ch < numChannels; ++ch)
+	{
+		end0[ch] = std::min(std::max((c * sum0[ch] - b * sum1[ch]) / determinant, 0.0f), 255.0f);
+		end1[ch] = std::min(std::max((a * sum1[ch] - b * sum0[ch]) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+
+// Write numBits of a value into a block at the given bit position (from the lowest bit of the first byte), moving the
+// position on. The block must start zeroed
+static void WriteBits(uint8_t* output, unsigned int& position, uint32_t value, unsigned int numBits)
+{
+	for (unsigned int bit = 0; bit < numBits; ++bit, ++position)
+	{
+		if ((value >> bit) & 1)  output[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Block formats
+//--------------------------------------------------------------------------------------
+
+static uint16_t PackColour565(const float* colour)
+{
+	unsigned int r = static_cast<unsigned int>(colour[0] * 31.0f / 255.0f + 0.5f);
+	unsigned int g = static_cast<unsigned int>(colour[1] * 63.0f / 255.0f + 0.5f);
+	unsigned int b = static_cast<unsigned int>(colour[2] * 31.0f / 255.0f + 0.5f);
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void UnpackColour565(uint16_t packed, float* colour)
+{
+	unsigned int r = packed >> 11;
+	unsigned int g = (packed >> 5) & 63;
+	unsigned int b = packed & 31;
+	colour[0] = static_cast<float>((r << 3) | (r >> 2));
+	colour[1] = static_cast<float>((g << 2) | (g >> 4));
+	colour[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+
+// Compress the RGB of a block to a BC1 block. Always uses the four colour mode, so is also the colour part of BC3
+static void CompressColourBlock(const Block& block, uint8_t* output)
+{
+	float end0[4], end1[4];
+	FitLine(block, 0, 3, end0, end1);
+
+	uint16_t bestColour0 = 0, bestColour1 = 0;
+	uint8_t  bestIndices[16] = {};
+	float    bestError = 3.4e38f;
+	for (unsigned int iteration = 0; iteration <= REFINE_ITERATIONS; ++iteration)
+	{
+		// The four colour mode needs the first endpoint larger. Equal endpoints give the three colour mode, but every
+		// pixel can use the first entry then
+		uint16_t colour0 = PackColour565(end0);
+		uint16_t colour1 = PackColour565(end1);
+		if (colour0 < colour1)
+		{
+			std::swap(colour0, colour1);
+			std::swap_ranges(end0, end0 + 3, end1);
+		}
+
+		float palette[4][4];
+		UnpackColour565(colour0, palette[0]);
+		UnpackColour565(colour1, palette[1]);
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+
+		uint8_t indices[16];
+		float error = FindIndices(block, 0, 3, palette, colour0 == colour1 ? 1 : 4, indices);
+		if (error < bestError)
+		{
+			bestError = error;
+			bestColour0 = colour0;
+			bestColour1 = colour1;
+			std::memcpy(bestIndices, indices, 16);
+		}
+		if (error == 0.0f || colour0 == colour1 || !RefineEndpoints(block, 0, 3, indices, BC1_WEIGHTS, end0, end1))  break;
+	}
+
+	std::memset(output, 0, 8);
+	unsigned int position = 0;
+	WriteBits(output, position, bestColour0, 16);
+	WriteBits(output, position, bestColour1, 16);
+	for (unsigned int p = 0; p < 16; ++p)  WriteBits(output, position, bestIndices[p], 2);
+}
+
+
+// Palette of a BC4 block from its endpoints. The order of the endpoints chooses the mode: six levels between them if the
+// first is larger, otherwise four levels between them plus 0 and 255 (for blocks with a few extreme pixels)
+static void ChannelPalette(unsigned int end0, unsigned int end1, float (*palette)[4])
+{
+	palette[0][0] = static_cast<float>(end0);
+	palette[1][0] = static_cast<float>(end1);
+	if (end0 > end1)
+	{
+		for (unsigned int i = 1; i < 7; ++i)  palette[i + 1][0] = ((7 - i) * end0 + i * end1) / 7.0f;
+	}
+	else
+	{
+		for (unsigned int i = 1; i < 5; ++i)  palette[i + 1][0] = ((5 - i) * end0 + i * end1) / 5.0f;
+		palette[6][0] = 0.0f;
+		palette[7][0] = 255.0f;
+	}
+}
+
+
+// Compress one channel of a block to a BC4 block. Also used for the alpha of BC3 and each channel of BC5
+static void CompressChannelBlock(const Block& block, unsigned int channel, uint8_t* output)
+{
+	const float* values = block.channels[channel];
+	float minValue = 255.0f, maxValue = 0.0f;
+	float minInner = 255.0f, maxInner = 0.0f; // Ignoring 0 and 255, for the mode that has those levels anyway
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		minValue = std::min(minValue, values[p]);
+		maxValue = std::max(maxValue, values[p]);
+		if (values[p] > 0.0f && values[p] < 255.0f)
+		{
+			minInner = std::min(minInner, values[p]);
+			maxInner = std::max(maxInner, values[p]);
+		}
+	}
+	if (minInner > maxInner)  minInner = maxInner = 0.0f;
+
+	unsigned int bestEnd0 = 0, bestEnd1 = 0;
+	uint8_t      bestIndices[16] = {};
+	float        bestError = 3.4e38f;
+	auto tryEndpoints = [&](unsigned int end0, unsigned int end1, uint8_t* indices)
+	{
+		float palette[8][4];
+		ChannelPalette(end0, end1, palette);
+		float error = FindIndices(block, channel, 1, palette, 8, indices);
+		if (error < bestError)
+		{
+			bestError = error;
+			bestEnd0 = end0;
+			bestEnd1 = end1;
+			std::memcpy(bestIndices, indices, 16);
+		}
+		return error;
+	};
+
+	// Six levels between the full range, refined by least squares. The endpoints must stay in order for the mode
+	float end0 = maxValue, end1 = minValue;
+	for (unsigned int iteration = 0; iteration <= REFINE_ITERATIONS; ++iteration)
+	{
+		unsigned int quantised0 = static_cast<unsigned int>(end0 + 0.5f);
+		unsigned int quantised1 = static_cast<unsigned int>(end1 + 0.5f);
+		if (quantised0 < quantised1)  std::swap(quantised0, quantised1);
+		if (quantised0 == quantised1)
+		{
+			if (quantised0 < 255)  ++quantised0;  else  --quantised1;
+		}
+
+		uint8_t indices[16];
+		if (tryEndpoints(quantised0, quantised1, indices) == 0.0f)  break;
+
+		end0 = static_cast<float>(quantised0);
+		end1 = static_cast<float>(quantised1);
+		if (!RefineEndpoints(block, channel, 1, indices, BC4_WEIGHTS, &end0, &end1))  break;
+	}
+
+	// Four levels between the range of the other pixels, with 0 and 255 for the extremes
+	if (bestError > 0.0f && (minValue == 0.0f || maxValue == 255.0f))
+	{
+		uint8_t indices[16];
+		tryEndpoints(static_cast<unsigned int>(minInner), static_cast<unsigned int>(maxInner), indices);
+	}
+
+	std::memset(output, 0, 8);
+	unsigned int position = 0;
+	WriteBits(output, position, bestEnd0, 8);
+	WriteBits(output, position, bestEnd1, 8);
+	for (unsigned int p = 0; p < 16; ++p)  WriteBits(output, position, bestIndices[p], 3);
+}
+
+
+// Quantise a BC7 mode 6 endpoint: 7 bits per channel plus a lowest bit (p-bit) shared by the channels. Chooses the p-bit
+// that gives the closest endpoint
+static void QuantiseBC7Endpoint(const float* end, unsigned int* quantised, unsigned int& pBit)
+{
+	float bestError = 3.4e38f;
+	for (unsigned int p = 0; p < 2; ++p)
+	{
+		unsigned int values[4];
+		float error = 0.0f;
+		for (unsigned int c = 0; c < 4; ++c)
+		{
+			int value = static_cast<int>((end[c] - p) * 0.5f + 0.5f);
+			values[c] = static_cast<unsigned int>(std::min(std::max(value, 0), 127));
+			float difference = static_cast<float>(values[c] * 2 + p) - end[c];
+			error += difference * difference;
+		}
+		if (error < bestError)
+		{
+			bestError = error;
+			pBit = p;
+			std::copy(values, values + 4, quantised);
+		}
+	}
+}
+
+
+// Compress a block to BC7 mode 6: one RGBA line with 16 levels, 7 bit endpoints plus a p-bit each. Returns the squared
+// error
+static float CompressBC7Mode6(const Block& block, uint8_t* output)
+{
+	float weights[16];
+	for (unsigned int i = 0; i < 16; ++i)  weights[i] = BC7_WEIGHTS4[i] / 64.0f;
+
+	float end0[4], end1[4];
+	FitLine(block, 0, 4, end0, end1);
+
+	unsigned int bestEnd0[4] = {}, bestEnd1[4] = {}, bestP0 = 0, bestP1 = 0;
+	uint8_t      bestIndices[16] = {};
+	float        bestError = 3.4e38f;
+	for (unsigned int iteration = 0; iteration <= REFINE_ITERATIONS; ++iteration)
+	{
+		unsigned int quantised0[4], quantised1[4], p0, p1;
+		QuantiseBC7Endpoint(end0, quantised0, p0);
+		QuantiseBC7Endpoint(end1, quantised1, p1);
+
+		float palette[16][4];
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			for (unsigned int c = 0; c < 4; ++c)
+			{
+				int e0 = quantised0[c] * 2 + p0;
+				int e1 = quantised1[c] * 2 + p1;
+				palette[i][c] = static_cast<float>(((64 - BC7_WEIGHTS4[i]) * e0 + BC7_WEIGHTS4[i] * e1 + 32) >> 6);
+			}
+		}
+
+		uint8_t indices[16];
+		float error = FindIndices(block, 0, 4, palette, 16, indices);
+		if (error < bestError)
+		{
+			bestError = error;
+			std::copy(quantised0, quantised0 + 4, bestEnd0);
+			std::copy(quantised1, quantised1 + 4, bestEnd1);
+			bestP0 = p0;
+			bestP1 = p1;
+			std::memcpy(bestIndices, indices, 16);
+		}
+		if (error == 0.0f || !RefineEndpoints(block, 0, 4, indices, weights, end0, end1))  break;
+	}
+
+	// The first pixel's index is stored without its top bit, so it must be in the first half of the palette. Reverse the
+	// line if not
+	if (bestIndices[0] & 8)
+	{
+		std::swap_ranges(bestEnd0, bestEnd0 + 4, bestEnd1);
+		std::swap(bestP0, bestP1);
+		for (unsigned int p = 0; p < 16; ++p)  bestIndices[p] = 15 - bestIndices[p];
+	}
+
+	std::memset(output, 0, 16);
+	unsigned int position = 0;
+	WriteBits(output, position, 1 << 6, 7); // Mode 6
+	for (unsigned int c = 0; c < 4; ++c)
+	{
+		WriteBits(output, position, bestEnd0[c], 7);
+		WriteBits(output, position, bestEnd1[c], 7);
+	}
+	WriteBits(output, position, bestP0, 1);
+	WriteBits(output, position, bestP1, 1);
+	WriteBits(output, position, bestIndices[0], 3);
+	for (unsigned int p = 1; p < 16; ++p)  WriteBits(output, position, bestIndices[p], 4);
+	return bestError;
+}
+
+
+// Compress a block to BC7 mode 5: separate lines for RGB (7 bit endpoints) and alpha (8 bit endpoints), 4 levels each.
+// Better than mode 6 when the alpha doesn't follow the colour, e.g. a specular map. Returns the squared error
+static float CompressBC7Mode5(const Block& block, uint8_t* output)
+{
+	float weights[4];
+	for (unsigned int i = 0; i < 4; ++i)  weights[i] = BC7_WEIGHTS2[i] / 64.0f;
+
+	// Colour line
+	float end0[4], end1[4];
+	FitLine(block, 0, 3, end0, end1);
+	unsigned int bestColour0[3] = {}, bestColour1[3] = {};
+	uint8_t      bestColourIndices[16] = {};
+	float        bestColourError = 3.4e38f;
+	for (unsigned int iteration = 0; iteration <= REFINE_ITERATIONS; ++iteration)
+	{
+		unsigned int quantised0[3], quantised1[3];
+		float palette[4][4];
+		for (unsigned int c = 0; c < 3; ++c)
+		{
+			quantised0[c] = static_cast<unsigned int>(end0[c] * 127.0f / 255.0f + 0.5f);
+			quantised1[c] = static_cast<unsigned int>(end1[c] * 127.0f / 255.0f + 0.5f);
+			int e0 = (quantised0[c] << 1) | (quantised0[c] >> 6);
+			int e1 = (quantised1[c] << 1) | (quantised1[c] >> 6);
+			for (unsigned int i = 0; i < 4; ++i)
+			{
+				palette[i][c] = static_cast<float>(((64 - BC7_WEIGHTS2[i]) * e0 + BC7_WEIGHTS2[i] * e1 + 32) >> 6);
+			}
+		}
+
+		uint8_t indices[16];
+		float error = FindIndices(block, 0, 3, palette, 4, indices);
+		if (error < bestColourError)
+		{
+			bestColourError = error;
+			std::copy(quantised0, quantised0 + 3, bestColour0);
+			std::copy(quantised1, quantised1 + 3, bestColour1);
+			std::memcpy(bestColourIndices, indices, 16);
+		}
+		if (error == 0.0f || !RefineEndpoints(block, 0, 3, indices, weights, end0, end1))  break;
+	}
+
+	// Alpha line
+	float alpha0 = 255.0f, alpha1 = 0.0f;
+	for (unsigned int p = 0; p < 16; ++p)
+	{
+		alpha0 = std::min(alpha0, block.channels[3][p]);
+		alpha1 = std::max(alpha1, block.channels[3][p]);
+	}
+	unsigned int bestAlpha0 = 0, bestAlpha1 = 0;
+	uint8_t      bestAlphaIndices[16] = {};
+	float        bestAlphaError = 3.4e38f;
+	for (unsigned int iteration = 0; iteration <= REFINE_ITERATIONS; ++iteration)
+	{
+		unsigned int quantised0 = static_cast<unsigned int>(alpha0 + 0.5f);
+		unsigned int quantised1 = static_cast<unsigned int>(alpha1 + 0.5f);
+		float palette[4][4];
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			palette[i][0] = static_cast<float>(((64 - BC7_WEIGHTS2[i]) * quantised0 + BC7_WEIGHTS2[i] * quantised1 + 32) >> 6);
+		}
+
+		uint8_t indices[16];
+		float error = FindIndices(block, 3, 1, palette, 4, indices);
+		if (error < bestAlphaError)
+		{
+			bestAlphaError = error;
+			bestAlpha0 = quantised0;
+			bestAlpha1 = quantised1;
+			std::memcpy(bestAlphaIndices, indices, 16);
+		}
+		if (error == 0.0f || !RefineEndpoints(block, 3, 1, indices, weights, &alpha0, &alpha1))  break;
+	}
+
+	// The first pixel's indices are stored without their top bit, reverse the lines if needed
+	if (bestColourIndices[0] & 2)
+	{
+		std::swap_ranges(bestColour0, bestColour0 + 3, bestColour1);
+		for (unsigned int p = 0; p < 16; ++p)  bestColourIndices[p] = 3 - bestColourIndices[p];
+	}
+	if (bestAlphaIndices[0] & 2)
+	{
+		std::swap(bestAlpha0, bestAlpha1);
+		for (unsigned int p = 0; p < 16; ++p)  bestAlphaIndices[p] = 3 - bestAlphaIndices[p];
+	}
+
+	std::memset(output, 0, 16);
+	unsigned int position = 0;
+	WriteBits(output, position, 1 << 5, 6); // Mode 5
+	WriteBits(output, position, 0, 2);      // No channel rotation
+	for (unsigned int c = 0; c < 3; ++c)
+	{
+		WriteBits(output, position, bestColour0[c], 7);
+		WriteBits(output, position, bestColour1[c], 7);
+	}
+	WriteBits(output, position, bestAlpha0, 8);
+	WriteBits(output, position, bestAlpha1, 8);
+	WriteBits(output, position, bestColourIndices[0], 1);
+	for (unsigned int p = 1; p < 16; ++p)  WriteBits(output, position, bestColourIndices[p], 2);
+	WriteBits(output, position, bestAlphaIndices[0], 1);
+	for (unsigned int p = 1; p < 16; ++p)  WriteBits(output, position, bestAlphaIndices[p], 2);
+	return bestColourError + bestAlphaError;
+}
+
+
+// Compress a block to BC7, using whichever of modes 5 and 6 fits it better
+static void CompressBC7Block(const Block& block, uint8_t* output)
+{
+	float error6 = CompressBC7Mode6(block, output);
+	if (error6 == 0.0f)  return;
+
+	uint8_t output5[16];
+	if (CompressBC7Mode5(block, output5) < error6)  std::memcpy(output, output5, 16);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+// Bytes used by each 4x4 block of a format
+unsigned int BlockBytes(BlockFormat format)
+{
+	return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+
+// Bytes used by an image of the given size in a format, partial blocks at the edges count as whole ones
+size_t CompressedSize(BlockFormat format, unsigned int width, unsigned int height)
+{
+	return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+
+// Choose the format for an RGBA8 image from the channels the shaders read and the channels the image uses
+BlockFormat ChooseBlockFormat(const uint8_t* pixels, unsigned int width, unsigned int height, TextureChannels channels,
+                              bool highQuality /*= false*/)
+{
+	if (channels == TextureChannels::R)   return BlockFormat::BC4;
+	if (channels == TextureChannels::RG)  return BlockFormat::BC5;
+	if (highQuality)                      return BlockFormat::BC7;
+	if (channels == TextureChannels::RGB) return BlockFormat::BC1;
+
+	size_t numPixels = static_cast<size_t>(width) * height;
+	for (size_t p = 0; p < numPixels; ++p)
+	{
+		if (pixels[p * 4 + 3] != 255)  return BlockFormat::BC3;
+	}
+	return BlockFormat::BC1;
+}
+
+
+// Compress one block of 16 RGBA8 pixels (row by row) in the given format
+void CompressBlock(BlockFormat format, const uint8_t* pixels, uint8_t* output)
+{
+	Block block;
+	LoadBlock(pixels, block);
+
+	switch (format)
+	{
+	case BlockFormat::BC1:
+		CompressColourBlock(block, output);
+		break;
+
+	case BlockFormat::BC3:
+		CompressChannelBlock(block, 3, output);
+		CompressColourBlock(block, output + 8);
+		break;
+
+	case BlockFormat::BC4:
+		CompressChannelBlock(block, 0, output);
+		break;
+
+	case BlockFormat::BC5:
+		CompressChannelBlock(block, 0, output);
+		CompressChannelBlock(block, 1, output + 8);
+		break;
+
+	case BlockFormat::BC7:
+		CompressBC7Block(block, output);
+		break;
+	}
+}
+
+
+// Compress an RGBA8 image of any size, rows of blocks are compressed in parallel. Pixels beyond the right and bottom
+// edges of partial blocks copy the edge
+void CompressImage(BlockFormat format, const uint8_t* pixels, unsigned int width, unsigned int height, uint8_t* output)
+{
+	unsigned int blocksX = (width  + 3) / 4;
+	unsigned int blocksY = (height + 3) / 4;
+	unsigned int blockBytes = BlockBytes(format);
+
+	ParallelFor(blocksY, 1, [&](unsigned int begin, unsigned int end)
+	{
+		uint8_t blockPixels[64];
+		for (unsigned int blockY = begin; blockY < end; ++blockY)
+		{
+			for (unsigned int blockX = 0; blockX < blocksX; ++blockX)
+			{
+				for (unsigned int y = 0; y < 4; ++y)
+				{
+					unsigned int pixelY = std::min(blockY * 4 + y, height - 1);
+					for (unsigned int x = 0; x < 4; ++x)
+					{
+						unsigned int pixelX = std::min(blockX * 4 + x, width - 1);
+						std::memcpy(&blockPixels[(y * 4 + x) * 4], &pixels[(static_cast<size_t>(pixelY) * width + pixelX) * 4], 4);
+					}
+				}
+				CompressBlock(format, blockPixels, output + (static_cast<size_t>(blockY) * blocksX + blockX) * blockBytes);
+			}
+		}
+	});
+}
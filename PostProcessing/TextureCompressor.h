@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------------------
+// Block compression of textures (BC1, BC3, BC4, BC5, BC7) on the CPU
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Block compressed textures store each 4x4 block of pixels in 8 or 16 bytes, 4-8 times smaller than RGBA8. The GPU
+// samples them directly, so they also use less memory bandwidth when rendering. Each block holds two endpoint colours
+// and an index per pixel choosing a colour on the line between them. The encoder finds the line that best fits the
+// block's pixels (principal axis), then refines the endpoints by least squares for the chosen indices
+// - BC1: RGB, 8 bytes per block
+// - BC3: RGBA, BC1 colour with a separate alpha block, 16 bytes
+// - BC4: one channel (read from .r in shaders), 8 bytes
+// - BC5: two channels (.rg, e.g. normal maps), 16 bytes
+// - BC7: RGBA at higher quality than BC1/BC3, 16 bytes. Only mode 6 (one line for the whole block, 16 levels) is used,
+//   which is the best single mode for most textures
+//
+// The nearest palette entry for each pixel is found with SSE, four pixels at a time, and rows of blocks are spread
+// over the thread pool
+
+#ifndef _TEXTURE_COMPRESSOR_H_INCLUDED_
+#define _TEXTURE_COMPRESSOR_H_INCLUDED_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+enum class BlockFormat
+{
+	BC1,
+	BC3,
+	BC4,
+	BC5,
+	BC7,
+};
+
+// Channels of a texture that shaders read. Textures whose shaders only read .r or .rg can use smaller formats
+enum class TextureChannels
+{
+	R,
+	RG,
+	RGB,
+	RGBA,
+};
+
+
+// Bytes used by each 4x4 block of a format
+unsigned int BlockBytes(BlockFormat format);
+
+// Bytes used by an image of the given size in a format, partial blocks at the edges count as whole ones
+size_t CompressedSize(BlockFormat format, unsigned int width, unsigned int height);
+
+
+// Choose the format for an RGBA8 image from the channels the shaders read and the channels the image uses:
+// - R: BC4, RG: BC5
+// - Otherwise BC7 if high quality is wanted, or BC1 if the alpha channel is unused (all 255) and BC3 if not
+BlockFormat ChooseBlockFormat(const uint8_t* pixels, unsigned int width, unsigned int height, TextureChannels channels,
+                              bool highQuality = false);
+
+
+// Compress one block of 16 RGBA8 pixels (row by row) in the given format
+void CompressBlock(BlockFormat format, const uint8_t* pixels, uint8_t* output);
+
+// Compress an RGBA8 image of any size, rows of blocks are compressed in parallel. Pixels beyond the right and bottom
+// edges of partial blocks copy the edge. The output must have space for CompressedSize bytes
+void CompressImage(BlockFormat format, const uint8_t* pixels, unsigned int width, unsigned int height, uint8_t* output);
+
+
+#endif //_TEXTURE_COMPRESSOR_H_INCLUDED_
@@ -0,0 +1,300 @@
+//--------------------------------------------------------------------------------------
+// Texture mip streaming - textures only keep the mips that are visible
+//--------------------------------------------------------------------------------------
+
+#include "TextureStreamer.h"
+#include "FileSystem.h"
+#include "Common.h" // For gD3DDevice
+
+#include <algorithm>
+#include <cmath>
+
+
+// Textures keep detail they no longer need for this many frames before dropping it, so a model moving back and forth
+// across a mip boundary doesn't cause a load every time
+const unsigned int EVICT_DELAY_FRAMES = 120;
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+// Add a DDS texture, loading only its mip tail now. Returns an id for the texture, or NoTexture on failure
+unsigned int TextureStreamer::Add(const std::string& filename)
+{
+	Texture texture;
+	if (!ReadDDSFileInfo(filename, texture.file))  return NoTexture;
+
+	// The tail starts at the first mip that fits in the tail size, or the last mip if none do
+	unsigned int numMips = static_cast<unsigned int>(texture.file.mips.size());
+	texture.tailMip = 0;
+	while (texture.tailMip + 1 < numMips && std::max(texture.file.width >> texture.tailMip, texture.file.height >> texture.tailMip) > MipTailSize)
+	{
+		++texture.tailMip;
+	}
+
+	if (!CreateTexture(texture.file, texture.tailMip, &texture.texture, &texture.srv))  return NoTexture;
+	texture.residentMip     = texture.tailMip;
+	texture.requestedMip    = texture.tailMip;
+	texture.requestedPixels = 0;
+
+	mResidentBytes += MipBytes(texture.file, texture.tailMip);
+	mFullBytes     += MipBytes(texture.file, 0);
+
+	unsigned int id = static_cast<unsigned int>(mTextures.size());
+	mTextureLookup[texture.srv] = id;
+	texture.resource = gResidency.Register(ResourceClass::Texture, MipBytes(texture.file, texture.tailMip), [this, id]() { Evict(id); });
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFiles.push_back(texture.file);
+	}
+	mTextures.push_back(std::move(texture));
+
+	if (!mThread.joinable())
+	{
+		mQuit = false;
+		mThread = std::thread(&TextureStreamer::LoadThread, this);
+	}
+	return id;
+}
+
+
+// Note that a texture is used this frame by a model covering the given number of pixels across the screen. Can be
+// called with any view, those not from the streamer are ignored
+void TextureStreamer::Request(ID3D11ShaderResourceView* srv, float screenPixels)
+{
+	auto found = mTextureLookup.find(srv);
+	if (found == mTextureLookup.end())  return;
+	Texture& texture = mTextures[found->second];
+	gResidency.Touch(texture.resource);
+
+	// Mip n is 2^n times smaller than the full texture, so the mip that matches the screen size is log2 of the ratio of
+	// the sizes. Assumes the texture is stretched once across the model, textures repeated many times across a model
+	// will be a little blurry
+	float textureSize = static_cast<float>(std::max(texture.file.width, texture.file.height));
+	unsigned int mip = 0;
+	if (screenPixels < textureSize)
+	{
+		mip = (screenPixels > 1.0f) ? static_cast<unsigned int>(std::log2(textureSize / screenPixels)) : texture.tailMip;
+	}
+	texture.requestedMip    = std::min(std::min(mip, texture.tailMip), texture.requestedMip);
+	texture.requestedPixels = std::max(screenPixels, texture.requestedPixels);
+}
+
+
+// Swap in the textures loaded since the last update, then choose the mips each texture should have from this frame's
+// requests and queue the loads. Call once a frame after the requests. Returns true if any texture's view has changed
+bool TextureStreamer::Update()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Swap in finished loads, replacing the previous texture
+	bool changed = !mResults.empty();
+	for (auto& result : mResults)
+	{
+		SwapTexture(result.texture, result.gpuTexture, result.srv, result.firstMip);
+	}
+	mResults.clear();
+
+	// Queue a load for each texture that should change. More detail is loaded as soon as it's needed, most missing mips
+	// first then largest on screen. Detail is only dropped when it has been unneeded for a while, after all other loads
+	mQueue.clear();
+	for (unsigned int t = 0; t < mTextures.size(); ++t)
+	{
+		Texture& texture = mTextures[t];
+
+		unsigned int wantedMip = texture.residentMip;
+		if (texture.requestedMip <= texture.residentMip)
+		{
+			texture.framesUnneeded = 0;
+			wantedMip = texture.requestedMip;
+		}
+		else if (++texture.framesUnneeded > EVICT_DELAY_FRAMES)
+		{
+			wantedMip = texture.requestedMip;
+		}
+
+		if (wantedMip != texture.residentMip && t != mLoadingTexture)
+		{
+			float priority = (wantedMip < texture.residentMip) ? (texture.residentMip - wantedMip) * 1e6f + texture.requestedPixels : -1.0f;
+			mQueue.push_back({ t, wantedMip, priority });
+		}
+
+		// Start the next frame's requests
+		texture.requestedMip    = texture.tailMip;
+		texture.requestedPixels = 0;
+	}
+	std::sort(mQueue.begin(), mQueue.end(), [](const Load& a, const Load& b) { return a.priority < b.priority; });
+	if (!mQueue.empty())  mWakeThread.notify_one();
+
+	return changed;
+}
+
+
+// Number of loads queued or in progress
+unsigned int TextureStreamer::NumPendingLoads()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return static_cast<unsigned int>(mQueue.size()) + (mLoadingTexture != NoTexture ? 1 : 0);
+}
+
+
+// Stop the background thread and release all the textures
+void TextureStreamer::Release()
+{
+	if (mThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mQuit = true;
+		}
+		mWakeThread.notify_one();
+		mThread.join();
+	}
+
+	for (auto& result : mResults)
+	{
+		result.srv       ->Release();
+		result.gpuTexture->Release();
+	}
+	for (auto& texture : mTextures)
+	{
+		if (texture.srv)      texture.srv     ->Release();
+		if (texture.texture)  texture.texture ->Release();
+		gResidency.Unregister(texture.resource);
+	}
+	mResults.clear();
+	mQueue.clear();
+	mFiles.clear();
+	mTextures.clear();
+	mTextureLookup.clear();
+	mResidentBytes = 0;
+	mFullBytes     = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private members
+//--------------------------------------------------------------------------------------
+
+// The background thread, takes loads from the queue highest priority first
+void TextureStreamer::LoadThread()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWakeThread.wait(lock, [this]() { return mQuit || !mQueue.empty(); });
+		if (mQuit)  return;
+
+		Load load = mQueue.back();
+		mQueue.pop_back();
+		mLoadingTexture = load.texture;
+		const DDSFileInfo file = mFiles[load.texture];
+
+		// Reading the file and creating the texture is the slow part, don't hold the lock for it
+		lock.unlock();
+		ID3D11Texture2D*          gpuTexture = nullptr;
+		ID3D11ShaderResourceView* srv = nullptr;
+		bool created = CreateTexture(file, load.firstMip, &gpuTexture, &srv);
+		lock.lock();
+
+		if (created)  mResults.push_back({ load.texture, load.firstMip, gpuTexture, srv });
+		mLoadingTexture = NoTexture;
+	}
+}
+
+
+// Replace a texture's GPU texture and view with ones holding its mips from firstMip, releasing the old ones
+void TextureStreamer::SwapTexture(unsigned int t, ID3D11Texture2D* gpuTexture, ID3D11ShaderResourceView* srv, unsigned int firstMip)
+{
+	Texture& texture = mTextures[t];
+	mTextureLookup.erase(texture.srv);
+	texture.srv    ->Release();
+	texture.texture->Release();
+	mResidentBytes -= MipBytes(texture.file, texture.residentMip);
+
+	texture.texture     = gpuTexture;
+	texture.srv         = srv;
+	texture.residentMip = firstMip;
+	mTextureLookup[texture.srv] = t;
+	mResidentBytes += MipBytes(texture.file, texture.residentMip);
+	gResidency.Resize(texture.resource, MipBytes(texture.file, texture.residentMip));
+}
+
+
+// Drop a texture to its mip tail straight away, called by the residency manager when over budget. The tail is small so
+// it is created here rather than on the background thread, then the memory is freed before the manager checks the
+// budget again. Any queued load for the texture is cancelled, one already in progress is swapped in as usual
+void TextureStreamer::Evict(unsigned int t)
+{
+	Texture& texture = mTextures[t];
+	if (texture.residentMip == texture.tailMip)  return;
+
+	ID3D11Texture2D*          gpuTexture = nullptr;
+	ID3D11ShaderResourceView* srv = nullptr;
+	if (!CreateTexture(texture.file, texture.tailMip, &gpuTexture, &srv))  return;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.erase(std::remove_if(mQueue.begin(), mQueue.end(), [t](const Load& load) { return load.texture == t; }), mQueue.end());
+	}
+	SwapTexture(t, gpuTexture, srv, texture.tailMip);
+	texture.framesUnneeded = 0;
+}
+
+
+// Create a GPU texture and view holding a file's mips from firstMip to the last. Can be called from any thread
+bool TextureStreamer::CreateTexture(const DDSFileInfo& file, unsigned int firstMip,
+                                    ID3D11Texture2D** texture, ID3D11ShaderResourceView** srv)
+{
+	unsigned int numMips = static_cast<unsigned int>(file.mips.size()) - firstMip;
+
+	// Open the file (from a pack or mapped from disk, see FileSystem.h) and pass the mips to DirectX straight from its
+	// memory, only the pages holding the mips needed are read. The file is closed when this returns. Check the file hasn't
+	// shrunk since its header was read
+	AssetFile mappedFile;
+	if (!mappedFile.Open(file.filename))  return false;
+	const DDSFileInfo::Mip& last = file.mips.back();
+	if (mappedFile.Size() < last.offset + last.size)  return false;
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initData;
+	DDSSubresourceData(file, mappedFile.Data(), firstMip, initData);
+
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width  = std::max(file.width  >> firstMip, 1u);
+	textureDesc.Height = std::max(file.height >> firstMip, 1u);
+	textureDesc.MipLevels = numMips;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = file.format;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_IMMUTABLE; // Never changes, a new texture is made when the mips change
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, initData.data(), texture)))  return false;
+
+	// Viewed as an array of one layer so shaders can treat it like a texture from TextureArrays (as slot 0)
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = file.format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = numMips;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = 1;
+	if (FAILED(gD3DDevice->CreateShaderResourceView(*texture, &srvDesc, srv)))
+	{
+		(*texture)->Release();
+		*texture = nullptr;
+		return false;
+	}
+	return true;
+}
+
+
+// GPU memory used by the mips of a file from firstMip to the last
+uint64_t TextureStreamer::MipBytes(const DDSFileInfo& file, unsigned int firstMip)
+{
+	uint64_t bytes = 0;
+	for (unsigned int mip = firstMip; mip < file.mips.size(); ++mip)  bytes += file.mips[mip].size;
+	return bytes;
+}
@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+// Texture mip streaming - textures only keep the mips that are visible
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Textures added to the streamer start with only their mip tail on the GPU (the mips of MipTailSize pixels or less),
+// which is quick to load and small. Each frame the scene reports how large each texture's models are on screen, which
+// gives the most detailed mip that could be seen. Textures that need more detail are loaded on a background thread, most
+// needed first (the texture missing the most mip levels, then the largest on screen). Textures that haven't needed their
+// detail for a while drop back down to what they do need, so GPU memory is only spent on what is visible.
+//
+// - A new GPU texture is made for each change, holding exactly the mips that should be resident. The background thread
+//   maps the file and creates the texture and its shader resource view (the D3D11 device can be used from
+//   any thread). The main thread swaps the new view in between frames in Update, so a frame never sees a texture in the
+//   middle of changing. The old texture is released then (DirectX keeps it alive until the GPU has finished with it)
+// - Only DDS files can be streamed, as they store the mips ready made. Single 2D textures in block compressed or
+//   32-bit formats are supported, others should be loaded with LoadTexture
+// - Each texture is registered with the residency manager (see ResidencyManager.h). Requests mark it as used, and when
+//   over the GPU memory budget it is evicted by dropping straight to its mip tail. More detail is loaded again as
+//   usual the next time it is requested
+
+#ifndef _TEXTURE_STREAMER_H_INCLUDED_
+#define _TEXTURE_STREAMER_H_INCLUDED_
+
+#include "DDSFile.h"
+#include "ResidencyManager.h"
+
+#include <d3d11.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+class TextureStreamer
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Mips with width and height no larger than this are always resident
+	static const unsigned int MipTailSize = 64;
+
+	// Returned by Add on failure
+	static const unsigned int NoTexture = ~0u;
+
+	// The background thread is started when the first texture is added
+	TextureStreamer() {}
+	~TextureStreamer()  { Release(); }
+
+	// Prevent copying - owns GPU resources and a thread
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// Add a DDS texture, loading only its mip tail now. Returns an id for the texture, or NoTexture on failure (missing
+	// file or unsupported format)
+	unsigned int Add(const std::string& filename);
+
+	// Shader resource view for a texture. Changes when Update returns true and when textures are evicted (during
+	// ResidencyManager::EndFrame), so anything holding the view (e.g. a Material) must get it again then
+	ID3D11ShaderResourceView* SRV(unsigned int texture)  { return mTextures[texture].srv; }
+
+	// Note that a texture is used this frame by a model covering the given number of pixels across the screen. Can be
+	// called with any view, those not from the streamer are ignored
+	void Request(ID3D11ShaderResourceView* srv, float screenPixels);
+
+	// Swap in the textures loaded since the last update, then choose the mips each texture should have from this frame's
+	// requests and queue the loads. Call once a frame after the requests. Returns true if any texture's view has changed
+	bool Update();
+
+	// Stop the background thread and release all the textures
+	void Release();
+
+
+	// Statistics: bytes of GPU memory used by the resident mips, bytes if every mip was resident, loads still to do
+	uint64_t     ResidentBytes()    { return mResidentBytes; }
+	uint64_t     FullBytes()        { return mFullBytes;     }
+	unsigned int NumPendingLoads();
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Texture
+	{
+		DDSFileInfo file;
+		unsigned int tailMip = 0; // First mip of the mip tail
+
+		ID3D11Texture2D*          texture = nullptr;
+		ID3D11ShaderResourceView* srv     = nullptr;
+		unsigned int              residentMip = 0; // Most detailed mip on the GPU
+
+		unsigned int requestedMip    = 0; // Most detailed mip needed this frame (tailMip if unused)
+		float        requestedPixels = 0; // Largest size on screen this frame
+		unsigned int framesUnneeded  = 0; // Frames the resident detail hasn't been needed
+
+		unsigned int resource = ResidencyManager::NoResource; // Id in the residency manager
+	};
+
+	// A texture to create with mips from firstMip to the last
+	struct Load
+	{
+		unsigned int texture;
+		unsigned int firstMip;
+		float        priority;
+	};
+
+	// A finished load waiting for Update to swap it in
+	struct LoadResult
+	{
+		unsigned int              texture;
+		unsigned int              firstMip;
+		ID3D11Texture2D*          gpuTexture;
+		ID3D11ShaderResourceView* srv;
+	};
+
+	// Create a GPU texture and view holding a file's mips from firstMip to the last. Can be called from any thread
+	static bool CreateTexture(const DDSFileInfo& file, unsigned int firstMip,
+	                          ID3D11Texture2D** texture, ID3D11ShaderResourceView** srv);
+
+	// Replace a texture's GPU texture and view with ones holding its mips from firstMip, releasing the old ones
+	void SwapTexture(unsigned int texture, ID3D11Texture2D* gpuTexture, ID3D11ShaderResourceView* srv, unsigned int firstMip);
+
+	// Drop a texture to its mip tail straight away, called by the residency manager when over budget
+	void Evict(unsigned int texture);
+
+	// GPU memory used by the mips of a file from firstMip to the last
+	static uint64_t MipBytes(const DDSFileInfo& file, unsigned int firstMip);
+
+	// The background thread, takes loads from the queue highest priority first
+	void LoadThread();
+
+
+	std::vector<Texture> mTextures;
+	std::unordered_map<ID3D11ShaderResourceView*, unsigned int> mTextureLookup; // Current view to texture
+
+	std::thread              mThread;
+	std::mutex               mMutex;   // Protects the members below, shared with the background thread
+	std::condition_variable  mWakeThread;
+	std::vector<Load>        mQueue;   // Sorted by priority, highest last
+	std::vector<LoadResult>  mResults;
+	std::vector<DDSFileInfo> mFiles;   // Copy of each texture's file details for the background thread
+	unsigned int             mLoadingTexture = NoTexture; // Texture the background thread is loading now
+	bool                     mQuit = false;
+
+	uint64_t mResidentBytes = 0;
+	uint64_t mFullBytes     = 0;
+};
+
+
+#endif //_TEXTURE_STREAMER_H_INCLUDED_
@@ -13,9 +13,10 @@
 // Here we allow the shader access to a texture that has been loaded from the C++ side and stored in GPU memory.
 // Note that textures are often called maps (because texture mapping describes wrapping a texture round a mesh).
 // Get used to people using the word "texture" and "map" interchangably.
-Texture2D    DiffuseMap : register(t0); // A diffuse map is the main texture for a model.
-                                        // The t0 indicates this texture is in slot 0 and the C++ code must load the texture into the this slot
-SamplerState TexSampler : register(s0); // A sampler is a filter for a texture like bilinear, trilinear or anisotropic
+// The texture is one of the layers of a texture array (see TextureArrays.h in the C++ code), the model's texture slot says which
+Texture2DArray DiffuseMaps : register(t0); // A diffuse map is the main texture for a model.
+                                           // The t0 indicates this texture is in slot 0 and the C++ code must load the texture into the this slot
+SamplerState   TexSampler  : register(s0); // A sampler is a filter for a texture like bilinear, trilinear or anisotropic
 
 
 //--------------------------------------------------------------------------------------
@@ -28,10 +29,10 @@ float4 main(SimplePixelShaderInput input) : SV_Target
 {
     // Sample diffuse material colour for this pixel from a texture using a given sampler that you set up in the C++ code
     // Ignoring any alpha in the texture, just reading RGB
-    float3 diffuseMapColour = DiffuseMap.Sample(TexSampler, input.uv).rgb;
+    float3 diffuseMapColour = SampleTextureSlot(DiffuseMaps, TexSampler, input.textureSlot, input.uv).rgb;
 
-    // Blend texture colour with fixed per-object colour
-    float3 finalColour = gObjectColour * diffuseMapColour;
+    // Blend texture colour with fixed per-object colour (passed on by the vertex shader, it may come from instance data)
+    float3 finalColour = input.colour * diffuseMapColour;
 
     return float4(finalColour, 1.0f); // Always use 1.0f for alpha - no alpha blending in this lab
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+// Cached node matrices for a model, with dirty flags so only changed parts are recalculated
+//--------------------------------------------------------------------------------------
+
+#include "TransformHierarchy.h"
+#include "Mesh.h"
+
+
+// Local matrices start at the mesh's default node matrices
+TransformHierarchy::TransformHierarchy(Mesh* mesh)
+	: mMesh(mesh)
+{
+	unsigned int numNodes = mesh->NumberNodes();
+	mLocalMatrices.resize(numNodes);
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		mLocalMatrices[node] = mesh->GetNodeDefaultMatrix(node);
+	}
+
+	mAbsoluteMatrices.resize(numNodes);
+	if (mesh->HasBones())  mSkinningMatrices.resize(numNodes);
+
+	// Everything needs calculating the first time
+	mDirty.resize(numNodes, 1);
+}
+
+
+// Bring the absolute matrices up to date, only visiting subtrees below dirty nodes. Returns true if any
+// matrix changed. Called by the mesh when rendering, there is no need to call it directly
+bool TransformHierarchy::Update()
+{
+	if (!mAnyDirty)  return false;
+
+	const unsigned int* parents     = mMesh->NodeParents();
+	const unsigned int* subtreeEnds = mMesh->NodeSubtreeEnds();
+	const CMatrix4x4*   offsets     = mMesh->NodeOffsetMatrices();
+
+	// Nodes are in depth-first order, so a node's descendants are the contiguous range up to its subtree end and
+	// every parent comes before its children. When a dirty node is found, recalculate its whole subtree in one
+	// linear pass (a parent is always calculated before its children) then skip past it
+	unsigned int numNodes = NumberNodes();
+	unsigned int node = 0;
+	while (node < numNodes)
+	{
+		if (!mDirty[node])
+		{
+			++node;
+			continue;
+		}
+
+		unsigned int subtreeEnd = subtreeEnds[node];
+		for (unsigned int child = node; child < subtreeEnd; ++child)
+		{
+			// Root matrix is already in world space, others are relative to their parent's absolute matrix
+			if (child == 0)  mAbsoluteMatrices[0] = mLocalMatrices[0];
+			else             MatrixMultiply(mAbsoluteMatrices[child], mLocalMatrices[child], mAbsoluteMatrices[parents[child]]);
+			mDirty[child] = 0;
+		}
+
+		// Apply each bone's fixed offset from the skinned mesh's origin over the subtree
+		if (!mSkinningMatrices.empty())
+		{
+			for (unsigned int child = node; child < subtreeEnd; ++child)
+			{
+				MatrixMultiply(mSkinningMatrices[child], offsets[child], mAbsoluteMatrices[child]);
+			}
+		}
+
+		node = subtreeEnd;
+	}
+
+	mAnyDirty = false;
+	++mVersion;
+	return true;
+}
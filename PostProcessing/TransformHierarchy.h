@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// Cached node matrices for a model, with dirty flags so only changed parts are recalculated
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The node hierarchy itself (parents, subtree sizes, bone offsets) belongs to the mesh and is shared by every
+// model using it. This class holds one model's matrices for those nodes as flat arrays in the same depth-first
+// order. Changing a node's matrix marks it dirty; Update recalculates only the subtrees under dirty nodes and
+// the results are kept until something changes again, so a model that isn't moving costs nothing per frame.
+
+#ifndef _TRANSFORM_HIERARCHY_H_INCLUDED_
+#define _TRANSFORM_HIERARCHY_H_INCLUDED_
+
+#include "CMatrix4x4.h"
+
+#include <vector>
+#include <stdint.h>
+
+class Mesh;
+
+class TransformHierarchy
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Local matrices start at the mesh's default node matrices
+	TransformHierarchy(Mesh* mesh);
+
+	unsigned int NumberNodes()  { return static_cast<unsigned int>(mLocalMatrices.size()); }
+
+	// Matrix for a node relative to its parent. The root node (0) is relative to the world
+	const CMatrix4x4& LocalMatrix(unsigned int node)  { return mLocalMatrices[node]; }
+
+	// Change the matrix for a node relative to its parent, marks the node and everything below it for update
+	void SetLocalMatrix(unsigned int node, const CMatrix4x4& matrix)
+	{
+		mLocalMatrices[node] = matrix;
+		mDirty[node] = 1;
+		mAnyDirty = true;
+	}
+
+
+	// Bring the absolute matrices up to date, only visiting subtrees below dirty nodes. Returns true if any
+	// matrix changed. Called by the mesh when rendering, there is no need to call it directly
+	bool Update();
+
+	// Matrix for each node in world space. Only valid after Update
+	const CMatrix4x4* AbsoluteMatrices()  { return mAbsoluteMatrices.data(); }
+
+	// For skinned meshes, each node's absolute matrix with the mesh's bone offset applied, ready to send to
+	// the shader. Only valid after Update. Empty for meshes without bones
+	const CMatrix4x4* SkinningMatrices()  { return mSkinningMatrices.data(); }
+
+	// Incremented every time Update changes any matrix, so users can tell if their copy of the data is stale
+	uint32_t Version()  { return mVersion; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	Mesh* mMesh;
+
+	// All arrays are indexed by node, in the mesh's depth-first order
+	std::vector<CMatrix4x4>    mLocalMatrices;
+	std::vector<CMatrix4x4>    mAbsoluteMatrices;
+	std::vector<CMatrix4x4>    mSkinningMatrices;
+	std::vector<unsigned char> mDirty;
+
+	bool     mAnyDirty = true;
+	uint32_t mVersion  = 0;
+};
+
+
+#endif //_TRANSFORM_HIERARCHY_H_INCLUDED_
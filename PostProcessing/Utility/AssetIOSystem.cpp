@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Assimp file access through the virtual file system
+//--------------------------------------------------------------------------------------
+
+#include "AssetIOSystem.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+//--------------------------------------------------------------------------------------
+// Files
+//--------------------------------------------------------------------------------------
+
+// Open a file, check IsOpen afterwards
+AssetIOStream::AssetIOStream(const std::string& filename)
+{
+	if (mFile.Open(filename))  mSize = static_cast<size_t>(mFile.Size());
+}
+
+
+// Read up to count items of the given size, returns the number of whole items read
+size_t AssetIOStream::Read(void* buffer, size_t size, size_t count)
+{
+	if (size == 0)  return 0;
+	count = std::min(count, (mSize - mPosition) / size);
+	std::memcpy(buffer, mFile.Data() + mPosition, size * count);
+	mPosition += size * count;
+	return count;
+}
+
+
+// Move the read position. Offsets from the end are negative, which wraps around in the size_t
+aiReturn AssetIOStream::Seek(size_t offset, aiOrigin origin)
+{
+	size_t position = offset;
+	if      (origin == aiOrigin_CUR)  position = mPosition + offset;
+	else if (origin == aiOrigin_END)  position = mSize + offset;
+	if (position > mSize)  return aiReturn_FAILURE;
+	mPosition = position;
+	return aiReturn_SUCCESS;
+}
+
+
+//--------------------------------------------------------------------------------------
+// File system
+//--------------------------------------------------------------------------------------
+
+// Open a file for assimp, returns null if it can't be opened or is opened for writing
+Assimp::IOStream* AssetIOSystem::Open(const char* filename, const char* mode /*= "rb"*/)
+{
+	if (std::strchr(mode, 'w') || std::strchr(mode, 'a') || std::strchr(mode, '+'))  return nullptr;
+
+	AssetIOStream* file = new AssetIOStream(filename);
+	if (!file->IsOpen())
+	{
+		delete file;
+		return nullptr;
+	}
+	return file;
+}
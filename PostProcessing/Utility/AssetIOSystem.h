@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------
+// Assimp file access through the virtual file system
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Assimp normally opens files itself. Giving an importer one of these (Assimp::Importer::SetIOHandler, which takes
+// ownership) makes it read through the file system instead (see FileSystem.h), so meshes load from packs. Files are
+// read-only, assimp only writes files when exporting
+
+#ifndef _ASSET_IO_SYSTEM_H_INCLUDED_
+#define _ASSET_IO_SYSTEM_H_INCLUDED_
+
+#include "FileSystem.h"
+
+#include <assimp/IOSystem.hpp>
+#include <assimp/IOStream.hpp>
+
+
+// A file opened by assimp, reading from an AssetFile
+class AssetIOStream : public Assimp::IOStream
+{
+public:
+	// Open a file, check IsOpen afterwards
+	AssetIOStream(const std::string& filename);
+
+	bool IsOpen()  { return mFile.Data() != nullptr; }
+
+	size_t   Read(void* buffer, size_t size, size_t count) override;
+	size_t   Write(const void* buffer, size_t size, size_t count) override  { return 0; }
+	aiReturn Seek(size_t offset, aiOrigin origin) override;
+	size_t   Tell() const override      { return mPosition; }
+	size_t   FileSize() const override  { return mSize; }
+	void     Flush() override {}
+
+private:
+	AssetFile mFile;
+	size_t    mSize = 0;
+	size_t    mPosition = 0;
+};
+
+
+class AssetIOSystem : public Assimp::IOSystem
+{
+public:
+	bool              Exists(const char* filename) const override  { return gFileSystem.Exists(filename); }
+	char              getOsSeparator() const override               { return '/'; } // Either slash finds the same file
+	Assimp::IOStream* Open(const char* filename, const char* mode = "rb") override; // Returns null on failure
+	void              Close(Assimp::IOStream* file) override        { delete file; }
+};
+
+
+#endif //_ASSET_IO_SYSTEM_H_INCLUDED_
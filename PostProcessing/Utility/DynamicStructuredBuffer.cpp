@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// GPU structured buffer rewritten by the CPU each frame
+//--------------------------------------------------------------------------------------
+
+#include "DynamicStructuredBuffer.h"
+#include "../Common.h" // For gD3DDevice / gD3DContext
+
+#include <algorithm>
+#include <cstring>
+
+
+// Replace the contents of the GPU buffer with the given elements, making the buffer larger if necessary
+// Returns false on failure
+bool DynamicStructuredBuffer::Upload(const void* data, unsigned int count)
+{
+	if (count == 0)  return true; // Nothing to send
+
+	// Grow the GPU buffer if it is too small. Double the size each time so this rarely happens
+	if (count > mCapacity)
+	{
+		Release();
+		unsigned int capacity = std::max(count * 2, 256u);
+
+		// Dynamic structured buffer, written by the CPU once per frame and read by shaders
+		D3D11_BUFFER_DESC bufferDesc;
+		bufferDesc.ByteWidth           = capacity * mElementSize;
+		bufferDesc.Usage               = D3D11_USAGE_DYNAMIC;
+		bufferDesc.BindFlags           = D3D11_BIND_SHADER_RESOURCE;
+		bufferDesc.CPUAccessFlags      = D3D11_CPU_ACCESS_WRITE;
+		bufferDesc.MiscFlags           = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bufferDesc.StructureByteStride = mElementSize;
+		if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &mBuffer)))  return false;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format              = DXGI_FORMAT_UNKNOWN; // Structured buffers have no format
+		srvDesc.ViewDimension       = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements  = capacity;
+		if (FAILED(gD3DDevice->CreateShaderResourceView(mBuffer, &srvDesc, &mSRV)))
+		{
+			Release();
+			return false;
+		}
+		mCapacity = capacity;
+	}
+
+	// Copy the new contents over, discarding the previous contents
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(mBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))  return false;
+	std::memcpy(mapped.pData, data, count * mElementSize);
+	gD3DContext->Unmap(mBuffer, 0);
+	return true;
+}
+
+
+// Release GPU resources (they will be recreated if the buffer is uploaded again)
+void DynamicStructuredBuffer::Release()
+{
+	if (mSRV)     mSRV   ->Release();
+	if (mBuffer)  mBuffer->Release();
+	mSRV = nullptr;
+	mBuffer = nullptr;
+	mCapacity = 0;
+}
@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// GPU structured buffer rewritten by the CPU each frame
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Used for per-frame data that is too large or too variable in size for a constant buffer (bone matrices, instance
+// data etc.). Shaders read it as a StructuredBuffer<T>. The buffer grows as needed so there is no fixed limit.
+
+#ifndef _DYNAMIC_STRUCTURED_BUFFER_H_INCLUDED_
+#define _DYNAMIC_STRUCTURED_BUFFER_H_INCLUDED_
+
+#include <d3d11.h>
+
+
+class DynamicStructuredBuffer
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Pass the size in bytes of one element. Must match the size of the structure used in the shader
+	// The GPU buffer is created on the first upload so a buffer can be declared before DirectX is set up
+	DynamicStructuredBuffer(unsigned int elementSize) : mElementSize(elementSize) {}
+	~DynamicStructuredBuffer()  { Release(); }
+
+	// Prevent copying - the buffer owns GPU resources
+	DynamicStructuredBuffer(const DynamicStructuredBuffer&) = delete;
+	DynamicStructuredBuffer& operator=(const DynamicStructuredBuffer&) = delete;
+
+
+	// Replace the contents of the GPU buffer with the given elements, making the buffer larger if necessary
+	// Returns false on failure
+	bool Upload(const void* data, unsigned int count);
+
+	// Shader resource view to bind the buffer to a shader. Null until the first upload
+	ID3D11ShaderResourceView* SRV()  { return mSRV; }
+
+	// Release GPU resources (they will be recreated if the buffer is uploaded again)
+	void Release();
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	unsigned int              mElementSize;
+	unsigned int              mCapacity = 0; // Number of elements the GPU buffer can hold
+
+	ID3D11Buffer*             mBuffer = nullptr;
+	ID3D11ShaderResourceView* mSRV    = nullptr;
+};
+
+
+#endif //_DYNAMIC_STRUCTURED_BUFFER_H_INCLUDED_
@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// Virtual file system - asset files read from packs or from disk
+//--------------------------------------------------------------------------------------
+
+#include "FileSystem.h"
+#include "ThreadPool.h" // Packs are decompressed in parallel
+
+#include <atomic>
+
+#define NOMINMAX // Stop Windows headers defining "min" and "max"
+#include <windows.h>
+
+
+// The file system used for all assets
+FileSystem gFileSystem;
+
+
+//--------------------------------------------------------------------------------------
+// File system
+//--------------------------------------------------------------------------------------
+
+// Add a pack, decompressing its compressed entries. Files in packs mounted later hide files of the same name in earlier
+// ones. Returns false if the pack can't be opened or is damaged
+bool FileSystem::Mount(const std::string& packFilename)
+{
+	std::unique_ptr<Pack> pack(new Pack);
+	if (!pack->file.Open(packFilename))  return false;
+
+	// Place the compressed entries in one buffer, aligned like the stored entries in the pack
+	std::vector<unsigned int> compressed;
+	pack->decompressedOffsets.resize(pack->file.NumEntries(), 0);
+	for (unsigned int entry = 0; entry < pack->file.NumEntries(); ++entry)
+	{
+		const PackEntry& packEntry = pack->file.Entry(entry);
+		if (packEntry.compression == PackCompression::None)  continue;
+		compressed.push_back(entry);
+		pack->decompressedOffsets[entry] = pack->decompressedSize;
+		pack->decompressedSize += (packEntry.size + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+	}
+	pack->decompressed.reset(new uint8_t[static_cast<size_t>(pack->decompressedSize)]);
+
+	// Entries are independent, so are decompressed on all cores at once
+	std::atomic<bool> damaged{ false };
+	Pack& newPack = *pack;
+	ParallelFor(static_cast<unsigned int>(compressed.size()), 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			unsigned int entry = compressed[i];
+			if (!newPack.file.Read(entry, newPack.decompressed.get() + newPack.decompressedOffsets[entry]))  damaged = true;
+		}
+	});
+	if (damaged)  return false;
+
+	mPacks.push_back(std::move(pack));
+	return true;
+}
+
+
+// Remove all packs, files will be read from disk
+void FileSystem::UnmountAll()
+{
+	mPacks.clear();
+}
+
+
+// Find a file in the mounted packs, giving its contents in memory. Returns false if it is in none of them
+bool FileSystem::FindPacked(const std::string& filename, const uint8_t*& data, uint64_t& size)
+{
+	// Latest pack first
+	for (auto pack = mPacks.rbegin(); pack != mPacks.rend(); ++pack)
+	{
+		PackFile& file = (*pack)->file;
+		unsigned int entry = file.Find(filename);
+		if (entry == PackFile::NotFound)  continue;
+
+		const PackEntry& packEntry = file.Entry(entry);
+		data = (packEntry.compression == PackCompression::None) ? file.StoredData(entry) :
+		                                                          (*pack)->decompressed.get() + (*pack)->decompressedOffsets[entry];
+		size = packEntry.size;
+		return true;
+	}
+	return false;
+}
+
+
+// Whether a file can be opened, from a pack or disk
+bool FileSystem::Exists(const std::string& filename)
+{
+	const uint8_t* data;
+	uint64_t size;
+	if (FindPacked(filename, data, size))  return true;
+	DWORD attributes = GetFileAttributesA(filename.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+
+// Statistics: files in the mounted packs and bytes decompressed when mounting
+unsigned int FileSystem::NumPackedFiles()
+{
+	unsigned int count = 0;
+	for (auto& pack : mPacks)  count += pack->file.NumEntries();
+	return count;
+}
+
+uint64_t FileSystem::DecompressedBytes()
+{
+	uint64_t bytes = 0;
+	for (auto& pack : mPacks)  bytes += pack->decompressedSize;
+	return bytes;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Asset files
+//--------------------------------------------------------------------------------------
+
+// Open a file from the packs or disk, closing any file already open. Returns false on failure (e.g. missing or empty
+// file)
+bool AssetFile::Open(const std::string& filename)
+{
+	Close();
+	if (gFileSystem.FindPacked(filename, mData, mSize))
+	{
+		// Empty files fail like they do from disk
+		if (mSize > 0)  return true;
+		Close();
+		return false;
+	}
+
+	if (!mMappedFile.Open(filename))  return false;
+	mData = mMappedFile.Data();
+	mSize = mMappedFile.Size();
+	return true;
+}
+
+
+void AssetFile::Close()
+{
+	mMappedFile.Close();
+	mData = nullptr;
+	mSize = 0;
+}
@@ -0,0 +1,120 @@
+//--------------------------------------------------------------------------------------
+// Virtual file system - asset files read from packs or from disk
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Loaders open files through here rather than directly. A file is looked for in the mounted packs first (see
+// PackFile.h), then on disk, so the app runs the same with or without packs and a file missing from the packs can be
+// added loose while developing.
+//
+// Mounting a pack maps it and decompresses all its compressed entries at once, spread over the thread pool. After that
+// every packed file is already in memory: stored entries in the pack's mapping, compressed ones in one buffer per pack.
+// Opening a packed file just finds it in the index, so loading the scene from a pack is one file mapping plus the
+// parallel decompression rather than many separate file reads.
+//
+// - Mount and unmount from the main thread while nothing is loading. Files can be opened from any thread
+// - Data from packs stays valid until the pack is unmounted, even after the AssetFile is closed
+
+#ifndef _FILE_SYSTEM_H_INCLUDED_
+#define _FILE_SYSTEM_H_INCLUDED_
+
+#include "PackFile.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+
+class FileSystem
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	FileSystem() {}
+
+	// Prevent copying - owns the packs
+	FileSystem(const FileSystem&) = delete;
+	FileSystem& operator=(const FileSystem&) = delete;
+
+
+	// Add a pack, decompressing its compressed entries. Files in packs mounted later hide files of the same name in earlier
+	// ones. Returns false if the pack can't be opened or is damaged
+	bool Mount(const std::string& packFilename);
+
+	// Remove all packs, files will be read from disk
+	void UnmountAll();
+
+
+	// Find a file in the mounted packs, giving its contents in memory. Returns false if it is in none of them
+	bool FindPacked(const std::string& filename, const uint8_t*& data, uint64_t& size);
+
+	// Whether a file can be opened, from a pack or disk
+	bool Exists(const std::string& filename);
+
+
+	// Statistics: files in the mounted packs and bytes decompressed when mounting
+	unsigned int NumPackedFiles();
+	uint64_t     DecompressedBytes();
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct Pack
+	{
+		PackFile                   file;
+		std::unique_ptr<uint8_t[]> decompressed;        // All the compressed entries' data, decompressed
+		uint64_t                   decompressedSize = 0;
+		std::vector<uint64_t>      decompressedOffsets; // For each entry, where its data is in the buffer above
+	};
+
+	std::vector<std::unique_ptr<Pack>> mPacks; // In the order mounted
+};
+
+
+// The file system used for all assets
+extern FileSystem gFileSystem;
+
+
+// A file opened through the file system, used like MappedFile. Packed files point into the pack's memory, other files
+// are mapped from disk
+class AssetFile
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	AssetFile() {}
+	~AssetFile()  { Close(); }
+
+	// Prevent copying - may own a mapping
+	AssetFile(const AssetFile&) = delete;
+	AssetFile& operator=(const AssetFile&) = delete;
+
+	// Open a file from the packs or disk, closing any file already open. Returns false on failure (e.g. missing or empty
+	// file)
+	bool Open(const std::string& filename);
+
+	void Close();
+
+	// The file's contents, null if no file is open
+	const uint8_t* Data()  { return mData; }
+	uint64_t       Size()  { return mSize; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	MappedFile     mMappedFile; // Used for files on disk
+	const uint8_t* mData = nullptr;
+	uint64_t       mSize = 0;
+};
+
+
+#endif //_FILE_SYSTEM_H_INCLUDED_
@@ -0,0 +1,190 @@
+//--------------------------------------------------------------------------------------
+// Per-frame linear (bump) allocator for transient data
+//--------------------------------------------------------------------------------------
+
+#include "FrameAllocator.h"
+
+#define NOMINMAX // Stop Windows headers defining "min" and "max"
+#include <windows.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+
+
+// The allocator used for per-frame render data, reset when the frame is presented
+FrameAllocator gFrameAllocator(4 * 1024 * 1024);
+
+
+//--------------------------------------------------------------------------------------
+// Debug heap allocation counter
+//--------------------------------------------------------------------------------------
+// In debug builds global operator new is replaced to count heap allocations made during a frame. Counting starts at
+// the first reset (i.e. after the first Present) so loading is not included. The other forms of new / delete
+// (array, nothrow, sized) forward to these two by default so they are counted too.
+#ifdef _DEBUG
+
+static std::atomic<bool>         sCountHeapAllocations{ false };
+static std::atomic<unsigned int> sFrameHeapAllocations{ 0 };
+
+void* operator new(size_t size)
+{
+	if (sCountHeapAllocations.load(std::memory_order_relaxed))
+	{
+		sFrameHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+	void* memory = std::malloc(size > 0 ? size : 1);
+	if (memory == nullptr)  throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Per-thread sub-arenas
+//--------------------------------------------------------------------------------------
+
+// Each thread bumps through its own chunk of the frame memory. The chunk is discarded when the frame number
+// changes (i.e. the allocator has been reset), the next allocation will then take a new chunk
+struct ThreadArena
+{
+	FrameAllocator* owner   = nullptr;
+	uint32_t        frame   = 0;
+	unsigned char*  current = nullptr;
+	unsigned char*  end     = nullptr;
+};
+static thread_local ThreadArena tArena;
+
+
+// Round pointer or size up to the given power of 2 alignment
+static inline uintptr_t AlignUp(uintptr_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Construction / Usage
+//--------------------------------------------------------------------------------------
+
+// Capacity is the total memory available per frame, chunkSize is how much memory each thread takes from it at a time
+FrameAllocator::FrameAllocator(size_t capacity, size_t chunkSize /*= 64 * 1024*/)
+	: mCapacity(capacity), mChunkSize(chunkSize)
+{
+	mMemory = static_cast<unsigned char*>(::operator new(capacity));
+}
+
+FrameAllocator::~FrameAllocator()
+{
+	for (auto memory : mOverflow)  std::free(memory);
+	::operator delete(mMemory);
+}
+
+
+// Allocate memory that is valid until the next call to Reset. Alignment must be a power of 2.
+// Thread-safe, each thread allocates from its own sub-arena. If the allocator is full the memory comes from
+// the heap instead (and is counted as a frame heap allocation in debug builds), so this never fails
+void* FrameAllocator::Allocate(size_t size, size_t alignment /*= 16*/)
+{
+	if (size == 0)  size = 1;
+
+	// Get this thread's sub-arena, discarding its chunk if it belongs to an earlier frame
+	ThreadArena& arena = tArena;
+	uint32_t frame = mFrame.load(std::memory_order_acquire);
+	if (arena.owner != this || arena.frame != frame)
+	{
+		arena = { this, frame, nullptr, nullptr };
+	}
+
+	// Fast path - bump through the current chunk
+	uintptr_t aligned = AlignUp(reinterpret_cast<uintptr_t>(arena.current), alignment);
+	if (arena.current != nullptr && aligned + size <= reinterpret_cast<uintptr_t>(arena.end))
+	{
+		arena.current = reinterpret_cast<unsigned char*>(aligned + size);
+		return reinterpret_cast<void*>(aligned);
+	}
+
+	// Large allocations go straight to the shared memory so they don't waste most of a thread's chunk
+	if (size + alignment > mChunkSize / 4)
+	{
+		unsigned char* memory = AllocateShared(size, alignment);
+		if (memory != nullptr)  return memory;
+	}
+	else
+	{
+		// Take a new chunk for this thread and allocate from that
+		unsigned char* chunk = AllocateShared(mChunkSize, 64);
+		if (chunk != nullptr)
+		{
+			arena.end = chunk + mChunkSize;
+			aligned = AlignUp(reinterpret_cast<uintptr_t>(chunk), alignment);
+			arena.current = reinterpret_cast<unsigned char*>(aligned + size);
+			return reinterpret_cast<void*>(aligned);
+		}
+	}
+
+	// Frame memory is exhausted - fall back to the heap. The memory is freed at the next reset. Increase the
+	// capacity if this happens regularly
+#ifdef _DEBUG
+	if (sCountHeapAllocations.load(std::memory_order_relaxed))
+	{
+		sFrameHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+#endif
+	void* memory = std::malloc(size + alignment);
+	if (memory == nullptr)  throw std::bad_alloc();
+	{
+		std::lock_guard<std::mutex> lock(mOverflowMutex);
+		mOverflow.push_back(memory);
+	}
+	return reinterpret_cast<void*>(AlignUp(reinterpret_cast<uintptr_t>(memory), alignment));
+}
+
+
+// Free all allocations from this frame. Called once per frame after Present. Must not be called while
+// other threads are allocating. In debug builds, also reports any heap allocations made during the frame
+void FrameAllocator::Reset()
+{
+	mPeakBytesUsed = std::max(mPeakBytesUsed, mOffset.load(std::memory_order_relaxed));
+
+	for (auto memory : mOverflow)  std::free(memory);
+	mOverflow.clear();
+
+	mOffset.store(0, std::memory_order_relaxed);
+	mFrame.fetch_add(1, std::memory_order_release); // Invalidates every thread's current chunk
+
+#ifdef _DEBUG
+	// Any heap allocation in a steady-state frame is a performance bug - report it in the debugger output window.
+	// Note this message is built without using the heap
+	bool counting = sCountHeapAllocations.exchange(true);
+	mLastFrameHeapAllocations = sFrameHeapAllocations.exchange(0);
+	if (counting && mLastFrameHeapAllocations > 0)
+	{
+		char message[128];
+		std::snprintf(message, sizeof(message), "FrameAllocator: %u heap allocation(s) made during the frame\n", mLastFrameHeapAllocations);
+		OutputDebugStringA(message);
+	}
+#endif
+}
+
+
+// Take a block directly from the shared memory (used to give threads new chunks). Returns nullptr when full
+unsigned char* FrameAllocator::AllocateShared(size_t size, size_t alignment)
+{
+	uintptr_t base = reinterpret_cast<uintptr_t>(mMemory);
+	size_t offset = mOffset.load(std::memory_order_relaxed);
+	size_t aligned;
+	do
+	{
+		aligned = AlignUp(base + offset, alignment) - base;
+		if (aligned + size > mCapacity)  return nullptr;
+	} while (!mOffset.compare_exchange_weak(offset, aligned + size, std::memory_order_relaxed));
+
+	return mMemory + aligned;
+}
@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------------------
+// Per-frame linear (bump) allocator for transient data
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Memory handed out by the frame allocator is only valid until the end of the current frame. The whole
+// allocator is reset in one step after Present, so there is no per-allocation free and no heap traffic.
+// Each thread takes its own chunks from the shared block, so allocation from worker threads needs no locking.
+
+#ifndef _FRAME_ALLOCATOR_H_INCLUDED_
+#define _FRAME_ALLOCATOR_H_INCLUDED_
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+#include <stdint.h>
+
+
+class FrameAllocator
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Capacity is the total memory available per frame, chunkSize is how much memory each thread takes from it at a time
+	FrameAllocator(size_t capacity, size_t chunkSize = 64 * 1024);
+	~FrameAllocator();
+
+	// Allocate memory that is valid until the next call to Reset. Alignment must be a power of 2.
+	// Thread-safe, each thread allocates from its own sub-arena. If the allocator is full the memory comes from
+	// the heap instead (and is counted as a frame heap allocation in debug builds), so this never fails
+	void* Allocate(size_t size, size_t alignment = 16);
+
+	// Allocate an uninitialised array of the given type
+	template <class T>
+	T* AllocateArray(size_t count)  { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	// Free all allocations from this frame. Called once per frame after Present. Must not be called while
+	// other threads are allocating. In debug builds, also reports any heap allocations made during the frame
+	void Reset();
+
+
+	//-------------------------------------
+	// Statistics
+	//-------------------------------------
+
+	size_t Capacity()       { return mCapacity; }
+	size_t BytesUsed()      { return mOffset.load(std::memory_order_relaxed); }
+	size_t PeakBytesUsed()  { return mPeakBytesUsed; }
+
+	// Number of heap allocations (operator new, or the allocator falling back to the heap when full) made in the last
+	// complete frame. Always 0 in release builds
+	unsigned int LastFrameHeapAllocations()  { return mLastFrameHeapAllocations; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	// Take a block directly from the shared memory (used to give threads new chunks). Returns nullptr when full
+	unsigned char* AllocateShared(size_t size, size_t alignment);
+
+	unsigned char*        mMemory;
+	size_t                mCapacity;
+	size_t                mChunkSize;
+	std::atomic<size_t>   mOffset{ 0 };
+	std::atomic<uint32_t> mFrame{ 1 };   // Incremented on reset, tells thread sub-arenas their chunk is stale
+	size_t                mPeakBytesUsed = 0;
+
+	// Allocations that didn't fit in the frame memory, freed on reset
+	std::mutex         mOverflowMutex;
+	std::vector<void*> mOverflow;
+
+	unsigned int mLastFrameHeapAllocations = 0;
+};
+
+
+// The allocator used for per-frame render data, reset when the frame is presented
+extern FrameAllocator gFrameAllocator;
+
+
+//--------------------------------------------------------------------------------------
+// STL adapter
+//--------------------------------------------------------------------------------------
+// Allocator for STL containers so they can use frame memory, e.g. FrameVector<CMatrix4x4> matrices(numNodes);
+// Deallocation does nothing - the memory is reclaimed when the frame allocator is reset. Containers using this
+// adapter must not live beyond the end of the frame.
+
+template <class T>
+class FrameAllocatorAdapter
+{
+public:
+	using value_type = T;
+
+	FrameAllocatorAdapter(FrameAllocator& allocator = gFrameAllocator) : mAllocator(&allocator) {}
+
+	template <class U>
+	FrameAllocatorAdapter(const FrameAllocatorAdapter<U>& other) : mAllocator(other.mAllocator) {}
+
+	T*   allocate(size_t n)          { return mAllocator->AllocateArray<T>(n); }
+	void deallocate(T*, size_t)      {}
+
+	template <class U> bool operator==(const FrameAllocatorAdapter<U>& other) const  { return mAllocator == other.mAllocator; }
+	template <class U> bool operator!=(const FrameAllocatorAdapter<U>& other) const  { return mAllocator != other.mAllocator; }
+
+	FrameAllocator* mAllocator;
+};
+
+template <class T>
+using FrameVector = std::vector<T, FrameAllocatorAdapter<T>>;
+
+
+// Give a frame vector that is kept between frames (e.g. a class member) new, empty storage for this frame, with room
+// for as many elements as it held last time so it doesn't normally need to grow. Call before using the vector in a
+// new frame - clear alone is not enough, its old storage may belong to a frame that has been reset
+template <class T>
+void NewFrameStorage(FrameVector<T>& vector)
+{
+	size_t lastSize = vector.size();
+	FrameVector<T>(vector.get_allocator()).swap(vector); // Nothing is freed, the old storage is just abandoned
+	vector.reserve(lastSize);
+}
+
+
+#endif //_FRAME_ALLOCATOR_H_INCLUDED_
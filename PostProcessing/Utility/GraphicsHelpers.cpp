@@ -5,33 +5,99 @@
 #include "GraphicsHelpers.h"
 #include "../Shader.h"
 #include "../Common.h"
+#include "../TextureCache.h"
+#include "../DDSLayout.h"
+#include "FileSystem.h"
 
 #include <WICTextureLoader.h>
 #include <DDSTextureLoader.h>
 #include <cmath>
 #include <cctype>
-#include <atlbase.h> // C-string to unicode conversion function CA2CT
+#include <vector>
+#include <algorithm>
 
 //--------------------------------------------------------------------------------------
 // Texture Loading
 //--------------------------------------------------------------------------------------
 
-// Using Microsoft's open source DirectX Tool Kit (DirectXTK) to simplify texture loading
+// Load a DDS file by giving DirectX pointers to the mips in the file's memory (a pack or a mapped file, see FileSystem.h),
+// so the texture data isn't read into a buffer first. Handles single 2D textures (see ParseDDSHeader), returns false for
+// anything else or on failure
+static bool LoadMappedDDSTexture(AssetFile& file, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
+{
+    DDSFileInfo info;
+    size_t headerBytes = static_cast<size_t>(std::min<uint64_t>(file.Size(), DDS_MAX_HEADER_BYTES));
+    if (!ParseDDSHeader(file.Data(), headerBytes, file.Size(), info))  return false;
+
+    std::vector<D3D11_SUBRESOURCE_DATA> initData;
+    DDSSubresourceData(info, file.Data(), 0, initData);
+
+    D3D11_TEXTURE2D_DESC textureDesc = {};
+    textureDesc.Width  = info.width;
+    textureDesc.Height = info.height;
+    textureDesc.MipLevels = static_cast<UINT>(info.mips.size());
+    textureDesc.ArraySize = 1;
+    textureDesc.Format = info.format;
+    textureDesc.SampleDesc.Count = 1;
+    textureDesc.SampleDesc.Quality = 0;
+    textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    textureDesc.CPUAccessFlags = 0;
+    textureDesc.MiscFlags = 0;
+    ID3D11Texture2D* texture2D = nullptr;
+    if (FAILED(gD3DDevice->CreateTexture2D(&textureDesc, initData.data(), &texture2D)))  return false;
+
+    if (FAILED(gD3DDevice->CreateShaderResourceView(texture2D, nullptr, textureSRV)))
+    {
+        texture2D->Release();
+        return false;
+    }
+    *texture = texture2D;
+    return true;
+}
+
+// DDS files are used straight from memory if possible, otherwise DirectXTK loads the less common kinds (cube maps, arrays,
+// older formats). The file is closed as soon as the texture is created
+static bool LoadDDSTexture(const std::string& filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
+{
+    AssetFile file;
+    if (!file.Open(filename))  return false;
+    return LoadMappedDDSTexture(file, texture, textureSRV) ||
+           SUCCEEDED(DirectX::CreateDDSTextureFromMemory(gD3DDevice, file.Data(), static_cast<size_t>(file.Size()), texture, textureSRV));
+}
+
+
+// Using Microsoft's open source DirectX Tool Kit (DirectXTK) to simplify texture loading. Files are read through the file
+// system (see FileSystem.h), so can come from a pack
 // This function requires you to pass a ID3D11Resource* (e.g. &gTilesDiffuseMap), which manages the GPU memory for the
 // texture and also a ID3D11ShaderResourceView* (e.g. &gTilesDiffuseMapSRV), which allows us to use the texture in shaders
 // The function will fill in these pointers with usable data. Returns false on failure
-bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV)
+bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                 TextureCompression compression /*= TextureCompression::Standard*/, TextureChannels channels /*= TextureChannels::RGBA*/)
 {
     // DDS files need a different function from other files
     std::string dds = ".dds"; // So check the filename extension (case insensitive)
     if (filename.size() >= 4 &&
         std::equal(dds.rbegin(), dds.rend(), filename.rbegin(), [](unsigned char a, unsigned char b) { return std::tolower(a) == std::tolower(b); }))
     {
-        return SUCCEEDED(DirectX::CreateDDSTextureFromFile(gD3DDevice, CA2CT(filename.c_str()), texture, textureSRV));
+        return LoadDDSTexture(filename, texture, textureSRV);
     }
     else
     {
-        return SUCCEEDED(DirectX::CreateWICTextureFromFile(gD3DDevice, gD3DContext, CA2CT(filename.c_str()), texture, textureSRV));
+        // Use the compressed version from the cache (made now if needed). If the image can't be compressed it is loaded
+        // uncompressed as usual
+        if (compression != TextureCompression::None)
+        {
+            std::string compressedFilename = CompressedTextureFile(filename, channels, compression == TextureCompression::HighQuality);
+            if (!compressedFilename.empty() && LoadDDSTexture(compressedFilename, texture, textureSRV))
+            {
+                return true;
+            }
+        }
+        AssetFile file;
+        return file.Open(filename) &&
+               SUCCEEDED(DirectX::CreateWICTextureFromMemory(gD3DDevice, gD3DContext, file.Data(), static_cast<size_t>(file.Size()),
+                                                             texture, textureSRV));
     }
 }
 
@@ -8,6 +8,7 @@
 
 #include "CMatrix4x4.h"
 #include "../Common.h"
+#include "../TextureCompressor.h"
 #include <d3d11.h>
 
 
@@ -27,6 +28,17 @@ void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
     gD3DContext->Unmap(buffer, 0);
 }
 
+// As above, but only copy the first "size" bytes of the structure. For large buffers where only the start is used
+// by the next draw (e.g. bone matrices). The remainder of the GPU buffer is undefined afterwards
+template <class T>
+void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData, size_t size)
+{
+    D3D11_MAPPED_SUBRESOURCE cb;
+    gD3DContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &cb);
+    memcpy(cb.pData, &bufferData, size < sizeof(T) ? size : sizeof(T));
+    gD3DContext->Unmap(buffer, 0);
+}
+
 
 //--------------------------------------------------------------------------------------
 // Texture Loading
@@ -36,7 +48,17 @@ void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
 // This function requires you to pass a ID3D11Resource* (e.g. &gTilesDiffuseMap), which manages the GPU memory for the
 // texture and also a ID3D11ShaderResourceView* (e.g. &gTilesDiffuseMapSRV), which allows us to use the texture in shaders
 // The function will fill in these pointers with usable data. Returns false on failure
-bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV);
+// Image files (jpg, png etc.) are block compressed and cached as DDS files the first time they are loaded (see
+// TextureCache.h), unless no compression is asked for. Pass the channels the shaders read, textures only read as .r or
+// .rg use smaller formats. DDS files are loaded as they are, straight from a memory mapping of the file where possible
+enum class TextureCompression
+{
+	None,        // 4 bytes per pixel
+	Standard,    // BC1 if opaque, otherwise BC3. BC4 or BC5 if the shaders read one or two channels
+	HighQuality, // BC7, also BC4 or BC5 if the shaders read one or two channels
+};
+bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderResourceView** textureSRV,
+                 TextureCompression compression = TextureCompression::Standard, TextureChannels channels = TextureChannels::RGBA);
 
 
 //--------------------------------------------------------------------------------------
@@ -0,0 +1,30 @@
+//--------------------------------------------------------------------------------------
+// Hashing of file contents and other data
+//--------------------------------------------------------------------------------------
+// FNV-1a: quick to compute and well spread, but not secure. Used to name cache files after the data they were made from
+// (see TextureCache.h) and to find resources with identical contents (see ResourceCache.h)
+
+#ifndef _HASH_H_INCLUDED_
+#define _HASH_H_INCLUDED_
+
+#include <cstddef>
+#include <stdint.h>
+
+
+// Starting value for a hash
+const uint64_t HASH_START = 14695981039346656037ull;
+
+// 64-bit FNV-1a hash of some bytes, pass the previous result to continue a hash
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = HASH_START)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+
+#endif //_HASH_H_INCLUDED_
@@ -0,0 +1,203 @@
+//--------------------------------------------------------------------------------------
+// LZ4 block compression
+//--------------------------------------------------------------------------------------
+
+#include "LZ4.h"
+
+#include <vector>
+#include <cstring>
+
+
+// Rules of the block format
+const size_t MIN_MATCH     = 4;      // Shortest match that can be encoded
+const size_t LAST_LITERALS = 5;      // The last bytes of a block are always literals
+const size_t MATCH_LIMIT   = 12;     // No match can start in the last bytes of a block
+const size_t MAX_OFFSET    = 65535;  // Furthest back a match can be
+
+// Positions of earlier 4-byte sequences are found in a hash table of this many bits
+const unsigned int HASH_BITS = 16;
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+static uint32_t Read32(const uint8_t* p)
+{
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t HashSequence(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+// Write a length that doesn't fit in its 4 bits of the token: 255 for each full byte then the remainder. Returns false
+// if it doesn't fit in the destination
+static bool WriteLength(size_t length, uint8_t*& out, const uint8_t* outEnd)
+{
+	for (; length >= 255; length -= 255)
+	{
+		if (out == outEnd)  return false;
+		*out++ = 255;
+	}
+	if (out == outEnd)  return false;
+	*out++ = static_cast<uint8_t>(length);
+	return true;
+}
+
+// Read a length continued after the token. Returns false if the data ends first
+static bool ReadLength(size_t& length, const uint8_t*& in, const uint8_t* inEnd)
+{
+	uint8_t byte;
+	do
+	{
+		if (in == inEnd)  return false;
+		byte = *in++;
+		length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+
+// Write a sequence: a run of literal bytes followed by a match (if matchLength isn't 0). Returns false if it doesn't
+// fit in the destination
+static bool WriteSequence(const uint8_t* literals, size_t numLiterals, size_t offset, size_t matchLength,
+                          uint8_t*& out, const uint8_t* outEnd)
+{
+	if (out == outEnd)  return false;
+	uint8_t* token = out++;
+	*token = static_cast<uint8_t>((numLiterals < 15 ? numLiterals : 15) << 4);
+	if (numLiterals >= 15 && !WriteLength(numLiterals - 15, out, outEnd))  return false;
+	if (static_cast<size_t>(outEnd - out) < numLiterals)  return false;
+	std::memcpy(out, literals, numLiterals);
+	out += numLiterals;
+
+	if (matchLength == 0)  return true; // The last sequence has no match
+	if (outEnd - out < 2)  return false;
+	*out++ = static_cast<uint8_t>(offset);
+	*out++ = static_cast<uint8_t>(offset >> 8);
+	size_t length = matchLength - MIN_MATCH;
+	*token |= static_cast<uint8_t>(length < 15 ? length : 15);
+	return length < 15 || WriteLength(length - 15, out, outEnd);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+// Largest possible compressed size of the given number of bytes (data that doesn't compress grows slightly)
+size_t LZ4CompressBound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+
+// Compress data into the destination, which should hold at least LZ4CompressBound(sourceSize) bytes. Returns the
+// compressed size, or 0 if the destination is too small
+size_t LZ4Compress(const uint8_t* source, size_t sourceSize, uint8_t* dest, size_t destCapacity)
+{
+	uint8_t* out = dest;
+	const uint8_t* outEnd = dest + destCapacity;
+	size_t anchor = 0; // Start of the literals not yet written
+
+	// Blocks too short to hold a match are all literals
+	if (sourceSize > MATCH_LIMIT)
+	{
+		// Positions are stored plus one, so 0 is an empty slot
+		std::vector<uint32_t> table(1u << HASH_BITS, 0);
+		size_t matchEnd = sourceSize - LAST_LITERALS;
+
+		size_t position = 0;
+		while (position + MATCH_LIMIT <= sourceSize)
+		{
+			uint32_t sequence = Read32(source + position);
+			uint32_t& slot = table[HashSequence(sequence)];
+			size_t candidate = slot;
+			slot = static_cast<uint32_t>(position + 1);
+
+			if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || Read32(source + candidate - 1) != sequence)
+			{
+				// No match. Step further the longer it has been since the last match, so data that doesn't compress is
+				// passed over quickly
+				position += 1 + ((position - anchor) >> 6);
+				continue;
+			}
+
+			// Extend the match forwards as far as the block allows, and backwards over literals that also match
+			size_t match = candidate - 1;
+			size_t length = MIN_MATCH;
+			while (position + length < matchEnd && source[match + length] == source[position + length])  ++length;
+			while (position > anchor && match > 0 && source[match - 1] == source[position - 1])
+			{
+				--position;
+				--match;
+				++length;
+			}
+
+			if (!WriteSequence(source + anchor, position - anchor, position - match, length, out, outEnd))  return 0;
+			position += length;
+			anchor = position;
+		}
+	}
+
+	if (!WriteSequence(source + anchor, sourceSize - anchor, 0, 0, out, outEnd))  return 0;
+	return static_cast<size_t>(out - dest);
+}
+
+
+// Decompress data into the destination, which must be exactly the uncompressed size. Checks every length and offset in
+// the data, so corrupt data can't read or write out of bounds. Returns false if the data is corrupt
+bool LZ4Decompress(const uint8_t* source, size_t sourceSize, uint8_t* dest, size_t destSize)
+{
+	const uint8_t* in = source;
+	const uint8_t* inEnd = source + sourceSize;
+	uint8_t* out = dest;
+	uint8_t* outEnd = dest + destSize;
+
+	while (in < inEnd)
+	{
+		uint8_t token = *in++;
+
+		// Most literal runs are short. Away from the ends of the buffers they are copied as a fixed 16 bytes, which is
+		// faster than a copy of variable length, the bytes past the run are overwritten later
+		size_t numLiterals = token >> 4;
+		if (numLiterals == 15 && !ReadLength(numLiterals, in, inEnd))  return false;
+		if (static_cast<size_t>(inEnd - in) < numLiterals || static_cast<size_t>(outEnd - out) < numLiterals)  return false;
+		if (numLiterals <= 16 && inEnd - in >= 16 && outEnd - out >= 16)  std::memcpy(out, in, 16);
+		else                                                              std::memcpy(out, in, numLiterals);
+		in  += numLiterals;
+		out += numLiterals;
+
+		// The last sequence is literals only
+		if (in == inEnd)  break;
+
+		if (inEnd - in < 2)  return false;
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		if (offset == 0 || offset > static_cast<size_t>(out - dest))  return false;
+
+		size_t length = token & 15;
+		if (length == 15 && !ReadLength(length, in, inEnd))  return false;
+		length += MIN_MATCH;
+		if (static_cast<size_t>(outEnd - out) < length)  return false;
+
+		// Matches closer than their length repeat the bytes being written. Matches at least 8 bytes back are copied 8
+		// bytes at a time, each piece only reads bytes already written. Closer ones are copied a byte at a time
+		const uint8_t* match = out - offset;
+		if (offset >= 8 && static_cast<size_t>(outEnd - out) >= length + 8)
+		{
+			for (size_t i = 0; i < length; i += 8)  std::memcpy(out + i, match + i, 8);
+			out += length;
+		}
+		else
+		{
+			for (size_t i = 0; i < length; ++i)  *out++ = *match++;
+		}
+	}
+	return out == outEnd;
+}
@@ -0,0 +1,33 @@
+//--------------------------------------------------------------------------------------
+// LZ4 block compression
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Compresses and decompresses data in the LZ4 block format, which decompresses at several gigabytes a second, so
+// compressed assets are quicker to load than reading them uncompressed from disk. Output is compatible with other LZ4
+// implementations (e.g. LZ4_decompress_safe in the reference library), so packs can be checked with standard tools.
+//
+// - The compressor is a simple greedy one, it finds most of the matches the reference "fast" mode finds. Compression
+//   is done by the pack tool (see PackFile.h), so its speed matters much less than decompression
+// - Only single blocks are handled, not the LZ4 frame format. The uncompressed size must be stored with the data (packs
+//   store it in their index)
+
+#ifndef _LZ4_H_INCLUDED_
+#define _LZ4_H_INCLUDED_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Largest possible compressed size of the given number of bytes (data that doesn't compress grows slightly)
+size_t LZ4CompressBound(size_t size);
+
+// Compress data into the destination, which should hold at least LZ4CompressBound(sourceSize) bytes. Returns the
+// compressed size, or 0 if the destination is too small
+size_t LZ4Compress(const uint8_t* source, size_t sourceSize, uint8_t* dest, size_t destCapacity);
+
+// Decompress data into the destination, which must be exactly the uncompressed size. Checks every length and offset in
+// the data, so corrupt data can't read or write out of bounds. Returns false if the data is corrupt
+bool LZ4Decompress(const uint8_t* source, size_t sourceSize, uint8_t* dest, size_t destSize);
+
+
+#endif //_LZ4_H_INCLUDED_
@@ -0,0 +1,57 @@
+//--------------------------------------------------------------------------------------
+// Read-only memory-mapped file
+//--------------------------------------------------------------------------------------
+
+#include "MappedFile.h"
+
+#define NOMINMAX // Stop Windows headers defining "min" and "max"
+#include <windows.h>
+
+
+// Map a whole file into memory, closing any file already open. Returns false on failure (e.g. missing or empty file)
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	// Files are usually read from start to end, which the OS can use to read ahead
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)  return false;
+	mFile = file;
+
+	// Empty files can't be mapped
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mSize = static_cast<uint64_t>(size.QuadPart);
+	return true;
+}
+
+
+// Unmap the file
+void MappedFile::Close()
+{
+	if (mData)     UnmapViewOfFile(mData);
+	if (mMapping)  CloseHandle(mMapping);
+	if (mFile)     CloseHandle(mFile);
+	mData    = nullptr;
+	mMapping = nullptr;
+	mFile    = nullptr;
+	mSize    = 0;
+}
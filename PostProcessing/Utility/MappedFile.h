@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------------
+// Read-only memory-mapped file
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// The file's contents appear in memory without being read into a buffer first, the OS pages them in as they are
+// touched. Used to pass data in files straight to DirectX (e.g. the mips of a DDS file) without an extra copy.
+// The mapping lasts until Close or the object is destroyed, so close files as soon as their data has been used to
+// keep the address space used by a large set of files small
+
+#ifndef _MAPPED_FILE_H_INCLUDED_
+#define _MAPPED_FILE_H_INCLUDED_
+
+#include <string>
+#include <stdint.h>
+
+
+class MappedFile
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	MappedFile() {}
+	~MappedFile()  { Close(); }
+
+	// Prevent copying - owns the mapping
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Map a whole file into memory, closing any file already open. Returns false on failure (e.g. missing or empty file)
+	bool Open(const std::string& filename);
+
+	// Unmap the file
+	void Close();
+
+	// The file's contents, null if no file is open
+	const uint8_t* Data()  { return mData; }
+	uint64_t       Size()  { return mSize; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	void*          mFile    = nullptr; // Windows handles, void* so windows.h isn't needed here
+	void*          mMapping = nullptr;
+	const uint8_t* mData    = nullptr;
+	uint64_t       mSize    = 0;
+};
+
+
+#endif //_MAPPED_FILE_H_INCLUDED_
@@ -0,0 +1,282 @@
+//--------------------------------------------------------------------------------------
+// Packed asset archive - many files in one, with a sorted index and LZ4 compression
+//--------------------------------------------------------------------------------------
+
+#include "PackFile.h"
+#include "LZ4.h"
+#include "ThreadPool.h" // Files are compressed in parallel
+
+#include <algorithm>
+#include <fstream>
+#include <cctype>
+#include <cstring>
+
+
+static_assert(sizeof(PackHeader) == 16 && sizeof(PackEntry) == 32, "Pack layout must not depend on the compiler");
+
+const char PACK_MAGIC[4] = { 'P', 'A', 'C', 'K' };
+
+// Entries are only kept compressed if that saves at least 1/COMPRESSION_MIN_SAVING of their size, otherwise reading
+// them straight from the mapping is better than a small saving on disk
+const uint64_t COMPRESSION_MIN_SAVING = 8;
+
+// Files of these types are already compressed, LZ4 won't shrink them and DDS files must be stored to be streamed
+// straight from the mapping
+const char* const STORED_EXTENSIONS[] = { ".dds", ".jpg", ".jpeg", ".png" };
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+// The name a file is found by: lowercase, forward slashes and no leading "./". Windows filenames ignore case and accept
+// either slash, so these are the same file whichever way the name was written
+std::string NormaliseFilename(const std::string& filename)
+{
+	std::string result = filename;
+	for (char& c : result)
+	{
+		c = (c == '\\') ? '/' : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	}
+	while (result.compare(0, 2, "./") == 0)  result.erase(0, 2);
+	return result;
+}
+
+
+static bool IsStoredType(const std::string& name)
+{
+	for (const char* extension : STORED_EXTENSIONS)
+	{
+		size_t length = std::strlen(extension);
+		if (name.size() >= length && name.compare(name.size() - length, length, extension) == 0)  return true;
+	}
+	return false;
+}
+
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reading packs
+//--------------------------------------------------------------------------------------
+
+// Map a pack and check its index, closing any pack already open. Returns false on failure (missing file, a pack of
+// another version or a damaged pack)
+bool PackFile::Open(const std::string& filename)
+{
+	Close();
+	if (!mFile.Open(filename))  return false;
+
+	// Check everything the index refers to is inside the file, so nothing needs checking when entries are used
+	const uint8_t* data = mFile.Data();
+	uint64_t size = mFile.Size();
+	const PackHeader* header = reinterpret_cast<const PackHeader*>(data);
+	if (size < sizeof(PackHeader) || std::memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+	    header->version != PACK_VERSION)
+	{
+		Close();
+		return false;
+	}
+	uint64_t namesOffset = sizeof(PackHeader) + static_cast<uint64_t>(header->numEntries) * sizeof(PackEntry);
+	if (namesOffset + header->namesSize > size)
+	{
+		Close();
+		return false;
+	}
+
+	const PackEntry* entries = reinterpret_cast<const PackEntry*>(data + sizeof(PackHeader));
+	const char* names = reinterpret_cast<const char*>(data + namesOffset);
+	for (unsigned int i = 0; i < header->numEntries; ++i)
+	{
+		const PackEntry& entry = entries[i];
+		bool valid = static_cast<uint64_t>(entry.nameOffset) + entry.nameLength <= header->namesSize &&
+		             entry.offset <= size && entry.storedSize <= size - entry.offset &&
+		             (entry.compression == PackCompression::LZ4 ||
+		              (entry.compression == PackCompression::None && entry.storedSize == entry.size));
+
+		// Names must be in order for Find
+		if (valid && i > 0)
+		{
+			const PackEntry& previous = entries[i - 1];
+			std::string previousName(names + previous.nameOffset, previous.nameLength);
+			valid = previousName.compare(0, std::string::npos, names + entry.nameOffset, entry.nameLength) < 0;
+		}
+		if (!valid)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	mHeader  = header;
+	mEntries = entries;
+	mNames   = names;
+	return true;
+}
+
+
+// Unmap the pack, data from it can't be used after this
+void PackFile::Close()
+{
+	mFile.Close();
+	mHeader  = nullptr;
+	mEntries = nullptr;
+	mNames   = nullptr;
+}
+
+
+// Find an entry by name (normalised here). Returns its index or NotFound
+unsigned int PackFile::Find(const std::string& filename)
+{
+	if (mHeader == nullptr)  return NotFound;
+
+	// Binary search of the index in the mapping
+	std::string name = NormaliseFilename(filename);
+	const PackEntry* end = mEntries + mHeader->numEntries;
+	const PackEntry* found = std::lower_bound(mEntries, end, name, [this](const PackEntry& entry, const std::string& name)
+	{
+		return name.compare(0, std::string::npos, mNames + entry.nameOffset, entry.nameLength) > 0;
+	});
+	if (found == end || name.compare(0, std::string::npos, mNames + found->nameOffset, found->nameLength) != 0)
+	{
+		return NotFound;
+	}
+	return static_cast<unsigned int>(found - mEntries);
+}
+
+
+std::string PackFile::Name(unsigned int entry)
+{
+	return std::string(mNames + mEntries[entry].nameOffset, mEntries[entry].nameLength);
+}
+
+
+// Decompress or copy an entry's data into the destination, which must hold Entry(entry).size bytes. Returns false
+// if the data is damaged
+bool PackFile::Read(unsigned int entry, uint8_t* destination)
+{
+	const PackEntry& packEntry = mEntries[entry];
+	if (packEntry.compression == PackCompression::None)
+	{
+		std::memcpy(destination, StoredData(entry), static_cast<size_t>(packEntry.size));
+		return true;
+	}
+	return LZ4Decompress(StoredData(entry), static_cast<size_t>(packEntry.storedSize), destination,
+	                     static_cast<size_t>(packEntry.size));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writing packs
+//--------------------------------------------------------------------------------------
+
+// Write a pack holding the given files. Files are compressed in parallel, and stored uncompressed if compression saves
+// little or they are already compressed. Returns false on failure, with a message in error
+bool WritePackFile(const std::string& packFilename, const std::vector<PackInput>& files, std::string& error)
+{
+	// Sort by name, which is the order of the index
+	std::vector<PackInput> inputs = files;
+	for (auto& input : inputs)  input.name = NormaliseFilename(input.name);
+	std::sort(inputs.begin(), inputs.end(), [](const PackInput& a, const PackInput& b) { return a.name < b.name; });
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		if (inputs[i].name.empty() || inputs[i].name.size() > UINT16_MAX)
+		{
+			error = "Unusable name for file " + inputs[i].filename;
+			return false;
+		}
+		if (i > 0 && inputs[i].name == inputs[i - 1].name)
+		{
+			error = "Two files named " + inputs[i].name;
+			return false;
+		}
+	}
+
+	// Read and compress each file. Each holds its stored data, which is the file itself if not compressed
+	struct Packed
+	{
+		MappedFile           file;
+		std::vector<uint8_t> compressed;
+		bool                 read = false;
+	};
+	std::vector<Packed> packed(inputs.size());
+	ParallelFor(static_cast<unsigned int>(inputs.size()), 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			Packed& entry = packed[i];
+			entry.read = entry.file.Open(inputs[i].filename);
+			if (!entry.read || IsStoredType(inputs[i].name))  continue;
+
+			size_t size = static_cast<size_t>(entry.file.Size());
+			entry.compressed.resize(LZ4CompressBound(size));
+			size_t compressedSize = LZ4Compress(entry.file.Data(), size, entry.compressed.data(), entry.compressed.size());
+			if (compressedSize == 0 || compressedSize > size - size / COMPRESSION_MIN_SAVING)  compressedSize = 0;
+			entry.compressed.resize(compressedSize);
+			entry.compressed.shrink_to_fit();
+		}
+	});
+
+	// Build the index and names, data follows them with each entry aligned
+	PackHeader header;
+	std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+	header.version    = PACK_VERSION;
+	header.numEntries = static_cast<uint32_t>(inputs.size());
+
+	std::vector<PackEntry> index(inputs.size());
+	std::string names;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		if (!packed[i].read)
+		{
+			error = "Can't read " + inputs[i].filename + " (missing or empty)";
+			return false;
+		}
+		index[i].nameOffset = static_cast<uint32_t>(names.size());
+		index[i].nameLength = static_cast<uint16_t>(inputs[i].name.size());
+		names += inputs[i].name;
+	}
+	header.namesSize = static_cast<uint32_t>(names.size());
+
+	uint64_t offset = sizeof(PackHeader) + index.size() * sizeof(PackEntry) + names.size();
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		bool compressed = !packed[i].compressed.empty();
+		offset = AlignOffset(offset);
+		index[i].offset      = offset;
+		index[i].size        = packed[i].file.Size();
+		index[i].storedSize  = compressed ? packed[i].compressed.size() : packed[i].file.Size();
+		index[i].compression = compressed ? PackCompression::LZ4 : PackCompression::None;
+		offset += index[i].storedSize;
+	}
+
+	// Write everything in order, padding between entries
+	std::ofstream pack(packFilename, std::ios::binary | std::ios::trunc);
+	if (!pack)
+	{
+		error = "Can't create " + packFilename;
+		return false;
+	}
+	pack.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	pack.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(PackEntry));
+	pack.write(names.data(), names.size());
+	const char padding[PACK_ALIGNMENT] = {};
+	uint64_t written = sizeof(PackHeader) + index.size() * sizeof(PackEntry) + names.size();
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		pack.write(padding, static_cast<std::streamsize>(index[i].offset - written));
+		const uint8_t* data = packed[i].compressed.empty() ? packed[i].file.Data() : packed[i].compressed.data();
+		pack.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(index[i].storedSize));
+		written = index[i].offset + index[i].storedSize;
+	}
+	if (!pack)
+	{
+		error = "Error writing " + packFilename;
+		return false;
+	}
+	return true;
+}
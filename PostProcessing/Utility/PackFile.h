@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+// Packed asset archive - many files in one, with a sorted index and LZ4 compression
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// A pack holds the contents of many asset files (meshes, textures, shaders) so they can be loaded with one file mapping
+// rather than opening each file. Packs are written by the pack tool (see PackTool.cpp) and read through the file system
+// (see FileSystem.h), which loaders use in place of the files on disk.
+//
+// Layout: a header, then the index of entries sorted by name, then the names, then each entry's data. Everything is
+// used in place in the mapped file, the index is searched without being read into memory first.
+//
+// - Names are normalised (see NormaliseFilename), so lookups ignore case and which slashes are used
+// - Each entry is stored as it is or compressed with LZ4 (see LZ4.h), whichever the pack tool chose. Stored entries
+//   start on PACK_ALIGNMENT byte boundaries, so their data can be passed straight from the mapping to DirectX (e.g. DDS
+//   mips) without a copy. Already compressed files (DDS, JPG, PNG) are always stored
+// - A pack is read-only once written, and can be read from any thread
+
+#ifndef _PACK_FILE_H_INCLUDED_
+#define _PACK_FILE_H_INCLUDED_
+
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+// Change when the layout changes, packs of other versions won't open
+const uint32_t PACK_VERSION = 1;
+
+// Stored entry data starts on multiples of this many bytes from the start of the pack (and so of the mapping)
+const unsigned int PACK_ALIGNMENT = 64;
+
+
+// Start of a pack file
+struct PackHeader
+{
+	char     magic[4];   // "PACK"
+	uint32_t version;    // PACK_VERSION
+	uint32_t numEntries;
+	uint32_t namesSize;  // Bytes of names following the index
+};
+
+// How an entry's data is stored
+enum class PackCompression : uint16_t
+{
+	None,
+	LZ4,
+};
+
+// One file in a pack, the index is an array of these sorted by name
+struct PackEntry
+{
+	uint64_t        offset;      // Of the stored data from the start of the pack
+	uint64_t        size;        // Size of the file
+	uint64_t        storedSize;  // Size of the stored data, the same as size if not compressed
+	uint32_t        nameOffset;  // Into the names, which aren't null terminated
+	uint16_t        nameLength;
+	PackCompression compression;
+};
+
+
+// The name a file is found by: lowercase, forward slashes and no leading "./". Windows filenames ignore case and accept
+// either slash, so these are the same file whichever way the name was written
+std::string NormaliseFilename(const std::string& filename);
+
+
+// A pack opened for reading
+class PackFile
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Returned by Find when there is no such entry
+	static const unsigned int NotFound = ~0u;
+
+	PackFile() {}
+
+	// Prevent copying - owns the mapping
+	PackFile(const PackFile&) = delete;
+	PackFile& operator=(const PackFile&) = delete;
+
+
+	// Map a pack and check its index, closing any pack already open. Returns false on failure (missing file, a pack of
+	// another version or a damaged pack)
+	bool Open(const std::string& filename);
+
+	// Unmap the pack, data from it can't be used after this
+	void Close();
+
+
+	// Find an entry by name (normalised here). Returns its index or NotFound
+	unsigned int Find(const std::string& filename);
+
+	unsigned int     NumEntries()                    { return mHeader ? mHeader->numEntries : 0; }
+	const PackEntry& Entry(unsigned int entry)       { return mEntries[entry]; }
+	std::string      Name(unsigned int entry);
+
+	// An entry's data as stored in the pack (compressed or not), in the mapping
+	const uint8_t* StoredData(unsigned int entry)    { return mFile.Data() + mEntries[entry].offset; }
+
+	// Decompress or copy an entry's data into the destination, which must hold Entry(entry).size bytes. Returns false
+	// if the data is damaged
+	bool Read(unsigned int entry, uint8_t* destination);
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	MappedFile        mFile;
+	const PackHeader* mHeader  = nullptr;
+	const PackEntry*  mEntries = nullptr;
+	const char*       mNames   = nullptr;
+};
+
+
+// A file to put in a pack
+struct PackInput
+{
+	std::string name;     // Name the file will be found by (normalised when written)
+	std::string filename; // The file to read
+};
+
+// Write a pack holding the given files. Files are compressed in parallel, and stored uncompressed if compression saves
+// little or they are already compressed. Returns false on failure, with a message in error
+bool WritePackFile(const std::string& packFilename, const std::vector<PackInput>& files, std::string& error);
+
+
+#endif //_PACK_FILE_H_INCLUDED_
@@ -0,0 +1,113 @@
+//--------------------------------------------------------------------------------------
+// Simple worker thread pool to spread CPU-heavy loops over all cores
+//--------------------------------------------------------------------------------------
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+
+// Set on pool worker threads so loops started from inside a loop run inline rather than deadlocking
+static thread_local bool tIsPoolWorker = false;
+
+
+ThreadPool::ThreadPool(unsigned int numThreads /*= 0*/)
+{
+	if (numThreads == 0)  numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	// The calling thread also works on each loop, so start one fewer worker
+	for (unsigned int i = 1; i < numThreads; ++i)
+	{
+		mThreads.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWakeWorkers.notify_all();
+	for (auto& thread : mThreads)  thread.join();
+}
+
+
+// Split the range [0, count) into chunks of (at least) grainSize items and call task(begin, end) for each chunk.
+// The calling thread helps with the work and the function returns when every chunk is complete
+void ThreadPool::ParallelFor(unsigned int count, unsigned int grainSize, const std::function<void(unsigned int, unsigned int)>& task)
+{
+	if (count == 0)  return;
+	if (grainSize == 0)  grainSize = 1;
+
+	// Small loops, nested loops and loops requested while the pool is busy with another thread's work all run inline
+	std::unique_lock<std::mutex> loopLock(mLoopMutex, std::defer_lock);
+	if (mThreads.empty() || count <= grainSize || tIsPoolWorker || !loopLock.try_lock())
+	{
+		task(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mCount = count;
+		mGrainSize = grainSize;
+		mNextItem = 0;
+		mActiveWorkers = static_cast<unsigned int>(mThreads.size());
+		++mLoopId;
+	}
+	mWakeWorkers.notify_all();
+
+	RunChunks();
+
+	// Wait for workers to finish their final chunks before the task (owned by the caller) goes out of scope
+	std::unique_lock<std::mutex> lock(mMutex);
+	mLoopDone.wait(lock, [this] { return mActiveWorkers == 0; });
+	mTask = nullptr;
+}
+
+
+void ThreadPool::WorkerLoop()
+{
+	tIsPoolWorker = true;
+	uint64_t lastLoopId = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWakeWorkers.wait(lock, [&] { return mQuit || mLoopId != lastLoopId; });
+			if (mQuit)  return;
+			lastLoopId = mLoopId;
+		}
+
+		RunChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			--mActiveWorkers;
+		}
+		mLoopDone.notify_one();
+	}
+}
+
+
+// Take chunks from the current loop until there are none left
+void ThreadPool::RunChunks()
+{
+	while (true)
+	{
+		unsigned int begin = mNextItem.fetch_add(mGrainSize);
+		if (begin >= mCount)  return;
+		unsigned int end = std::min(begin + mGrainSize, mCount);
+		(*mTask)(begin, end);
+	}
+}
+
+
+// Global pool shared by the app, created on first use
+ThreadPool& GetThreadPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
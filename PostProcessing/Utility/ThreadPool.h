@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------
+// Simple worker thread pool to spread CPU-heavy loops over all cores
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+
+#ifndef _THREAD_POOL_H_INCLUDED_
+#define _THREAD_POOL_H_INCLUDED_
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+
+// The pool starts its worker threads once and keeps them asleep until there is work. Only one parallel loop runs at a
+// time - if a second loop is requested while the pool is busy (e.g. from a worker thread, or a background loader thread)
+// then it simply runs on the calling thread, so nested calls are safe but not parallel
+class ThreadPool
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Pass 0 to use one thread per hardware core (the calling thread counts as one of them)
+	ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool();
+
+	// Split the range [0, count) into chunks of (at least) grainSize items and call task(begin, end) for each chunk.
+	// The calling thread helps with the work and the function returns when every chunk is complete
+	void ParallelFor(unsigned int count, unsigned int grainSize, const std::function<void(unsigned int, unsigned int)>& task);
+
+	// Number of threads that work on a loop, including the calling thread
+	unsigned int NumThreads()  { return static_cast<unsigned int>(mThreads.size()) + 1; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	void WorkerLoop();
+
+	// Take chunks from the current loop until there are none left
+	void RunChunks();
+
+	std::vector<std::thread> mThreads;
+
+	std::mutex              mLoopMutex; // Held for the duration of a parallel loop, only one loop runs at a time
+	std::mutex              mMutex;     // Protects the loop description below
+	std::condition_variable mWakeWorkers;
+	std::condition_variable mLoopDone;
+
+	// Current loop
+	const std::function<void(unsigned int, unsigned int)>* mTask = nullptr;
+	unsigned int              mCount = 0;
+	unsigned int              mGrainSize = 1;
+	std::atomic<unsigned int> mNextItem{ 0 };
+	unsigned int              mActiveWorkers = 0;
+	uint64_t                  mLoopId = 0;
+	bool                      mQuit = false;
+};
+
+
+// Global pool shared by the app, created on first use
+ThreadPool& GetThreadPool();
+
+// Convenience function to run a parallel loop on the global pool
+inline void ParallelFor(unsigned int count, unsigned int grainSize, const std::function<void(unsigned int, unsigned int)>& task)
+{
+	GetThreadPool().ParallelFor(count, grainSize, task);
+}
+
+
+#endif //_THREAD_POOL_H_INCLUDED_
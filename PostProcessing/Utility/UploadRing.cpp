@@ -0,0 +1,192 @@
+//--------------------------------------------------------------------------------------
+// Staging upload ring - buffer data sent to the GPU a frame's budget at a time
+//--------------------------------------------------------------------------------------
+
+#include "UploadRing.h"
+#include "ThreadPool.h" // Staging memory is filled in parallel
+#include "../Common.h"  // For gD3DDevice / gD3DContext
+
+#include <algorithm>
+#include <cstring>
+
+
+// The ring used for all mesh uploads. 4MB a frame is enough to bring back an evicted mesh in a frame or two
+UploadRing gUploadRing(4 * 1024 * 1024);
+
+// Pieces are placed in the staging buffers at multiples of this, so the copies into staging memory are aligned
+const unsigned int STAGING_ALIGNMENT = 16;
+
+
+
+//--------------------------------------------------------------------------------------
+// Usage
+//--------------------------------------------------------------------------------------
+
+// Queue data to copy into a default usage GPU buffer at a byte offset. The data must stay unchanged until the upload is
+// complete or cancelled. Can be called from any thread. Returns a ticket to check when the upload is complete
+uint64_t UploadRing::Upload(ID3D11Buffer* destination, unsigned int destinationOffset, const void* data, unsigned int size)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	uint64_t ticket = mNextTicket++;
+	if (size == 0)
+	{
+		// Complete as soon as every upload before it is, which is now if nothing is queued (no update would complete it)
+		if (mQueue.empty())  mCompletedTicket = ticket;
+		return ticket;
+	}
+
+	destination->AddRef();
+	mQueue.push_back({ destination, destinationOffset, static_cast<const uint8_t*>(data), size, ticket });
+	return ticket;
+}
+
+
+// Remove queued uploads into a buffer, call before releasing the buffer or the data being uploaded into it
+void UploadRing::Cancel(ID3D11Buffer* destination)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto cancelled = std::remove_if(mQueue.begin(), mQueue.end(), [destination](const PendingUpload& upload)
+	{
+		return upload.destination == destination;
+	});
+	for (auto upload = cancelled; upload != mQueue.end(); ++upload)  upload->destination->Release();
+	mQueue.erase(cancelled, mQueue.end());
+
+	// Uploads before the first still queued have all been issued or cancelled
+	mCompletedTicket = mQueue.empty() ? mNextTicket - 1 : mQueue.front().ticket - 1;
+}
+
+
+// Copy up to a frame's budget of queued uploads into the next staging buffer and issue the GPU copies. Call once a
+// frame from the main thread, before drawing. Does nothing this frame if the GPU is still using the staging buffer
+void UploadRing::Update()
+{
+	mBytesLastUpdate = 0;
+	UploadNext(false);
+}
+
+
+// Upload everything queued now, ignoring the budget and waiting for the GPU if needed. For use while loading
+void UploadRing::Flush()
+{
+	while (UploadNext(true)) {}
+}
+
+
+// Release GPU resources and cancel all queued uploads (the staging buffers will be recreated on the next update)
+void UploadRing::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (auto& upload : mQueue)  upload.destination->Release();
+		mQueue.clear();
+		mCompletedTicket = mNextTicket - 1;
+	}
+
+	for (auto& stagingBuffer : mStagingBuffers)
+	{
+		if (stagingBuffer)  stagingBuffer->Release();
+		stagingBuffer = nullptr;
+	}
+	mNextStagingBuffer = 0;
+}
+
+
+// Bytes still queued
+uint64_t UploadRing::PendingBytes()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	uint64_t bytes = 0;
+	for (auto& upload : mQueue)  bytes += upload.size;
+	return bytes;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Private members
+//--------------------------------------------------------------------------------------
+
+// Copy up to a frame's budget of queued uploads through the next staging buffer, optionally waiting for the GPU to
+// finish with it. Returns false if nothing could be uploaded
+bool UploadRing::UploadNext(bool wait)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mQueue.empty())  return false;
+	}
+
+	// Staging buffers can only be copied from by the GPU and written by the CPU, they live in CPU memory
+	ID3D11Buffer*& stagingBuffer = mStagingBuffers[mNextStagingBuffer];
+	if (stagingBuffer == nullptr)
+	{
+		D3D11_BUFFER_DESC bufferDesc = {};
+		bufferDesc.ByteWidth      = mBytesPerFrame;
+		bufferDesc.Usage          = D3D11_USAGE_STAGING;
+		bufferDesc.BindFlags      = 0;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		if (FAILED(gD3DDevice->CreateBuffer(&bufferDesc, nullptr, &stagingBuffer)))  return false;
+	}
+
+	// The GPU may still be copying from this staging buffer, from NumStagingBuffers updates ago. Unless asked to wait,
+	// try again next frame rather than stall
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(gD3DContext->Map(stagingBuffer, 0, D3D11_MAP_WRITE, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped)))  return false;
+	uint8_t* staging = static_cast<uint8_t*>(mapped.pData);
+
+	// Take pieces of the oldest uploads until the staging buffer is full. An upload that doesn't fit is split, the rest of
+	// it stays at the front of the queue for the next update
+	mPieces.clear();
+	unsigned int stagingOffset = 0;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		while (!mQueue.empty() && stagingOffset < mBytesPerFrame)
+		{
+			PendingUpload& upload = mQueue.front();
+			unsigned int size = std::min(upload.size, mBytesPerFrame - stagingOffset);
+			bool last = (size == upload.size);
+			mPieces.push_back({ upload.destination, upload.destinationOffset, upload.data, size, stagingOffset, last });
+			stagingOffset = (stagingOffset + size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+			if (last)
+			{
+				mQueue.pop_front();
+			}
+			else
+			{
+				upload.destinationOffset += size;
+				upload.data += size;
+				upload.size -= size;
+			}
+		}
+	}
+
+	// Worker threads copy the data straight into the mapped staging memory, a piece at a time
+	ParallelFor(static_cast<unsigned int>(mPieces.size()), 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int p = begin; p < end; ++p)
+		{
+			const Piece& piece = mPieces[p];
+			std::memcpy(staging + piece.stagingOffset, piece.data, piece.size);
+		}
+	});
+	gD3DContext->Unmap(stagingBuffer, 0);
+
+	// The GPU copies each piece from the staging buffer into its destination. Draws issued after this see the data
+	for (auto& piece : mPieces)
+	{
+		D3D11_BOX box = { piece.stagingOffset, 0, 0, piece.stagingOffset + piece.size, 1, 1 };
+		gD3DContext->CopySubresourceRegion(piece.destination, 0, piece.destinationOffset, 0, 0, stagingBuffer, 0, &box);
+		if (piece.last)  piece.destination->Release();
+		mBytesLastUpdate += piece.size;
+	}
+
+	// Uploads before the first still queued are now complete. Found after the copies are issued, and under the lock so
+	// it includes any empty uploads queued meanwhile (they completed themselves, and must not be moved back)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mCompletedTicket = mQueue.empty() ? mNextTicket - 1 : mQueue.front().ticket - 1;
+	}
+
+	mNextStagingBuffer = (mNextStagingBuffer + 1) % NumStagingBuffers;
+	return true;
+}
@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// Staging upload ring - buffer data sent to the GPU a frame's budget at a time
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Creating a buffer with initial data makes DirectX copy the data into its own upload memory before it reaches the GPU,
+// all in one go however large it is. Instead, buffers are created empty in default (GPU) memory and their data is
+// queued here. Each frame the ring maps its next staging buffer, copies up to a fixed budget of queued data into it,
+// then has the GPU copy each piece into its destination with CopySubresourceRegion. Large uploads are split over
+// several frames, so loading a mesh during gameplay can't cause a long frame.
+//
+// - There are several staging buffers used in turn, so the CPU fills one while the GPU is still copying from the ones
+//   before. If the GPU hasn't finished with the next one, uploads wait a frame rather than stall
+// - The copies into mapped staging memory are spread over the thread pool, so worker threads write the staging memory
+//   directly. The GPU copies must be issued from the main thread, which owns the device context
+// - Queued data isn't copied when queued, it must stay unchanged until the upload is complete or cancelled. Meshes
+//   upload from the CPU-side copy they keep anyway (see Mesh.h). Textures don't use the ring: DirectX 11 can't copy
+//   from a buffer into a texture, and texture files are already passed to DirectX straight from a memory mapping
+
+#ifndef _UPLOAD_RING_H_INCLUDED_
+#define _UPLOAD_RING_H_INCLUDED_
+
+#include <d3d11.h>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+
+class UploadRing
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+	// Number of staging buffers used in turn
+	static const unsigned int NumStagingBuffers = 3;
+
+	// Pass the most bytes to upload each frame, which is also the size of each staging buffer
+	// The staging buffers are created on the first update so a ring can be declared before DirectX is set up
+	UploadRing(unsigned int bytesPerFrame) : mBytesPerFrame(bytesPerFrame) {}
+	~UploadRing()  { Release(); }
+
+	// Prevent copying - owns GPU resources
+	UploadRing(const UploadRing&) = delete;
+	UploadRing& operator=(const UploadRing&) = delete;
+
+
+	// Queue data to copy into a default usage GPU buffer at a byte offset. The data must stay unchanged until the upload
+	// is complete or cancelled. Can be called from any thread. Returns a ticket to check when the upload is complete
+	uint64_t Upload(ID3D11Buffer* destination, unsigned int destinationOffset, const void* data, unsigned int size);
+
+	// Whether the GPU copy for an upload has been issued, so draws using the destination buffer will see the data
+	bool IsComplete(uint64_t ticket)  { return ticket <= mCompletedTicket; }
+
+	// Remove queued uploads into a buffer, call before releasing the buffer or the data being uploaded into it
+	void Cancel(ID3D11Buffer* destination);
+
+	// Copy up to a frame's budget of queued uploads into the next staging buffer and issue the GPU copies. Call once a
+	// frame from the main thread, before drawing. Does nothing this frame if the GPU is still using the staging buffer
+	void Update();
+
+	// Upload everything queued now, ignoring the budget and waiting for the GPU if needed. For use while loading
+	void Flush();
+
+	// Release GPU resources and cancel all queued uploads (the staging buffers will be recreated on the next update)
+	void Release();
+
+
+	// Statistics: bytes uploaded in the last update and bytes still queued
+	unsigned int BytesLastUpdate()  { return mBytesLastUpdate; }
+	uint64_t     PendingBytes();
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	struct PendingUpload
+	{
+		ID3D11Buffer*  destination; // Holds a reference until the upload is complete or cancelled
+		unsigned int   destinationOffset;
+		const uint8_t* data;
+		unsigned int   size;
+		uint64_t       ticket;
+	};
+
+	// Part of an upload copied through a staging buffer
+	struct Piece
+	{
+		ID3D11Buffer*  destination;
+		unsigned int   destinationOffset;
+		const uint8_t* data;
+		unsigned int   size;
+		unsigned int   stagingOffset;
+		bool           last; // Last piece of its upload, releases the reference to the destination
+	};
+
+	// Copy up to a frame's budget of queued uploads through the next staging buffer, optionally waiting for the GPU to
+	// finish with it. Returns false if nothing could be uploaded
+	bool UploadNext(bool wait);
+
+
+	unsigned int  mBytesPerFrame;
+	ID3D11Buffer* mStagingBuffers[NumStagingBuffers] = {};
+	unsigned int  mNextStagingBuffer = 0;
+
+	std::mutex                mMutex;  // Protects the queue and ticket count, uploads can be queued from any thread
+	std::deque<PendingUpload> mQueue;  // Oldest first, the first may be partly uploaded
+	uint64_t                  mNextTicket = 1;
+	std::atomic<uint64_t>     mCompletedTicket{ 0 }; // Every upload up to this ticket is complete
+
+	std::vector<Piece> mPieces; // Pieces for the current update, kept to avoid reallocating
+
+	unsigned int mBytesLastUpdate = 0;
+};
+
+
+// The ring used for all mesh uploads
+extern UploadRing gUploadRing;
+
+
+#endif //_UPLOAD_RING_H_INCLUDED_
@@ -0,0 +1,970 @@
+//--------------------------------------------------------------------------------------
+// DirectX .x file parser - reads .x meshes without assimp
+//--------------------------------------------------------------------------------------
+
+#include "XFileParser.h"
+#include "ThreadPool.h" // Meshes are read in parallel
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+
+// Normals are generated for meshes without them, smoothing between faces less than this angle apart (as assimp is
+// asked to in MeshImport.cpp)
+const float SMOOTHING_ANGLE = 80.0f;
+
+// Vertices keep their strongest bone weights up to this limit, and sub-meshes can have up to this many bones (bone
+// indexes are stored in a byte)
+const unsigned int MAX_BONES_PER_VERTEX = 4;
+const unsigned int MAX_BONES_PER_MESH = 256;
+
+// Marks a top-level frame while reading
+const unsigned int NO_PARENT = ~0u;
+
+// Token types in binary files (only those the parser needs to tell apart). Any other token is a single 16-bit value
+const uint16_t TOKEN_NAME         = 1;
+const uint16_t TOKEN_STRING       = 2;
+const uint16_t TOKEN_INTEGER      = 3;
+const uint16_t TOKEN_GUID         = 5;
+const uint16_t TOKEN_INTEGER_LIST = 6;
+const uint16_t TOKEN_FLOAT_LIST   = 7;
+const uint16_t TOKEN_OPEN_BRACE   = 10;
+const uint16_t TOKEN_CLOSE_BRACE  = 11;
+const uint16_t TOKEN_COMMA        = 19;
+const uint16_t TOKEN_SEMICOLON    = 20;
+const uint16_t TOKEN_TEMPLATE     = 31;
+
+// Exact powers of ten for the float reader, larger powers can't be held exactly by a double
+const double POWERS_OF_10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+
+//--------------------------------------------------------------------------------------
+// Reading tokens and values
+//--------------------------------------------------------------------------------------
+
+// Problems found while reading are thrown as exceptions, caught in ParseXFile
+static void Fail(const std::string& message)
+{
+	throw std::runtime_error(message);
+}
+
+
+// Reads the structure (names, braces) and data values of a .x file, in either text or binary format. Several readers
+// can read different parts of the same file at once
+class XFileReader
+{
+public:
+	enum class Token
+	{
+		End,        // End of file
+		Name,       // Template name, object name or (text files) a data value
+		String,
+		OpenBrace,
+		CloseBrace,
+		Other,      // GUIDs and data values, separators and keywords in binary files
+	};
+
+	// Read from the given position up to the end of the file data
+	XFileReader(const uint8_t* position, const uint8_t* end, bool binary, bool doubles)
+		: mPosition(position), mEnd(end), mBinary(binary), mDoubles(doubles) {}
+
+	const uint8_t* Position()  { return mPosition; }
+
+
+	// Read the next part of the structure, skipping any data values not yet read. Names and strings are returned in text
+	Token NextToken(std::string* text = nullptr)
+	{
+		return mBinary ? NextBinaryToken(text) : NextTextToken(text);
+	}
+
+	// Skip to the end of the current object, including any objects inside it
+	void SkipObject()
+	{
+		if (mBinary)
+		{
+			int depth = 1;
+			while (depth > 0)
+			{
+				Token token = NextBinaryToken(nullptr);
+				if      (token == Token::OpenBrace)  ++depth;
+				else if (token == Token::CloseBrace) --depth;
+				else if (token == Token::End)        Fail("Unexpected end of file");
+			}
+			return;
+		}
+
+		// Text objects are skipped a character at a time, only braces, strings and comments matter
+		int depth = 1;
+		while (mPosition < mEnd)
+		{
+			char c = static_cast<char>(*mPosition++);
+			if (c == '{')
+			{
+				++depth;
+			}
+			else if (c == '}')
+			{
+				if (--depth == 0)  return;
+			}
+			else if (c == '"')
+			{
+				while (mPosition < mEnd && *mPosition != '"')  ++mPosition;
+				if (mPosition < mEnd)  ++mPosition;
+			}
+			else if (c == '#' || (c == '/' && mPosition < mEnd && *mPosition == '/'))
+			{
+				while (mPosition < mEnd && *mPosition != '\n')  ++mPosition;
+			}
+		}
+		Fail("Unexpected end of file");
+	}
+
+
+	// Read a count of items that follow, checking the file is big enough to hold them (so a damaged count can't ask for
+	// a huge allocation)
+	uint32_t ReadCount()
+	{
+		uint32_t count = ReadInt();
+		if (count > static_cast<size_t>(mEnd - mPosition))  Fail("Item count larger than the file");
+		return count;
+	}
+
+	uint32_t ReadInt()
+	{
+		if (mBinary)
+		{
+			if (mNumInts == 0 && mNumFloats == 0)  NextBinaryList();
+			if (mNumInts > 0)
+			{
+				--mNumInts;
+				return ReadBinary<uint32_t>();
+			}
+			return static_cast<uint32_t>(ReadBinaryFloat());
+		}
+
+		SkipTextSpace();
+		bool negative = false;
+		if (mPosition < mEnd && (*mPosition == '-' || *mPosition == '+'))  negative = (*mPosition++ == '-');
+		if (mPosition == mEnd || !IsDigit(*mPosition))  Fail("Expected an integer");
+		uint32_t value = 0;
+		while (mPosition < mEnd && IsDigit(*mPosition))  value = value * 10 + (*mPosition++ - '0');
+		return negative ? 0u - value : value;
+	}
+
+	float ReadFloat()
+	{
+		if (mBinary)
+		{
+			if (mNumInts == 0 && mNumFloats == 0)  NextBinaryList();
+			if (mNumFloats > 0)  return ReadBinaryFloat();
+			--mNumInts;
+			return static_cast<float>(static_cast<int32_t>(ReadBinary<uint32_t>()));
+		}
+
+		// The digits are gathered into a 64-bit integer then scaled by an exact power of ten in double precision, which
+		// gives the nearest float for all the values found in real files. Digits beyond the 19 that fit are ignored
+		SkipTextSpace();
+		bool negative = false;
+		if (mPosition < mEnd && (*mPosition == '-' || *mPosition == '+'))  negative = (*mPosition++ == '-');
+
+		uint64_t mantissa = 0;
+		int numDigits = 0;
+		int exponent = 0;
+		bool anyDigits = false;
+		while (mPosition < mEnd && IsDigit(*mPosition))
+		{
+			if (numDigits < 19)
+			{
+				mantissa = mantissa * 10 + (*mPosition - '0');
+				if (mantissa > 0)  ++numDigits;
+			}
+			else
+			{
+				++exponent;
+			}
+			++mPosition;
+			anyDigits = true;
+		}
+		if (mPosition < mEnd && *mPosition == '.')
+		{
+			++mPosition;
+			while (mPosition < mEnd && IsDigit(*mPosition))
+			{
+				if (numDigits < 19)
+				{
+					mantissa = mantissa * 10 + (*mPosition - '0');
+					if (mantissa > 0)  ++numDigits;
+					--exponent;
+				}
+				++mPosition;
+				anyDigits = true;
+			}
+		}
+		if (!anyDigits)  Fail("Expected a number");
+		if (mPosition < mEnd && (*mPosition == 'e' || *mPosition == 'E'))
+		{
+			++mPosition;
+			bool negativeExponent = false;
+			if (mPosition < mEnd && (*mPosition == '-' || *mPosition == '+'))  negativeExponent = (*mPosition++ == '-');
+			int value = 0;
+			while (mPosition < mEnd && IsDigit(*mPosition))
+			{
+				if (value < 10000)  value = value * 10 + (*mPosition - '0');
+				++mPosition;
+			}
+			exponent += negativeExponent ? -value : value;
+		}
+
+		double result = static_cast<double>(mantissa);
+		if (mantissa != 0 && exponent != 0)
+		{
+			if      (exponent < 0 && exponent >= -22)  result /= POWERS_OF_10[-exponent];
+			else if (exponent > 0 && exponent <=  22)  result *= POWERS_OF_10[exponent];
+			else                                       result *= std::pow(10.0, exponent);
+		}
+		return static_cast<float>(negative ? -result : result);
+	}
+
+	std::string ReadString()
+	{
+		std::string text;
+		Token token = NextToken(&text);
+		if (token != Token::String && token != Token::Name)  Fail("Expected a string");
+		return text;
+	}
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+	static bool IsDigit(uint8_t c)  { return c >= '0' && c <= '9'; }
+
+	// Text files separate values with commas and semicolons, which are treated like spaces. That accepts slightly more
+	// than the format allows, which helps with files from exporters that don't follow it exactly
+	void SkipTextSpace()
+	{
+		while (mPosition < mEnd)
+		{
+			uint8_t c = *mPosition;
+			if (c <= ' ' || c == ',' || c == ';')
+			{
+				++mPosition;
+			}
+			else if (c == '#' || (c == '/' && mPosition + 1 < mEnd && mPosition[1] == '/'))
+			{
+				while (mPosition < mEnd && *mPosition != '\n')  ++mPosition;
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	Token NextTextToken(std::string* text)
+	{
+		SkipTextSpace();
+		if (mPosition == mEnd)  return Token::End;
+
+		uint8_t c = *mPosition;
+		if (c == '{')
+		{
+			++mPosition;
+			return Token::OpenBrace;
+		}
+		if (c == '}')
+		{
+			++mPosition;
+			return Token::CloseBrace;
+		}
+		if (c == '"')
+		{
+			const uint8_t* start = ++mPosition;
+			while (mPosition < mEnd && *mPosition != '"')  ++mPosition;
+			if (mPosition == mEnd)  Fail("Unterminated string");
+			if (text)  text->assign(reinterpret_cast<const char*>(start), mPosition - start);
+			++mPosition;
+			return Token::String;
+		}
+		if (c == '<')
+		{
+			while (mPosition < mEnd && *mPosition != '>')  ++mPosition;
+			if (mPosition == mEnd)  Fail("Unterminated GUID");
+			++mPosition;
+			return Token::Other;
+		}
+
+		const uint8_t* start = mPosition;
+		while (mPosition < mEnd)
+		{
+			c = *mPosition;
+			if (c <= ' ' || c == '{' || c == '}' || c == '"' || c == ',' || c == ';' || c == '<' || c == '#')  break;
+			++mPosition;
+		}
+		if (text)  text->assign(reinterpret_cast<const char*>(start), mPosition - start);
+		return Token::Name;
+	}
+
+
+	// Binary values are little-endian and not aligned
+	template <typename T> T ReadBinary()
+	{
+		if (static_cast<size_t>(mEnd - mPosition) < sizeof(T))  Fail("Unexpected end of file");
+		T value;
+		std::memcpy(&value, mPosition, sizeof(T));
+		mPosition += sizeof(T);
+		return value;
+	}
+
+	void SkipBinary(uint64_t size)
+	{
+		if (static_cast<uint64_t>(mEnd - mPosition) < size)  Fail("Unexpected end of file");
+		mPosition += size;
+	}
+
+	float ReadBinaryFloat()
+	{
+		--mNumFloats;
+		return mDoubles ? static_cast<float>(ReadBinary<double>()) : ReadBinary<float>();
+	}
+
+	// Move to the next list of numbers, skipping separators. Single integers are read as a list of one
+	void NextBinaryList()
+	{
+		for (;;)
+		{
+			uint16_t token = ReadBinary<uint16_t>();
+			if (token == TOKEN_COMMA || token == TOKEN_SEMICOLON)  continue;
+
+			if      (token == TOKEN_INTEGER)       mNumInts = 1;
+			else if (token == TOKEN_INTEGER_LIST)  mNumInts = ReadBinary<uint32_t>();
+			else if (token == TOKEN_FLOAT_LIST)    mNumFloats = ReadBinary<uint32_t>();
+			else                                   Fail("Expected a number");
+			if (mNumInts > 0 || mNumFloats > 0)  return;
+		}
+	}
+
+	Token NextBinaryToken(std::string* text)
+	{
+		// Skip any values left in the current list
+		SkipBinary(static_cast<uint64_t>(mNumInts) * 4 + static_cast<uint64_t>(mNumFloats) * (mDoubles ? 8 : 4));
+		mNumInts = mNumFloats = 0;
+
+		if (static_cast<size_t>(mEnd - mPosition) < 2)  return Token::End;
+		uint16_t token = ReadBinary<uint16_t>();
+		switch (token)
+		{
+		case TOKEN_NAME:
+		case TOKEN_STRING:
+		{
+			uint32_t length = ReadBinary<uint32_t>();
+			const uint8_t* start = mPosition;
+			SkipBinary(length);
+			if (text)  text->assign(reinterpret_cast<const char*>(start), length);
+			if (token == TOKEN_NAME)  return Token::Name;
+			ReadBinary<uint16_t>(); // Strings end with a separator token
+			return Token::String;
+		}
+		case TOKEN_INTEGER:       SkipBinary(4);  return Token::Other;
+		case TOKEN_GUID:          SkipBinary(16); return Token::Other;
+		case TOKEN_INTEGER_LIST:  SkipBinary(static_cast<uint64_t>(ReadBinary<uint32_t>()) * 4); return Token::Other;
+		case TOKEN_FLOAT_LIST:    SkipBinary(static_cast<uint64_t>(ReadBinary<uint32_t>()) * (mDoubles ? 8 : 4)); return Token::Other;
+		case TOKEN_OPEN_BRACE:    return Token::OpenBrace;
+		case TOKEN_CLOSE_BRACE:   return Token::CloseBrace;
+		case TOKEN_TEMPLATE:
+			if (text)  *text = "template";
+			return Token::Name;
+		default:
+			return Token::Other;
+		}
+	}
+
+	const uint8_t* mPosition;
+	const uint8_t* mEnd;
+	bool           mBinary;
+	bool           mDoubles; // Binary files only, whether floats are 64-bit
+
+	// Binary files store numbers in lists, these are the values left to read from the current list
+	uint32_t mNumInts = 0;
+	uint32_t mNumFloats = 0;
+};
+
+
+// Read the rest of an object's header after its template name, up to the opening brace. The object's name is optional,
+// returns an empty string if it has none
+static std::string ReadObjectHeader(XFileReader& reader)
+{
+	std::string name, text;
+	for (;;)
+	{
+		XFileReader::Token token = reader.NextToken(&text);
+		if      (token == XFileReader::Token::OpenBrace)                 return name;
+		else if (token == XFileReader::Token::Name && name.empty())      name = text;
+		else if (token != XFileReader::Token::Other)                     Fail("Expected an object");
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reading meshes
+//--------------------------------------------------------------------------------------
+
+// A mesh as stored in the file. Faces can have any number of corners, and each corner refers to a position and a normal
+// separately. UVs and skin weights belong to positions
+struct XFileMesh
+{
+	std::vector<CVector3> positions;
+	std::vector<uint32_t> faceSizes;     // Number of corners in each face
+	std::vector<uint32_t> faceIndices;   // Position for each corner, all faces one after another
+	std::vector<CVector3> normals;
+	std::vector<uint32_t> normalIndices; // Normal for each corner, laid out as faceIndices. Empty if there are no normals
+	std::vector<CVector2> uvs;           // One for each position, empty if there are none
+	std::vector<ImportedBone> bones;     // Vertex indexes are positions until the vertices are built
+};
+
+
+// Read the contents of a Mesh object, the reader must be just after its opening brace
+static void ReadMesh(XFileReader& reader, XFileMesh& mesh)
+{
+	uint32_t numPositions = reader.ReadCount();
+	mesh.positions.resize(numPositions);
+	for (auto& position : mesh.positions)
+	{
+		position.x = reader.ReadFloat();
+		position.y = reader.ReadFloat();
+		position.z = reader.ReadFloat();
+	}
+
+	uint32_t numFaces = reader.ReadCount();
+	mesh.faceSizes.resize(numFaces);
+	mesh.faceIndices.reserve(numFaces * 3);
+	for (auto& faceSize : mesh.faceSizes)
+	{
+		faceSize = reader.ReadCount();
+		for (uint32_t i = 0; i < faceSize; ++i)  mesh.faceIndices.push_back(reader.ReadInt());
+	}
+
+	// Objects inside the mesh, until its closing brace
+	std::string text;
+	for (;;)
+	{
+		XFileReader::Token token = reader.NextToken(&text);
+		if (token == XFileReader::Token::CloseBrace)  return;
+		if (token == XFileReader::Token::End)         Fail("Unexpected end of file");
+		if (token == XFileReader::Token::OpenBrace)
+		{
+			reader.SkipObject(); // Reference to an object elsewhere
+			continue;
+		}
+		if (token != XFileReader::Token::Name)  continue;
+
+		std::string objectName = ReadObjectHeader(reader);
+		if (text == "MeshNormals")
+		{
+			// Normals have their own faces, which must match the mesh's faces
+			mesh.normals.resize(reader.ReadCount());
+			for (auto& normal : mesh.normals)
+			{
+				normal.x = reader.ReadFloat();
+				normal.y = reader.ReadFloat();
+				normal.z = reader.ReadFloat();
+			}
+			if (reader.ReadInt() != numFaces)  Fail("Normal faces don't match mesh faces");
+			mesh.normalIndices.resize(mesh.faceIndices.size());
+			uint32_t* index = mesh.normalIndices.data();
+			for (uint32_t faceSize : mesh.faceSizes)
+			{
+				if (reader.ReadInt() != faceSize)  Fail("Normal faces don't match mesh faces");
+				for (uint32_t i = 0; i < faceSize; ++i)  *index++ = reader.ReadInt();
+			}
+		}
+		else if (text == "MeshTextureCoords")
+		{
+			if (reader.ReadInt() != numPositions)  Fail("Texture coordinate count doesn't match position count");
+			mesh.uvs.resize(numPositions);
+			for (auto& uv : mesh.uvs)
+			{
+				uv.x = reader.ReadFloat();
+				uv.y = reader.ReadFloat();
+			}
+		}
+		else if (text == "SkinWeights")
+		{
+			mesh.bones.emplace_back();
+			ImportedBone& bone = mesh.bones.back();
+			bone.name = reader.ReadString();
+			bone.vertices.resize(reader.ReadCount());
+			bone.weights.resize(bone.vertices.size());
+			for (auto& vertex : bone.vertices)
+			{
+				vertex = reader.ReadInt();
+				if (vertex >= numPositions)  Fail("Skin weight for a position that doesn't exist");
+			}
+			for (auto& weight : bone.weights)  weight = reader.ReadFloat();
+			float* matrix = &bone.offsetMatrix.e00;
+			for (int i = 0; i < 16; ++i)  matrix[i] = reader.ReadFloat();
+		}
+		reader.SkipObject(); // Anything else in the object, and objects the parser doesn't use
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Building sub-meshes
+//--------------------------------------------------------------------------------------
+
+// Unit length normal, or zero for a zero length vector. Doesn't use Normalise, which treats the short normals of small
+// triangles as zero
+static CVector3 UnitVector(const CVector3& v)
+{
+	float length = std::sqrt(Dot(v, v));
+	return (length > 0) ? v * (1.0f / length) : CVector3{ 0, 0, 0 };
+}
+
+
+// Calculate a normal for each corner of a triangle list, averaging the normals of the triangles sharing the corner's
+// position that face less than the smoothing angle away from the corner's own triangle
+static std::vector<CVector3> GenerateNormals(const std::vector<CVector3>& cornerPositions)
+{
+	unsigned int numCorners = static_cast<unsigned int>(cornerPositions.size());
+	unsigned int numTriangles = numCorners / 3;
+	std::vector<CVector3> triangleNormals(numTriangles);
+	for (unsigned int t = 0; t < numTriangles; ++t)
+	{
+		const CVector3* p = &cornerPositions[t * 3];
+		triangleNormals[t] = UnitVector(Cross(p[1] - p[0], p[2] - p[0]));
+	}
+
+	// Group the corners at each position: sort corner numbers by position
+	std::vector<uint32_t> order(numCorners);
+	for (uint32_t c = 0; c < numCorners; ++c)  order[c] = c;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		return std::memcmp(&cornerPositions[a], &cornerPositions[b], sizeof(CVector3)) < 0;
+	});
+
+	const float minDot = std::cos(ToRadians(SMOOTHING_ANGLE));
+	std::vector<CVector3> normals(numCorners);
+	for (unsigned int groupStart = 0; groupStart < numCorners; )
+	{
+		unsigned int groupEnd = groupStart + 1;
+		while (groupEnd < numCorners &&
+		       std::memcmp(&cornerPositions[order[groupStart]], &cornerPositions[order[groupEnd]], sizeof(CVector3)) == 0)  ++groupEnd;
+
+		for (unsigned int i = groupStart; i < groupEnd; ++i)
+		{
+			const CVector3& ownNormal = triangleNormals[order[i] / 3];
+			CVector3 sum{ 0, 0, 0 };
+			for (unsigned int j = groupStart; j < groupEnd; ++j)
+			{
+				const CVector3& otherNormal = triangleNormals[order[j] / 3];
+				if (Dot(ownNormal, otherNormal) >= minDot)  sum += otherNormal;
+			}
+			normals[order[i]] = UnitVector(sum);
+		}
+		groupStart = groupEnd;
+	}
+	return normals;
+}
+
+
+// Calculate tangents for a sub-mesh's vertices from the direction of increasing U across each triangle, averaged over
+// the triangles using each vertex and made perpendicular to the normal
+static void CalculateTangents(ImportedSubMesh& subMesh)
+{
+	subMesh.tangents.assign(subMesh.positions.size(), CVector3{ 0, 0, 0 });
+	for (size_t i = 0; i < subMesh.indices.size(); i += 3)
+	{
+		uint32_t v0 = subMesh.indices[i], v1 = subMesh.indices[i + 1], v2 = subMesh.indices[i + 2];
+		CVector3 edge1 = subMesh.positions[v1] - subMesh.positions[v0];
+		CVector3 edge2 = subMesh.positions[v2] - subMesh.positions[v0];
+		float du1 = subMesh.uvs[v1].x - subMesh.uvs[v0].x, dv1 = subMesh.uvs[v1].y - subMesh.uvs[v0].y;
+		float du2 = subMesh.uvs[v2].x - subMesh.uvs[v0].x, dv2 = subMesh.uvs[v2].y - subMesh.uvs[v0].y;
+		float determinant = du1 * dv2 - du2 * dv1;
+		if (determinant == 0)  continue; // UVs don't span the triangle
+
+		CVector3 tangent = UnitVector((edge1 * dv2 - edge2 * dv1) * (1.0f / determinant));
+		subMesh.tangents[v0] += tangent;
+		subMesh.tangents[v1] += tangent;
+		subMesh.tangents[v2] += tangent;
+	}
+
+	for (size_t v = 0; v < subMesh.tangents.size(); ++v)
+	{
+		// If the triangles' tangents cancel out, or lie along the normal, what remains is mostly rounding error
+		const CVector3& normal = subMesh.normals[v];
+		const CVector3& sum = subMesh.tangents[v];
+		CVector3 tangent = sum - normal * Dot(normal, sum);
+		if (Dot(tangent, tangent) > 1e-6f * Dot(sum, sum))
+		{
+			tangent = UnitVector(tangent);
+		}
+		else
+		{
+			// No UV direction here, any direction perpendicular to the normal will do
+			CVector3 axis = (std::abs(normal.x) < 0.9f) ? CVector3{ 1, 0, 0 } : CVector3{ 0, 1, 0 };
+			tangent = UnitVector(Cross(normal, axis));
+		}
+		subMesh.tangents[v] = tangent;
+	}
+}
+
+
+// The data that makes a vertex unique, used to join identical corners of the triangles into one vertex
+struct VertexKey
+{
+	CVector3 position;
+	CVector3 normal;
+	CVector2 uv;
+	uint32_t source; // Position from the file (skinned meshes only)
+};
+static_assert(sizeof(VertexKey) == 9 * 4, "Vertex keys are hashed and compared as raw bytes so must have no padding");
+
+// Hash a vertex a word at a time, which is much quicker than hashing its bytes (see Hash.h) and spreads as well for this
+static uint32_t HashVertexKey(const VertexKey& key)
+{
+	uint32_t words[sizeof(VertexKey) / 4];
+	std::memcpy(words, &key, sizeof(VertexKey));
+	uint32_t hash = 0;
+	for (uint32_t word : words)  hash = (hash ^ word) * 0x9E3779B1u;
+	return hash ^ (hash >> 15);
+}
+
+
+// Turn a mesh read from the file into a sub-mesh: triangles with one index for each vertex, with the vertices' bone
+// weights limited
+static void BuildSubMesh(XFileMesh& mesh, bool requireTangents, ImportedSubMesh& subMesh)
+{
+	uint32_t numPositions = static_cast<uint32_t>(mesh.positions.size());
+	uint32_t numNormals   = static_cast<uint32_t>(mesh.normals.size());
+	const bool hasNormals = !mesh.normalIndices.empty();
+	const bool hasUVs     = !mesh.uvs.empty();
+	const bool hasBones   = !mesh.bones.empty();
+	if (mesh.bones.size() > MAX_BONES_PER_MESH)  Fail("Too many bones in mesh");
+	if (requireTangents && !hasUVs)  Fail("No texture coordinates to calculate tangents from");
+
+	// Split faces into triangle fans, leaving out points and lines, and triangles with two corners in the same place.
+	// The position and normal of each corner of the triangles is kept
+	std::vector<uint32_t> cornerPositionIndices, cornerNormalIndices;
+	std::vector<CVector3> cornerPositions;
+	cornerPositionIndices.reserve(mesh.faceIndices.size() * 2);
+	const uint32_t* face = mesh.faceIndices.data();
+	const uint32_t* faceNormals = mesh.normalIndices.data();
+	for (uint32_t faceSize : mesh.faceSizes)
+	{
+		for (uint32_t i = 0; i < faceSize; ++i)
+		{
+			if (face[i] >= numPositions)  Fail("Face uses a position that doesn't exist");
+			if (hasNormals && faceNormals[i] >= numNormals)  Fail("Face uses a normal that doesn't exist");
+		}
+
+		for (uint32_t i = 2; i < faceSize; ++i)
+		{
+			const uint32_t corners[3] = { 0, i - 1, i };
+			const CVector3& p0 = mesh.positions[face[0]];
+			const CVector3& p1 = mesh.positions[face[i - 1]];
+			const CVector3& p2 = mesh.positions[face[i]];
+			if (std::memcmp(&p0, &p1, sizeof(CVector3)) == 0 || std::memcmp(&p1, &p2, sizeof(CVector3)) == 0 ||
+			    std::memcmp(&p2, &p0, sizeof(CVector3)) == 0)  continue;
+
+			for (uint32_t corner : corners)
+			{
+				cornerPositionIndices.push_back(face[corner]);
+				cornerPositions.push_back(mesh.positions[face[corner]]);
+				if (hasNormals)  cornerNormalIndices.push_back(faceNormals[corner]);
+			}
+		}
+		face += faceSize;
+		if (hasNormals)  faceNormals += faceSize;
+	}
+	uint32_t numCorners = static_cast<uint32_t>(cornerPositionIndices.size());
+
+	std::vector<CVector3> generatedNormals;
+	if (!hasNormals)  generatedNormals = GenerateNormals(cornerPositions);
+
+
+	// Join corners with identical vertex data into one vertex, using a hash table of vertex numbers (plus one, zero is an
+	// empty slot). Corners with different skin weights must stay apart, so in skinned meshes corners are only joined if
+	// they use the same position from the file
+	uint32_t tableSize = 16;
+	while (tableSize < numCorners * 2)  tableSize *= 2;
+	std::vector<uint32_t> table(tableSize, 0);
+	std::vector<VertexKey> vertices;
+	vertices.reserve(numCorners / 2);
+	subMesh.indices.resize(numCorners);
+	for (uint32_t c = 0; c < numCorners; ++c)
+	{
+		// Every member is set, even those the mesh doesn't use, as keys are hashed and compared as raw bytes. The vector
+		// constructors leave their values uninitialised
+		VertexKey key;
+		key.position = cornerPositions[c];
+		key.normal   = hasNormals ? mesh.normals[cornerNormalIndices[c]] : generatedNormals[c];
+		key.uv       = hasUVs     ? mesh.uvs[cornerPositionIndices[c]]   : CVector2{ 0, 0 };
+		key.source   = hasBones   ? cornerPositionIndices[c]             : 0;
+
+		uint32_t slot = HashVertexKey(key) & (tableSize - 1);
+		while (table[slot] != 0 && std::memcmp(&vertices[table[slot] - 1], &key, sizeof(key)) != 0)
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (table[slot] == 0)
+		{
+			vertices.push_back(key);
+			table[slot] = static_cast<uint32_t>(vertices.size());
+		}
+		subMesh.indices[c] = table[slot] - 1;
+	}
+
+	uint32_t numVertices = static_cast<uint32_t>(vertices.size());
+	subMesh.positions.resize(numVertices);
+	subMesh.normals  .resize(numVertices);
+	if (hasUVs)  subMesh.uvs.resize(numVertices);
+	for (uint32_t v = 0; v < numVertices; ++v)
+	{
+		subMesh.positions[v] = vertices[v].position;
+		subMesh.normals  [v] = vertices[v].normal;
+		if (hasUVs)  subMesh.uvs[v] = vertices[v].uv;
+	}
+
+	if (requireTangents)  CalculateTangents(subMesh);
+
+
+	// Skin weights are given for positions in the file, give them to the vertices made from each position. Only the
+	// strongest weights for each position are kept, scaled to add up to one again
+	if (hasBones)
+	{
+		struct Influence
+		{
+			uint32_t bone;
+			float    weight;
+		};
+		std::vector<std::vector<Influence>> positionInfluences(numPositions);
+		for (uint32_t b = 0; b < mesh.bones.size(); ++b)
+		{
+			const ImportedBone& bone = mesh.bones[b];
+			for (size_t i = 0; i < bone.vertices.size(); ++i)  positionInfluences[bone.vertices[i]].push_back({ b, bone.weights[i] });
+		}
+		for (auto& influences : positionInfluences)
+		{
+			if (influences.size() <= MAX_BONES_PER_VERTEX)  continue;
+			std::partial_sort(influences.begin(), influences.begin() + MAX_BONES_PER_VERTEX, influences.end(),
+			                  [](const Influence& a, const Influence& b) { return a.weight > b.weight; });
+			influences.resize(MAX_BONES_PER_VERTEX);
+			float total = 0;
+			for (auto& influence : influences)  total += influence.weight;
+			if (total > 0)  for (auto& influence : influences)  influence.weight /= total;
+		}
+
+		subMesh.bones.resize(mesh.bones.size());
+		for (uint32_t b = 0; b < mesh.bones.size(); ++b)
+		{
+			subMesh.bones[b].name         = std::move(mesh.bones[b].name);
+			subMesh.bones[b].offsetMatrix = mesh.bones[b].offsetMatrix;
+		}
+		for (uint32_t v = 0; v < numVertices; ++v)
+		{
+			for (const Influence& influence : positionInfluences[vertices[v].source])
+			{
+				subMesh.bones[influence.bone].vertices.push_back(v);
+				subMesh.bones[influence.bone].weights .push_back(influence.weight);
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reading the file
+//--------------------------------------------------------------------------------------
+
+// The frames and meshes found in the first pass over the file
+struct XFileContents
+{
+	std::vector<ImportedNode>   nodes;      // Depth-first, top-level frames have NO_PARENT
+	std::vector<std::string>    meshNames;
+	std::vector<const uint8_t*> meshStarts; // Just after each mesh's opening brace
+	std::vector<unsigned int>   meshNodes;  // The frame containing each mesh, NO_PARENT for meshes outside any frame
+};
+
+
+// Read a Frame object, the reader must be just after its opening brace. Meshes are skipped over, their positions are
+// kept to read them later - recursive
+static void ReadFrame(XFileReader& reader, const std::string& name, unsigned int parent, XFileContents& contents)
+{
+	unsigned int frame = static_cast<unsigned int>(contents.nodes.size());
+	contents.nodes.emplace_back();
+	contents.nodes[frame].name   = name;
+	contents.nodes[frame].parent = parent;
+	contents.nodes[frame].matrix = MatrixIdentity();
+
+	std::string text;
+	for (;;)
+	{
+		XFileReader::Token token = reader.NextToken(&text);
+		if (token == XFileReader::Token::CloseBrace)  break;
+		if (token == XFileReader::Token::End)         Fail("Unexpected end of file");
+		if (token == XFileReader::Token::OpenBrace)
+		{
+			reader.SkipObject(); // Reference to an object elsewhere
+			continue;
+		}
+		if (token != XFileReader::Token::Name)  continue;
+
+		std::string objectName = ReadObjectHeader(reader);
+		if (text == "Frame")
+		{
+			ReadFrame(reader, objectName, frame, contents);
+			continue;
+		}
+		if (text == "FrameTransformMatrix")
+		{
+			// The matrix is stored the same way as this app stores matrices
+			float* matrix = &contents.nodes[frame].matrix.e00;
+			for (int i = 0; i < 16; ++i)  matrix[i] = reader.ReadFloat();
+		}
+		else if (text == "Mesh")
+		{
+			contents.meshNames .push_back(objectName);
+			contents.meshStarts.push_back(reader.Position());
+			contents.meshNodes .push_back(frame);
+		}
+		reader.SkipObject();
+	}
+	contents.nodes[frame].subtreeEnd = static_cast<unsigned int>(contents.nodes.size());
+}
+
+
+// Read a .x file in memory into the given mesh, throws an exception on failure
+static void ReadXFile(const uint8_t* data, size_t size, bool requireTangents, ImportedMesh& mesh)
+{
+	// 16 byte header, e.g. "xof 0303txt 0032" is a text file using 32-bit floats
+	if (size < 16 || std::memcmp(data, "xof ", 4) != 0)  Fail("Not a .x file");
+	bool binary;
+	if      (std::memcmp(data + 8, "txt ", 4) == 0)  binary = false;
+	else if (std::memcmp(data + 8, "bin ", 4) == 0)  binary = true;
+	else Fail("Unsupported .x file format (compressed files can't be read)");
+	bool doubles = (std::memcmp(data + 12, "0064", 4) == 0);
+
+	// First pass: find the frame hierarchy and where the meshes are
+	XFileContents contents;
+	XFileReader reader(data + 16, data + size, binary, doubles);
+	std::string text;
+	for (;;)
+	{
+		XFileReader::Token token = reader.NextToken(&text);
+		if (token == XFileReader::Token::End)  break;
+		if (token == XFileReader::Token::OpenBrace)
+		{
+			reader.SkipObject();
+			continue;
+		}
+		if (token != XFileReader::Token::Name)  continue;
+
+		std::string objectName = ReadObjectHeader(reader);
+		if (text == "Frame")
+		{
+			ReadFrame(reader, objectName, NO_PARENT, contents);
+			continue;
+		}
+		if (text == "Mesh")
+		{
+			contents.meshNames .push_back(objectName);
+			contents.meshStarts.push_back(reader.Position());
+			contents.meshNodes .push_back(NO_PARENT);
+		}
+		reader.SkipObject(); // Templates, materials, animations etc.
+	}
+	if (contents.meshStarts.empty())  Fail("No meshes in file");
+
+
+	// Second pass: read and build every mesh in parallel. Errors can't be thrown from the worker threads so are kept
+	// until all the meshes are done
+	unsigned int numMeshes = static_cast<unsigned int>(contents.meshStarts.size());
+	std::vector<ImportedSubMesh> subMeshes(numMeshes);
+	std::vector<std::string> errors(numMeshes);
+	const uint8_t* end = data + size;
+	ParallelFor(numMeshes, 1, [&](unsigned int begin, unsigned int last)
+	{
+		for (unsigned int m = begin; m < last; ++m)
+		{
+			try
+			{
+				XFileMesh xMesh;
+				XFileReader meshReader(contents.meshStarts[m], end, binary, doubles);
+				ReadMesh(meshReader, xMesh);
+				subMeshes[m].name = contents.meshNames[m];
+				BuildSubMesh(xMesh, requireTangents, subMeshes[m]);
+			}
+			catch (const std::exception& e)
+			{
+				errors[m] = e.what();
+			}
+		}
+	});
+	for (unsigned int m = 0; m < numMeshes; ++m)
+	{
+		if (!errors[m].empty())  Fail("Mesh " + contents.meshNames[m] + ": " + errors[m]);
+	}
+
+
+	// A single root node is needed. Files with several top-level frames get a new root above them, and files without
+	// frames get a root to hold their meshes (assimp names these nodes the same way)
+	unsigned int numTopLevel = 0;
+	for (const auto& node : contents.nodes)
+		if (node.parent == NO_PARENT)  ++numTopLevel;
+
+	if (numTopLevel != 1)
+	{
+		ImportedNode root;
+		root.name   = (numTopLevel == 0) ? "$dummy_node" : "$dummy_root";
+		root.parent = 0;
+		root.matrix = MatrixIdentity();
+		for (auto& node : contents.nodes)
+		{
+			node.parent = (node.parent == NO_PARENT) ? 0 : node.parent + 1;
+			++node.subtreeEnd;
+		}
+		for (auto& meshNode : contents.meshNodes)
+			if (meshNode != NO_PARENT)  ++meshNode;
+		contents.nodes.insert(contents.nodes.begin(), std::move(root));
+		contents.nodes[0].subtreeEnd = static_cast<unsigned int>(contents.nodes.size());
+	}
+	contents.nodes[0].parent = 0;
+
+	// Give each node its meshes, in file order. Meshes outside any frame belong to the root. Meshes left with no
+	// triangles are removed
+	mesh.nodes = std::move(contents.nodes);
+	for (unsigned int m = 0; m < numMeshes; ++m)
+	{
+		if (subMeshes[m].indices.empty())  continue;
+		unsigned int node = (contents.meshNodes[m] == NO_PARENT) ? 0 : contents.meshNodes[m];
+		mesh.nodes[node].subMeshes.push_back(static_cast<unsigned int>(mesh.subMeshes.size()));
+		mesh.subMeshes.push_back(std::move(subMeshes[m]));
+	}
+	if (mesh.subMeshes.empty())  Fail("No usable geometry in file");
+}
+
+
+//--------------------------------------------------------------------------------------
+// Public interface
+//--------------------------------------------------------------------------------------
+
+// Read a .x file held in memory into the given mesh, optionally calculating tangents (for normal mapping). Returns false
+// on failure, with a description of the problem in error
+bool ParseXFile(const uint8_t* data, size_t size, bool requireTangents, ImportedMesh& mesh, std::string& error)
+{
+	try
+	{
+		ReadXFile(data, size, requireTangents, mesh);
+	}
+	catch (const std::exception& e)
+	{
+		error = e.what();
+		return false;
+	}
+	return true;
+}
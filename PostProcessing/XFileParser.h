@@ -0,0 +1,44 @@
+//--------------------------------------------------------------------------------------
+// DirectX .x file parser - reads .x meshes without assimp
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Every mesh the app ships is a .x file, and assimp's general importer builds a complete scene of them and then runs a
+// long list of processing steps over it. This parser reads the file where it already is in memory (MeshImport.cpp
+// passes it a mapped file or one from a pack, see FileSystem.h) straight into the result Mesh is built from (see
+// MeshImport.h), with only the processing .x files need.
+//
+// - Text and binary files are supported, with 32 or 64-bit floats. Compressed files (tzip/bzip) are not, nor are
+//   meshes with over 256 bones. ParseXFile returns false for these so assimp can be used instead
+// - Frames become nodes (with their FrameTransformMatrix) and each Mesh object becomes one sub-mesh of the frame that
+//   contains it. Meshes outside any frame belong to the root node, and a root node is added if the file has more than
+//   one top-level frame, or none, the same as assimp does
+// - Positions, normals (MeshNormals), the first set of UVs (MeshTextureCoords) and skin weights (SkinWeights) are read.
+//   Materials, vertex colours, animations and templates are skipped. Material lists are ignored, all materials are
+//   removed on import so assimp merges a mesh's materials back together anyway
+// - Faces are split into triangles, triangles with two corners at the same position are removed, and corners with the
+//   same position, normal, UVs (and skin weights) are joined into one vertex
+// - Normals are generated if a mesh has none, smoothing between faces less than 80 degrees apart. Tangents are
+//   calculated if requested. Each vertex keeps its 4 strongest bone weights
+//
+// The result matches assimp's, except assimp also rebuilds UVs from material mapping modes and tries to flip normals
+// that point into the mesh. Neither applies to well formed .x files.
+//
+// The file is read once to find the frames and meshes, skipping over each mesh's data. Then the meshes are read and
+// processed in parallel on the thread pool. Numbers are parsed with a dedicated float reader rather than the C library
+
+#ifndef _X_FILE_PARSER_H_INCLUDED_
+#define _X_FILE_PARSER_H_INCLUDED_
+
+#include "MeshImport.h"
+
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Read a .x file held in memory into the given mesh, optionally calculating tangents (for normal mapping). Returns false
+// on failure, with a description of the problem in error
+bool ParseXFile(const uint8_t* data, size_t size, bool requireTangents, ImportedMesh& mesh, std::string& error);
+
+
+#endif //_X_FILE_PARSER_H_INCLUDED_